@@ -0,0 +1,108 @@
+#include <assets.hpp>
+#include <thread_pool.hpp>
+#include <texture_cache.hpp>
+#include <logger/logger.hpp>
+#include <limits>
+
+namespace assets {
+
+Model_asset::Model_asset( models::model_loader::pointer model ) :
+    loaded_model{ model },
+    current_state{ asset_state::importing }
+{
+}
+
+asset_state Model_asset::state() const
+{
+    return current_state.load();
+}
+
+models::model_loader::pointer Model_asset::model() const
+{
+    return loaded_model;
+}
+
+Asset_loader::Asset_loader( const std::size_t uploads_per_frame ) :
+    uploads_per_frame{ uploads_per_frame }
+{
+    LOG3( "Creating the asset loader, uploads per frame: ",
+          uploads_per_frame );
+}
+
+Model_asset::pointer Asset_loader::load_model( models::model_loader::pointer model )
+{
+    auto asset = std::make_shared< Model_asset >( model );
+    asset->import_result = workers::pool().submit( [ this, asset ]() {
+        bool imported{ false };
+        try {
+            imported = asset->loaded_model->import_model();
+        } catch ( std::exception& ex ) {
+            ERR( "Exception while importing a model: ", ex.what() );
+        }
+        if ( false == imported ) {
+            asset->current_state = asset_state::failed;
+            return;
+        }
+        asset->current_state = asset_state::waiting_upload;
+        std::lock_guard< std::mutex > lock( upload_mutex );
+        upload_queue.push_back( asset );
+    } );
+    return asset;
+}
+
+void Asset_loader::process_uploads()
+{
+    //The textures released by the worker threads
+    textures::cache().process_releases();
+    upload( uploads_per_frame );
+}
+
+bool Asset_loader::wait( const Model_asset::container& assets )
+{
+    LOG3( "Waiting for ", assets.size(), " assets" );
+    for ( auto&& asset : assets ) {
+        workers::pool().wait( asset->import_result );
+    }
+    upload( std::numeric_limits< std::size_t >::max() );
+    bool success{ true };
+    for ( auto&& asset : assets ) {
+        if ( asset->state() != asset_state::ready ) {
+            ERR( "Unable to load one of the assets!" );
+            success = false;
+        }
+    }
+    const auto stats = textures::cache().get_stats();
+    LOG1( "Texture cache, requests: ", stats.requests,
+          ", hit rate: ", stats.hit_rate(),
+          ", bytes saved: ", stats.bytes_saved );
+    return success;
+}
+
+void Asset_loader::upload( std::size_t budget )
+{
+    while ( budget > 0 ) {
+        Model_asset::pointer asset;
+        {
+            std::lock_guard< std::mutex > lock( upload_mutex );
+            if ( upload_queue.empty() ) {
+                return;
+            }
+            asset = upload_queue.front();
+        }
+        if ( false == asset->loaded_model->upload_model( budget ) ) {
+            //Budget exhausted, continue at the next frame
+            return;
+        }
+        asset->current_state = asset_state::ready;
+        std::lock_guard< std::mutex > lock( upload_mutex );
+        upload_queue.pop_front();
+    }
+}
+
+Asset_loader& loader()
+{
+    static Asset_loader instance( 16 );
+    return instance;
+}
+
+}
@@ -0,0 +1,84 @@
+#ifndef ASSETS_HPP
+#define ASSETS_HPP
+
+#include <headers.hpp>
+#include <models.hpp>
+#include <deque>
+#include <mutex>
+#include <future>
+#include <atomic>
+
+namespace assets {
+
+enum class asset_state {
+    importing,
+    waiting_upload,
+    ready,
+    failed
+};
+
+/*
+ * Handle to a model being loaded, the model
+ * can be rendered only when the state is ready
+ */
+class Model_asset
+{
+public:
+    using pointer = std::shared_ptr< Model_asset >;
+    using container = std::vector< pointer >;
+    explicit Model_asset( models::model_loader::pointer model );
+    asset_state state() const;
+    models::model_loader::pointer model() const;
+private:
+    friend class Asset_loader;
+    models::model_loader::pointer loaded_model;
+    std::atomic< asset_state > current_state;
+    std::future< void > import_result;
+};
+
+/*
+ * Asynchronous asset pipeline: the models are
+ * imported (parsing, conversion, texture decoding)
+ * by the worker threads, then uploaded to the GPU
+ * by the thread which owns the GL context. The
+ * amount of GL work performed at each frame is
+ * bounded by the upload budget.
+ */
+class Asset_loader
+{
+public:
+    using pointer = std::shared_ptr< Asset_loader >;
+    explicit Asset_loader( const std::size_t uploads_per_frame );
+    /*
+     * Queue the import of the model
+     */
+    Model_asset::pointer load_model( models::model_loader::pointer model );
+    /*
+     * To be called once per frame from the GL
+     * thread, upload the imported assets within
+     * the budget
+     */
+    void process_uploads();
+    /*
+     * Block until all the assets are ready, the
+     * calling thread (the GL one) takes part to
+     * the import and perform the uploads without
+     * any budget. False if any asset failed
+     */
+    bool wait( const Model_asset::container& assets );
+private:
+    void upload( std::size_t budget );
+    std::size_t uploads_per_frame;
+    std::mutex upload_mutex;
+    std::deque< Model_asset::pointer > upload_queue;
+};
+
+/*
+ * The loader used by the game, created
+ * at the first call
+ */
+Asset_loader& loader();
+
+}
+
+#endif //ASSETS_HPP
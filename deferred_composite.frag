@@ -0,0 +1,15 @@
+#version 330 core
+in vec2 screen_coords;
+
+out vec4 color;
+
+uniform sampler2D light_accumulation;
+
+/*
+ * The accumulated light is blended in the default
+ * framebuffer like the output of the forward shader
+ */
+void main()
+{
+    color = texture( light_accumulation, screen_coords );
+}
@@ -0,0 +1,10 @@
+#version 330 core
+layout (location = 0) in vec2 position;
+
+out vec2 screen_coords;
+
+void main()
+{
+    gl_Position = vec4( position, 0.0, 1.0 );
+    screen_coords = position * 0.5 + 0.5;
+}
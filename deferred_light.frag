@@ -0,0 +1,54 @@
+#version 330 core
+#include "light_data.glsl"
+#include "lighting.glsl"
+in vec2 screen_coords;
+flat in int light_index;
+
+out vec4 color;
+
+uniform sampler2D gbuffer_albedo;
+uniform sampler2D gbuffer_normal;
+uniform sampler2D gbuffer_specular;
+uniform sampler2D gbuffer_depth;
+
+uniform mat4 inverse_view_projection;
+uniform vec4 camera_position;
+
+/*
+ * A negative light_index identify the full screen
+ * volume, which output the surfaces not affected
+ * by the lights and evaluates the global lights.
+ */
+void main()
+{
+    vec4 normal_data = texture( gbuffer_normal, screen_coords );
+    int flags = int( normal_data.w + 0.5 );
+    vec4 albedo = texture( gbuffer_albedo, screen_coords );
+    if( ( flags & 1 ) == 0 ) {
+	color = light_index < 0 ? albedo : vec4(0.0);
+	return;
+    }
+    //Back to world space
+    float depth = texture( gbuffer_depth, screen_coords ).r;
+    vec4 pos = inverse_view_projection * vec4( screen_coords * 2.0 - 1.0,
+                                               depth * 2.0 - 1.0,
+                                               1.0 );
+    vec3 frag_pos = pos.xyz / pos.w;
+    vec3 norm = normal_data.xyz;
+    vec3 view_dir = normalize( camera_position.xyz - frag_pos );
+    vec4 spec_color = texture( gbuffer_specular, screen_coords );
+    bool attenuate_spec = ( flags & 2 ) != 0;
+
+    color = vec4(0.0);
+    if( light_index < 0 ) {
+	for( int idx = 0 ; idx < global_light_count ; ++idx ) {
+	    color += light_contribution( fetch_light( fetch_light_index( idx ) ),
+	                                 frag_pos, norm, view_dir,
+	                                 albedo, spec_color, attenuate_spec );
+	}
+    } else {
+	color = light_contribution( fetch_light( light_index ),
+	                            frag_pos, norm, view_dir,
+	                            albedo, spec_color, attenuate_spec );
+    }
+}
@@ -0,0 +1,17 @@
+#version 330 core
+layout (location = 0) in vec2 position;
+layout (location = 1) in float light_idx;
+
+out vec2 screen_coords;
+flat out int light_index;
+
+/*
+ * The light volumes are provided already
+ * in normalized device coordinates
+ */
+void main()
+{
+    gl_Position = vec4( position, 0.0, 1.0 );
+    screen_coords = position * 0.5 + 0.5;
+    light_index = int( light_idx );
+}
@@ -0,0 +1,239 @@
+#include <deferred_renderer.hpp>
+#include <light_clusters.hpp>
+#include <factory.hpp>
+#include <logger/logger.hpp>
+
+namespace renderer {
+
+Deferred_renderer::Deferred_renderer( const types::win_size& window,
+                                      const glm::mat4& projection,
+                                      const GLfloat near_plane,
+                                      buffers::Framebuffers::pointer framebuffers,
+                                      lighting::lighting_pointer lights ) :
+    window_size{ window },
+    projection{ projection },
+    near_plane{ near_plane },
+    framebuffers{ framebuffers },
+    lights{ lights }
+{
+    LOG3( "Creating the deferred renderer, size: ",
+          window.width, "/", window.height );
+    /*
+     * G-buffer layout:
+     * 0: albedo (RGBA8)
+     * 1: normal (RGB16F), w: surface flags
+     * 2: specular color (RGBA8)
+     * depth: depth/stencil texture
+     */
+    gbuffer = framebuffers->create_buffer( {
+        { GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE },
+        { GL_RGBA16F, GL_RGBA, GL_FLOAT },
+        { GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE }
+    } );
+    accumulation_buffer = framebuffers->create_buffer( {
+        { GL_RGBA16F, GL_RGBA, GL_FLOAT }
+    } );
+
+    light_shader = load_shader( "../deferred_light.vert",
+                                "../deferred_light.frag" );
+    light_shader->use_shaders();
+    lights->configure_shader( light_shader );
+    light_shader->set_uniform( shaders::uniforms::gbuffer_albedo, gbuffer_albedo_unit );
+    light_shader->set_uniform( shaders::uniforms::gbuffer_normal, gbuffer_normal_unit );
+    light_shader->set_uniform( shaders::uniforms::gbuffer_specular, gbuffer_specular_unit );
+    light_shader->set_uniform( shaders::uniforms::gbuffer_depth, gbuffer_depth_unit );
+
+    composite_shader = load_shader( "../deferred_composite.vert",
+                                    "../deferred_composite.frag" );
+    composite_shader->use_shaders();
+    composite_shader->set_uniform( shaders::uniforms::light_accumulation,
+                                   static_cast< GLint >( 0 ) );
+
+    create_vertex_array( volumes_vao, volumes_vbo );
+    create_vertex_array( quad_vao, quad_vbo );
+    const Light_volume_vertex quad[] = {
+        { -1.0f, -1.0f, -1.0f }, { 1.0f, -1.0f, -1.0f }, { 1.0f, 1.0f, -1.0f },
+        { -1.0f, -1.0f, -1.0f }, { 1.0f, 1.0f, -1.0f }, { -1.0f, 1.0f, -1.0f }
+    };
+    glBindBuffer( GL_ARRAY_BUFFER, quad_vbo );
+    glBufferData( GL_ARRAY_BUFFER,
+                  sizeof( quad ),
+                  quad,
+                  GL_STATIC_DRAW );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+}
+
+Deferred_renderer::~Deferred_renderer()
+{
+    glDeleteBuffers( 1, &volumes_vbo );
+    glDeleteVertexArrays( 1, &volumes_vao );
+    glDeleteBuffers( 1, &quad_vbo );
+    glDeleteVertexArrays( 1, &quad_vao );
+}
+
+shaders::Shader::pointer Deferred_renderer::load_shader(
+    const std::string& vertex,
+    const std::string& fragment )
+{
+    auto shader = factory< shaders::Shader >::create();
+    shader->add_include( lighting::light_data_include,
+                         lighting::light_data_glsl() );
+    shader->add_include( "lighting.glsl",
+                         shader->read_shader_body( "../lighting.glsl" ) );
+    shader->load_vertex_shader( shader->read_shader_body( vertex ) );
+    shader->load_fragment_shader( shader->read_shader_body( fragment ) );
+    if ( !shader->create_shader_program() ) {
+        ERR( "Unable to create the shader ", fragment );
+        throw std::runtime_error( "Shader creation failure" );
+    }
+    return shader;
+}
+
+void Deferred_renderer::create_vertex_array( GLuint& vao,
+        GLuint& vbo )
+{
+    glGenVertexArrays( 1, &vao );
+    glGenBuffers( 1, &vbo );
+    glBindVertexArray( vao );
+    glBindBuffer( GL_ARRAY_BUFFER, vbo );
+    glEnableVertexAttribArray( 0 );
+    glVertexAttribPointer( 0, 2, GL_FLOAT, GL_FALSE, sizeof( Light_volume_vertex ),
+                           ( GLvoid* )0 );
+    glEnableVertexAttribArray( 1 );
+    glVertexAttribPointer( 1, 1, GL_FLOAT, GL_FALSE, sizeof( Light_volume_vertex ),
+                           ( GLvoid* )offsetof( Light_volume_vertex, light_idx ) );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    glBindVertexArray( 0 );
+}
+
+void Deferred_renderer::begin_geometry_pass( shaders::Shader::pointer& scene_shader )
+{
+    framebuffers->bind( gbuffer );
+    glClearColor( 0.0, 0.0, 0.0, 0.0 );
+    glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
+    //The G-buffer content must not be blended
+    glDisable( GL_BLEND );
+    scene_shader->set_uniform( shaders::uniforms::geometry_pass,
+                               static_cast< GLint >( 1 ) );
+}
+
+void Deferred_renderer::end_geometry_pass( shaders::Shader::pointer& scene_shader,
+        const glm::mat4& view )
+{
+    scene_shader->set_uniform( shaders::uniforms::geometry_pass,
+                               static_cast< GLint >( 0 ) );
+    glDisable( GL_DEPTH_TEST );
+    light_pass( view );
+    composite_pass();
+    /*
+     * Copy the scene depth, what is rendered
+     * later is properly occluded
+     */
+    glBindFramebuffer( GL_READ_FRAMEBUFFER, gbuffer );
+    glBindFramebuffer( GL_DRAW_FRAMEBUFFER, 0 );
+    glBlitFramebuffer( 0, 0, window_size.width, window_size.height,
+                       0, 0, window_size.width, window_size.height,
+                       GL_DEPTH_BUFFER_BIT, GL_NEAREST );
+    framebuffers->unbind();
+    glEnable( GL_DEPTH_TEST );
+    glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+    glBindVertexArray( 0 );
+    scene_shader->use_shaders();
+}
+
+void Deferred_renderer::add_volume( const glm::vec4& bounds,
+                                    const GLfloat light_idx )
+{
+    volume_vertices.push_back( { bounds.x, bounds.y, light_idx } );
+    volume_vertices.push_back( { bounds.z, bounds.y, light_idx } );
+    volume_vertices.push_back( { bounds.z, bounds.w, light_idx } );
+    volume_vertices.push_back( { bounds.x, bounds.y, light_idx } );
+    volume_vertices.push_back( { bounds.z, bounds.w, light_idx } );
+    volume_vertices.push_back( { bounds.x, bounds.w, light_idx } );
+}
+
+/*
+ * One screen space quad for each light with a
+ * finite range, plus the full screen quad for the
+ * global lights and the unlit surfaces
+ */
+void Deferred_renderer::build_light_volumes( const glm::mat4& view )
+{
+    volume_vertices.clear();
+    add_volume( glm::vec4( -1.0f, -1.0f, 1.0f, 1.0f ), -1.0f );
+    const auto& records = lights->light_records();
+    for ( std::size_t idx{ 0 } ; idx < records.size() ; ++idx ) {
+        const GLfloat range = records[ idx ].cutoff.z;
+        if ( range <= 0.0f ) {
+            continue;
+        }
+        const glm::vec4 view_pos = view * glm::vec4( glm::vec3( records[ idx ].position ),
+                                   1.0f );
+        if ( -view_pos.z + range < near_plane ) {
+            //Behind the camera
+            continue;
+        }
+        const glm::vec4 bounds = lighting::sphere_ndc_bounds( glm::vec3( view_pos ),
+                                 range,
+                                 projection[0][0],
+                                 projection[1][1],
+                                 near_plane );
+        if ( bounds.x >= bounds.z || bounds.y >= bounds.w ) {
+            //Outside the screen
+            continue;
+        }
+        add_volume( bounds, static_cast< GLfloat >( idx ) );
+    }
+}
+
+void Deferred_renderer::light_pass( const glm::mat4& view )
+{
+    framebuffers->bind( accumulation_buffer );
+    glClearColor( 0.0, 0.0, 0.0, 0.0 );
+    glClear( GL_COLOR_BUFFER_BIT );
+    glEnable( GL_BLEND );
+    glBlendFunc( GL_ONE, GL_ONE );
+
+    light_shader->use_shaders();
+    lights->apply_to_shader( light_shader );
+    light_shader->set_uniform( shaders::uniforms::inverse_view_projection,
+                               glm::inverse( projection * view ) );
+    light_shader->set_uniform( shaders::uniforms::camera_position,
+                               glm::inverse( view )[3] );
+
+    const std::pair< GLint, GLuint > bindings[] = {
+        { gbuffer_albedo_unit, framebuffers->color_texture( gbuffer, 0 ) },
+        { gbuffer_normal_unit, framebuffers->color_texture( gbuffer, 1 ) },
+        { gbuffer_specular_unit, framebuffers->color_texture( gbuffer, 2 ) },
+        { gbuffer_depth_unit, framebuffers->depth_texture( gbuffer ) }
+    };
+    for ( auto&& binding : bindings ) {
+        glActiveTexture( GL_TEXTURE0 + binding.first );
+        glBindTexture( GL_TEXTURE_2D, binding.second );
+    }
+    glActiveTexture( GL_TEXTURE0 );
+
+    build_light_volumes( view );
+    glBindVertexArray( volumes_vao );
+    glBindBuffer( GL_ARRAY_BUFFER, volumes_vbo );
+    glBufferData( GL_ARRAY_BUFFER,
+                  volume_vertices.size() * sizeof( Light_volume_vertex ),
+                  volume_vertices.data(),
+                  GL_STREAM_DRAW );
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    glDrawArrays( GL_TRIANGLES, 0, volume_vertices.size() );
+}
+
+void Deferred_renderer::composite_pass()
+{
+    framebuffers->unbind();
+    glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+    composite_shader->use_shaders();
+    glActiveTexture( GL_TEXTURE0 );
+    glBindTexture( GL_TEXTURE_2D,
+                   framebuffers->color_texture( accumulation_buffer, 0 ) );
+    glBindVertexArray( quad_vao );
+    glDrawArrays( GL_TRIANGLES, 0, 6 );
+}
+
+}
@@ -0,0 +1,97 @@
+#ifndef DEFERRED_RENDERER_HPP
+#define DEFERRED_RENDERER_HPP
+
+#include <headers.hpp>
+#include <shaders.hpp>
+#include <lights.hpp>
+#include <framebuffers.hpp>
+#include <types.hpp>
+#include <vector>
+
+namespace renderer {
+
+/*
+ * Available rendering paths, both produce the
+ * same output. The deferred path is convenient
+ * when many lights overlap dense geometry.
+ */
+enum class rendering_path {
+    forward,
+    deferred
+};
+
+/*
+ * Texture units used by the light pass to
+ * read the G-buffer
+ */
+constexpr GLint gbuffer_albedo_unit{ 9 };
+constexpr GLint gbuffer_normal_unit{ 10 };
+constexpr GLint gbuffer_specular_unit{ 11 };
+constexpr GLint gbuffer_depth_unit{ 12 };
+
+/*
+ * Deferred shading: the scene shader writes the
+ * surface data in the G-buffer (albedo, normal,
+ * specular and depth), then each light is rendered
+ * as a screen space quad covering its volume and
+ * accumulated with additive blending. The result
+ * is composited in the default framebuffer.
+ */
+class Deferred_renderer
+{
+public:
+    using pointer = std::shared_ptr< Deferred_renderer >;
+    Deferred_renderer( const types::win_size& window,
+                       const glm::mat4& projection,
+                       const GLfloat near_plane,
+                       buffers::Framebuffers::pointer framebuffers,
+                       lighting::lighting_pointer lights );
+    ~Deferred_renderer();
+    /*
+     * Bind the G-buffer, until end_geometry_pass
+     * the scene shader writes the surface data
+     * instead of the lit color
+     */
+    void begin_geometry_pass( shaders::Shader::pointer& scene_shader );
+    /*
+     * Accumulate the lights and composite the result,
+     * the depth of the G-buffer is copied to the default
+     * framebuffer so that the forward rendering (camera
+     * space objects, picking &c) can continue.
+     */
+    void end_geometry_pass( shaders::Shader::pointer& scene_shader,
+                            const glm::mat4& view );
+private:
+    struct Light_volume_vertex {
+        GLfloat x;
+        GLfloat y;
+        GLfloat light_idx; //-1 for the full screen volume
+    };
+    shaders::Shader::pointer load_shader( const std::string& vertex,
+                                          const std::string& fragment );
+    void create_vertex_array( GLuint& vao,
+                              GLuint& vbo );
+    void add_volume( const glm::vec4& bounds,
+                     const GLfloat light_idx );
+    void build_light_volumes( const glm::mat4& view );
+    void light_pass( const glm::mat4& view );
+    void composite_pass();
+    types::win_size window_size;
+    glm::mat4 projection;
+    GLfloat near_plane;
+    buffers::Framebuffers::pointer framebuffers;
+    lighting::lighting_pointer lights;
+    GLuint gbuffer;
+    GLuint accumulation_buffer;
+    shaders::Shader::pointer light_shader;
+    shaders::Shader::pointer composite_shader;
+    GLuint volumes_vao;
+    GLuint volumes_vbo;
+    GLuint quad_vao;
+    GLuint quad_vbo;
+    std::vector< Light_volume_vertex > volume_vertices;
+};
+
+}
+
+#endif //DEFERRED_RENDERER_HPP
@@ -1,5 +1,6 @@
 #include <new>
 #include <cstdint>
+#include <atomic>
 #include <logger/logger.hpp>
 #include <types.hpp>
 
@@ -27,6 +28,10 @@ constexpr uint64_t INVALID_ID{ 0 };
 
 }
 
+/*
+ * Atomic, the objects might be
+ * created by the worker threads
+ */
 template< typename T >
 struct ids {
     static types::id_type create()
@@ -35,11 +40,11 @@ struct ids {
     }
 
 private:
-    static types::id_type next_id;
+    static std::atomic< types::id_type > next_id;
 };
 
 template< typename T >
-types::id_type ids< T >::next_id{ constants::INVALID_ID + 1 };
+std::atomic< types::id_type > ids< T >::next_id{ constants::INVALID_ID + 1 };
 
 /*
  * A class that generate unique IDs'
@@ -48,6 +48,79 @@ GLuint Framebuffers::create_buffer()
     return new_buf.FBO;
 }
 
+GLuint Framebuffers::create_buffer( const std::vector< Attachment_format >& attachments )
+{
+    LOG3( "Creating a new buffer with ", attachments.size(),
+          " render targets" );
+
+    Buffer new_buf;
+    glGenFramebuffers( 1, &new_buf.FBO );
+    glBindFramebuffer( GL_FRAMEBUFFER,
+                       new_buf.FBO );
+
+    std::vector< GLenum > draw_buffers;
+    for ( std::size_t idx{ 0 } ; idx < attachments.size() ; ++idx ) {
+        const GLuint texture = create_texture( attachments[ idx ] );
+        glFramebufferTexture2D(
+            GL_FRAMEBUFFER,
+            GL_COLOR_ATTACHMENT0 + idx,
+            GL_TEXTURE_2D,
+            texture,
+            0 );
+        new_buf.color_textures.push_back( texture );
+        draw_buffers.push_back( GL_COLOR_ATTACHMENT0 + idx );
+    }
+    if ( false == new_buf.color_textures.empty() ) {
+        new_buf.texture = new_buf.color_textures.front();
+    }
+    glDrawBuffers( draw_buffers.size(), draw_buffers.data() );
+
+    new_buf.depth_texture = create_texture( { GL_DEPTH24_STENCIL8,
+                                              GL_DEPTH_STENCIL,
+                                              GL_UNSIGNED_INT_24_8
+                                            } );
+    glFramebufferTexture2D( GL_FRAMEBUFFER,
+                            GL_DEPTH_STENCIL_ATTACHMENT,
+                            GL_TEXTURE_2D,
+                            new_buf.depth_texture,
+                            0 );
+
+    glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+    if ( false == buffers.insert( new_buf ).second ) {
+        ERR( "Failed while inserting a new FBO with ID ", new_buf.FBO );
+        glDeleteTextures( new_buf.color_textures.size(),
+                          new_buf.color_textures.data() );
+        glDeleteTextures( 1, &new_buf.depth_texture );
+        return -1;
+    }
+
+    LOG3( "Creation completed, all buffers ready!" );
+    return new_buf.FBO;
+}
+
+GLuint Framebuffers::color_texture( const GLuint fbo,
+                                    const std::size_t attachment ) const
+{
+    auto it = buffers.find( Buffer( fbo ) );
+    if ( it == buffers.end() ||
+         attachment >= it->color_textures.size() ) {
+        ERR( "Attachment ", attachment, " of the buffer ",
+             fbo, " not found!" );
+        return GL_INVALID_INDEX;
+    }
+    return it->color_textures[ attachment ];
+}
+
+GLuint Framebuffers::depth_texture( const GLuint fbo ) const
+{
+    auto it = buffers.find( Buffer( fbo ) );
+    if ( it == buffers.end() ) {
+        ERR( "Buffer ", fbo, " not found!" );
+        return GL_INVALID_INDEX;
+    }
+    return it->depth_texture;
+}
+
 GLenum Framebuffers::bind( const GLuint fbo )
 {
     if ( buffers.find( Buffer( fbo ) ) == buffers.end() ) {
@@ -74,7 +147,15 @@ void Framebuffers::unbind()
 Framebuffers::~Framebuffers()
 {
     for ( auto& fbo : buffers ) {
-        glDeleteBuffers( 1, &fbo.FBO );
+        if ( fbo.color_textures.empty() ) {
+            glDeleteTextures( 1, &fbo.texture );
+            glDeleteRenderbuffers( 1, &fbo.RBO );
+        } else {
+            glDeleteTextures( fbo.color_textures.size(),
+                              fbo.color_textures.data() );
+            glDeleteTextures( 1, &fbo.depth_texture );
+        }
+        glDeleteFramebuffers( 1, &fbo.FBO );
     }
 }
 
@@ -145,4 +226,33 @@ GLuint Framebuffers::create_texture()
     return texture;
 }
 
+GLuint Framebuffers::create_texture( const Attachment_format& attachment_format )
+{
+    GLuint texture;
+    glGenTextures( 1, &texture );
+    glBindTexture( GL_TEXTURE_2D, texture );
+    glTexImage2D( GL_TEXTURE_2D,
+                  0,
+                  attachment_format.internal_format,
+                  window_size.width,
+                  window_size.height,
+                  0,
+                  attachment_format.format,
+                  attachment_format.type,
+                  nullptr );
+    /*
+     * The render targets are read texel by
+     * texel, no filtering
+     */
+    glTexParameteri( GL_TEXTURE_2D,
+                     GL_TEXTURE_MIN_FILTER,
+                     GL_NEAREST );
+    glTexParameteri( GL_TEXTURE_2D,
+                     GL_TEXTURE_MAG_FILTER,
+                     GL_NEAREST );
+    glBindTexture( GL_TEXTURE_2D, 0 );
+    LOG3( "New render target texture ID: ", texture );
+    return texture;
+}
+
 }
@@ -2,6 +2,7 @@
 #define FRAMEBUFFERS_HPP
 #include <headers.hpp>
 #include <set>
+#include <vector>
 #include <types.hpp>
 
 namespace buffers {
@@ -17,6 +18,13 @@ struct Buffer {
     GLuint FBO{ GL_INVALID_INDEX };
     GLuint texture{ GL_INVALID_INDEX };
     GLuint RBO{ GL_INVALID_INDEX };
+    /*
+     * Only for the buffers with multiple
+     * render targets, texture is the first
+     * color attachment
+     */
+    std::vector< GLuint > color_textures;
+    GLuint depth_texture{ GL_INVALID_INDEX };
 
     operator GLuint() const
     {
@@ -29,6 +37,15 @@ struct Buffer {
     }
 };
 
+/*
+ * Format of a color attachment
+ */
+struct Attachment_format {
+    GLint  internal_format;
+    GLenum format;
+    GLenum type;
+};
+
 /*
  * Handle the creation and destruction
  * of framebuffers
@@ -41,6 +58,16 @@ public:
 
     Framebuffers( const types::win_size& window );
     GLuint create_buffer();
+    /*
+     * Create a buffer with one texture for each
+     * provided color attachment (multiple render
+     * targets) and a depth/stencil texture which
+     * can be sampled by the shaders
+     */
+    GLuint create_buffer( const std::vector< Attachment_format >& attachments );
+    GLuint color_texture( const GLuint fbo,
+                          const std::size_t attachment ) const;
+    GLuint depth_texture( const GLuint fbo ) const;
     GLenum bind( const GLuint fbo );
     void unbind();
     ~Framebuffers();
@@ -52,6 +79,7 @@ public:
 private:
     GLuint create_renderbuffer();
     GLuint create_texture();
+    GLuint create_texture( const Attachment_format& attachment_format );
     std::set<Buffer> buffers;
     types::win_size window_size;
 };
@@ -0,0 +1,157 @@
+#include <highres_residency.hpp>
+#include <logger/logger.hpp>
+#include <factory.hpp>
+
+namespace game_terrains {
+
+Highres_residency::Highres_residency( const GLfloat stream_in_distance,
+                                      const uint64_t budget_bytes ) :
+    stream_in_distance{ stream_in_distance },
+    budget_bytes{ budget_bytes },
+    current_update{ 0 }
+{
+    LOG3( "Creating the highres residency, distance: ", stream_in_distance,
+          ", budget: ", budget_bytes );
+}
+
+void Highres_residency::register_model( const long terrain_id,
+                                        const std::string& model_path )
+{
+    auto& entry = entries[ terrain_id ];
+    if ( nullptr != entry.model || nullptr != entry.asset ) {
+        evict( entry );
+    }
+    entry = Entry();
+    entry.model_path = model_path;
+}
+
+bool Highres_residency::has_model( const long terrain_id ) const
+{
+    return entries.find( terrain_id ) != entries.end();
+}
+
+void Highres_residency::begin_update()
+{
+    ++current_update;
+    for ( auto&& item : entries ) {
+        auto& entry = item.second;
+        if ( nullptr == entry.asset ) {
+            continue;
+        }
+        switch ( entry.asset->state() ) {
+        case assets::asset_state::ready:
+            complete_stream_in( entry );
+            break;
+        case assets::asset_state::failed:
+            ERR( "Unable to stream in ", entry.model_path,
+                 ", the low resolution model is used" );
+            entry.failed = true;
+            entry.asset = nullptr;
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void Highres_residency::end_update()
+{
+    while ( stats.resident_bytes > budget_bytes ) {
+        Entry* victim{ nullptr };
+        for ( auto&& item : entries ) {
+            auto& entry = item.second;
+            if ( nullptr == entry.model || entry.last_used == current_update ) {
+                continue;
+            }
+            if ( nullptr == victim || entry.last_used < victim->last_used ) {
+                victim = &entry;
+            }
+        }
+        if ( nullptr == victim ) {
+            //All the resident models are in use
+            break;
+        }
+        evict( *victim );
+    }
+}
+
+models::model_loader::pointer Highres_residency::request( const long terrain_id )
+{
+    auto it = entries.find( terrain_id );
+    if ( it == entries.end() ) {
+        return nullptr;
+    }
+    auto& entry = it->second;
+    entry.last_used = current_update;
+    if ( nullptr == entry.model && nullptr == entry.asset && false == entry.failed ) {
+        LOG1( "Streaming in ", entry.model_path );
+        entry.request_time = std::chrono::steady_clock::now();
+        entry.asset = assets::loader().load_model(
+                          factory< models::model_loader >::create(
+                              entry.model_path,
+                              models::z_axis::normal,
+                              models::mesh_retention::release ) );
+    }
+    return entry.model;
+}
+
+GLfloat Highres_residency::get_stream_in_distance() const
+{
+    return stream_in_distance;
+}
+
+Residency_stats Highres_residency::get_stats() const
+{
+    return stats;
+}
+
+void Highres_residency::complete_stream_in( Entry& entry )
+{
+    entry.model = entry.asset->model();
+    entry.asset = nullptr;
+    entry.bytes = entry.model->get_memory_stats().uploaded_bytes;
+    entry.textures = entry.model->get_cached_textures();
+    uint64_t texture_bytes{ 0 };
+    for ( auto&& texture : entry.textures ) {
+        if ( ++texture_users[ texture.get() ] == 1 ) {
+            texture_bytes += texture->size_in_bytes();
+        }
+    }
+    stats.last_latency = std::chrono::duration_cast< std::chrono::milliseconds >(
+                             std::chrono::steady_clock::now() - entry.request_time );
+    stats.total_latency += stats.last_latency;
+    stats.resident_bytes += entry.bytes + texture_bytes;
+    ++stats.resident_models;
+    ++stats.stream_ins;
+    LOG1( "Streamed in ", entry.model_path, ", bytes: ", entry.bytes,
+          ", new texture bytes: ", texture_bytes,
+          ", latency: ", stats.last_latency.count(),
+          "ms, resident bytes: ", stats.resident_bytes,
+          ", models: ", stats.resident_models );
+}
+
+void Highres_residency::evict( Entry& entry )
+{
+    if ( nullptr == entry.model ) {
+        return;
+    }
+    stats.resident_bytes -= entry.bytes;
+    //The textures still used by other models stay resident
+    for ( auto&& texture : entry.textures ) {
+        auto it = texture_users.find( texture.get() );
+        if ( it != texture_users.end() && --it->second == 0 ) {
+            stats.resident_bytes -= texture->size_in_bytes();
+            texture_users.erase( it );
+        }
+    }
+    entry.textures.clear();
+    --stats.resident_models;
+    ++stats.evictions;
+    LOG1( "Evicted ", entry.model_path, ", bytes: ", entry.bytes,
+          ", resident bytes: ", stats.resident_bytes,
+          ", models: ", stats.resident_models );
+    entry.model = nullptr;
+    entry.bytes = 0;
+}
+
+}
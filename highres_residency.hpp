@@ -0,0 +1,100 @@
+#ifndef HIGHRES_RESIDENCY_HPP
+#define HIGHRES_RESIDENCY_HPP
+
+#include <headers.hpp>
+#include <models.hpp>
+#include <assets.hpp>
+#include <texture_cache.hpp>
+#include <unordered_map>
+#include <chrono>
+
+namespace game_terrains {
+
+/*
+ * Default streaming parameters, distance
+ * from the camera in world units
+ */
+constexpr GLfloat default_highres_distance{ 20.0f };
+constexpr uint64_t default_highres_budget{ 128 * 1024 * 1024 };
+
+struct Residency_stats {
+    uint64_t    resident_bytes{ 0 };
+    std::size_t resident_models{ 0 };
+    std::size_t stream_ins{ 0 };
+    std::size_t evictions{ 0 };
+    std::chrono::milliseconds last_latency{ 0 };
+    std::chrono::milliseconds total_latency{ 0 };
+    std::chrono::milliseconds average_latency() const
+    {
+        return stream_ins == 0 ? std::chrono::milliseconds( 0 ) :
+               total_latency / static_cast< long >( stream_ins );
+    }
+};
+
+/*
+ * Residency of the high resolution terrain models.
+ * The models are streamed in by the asset loader
+ * when a lot using them is close to the camera and
+ * evicted, least recently used first, when the
+ * resident bytes (meshes and textures, a texture
+ * shared by many models counted once) exceed
+ * the budget. The low
+ * resolution models are always resident and are
+ * rendered until the high resolution one is ready.
+ *
+ * To be used from the thread which owns the GL
+ * context, the eviction releases GL objects.
+ */
+class Highres_residency
+{
+public:
+    using pointer = std::shared_ptr< Highres_residency >;
+    Highres_residency( const GLfloat stream_in_distance,
+                       const uint64_t budget_bytes );
+    /*
+     * The high resolution model of the terrain,
+     * not loaded until requested
+     */
+    void register_model( const long terrain_id,
+                         const std::string& model_path );
+    bool has_model( const long terrain_id ) const;
+    /*
+     * Mark the begin and the end of the requests of
+     * one update, the models not requested during the
+     * update are candidates for the eviction
+     */
+    void begin_update();
+    void end_update();
+    /*
+     * The model if resident, otherwise nullptr
+     * and the streaming is started
+     */
+    models::model_loader::pointer request( const long terrain_id );
+    GLfloat get_stream_in_distance() const;
+    Residency_stats get_stats() const;
+private:
+    struct Entry {
+        std::string model_path;
+        models::model_loader::pointer model;
+        assets::Model_asset::pointer asset;
+        std::vector< std::shared_ptr< textures::Cached_texture > > textures;
+        //Meshes only
+        uint64_t bytes{ 0 };
+        uint64_t last_used{ 0 };
+        bool failed{ false };
+        std::chrono::steady_clock::time_point request_time;
+    };
+    void complete_stream_in( Entry& entry );
+    void evict( Entry& entry );
+    GLfloat stream_in_distance;
+    uint64_t budget_bytes;
+    uint64_t current_update;
+    std::unordered_map< long, Entry > entries;
+    //Number of resident models using each texture
+    std::unordered_map< const textures::Cached_texture*, std::size_t > texture_users;
+    Residency_stats stats;
+};
+
+}
+
+#endif //HIGHRES_RESIDENCY_HPP
@@ -0,0 +1,388 @@
+#include <light_clusters.hpp>
+#include <thread_pool.hpp>
+#include <logger/logger.hpp>
+#include <algorithm>
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace lighting {
+
+namespace {
+
+constexpr std::size_t tiles_per_slice{ cluster_grid_x * cluster_grid_y };
+
+std::size_t padded_size( const std::size_t size )
+{
+    return ( size + 3 ) & ~std::size_t( 3 );
+}
+
+}
+
+glm::vec4 sphere_ndc_bounds( const glm::vec3& view_pos,
+                             const GLfloat radius,
+                             const GLfloat proj_x,
+                             const GLfloat proj_y,
+                             const GLfloat near_plane )
+{
+    /*
+     * Upper and lower bound of x/depth for the sphere,
+     * the nearest depth gives the extreme value when
+     * the numerator is positive (for the upper bound)
+     */
+    const GLfloat depth = -view_pos.z;
+    const GLfloat near_depth = std::max( depth - radius, near_plane );
+    const GLfloat far_depth = std::max( depth + radius, near_plane );
+    const GLfloat hi_x = view_pos.x + radius, lo_x = view_pos.x - radius;
+    const GLfloat hi_y = view_pos.y + radius, lo_y = view_pos.y - radius;
+    const glm::vec4 bounds( proj_x * lo_x / ( lo_x <= 0 ? near_depth : far_depth ),
+                            proj_y * lo_y / ( lo_y <= 0 ? near_depth : far_depth ),
+                            proj_x * hi_x / ( hi_x >= 0 ? near_depth : far_depth ),
+                            proj_y * hi_y / ( hi_y >= 0 ? near_depth : far_depth ) );
+    return glm::clamp( bounds, -1.0f, 1.0f );
+}
+
+Light_clusters::Light_clusters( const glm::mat4& projection,
+                                const GLfloat near_plane,
+                                const GLfloat far_plane ) :
+    proj_x{ projection[0][0] },
+    proj_y{ projection[1][1] },
+    near_plane{ near_plane },
+    far_plane{ far_plane },
+    log_depth_ratio{ std::log( far_plane / near_plane ) },
+    num_of_lights{ 0 }
+{
+    LOG3( "Creating the light clusters, grid: ",
+          cluster_grid_x, "x", cluster_grid_y, "x", cluster_grid_z,
+          ", near: ", near_plane, ", far: ", far_plane );
+    cluster_min.resize( number_of_clusters );
+    cluster_max.resize( number_of_clusters );
+    for ( std::size_t z{ 0 } ; z < cluster_grid_z ; ++z ) {
+        const GLfloat depth_near = near_plane * std::pow( far_plane / near_plane,
+                                   static_cast< GLfloat >( z ) / cluster_grid_z );
+        const GLfloat depth_far = near_plane * std::pow( far_plane / near_plane,
+                                  static_cast< GLfloat >( z + 1 ) / cluster_grid_z );
+        for ( std::size_t y{ 0 } ; y < cluster_grid_y ; ++y ) {
+            const GLfloat ndc_y0 = -1.0f + 2.0f * y / cluster_grid_y;
+            const GLfloat ndc_y1 = -1.0f + 2.0f * ( y + 1 ) / cluster_grid_y;
+            for ( std::size_t x{ 0 } ; x < cluster_grid_x ; ++x ) {
+                const GLfloat ndc_x0 = -1.0f + 2.0f * x / cluster_grid_x;
+                const GLfloat ndc_x1 = -1.0f + 2.0f * ( x + 1 ) / cluster_grid_x;
+                glm::vec3 min_pt( std::numeric_limits< GLfloat >::max() );
+                glm::vec3 max_pt( -std::numeric_limits< GLfloat >::max() );
+                for ( const GLfloat depth : { depth_near, depth_far } ) {
+                    for ( const GLfloat ndc_x : { ndc_x0, ndc_x1 } ) {
+                        for ( const GLfloat ndc_y : { ndc_y0, ndc_y1 } ) {
+                            const glm::vec3 corner( ndc_x * depth / proj_x,
+                                                    ndc_y * depth / proj_y,
+                                                    -depth );
+                            min_pt = glm::min( min_pt, corner );
+                            max_pt = glm::max( max_pt, corner );
+                        }
+                    }
+                }
+                const std::size_t idx = ( z * cluster_grid_y + y ) * cluster_grid_x + x;
+                cluster_min[ idx ] = min_pt;
+                cluster_max[ idx ] = max_pt;
+            }
+        }
+    }
+    slices.resize( cluster_grid_z );
+    for ( auto&& slice : slices ) {
+        slice.counts.resize( tiles_per_slice );
+    }
+    cluster_grid.resize( number_of_clusters );
+}
+
+void Light_clusters::reserve( const std::size_t lights )
+{
+    const std::size_t padded = padded_size( lights );
+    global_lights.reserve( lights );
+    light_indices.reserve( lights );
+    for ( auto vec : { &world_x, &world_y, &world_z, &radius,
+                       &view_x, &view_y, &view_z
+                     } ) {
+        vec->reserve( padded );
+    }
+    for ( auto vec : { &tile_min_x, &tile_max_x, &tile_min_y,
+                       &tile_max_y, &slice_min, &slice_max
+                     } ) {
+        vec->reserve( padded );
+    }
+    light_ids.reserve( padded );
+}
+
+void Light_clusters::begin_frame( const glm::mat4& view_matrix )
+{
+    view = view_matrix;
+    num_of_lights = 0;
+    global_lights.clear();
+    light_ids.clear();
+    world_x.clear();
+    world_y.clear();
+    world_z.clear();
+    radius.clear();
+}
+
+void Light_clusters::add_global_light( const light_index_t light_idx )
+{
+    global_lights.push_back( light_idx );
+}
+
+void Light_clusters::add_light( const light_index_t light_idx,
+                                const glm::vec3& position,
+                                const GLfloat light_radius )
+{
+    light_ids.push_back( light_idx );
+    world_x.push_back( position.x );
+    world_y.push_back( position.y );
+    world_z.push_back( position.z );
+    radius.push_back( light_radius );
+    ++num_of_lights;
+}
+
+void Light_clusters::calculate_light_bounds()
+{
+    const std::size_t padded = padded_size( num_of_lights );
+    for ( auto vec : { &world_x, &world_y, &world_z, &radius } ) {
+        vec->resize( padded, 0.0f );
+    }
+    for ( auto vec : { &view_x, &view_y, &view_z } ) {
+        vec->resize( padded );
+    }
+    for ( auto vec : { &tile_min_x, &tile_max_x, &tile_min_y,
+                       &tile_max_y, &slice_min, &slice_max
+                     } ) {
+        vec->resize( padded );
+    }
+    std::size_t idx{ 0 };
+#ifdef __SSE2__
+    /*
+     * Four lights at once: view space transformation
+     * and projection of the bounding sphere on the
+     * screen, the result is the range of tiles
+     */
+    const __m128 m00 = _mm_set1_ps( view[0][0] ), m10 = _mm_set1_ps( view[1][0] ),
+                 m20 = _mm_set1_ps( view[2][0] ), m30 = _mm_set1_ps( view[3][0] ),
+                 m01 = _mm_set1_ps( view[0][1] ), m11 = _mm_set1_ps( view[1][1] ),
+                 m21 = _mm_set1_ps( view[2][1] ), m31 = _mm_set1_ps( view[3][1] ),
+                 m02 = _mm_set1_ps( view[0][2] ), m12 = _mm_set1_ps( view[1][2] ),
+                 m22 = _mm_set1_ps( view[2][2] ), m32 = _mm_set1_ps( view[3][2] );
+    const __m128 zero = _mm_setzero_ps(),
+                 one = _mm_set1_ps( 1.0f ),
+                 minus_one = _mm_set1_ps( -1.0f ),
+                 near_v = _mm_set1_ps( near_plane ),
+                 proj_x_v = _mm_set1_ps( proj_x ),
+                 proj_y_v = _mm_set1_ps( proj_y ),
+                 half_grid_x = _mm_set1_ps( cluster_grid_x * 0.5f ),
+                 half_grid_y = _mm_set1_ps( cluster_grid_y * 0.5f ),
+                 max_tile_x = _mm_set1_ps( cluster_grid_x - 1 ),
+                 max_tile_y = _mm_set1_ps( cluster_grid_y - 1 );
+    //Vectorized version of sphere_ndc_bounds
+    auto bound = []( __m128 num, __m128 near_depth, __m128 far_depth,
+    __m128 use_near ) {
+        const __m128 depth = _mm_or_ps( _mm_and_ps( use_near, near_depth ),
+                                        _mm_andnot_ps( use_near, far_depth ) );
+        return _mm_div_ps( num, depth );
+    };
+    auto to_tile = []( __m128 ndc, __m128 half_grid, __m128 max_tile,
+                       __m128 minus_one, __m128 one, __m128 zero ) {
+        ndc = _mm_min_ps( _mm_max_ps( ndc, minus_one ), one );
+        const __m128 tile = _mm_mul_ps( _mm_add_ps( ndc, one ), half_grid );
+        return _mm_cvttps_epi32( _mm_min_ps( _mm_max_ps( tile, zero ), max_tile ) );
+    };
+    for ( ; idx < padded ; idx += 4 ) {
+        const __m128 wx = _mm_loadu_ps( &world_x[ idx ] ),
+                     wy = _mm_loadu_ps( &world_y[ idx ] ),
+                     wz = _mm_loadu_ps( &world_z[ idx ] ),
+                     r = _mm_loadu_ps( &radius[ idx ] );
+        const __m128 vx = _mm_add_ps( _mm_add_ps( _mm_mul_ps( m00, wx ), _mm_mul_ps( m10, wy ) ),
+                                      _mm_add_ps( _mm_mul_ps( m20, wz ), m30 ) );
+        const __m128 vy = _mm_add_ps( _mm_add_ps( _mm_mul_ps( m01, wx ), _mm_mul_ps( m11, wy ) ),
+                                      _mm_add_ps( _mm_mul_ps( m21, wz ), m31 ) );
+        const __m128 vz = _mm_add_ps( _mm_add_ps( _mm_mul_ps( m02, wx ), _mm_mul_ps( m12, wy ) ),
+                                      _mm_add_ps( _mm_mul_ps( m22, wz ), m32 ) );
+        _mm_storeu_ps( &view_x[ idx ], vx );
+        _mm_storeu_ps( &view_y[ idx ], vy );
+        _mm_storeu_ps( &view_z[ idx ], vz );
+        //Depth is positive in front of the camera
+        const __m128 depth = _mm_sub_ps( zero, vz );
+        const __m128 near_depth = _mm_max_ps( _mm_sub_ps( depth, r ), near_v );
+        const __m128 far_depth = _mm_max_ps( _mm_add_ps( depth, r ), near_v );
+
+        const __m128 hi_x = _mm_add_ps( vx, r ), lo_x = _mm_sub_ps( vx, r );
+        const __m128 hi_y = _mm_add_ps( vy, r ), lo_y = _mm_sub_ps( vy, r );
+        const __m128 ndc_hi_x = _mm_mul_ps( proj_x_v, bound( hi_x, near_depth, far_depth,
+                                            _mm_cmpge_ps( hi_x, zero ) ) );
+        const __m128 ndc_lo_x = _mm_mul_ps( proj_x_v, bound( lo_x, near_depth, far_depth,
+                                            _mm_cmple_ps( lo_x, zero ) ) );
+        const __m128 ndc_hi_y = _mm_mul_ps( proj_y_v, bound( hi_y, near_depth, far_depth,
+                                            _mm_cmpge_ps( hi_y, zero ) ) );
+        const __m128 ndc_lo_y = _mm_mul_ps( proj_y_v, bound( lo_y, near_depth, far_depth,
+                                            _mm_cmple_ps( lo_y, zero ) ) );
+        _mm_storeu_si128( reinterpret_cast< __m128i* >( &tile_min_x[ idx ] ),
+                          to_tile( ndc_lo_x, half_grid_x, max_tile_x, minus_one, one, zero ) );
+        _mm_storeu_si128( reinterpret_cast< __m128i* >( &tile_max_x[ idx ] ),
+                          to_tile( ndc_hi_x, half_grid_x, max_tile_x, minus_one, one, zero ) );
+        _mm_storeu_si128( reinterpret_cast< __m128i* >( &tile_min_y[ idx ] ),
+                          to_tile( ndc_lo_y, half_grid_y, max_tile_y, minus_one, one, zero ) );
+        _mm_storeu_si128( reinterpret_cast< __m128i* >( &tile_max_y[ idx ] ),
+                          to_tile( ndc_hi_y, half_grid_y, max_tile_y, minus_one, one, zero ) );
+    }
+#endif
+    for ( ; idx < padded ; ++idx ) {
+        const glm::vec4 pos = view * glm::vec4( world_x[ idx ],
+                                                world_y[ idx ],
+                                                world_z[ idx ],
+                                                1.0f );
+        view_x[ idx ] = pos.x;
+        view_y[ idx ] = pos.y;
+        view_z[ idx ] = pos.z;
+        const glm::vec4 bounds = sphere_ndc_bounds( glm::vec3( pos ),
+                                 radius[ idx ],
+                                 proj_x,
+                                 proj_y,
+                                 near_plane );
+        auto to_tile = []( const GLfloat ndc, const std::size_t grid ) {
+            return static_cast< GLint >( glm::clamp( ( ndc + 1.0f ) * grid * 0.5f,
+                                         0.0f,
+                                         static_cast< GLfloat >( grid - 1 ) ) );
+        };
+        tile_min_x[ idx ] = to_tile( bounds.x, cluster_grid_x );
+        tile_min_y[ idx ] = to_tile( bounds.y, cluster_grid_y );
+        tile_max_x[ idx ] = to_tile( bounds.z, cluster_grid_x );
+        tile_max_y[ idx ] = to_tile( bounds.w, cluster_grid_y );
+    }
+    /*
+     * Depth slices, the lights completely outside
+     * the depth range get an empty range
+     */
+    const GLfloat slice_scale = cluster_grid_z / log_depth_ratio;
+    auto to_slice = [ this, slice_scale ]( const GLfloat depth ) {
+        const GLfloat slice = std::log( std::max( depth, near_plane ) / near_plane ) * slice_scale;
+        return static_cast< GLint >( std::min( slice,
+                                               static_cast< GLfloat >( cluster_grid_z - 1 ) ) );
+    };
+    for ( idx = 0 ; idx < num_of_lights ; ++idx ) {
+        const GLfloat depth = -view_z[ idx ];
+        const GLfloat r = radius[ idx ];
+        if ( depth + r < near_plane || depth - r > far_plane ) {
+            slice_min[ idx ] = 1;
+            slice_max[ idx ] = 0;
+            continue;
+        }
+        slice_min[ idx ] = to_slice( depth - r );
+        slice_max[ idx ] = to_slice( depth + r );
+    }
+}
+
+bool Light_clusters::sphere_intersects_cluster( const std::size_t cluster_idx,
+        const std::size_t light ) const
+{
+    const glm::vec3& min_pt = cluster_min[ cluster_idx ];
+    const glm::vec3& max_pt = cluster_max[ cluster_idx ];
+    const GLfloat dx = std::max( std::max( min_pt.x - view_x[ light ], 0.0f ),
+                                 view_x[ light ] - max_pt.x );
+    const GLfloat dy = std::max( std::max( min_pt.y - view_y[ light ], 0.0f ),
+                                 view_y[ light ] - max_pt.y );
+    const GLfloat dz = std::max( std::max( min_pt.z - view_z[ light ], 0.0f ),
+                                 view_z[ light ] - max_pt.z );
+    return dx * dx + dy * dy + dz * dz <= radius[ light ] * radius[ light ];
+}
+
+void Light_clusters::assign_slices( const std::size_t first_slice,
+                                    const std::size_t last_slice )
+{
+    for ( std::size_t z{ first_slice } ; z < last_slice ; ++z ) {
+        Slice_data& slice = slices[ z ];
+        slice.pairs.clear();
+        std::fill( slice.counts.begin(), slice.counts.end(), 0 );
+        const GLint slice_idx = z;
+        for ( std::size_t light{ 0 } ; light < num_of_lights ; ++light ) {
+            if ( slice_idx < slice_min[ light ] || slice_idx > slice_max[ light ] ) {
+                continue;
+            }
+            for ( GLint y{ tile_min_y[ light ] } ; y <= tile_max_y[ light ] ; ++y ) {
+                for ( GLint x{ tile_min_x[ light ] } ; x <= tile_max_x[ light ] ; ++x ) {
+                    const GLuint local_idx = y * cluster_grid_x + x;
+                    if ( sphere_intersects_cluster( z * tiles_per_slice + local_idx,
+                                                    light ) ) {
+                        slice.pairs.emplace_back( local_idx, light_ids[ light ] );
+                        ++slice.counts[ local_idx ];
+                    }
+                }
+            }
+        }
+        /*
+         * Counting sort by cluster, the lights of
+         * each cluster become contiguous
+         */
+        slice.lights.resize( slice.pairs.size() );
+        GLuint offset{ 0 };
+        for ( auto&& count : slice.counts ) {
+            const GLuint cluster_count = count;
+            count = offset;
+            offset += cluster_count;
+        }
+        for ( auto&& pair : slice.pairs ) {
+            slice.lights[ slice.counts[ pair.first ]++ ] = pair.second;
+        }
+        //Now counts contains the end of each cluster range
+    }
+}
+
+void Light_clusters::build()
+{
+    calculate_light_bounds();
+    workers::pool().parallel_for( cluster_grid_z, 1,
+    [ this ]( std::size_t first, std::size_t last ) {
+        assign_slices( first, last );
+    } );
+    /*
+     * Merge the slices, the global lights
+     * are at the beginning of the list
+     */
+    light_indices.assign( global_lights.begin(), global_lights.end() );
+    for ( std::size_t z{ 0 } ; z < cluster_grid_z ; ++z ) {
+        const Slice_data& slice = slices[ z ];
+        const GLuint slice_offset = light_indices.size();
+        GLuint begin{ 0 };
+        for ( std::size_t local{ 0 } ; local < tiles_per_slice ; ++local ) {
+            const GLuint end = slice.counts[ local ];
+            cluster_grid[ z * tiles_per_slice + local ] = { slice_offset + begin,
+                                                            end - begin
+                                                          };
+            begin = end;
+        }
+        light_indices.insert( light_indices.end(),
+                              slice.lights.begin(),
+                              slice.lights.end() );
+    }
+}
+
+const std::vector< Cluster_range >& Light_clusters::grid() const
+{
+    return cluster_grid;
+}
+
+const std::vector< light_index_t >& Light_clusters::indices() const
+{
+    return light_indices;
+}
+
+std::size_t Light_clusters::global_light_count() const
+{
+    return global_lights.size();
+}
+
+glm::vec4 Light_clusters::shader_params( const types::win_size& viewport ) const
+{
+    const GLfloat slice_scale = cluster_grid_z / log_depth_ratio;
+    return glm::vec4( static_cast< GLfloat >( cluster_grid_x ) / viewport.width,
+                      static_cast< GLfloat >( cluster_grid_y ) / viewport.height,
+                      slice_scale,
+                      -std::log( near_plane ) * slice_scale );
+}
+
+}
@@ -0,0 +1,138 @@
+#ifndef LIGHT_CLUSTERS_HPP
+#define LIGHT_CLUSTERS_HPP
+
+#include <headers.hpp>
+#include <types.hpp>
+#include <vector>
+
+namespace lighting {
+
+/*
+ * The view frustum is divided in a grid of
+ * clusters (froxels): tiles on the screen and
+ * exponential slices on the depth.
+ */
+constexpr std::size_t cluster_grid_x{ 16 };
+constexpr std::size_t cluster_grid_y{ 9 };
+constexpr std::size_t cluster_grid_z{ 24 };
+constexpr std::size_t number_of_clusters{ cluster_grid_x *
+        cluster_grid_y *
+        cluster_grid_z };
+
+/*
+ * Range of the light index list
+ * containing the lights of one cluster
+ */
+struct Cluster_range {
+    GLuint offset;
+    GLuint count;
+};
+
+using light_index_t = GLushort;
+
+/*
+ * Conservative bounding rectangle of a view space
+ * sphere in normalized device coordinates, clamped
+ * to the screen. x,y: minimum corner, z,w: maximum
+ * corner. The part of the sphere behind the near
+ * plane is ignored.
+ */
+glm::vec4 sphere_ndc_bounds( const glm::vec3& view_pos,
+                             const GLfloat radius,
+                             const GLfloat proj_x,
+                             const GLfloat proj_y,
+                             const GLfloat near_plane );
+
+/*
+ * Assign the lights to the clusters which
+ * they affect. The lights are provided in world
+ * space at every frame, the global lights (like the
+ * directional lights) are not binned, they are
+ * placed at the beginning of the index list.
+ */
+class Light_clusters
+{
+public:
+    Light_clusters( const glm::mat4& projection,
+                    const GLfloat near_plane,
+                    const GLfloat far_plane );
+    /*
+     * Reserve the per light storage, the
+     * build does not allocate up to this
+     * amount of lights
+     */
+    void reserve( const std::size_t lights );
+    void begin_frame( const glm::mat4& view );
+    void add_global_light( const light_index_t light_idx );
+    void add_light( const light_index_t light_idx,
+                    const glm::vec3& position,
+                    const GLfloat radius );
+    /*
+     * Perform the light assignment, the work
+     * is split between the worker threads
+     */
+    void build();
+    const std::vector< Cluster_range >& grid() const;
+    const std::vector< light_index_t >& indices() const;
+    std::size_t global_light_count() const;
+    /*
+     * Parameters needed by the shader to calculate
+     * the cluster of a fragment:
+     * x,y: from window coordinates to tiles
+     * z,w: from log(view depth) to slices
+     */
+    glm::vec4 shader_params( const types::win_size& viewport ) const;
+private:
+    /*
+     * Transform the lights in view space and calculate
+     * the conservative range of tiles and slices
+     * covered by their bounding sphere
+     */
+    void calculate_light_bounds();
+    void assign_slices( const std::size_t first_slice,
+                        const std::size_t last_slice );
+    bool sphere_intersects_cluster( const std::size_t cluster_idx,
+                                    const std::size_t light ) const;
+    GLfloat proj_x;
+    GLfloat proj_y;
+    GLfloat near_plane;
+    GLfloat far_plane;
+    GLfloat log_depth_ratio;
+    glm::mat4 view;
+    /*
+     * View space bounding box of each cluster,
+     * depends only on the projection
+     */
+    std::vector< glm::vec3 > cluster_min;
+    std::vector< glm::vec3 > cluster_max;
+    /*
+     * Light data, structure of arrays padded to a
+     * multiple of 4 for the SIMD processing
+     */
+    std::vector< GLfloat > world_x, world_y, world_z, radius;
+    std::vector< GLfloat > view_x, view_y, view_z;
+    std::vector< GLint > tile_min_x, tile_max_x,
+        tile_min_y, tile_max_y,
+        slice_min, slice_max;
+    std::vector< light_index_t > light_ids;
+    std::size_t num_of_lights;
+    std::vector< light_index_t > global_lights;
+    /*
+     * Per slice assignment, filled in parallel:
+     * pairs of cluster (local to the slice) and
+     * light, sorted by cluster when the slice
+     * is completed.
+     */
+    struct Slice_data {
+        std::vector< GLuint > counts;
+        std::vector< light_index_t > lights;
+        std::vector< std::pair< GLuint, light_index_t > > pairs;
+    };
+    std::vector< Slice_data > slices;
+    std::vector< Cluster_range > cluster_grid;
+    std::vector< light_index_t > light_indices;
+};
+
+}
+
+#endif //LIGHT_CLUSTERS_HPP
@@ -0,0 +1,114 @@
+#include <light_grid.hpp>
+#include <logger/logger.hpp>
+#include <cmath>
+
+namespace lighting {
+
+Light_grid::Light_grid( const GLfloat cell_size ) :
+    cell_size{ cell_size },
+    query_stamp{ 0 }
+{
+    LOG3( "Creating the light grid, cell size: ", cell_size );
+    bucket_offsets.resize( number_of_buckets + 1 );
+}
+
+void Light_grid::reserve( const std::size_t lights )
+{
+    light_ids.reserve( lights );
+    positions.reserve( lights );
+    radius.reserve( lights );
+    large_lights.reserve( lights );
+    light_stamp.reserve( lights );
+}
+
+void Light_grid::clear()
+{
+    light_ids.clear();
+    positions.clear();
+    radius.clear();
+    large_lights.clear();
+    entries.clear();
+}
+
+void Light_grid::add_light( const light_index_t light_idx,
+                            const glm::vec3& position,
+                            const GLfloat light_radius )
+{
+    const GLuint light = light_ids.size();
+    light_ids.push_back( light_idx );
+    positions.push_back( position );
+    radius.push_back( light_radius );
+
+    const GLint min_x = cell_of( position.x - light_radius ),
+                max_x = cell_of( position.x + light_radius ),
+                min_y = cell_of( position.y - light_radius ),
+                max_y = cell_of( position.y + light_radius );
+    if ( ( max_x - min_x + 1 ) * ( max_y - min_y + 1 ) > max_cells_per_light ) {
+        large_lights.push_back( light );
+        return;
+    }
+    for ( GLint y{ min_y } ; y <= max_y ; ++y ) {
+        for ( GLint x{ min_x } ; x <= max_x ; ++x ) {
+            entries.emplace_back( bucket_of( x, y ), light );
+        }
+    }
+}
+
+/*
+ * Counting sort of the entries by bucket
+ */
+void Light_grid::build()
+{
+    std::fill( bucket_offsets.begin(), bucket_offsets.end(), 0 );
+    for ( auto&& entry : entries ) {
+        ++bucket_offsets[ entry.first + 1 ];
+    }
+    for ( std::size_t bucket{ 1 } ; bucket <= number_of_buckets ; ++bucket ) {
+        bucket_offsets[ bucket ] += bucket_offsets[ bucket - 1 ];
+    }
+    bucket_lights.resize( entries.size() );
+    for ( auto&& entry : entries ) {
+        bucket_lights[ bucket_offsets[ entry.first ]++ ] = entry.second;
+    }
+    //Now each offset is the end of its bucket, shift back
+    for ( std::size_t bucket{ number_of_buckets } ; bucket > 0 ; --bucket ) {
+        bucket_offsets[ bucket ] = bucket_offsets[ bucket - 1 ];
+    }
+    bucket_offsets[ 0 ] = 0;
+
+    if ( light_stamp.size() < light_ids.size() ) {
+        light_stamp.resize( light_ids.size(), query_stamp );
+    }
+}
+
+std::size_t Light_grid::bucket_of( const GLint x, const GLint y ) const
+{
+    const uint32_t hash = static_cast< uint32_t >( x ) * 73856093u ^
+                          static_cast< uint32_t >( y ) * 19349663u;
+    return hash & ( number_of_buckets - 1 );
+}
+
+GLint Light_grid::cell_of( const GLfloat coord ) const
+{
+    return static_cast< GLint >( std::floor( coord / cell_size ) );
+}
+
+bool Light_grid::intersects( const std::size_t light,
+                             const glm::vec3& center,
+                             const GLfloat query_radius ) const
+{
+    const glm::vec3 distance = positions[ light ] - center;
+    const GLfloat max_distance = radius[ light ] + query_radius;
+    return glm::dot( distance, distance ) <= max_distance * max_distance;
+}
+
+bool Light_grid::already_reported( const std::size_t light )
+{
+    if ( light_stamp[ light ] == query_stamp ) {
+        return true;
+    }
+    light_stamp[ light ] = query_stamp;
+    return false;
+}
+
+}
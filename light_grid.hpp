@@ -0,0 +1,103 @@
+#ifndef LIGHT_GRID_HPP
+#define LIGHT_GRID_HPP
+
+#include <headers.hpp>
+#include <light_clusters.hpp>
+#include <vector>
+
+namespace lighting {
+
+/*
+ * Spatial lookup of the light influence spheres,
+ * the XY plane is divided in square cells hashed
+ * in a fixed amount of buckets. Lights covering
+ * too many cells are kept in a separate list
+ * which is checked by every query.
+ */
+class Light_grid
+{
+public:
+    explicit Light_grid( const GLfloat cell_size );
+    //As Light_clusters::reserve
+    void reserve( const std::size_t lights );
+    void clear();
+    void add_light( const light_index_t light_idx,
+                    const glm::vec3& position,
+                    const GLfloat radius );
+    /*
+     * Sort the lights by bucket, to be called
+     * after all the lights are added
+     */
+    void build();
+    /*
+     * Call func( light_idx ) once for each light
+     * whose influence sphere intersects the
+     * given sphere
+     */
+    template< typename Func >
+    void query( const glm::vec3& center,
+                const GLfloat radius,
+                Func&& func );
+private:
+    static constexpr std::size_t number_of_buckets{ 4096 };
+    static constexpr GLint max_cells_per_light{ 64 };
+    std::size_t bucket_of( const GLint x, const GLint y ) const;
+    GLint cell_of( const GLfloat coord ) const;
+    bool intersects( const std::size_t light,
+                     const glm::vec3& center,
+                     const GLfloat radius ) const;
+    bool already_reported( const std::size_t light );
+    GLfloat cell_size;
+    std::vector< light_index_t > light_ids;
+    std::vector< glm::vec3 > positions;
+    std::vector< GLfloat > radius;
+    std::vector< std::size_t > large_lights;
+    /*
+     * Pairs of bucket and light, then sorted
+     * in bucket_lights with the offsets of
+     * each bucket in bucket_offsets
+     */
+    std::vector< std::pair< GLuint, GLuint > > entries;
+    std::vector< GLuint > bucket_offsets;
+    std::vector< GLuint > bucket_lights;
+    /*
+     * A light overlapping many cells can be found
+     * multiple times by the same query
+     */
+    std::vector< GLuint > light_stamp;
+    GLuint query_stamp;
+};
+
+template< typename Func >
+void Light_grid::query( const glm::vec3& center,
+                        const GLfloat query_radius,
+                        Func&& func )
+{
+    ++query_stamp;
+    for ( auto&& light : large_lights ) {
+        if ( intersects( light, center, query_radius ) ) {
+            func( light_ids[ light ] );
+        }
+    }
+    const GLint min_x = cell_of( center.x - query_radius ),
+                max_x = cell_of( center.x + query_radius ),
+                min_y = cell_of( center.y - query_radius ),
+                max_y = cell_of( center.y + query_radius );
+    for ( GLint y{ min_y } ; y <= max_y ; ++y ) {
+        for ( GLint x{ min_x } ; x <= max_x ; ++x ) {
+            const std::size_t bucket = bucket_of( x, y );
+            for ( GLuint idx{ bucket_offsets[ bucket ] } ;
+                  idx < bucket_offsets[ bucket + 1 ] ; ++idx ) {
+                const GLuint light = bucket_lights[ idx ];
+                if ( false == already_reported( light ) &&
+                     intersects( light, center, query_radius ) ) {
+                    func( light_ids[ light ] );
+                }
+            }
+        }
+    }
+}
+
+}
+
+#endif //LIGHT_GRID_HPP
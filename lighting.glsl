@@ -0,0 +1,95 @@
+/*
+ * Light evaluation shared by the forward
+ * and the deferred rendering paths, requires
+ * the light data declarations.
+ */
+
+/*
+ * Smooth fall off to zero at the light range,
+ * required since the light is not assigned to
+ * the clusters outside its range
+ */
+float range_window( float dist, float range )
+{
+    float ratio = dist / range;
+    float window = clamp( 1.0 - ratio * ratio * ratio * ratio, 0.0, 1.0 );
+    return window * window;
+}
+
+/*
+ * albedo and spec_color are the diffuse and specular
+ * colors of the surface, when attenuate_spec is false
+ * the specular term ignores the light attenuation
+ */
+vec4 light_contribution( Light_record light,
+                         vec3 frag_pos,
+                         vec3 norm,
+                         vec3 view_dir,
+                         vec4 albedo,
+                         vec4 spec_color,
+                         bool attenuate_spec )
+{
+    float attenuation = 1.0;
+    vec3 light_dir;
+    int light_type = int( light.position.w );
+    vec3 light_pos = light.position.xyz;
+    vec4 light_color = light.color;
+    float light_strength = light.direction.w;
+    vec3 light_direction = light.direction.xyz;
+    float cut_off_angle = light.cutoff.x;
+    float out_cutoff_angle = light.cutoff.y;
+    float light_range = light.cutoff.z;
+    //Now perform the calculations
+    if( light_type == POINT_LIGHT )
+    {
+	float dist = length( light_pos - frag_pos );
+	attenuation = (1.0 + dist * 0.22 + dist*dist*0.2);
+	attenuation = light_strength / attenuation;
+	light_dir = normalize( light_pos - frag_pos );
+    }
+    else if( light_type == DIRECTIONAL_LIGHT )
+    {
+	float dist = length( light_pos - frag_pos );
+	light_dir = normalize( light_pos );
+	attenuation = min( light_strength / sqrt( dist ), 1 );
+    }
+    else if( light_type == SPOT_LIGHT || light_type == FLASH_LIGHT )
+    {
+	light_dir = normalize( light_pos - frag_pos );
+	float dist = length( light_pos - frag_pos );
+	//This angle define the cone of the light,
+	//everything whithin this code is illuminated
+	float theta = dot( light_dir, normalize(-light_direction) );
+	//Angle which define the outer cone of the light,
+	//Things moving away from the theta angle are less
+	//illuminated
+	float epsilon = cut_off_angle - out_cutoff_angle;
+	float intensity = clamp((theta - out_cutoff_angle) / epsilon,
+	                        0.0,1.0);
+	if( light_type == SPOT_LIGHT )
+	    attenuation = 1.0 + dist * 0.20;
+	else
+	    attenuation = 1.0 + dist * 0.2;
+	attenuation = min( light_strength * intensity / attenuation, 1 );
+    }
+    if( light_range > 0 ) {
+	attenuation *= range_window( length( light_pos - frag_pos ), light_range );
+    }
+    if( attenuation == 0 ) {
+	return vec4(0.0);
+    }
+    //Common diffuse light calculations
+    float diff = max( dot( norm, light_dir ), 0.4);
+    vec4 diffuse = vec4(diff * light_color.rgb, light_color.a);
+    diffuse *= albedo * attenuation;
+    //The specular calculations are the same for both the lights
+    vec3 reflect_dir = reflect(-light_dir, norm);
+    float spec = pow( max( dot(view_dir,reflect_dir), 0.0), 32);
+    vec4 specular = vec4(spec * light_color.rgb, light_color.a);
+    specular *= spec_color;
+    if( attenuate_spec )
+    {
+	specular *= attenuation;
+    }
+    return diffuse + specular;
+}
@@ -1,65 +1,348 @@
 #include "lights.hpp"
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <sstream>
 
 namespace lighting {
 
-Core_lighting::Core_lighting()
+std::string light_data_glsl()
+{
+    std::stringstream glsl;
+    glsl << "#define MAX_LIGHTS " << max_number_of_lights << "\n"
+         << "#define POINT_LIGHT " << type_of_light::Point_Light << "\n"
+         << "#define DIRECTIONAL_LIGHT " << type_of_light::Directional_Light << "\n"
+         << "#define SPOT_LIGHT " << type_of_light::Spot_light << "\n"
+         << "#define FLASH_LIGHT " << type_of_light::Flash_light << "\n"
+         << "#define CLUSTER_GRID_X " << cluster_grid_x << "\n"
+         << "#define CLUSTER_GRID_Y " << cluster_grid_y << "\n"
+         << "#define CLUSTER_GRID_Z " << cluster_grid_z << "\n"
+         << "struct Light_record {\n";
+    for ( auto&& field : light_record_layout ) {
+        glsl << "    " << field.glsl_type << " " << field.name
+             << "; //offset " << field.offset << "\n";
+    }
+    glsl << "};\n"
+         << "uniform samplerBuffer light_records;\n"
+         << "uniform usamplerBuffer cluster_grid;\n"
+         << "uniform usamplerBuffer light_indices;\n"
+         << "uniform int global_light_count;\n"
+         << "uniform vec4 cluster_scale;\n"
+         << "#define MAX_OBJECT_LIGHTS " << max_lights_per_object << "\n"
+         << "uniform bool per_object_lights;\n"
+         << "uniform int object_light_count;\n"
+         << "uniform int object_lights[ MAX_OBJECT_LIGHTS ];\n"
+         << "Light_record fetch_light( int idx )\n"
+         << "{\n"
+         << "    Light_record light;\n"
+         << "    int base = idx * " << light_record_texels << ";\n";
+    for ( auto&& field : light_record_layout ) {
+        glsl << "    light." << field.name
+             << " = texelFetch( light_records, base + "
+             << field.offset / sizeof( glm::vec4 ) << " );\n";
+    }
+    glsl << "    return light;\n"
+         << "}\n"
+         << "int fetch_light_index( int idx )\n"
+         << "{\n"
+         << "    return int( texelFetch( light_indices, idx ).r );\n"
+         << "}\n"
+         /*
+          * Return the offset and the count of the
+          * cluster light list for the fragment
+          */
+         << "uvec2 fetch_cluster( vec2 frag_coord, float view_depth )\n"
+         << "{\n"
+         << "    ivec2 tile = ivec2( frag_coord * cluster_scale.xy );\n"
+         << "    int slice = int( log( max( view_depth, 1e-4 ) ) * cluster_scale.z + cluster_scale.w );\n"
+         << "    tile = clamp( tile, ivec2( 0 ), ivec2( CLUSTER_GRID_X - 1, CLUSTER_GRID_Y - 1 ) );\n"
+         << "    slice = clamp( slice, 0, CLUSTER_GRID_Z - 1 );\n"
+         << "    int cluster = ( slice * CLUSTER_GRID_Y + tile.y ) * CLUSTER_GRID_X + tile.x;\n"
+         << "    return texelFetch( cluster_grid, cluster ).xy;\n"
+         << "}\n";
+    return glsl.str();
+}
+
+namespace {
+
+/*
+ * Create a buffer object and the texture
+ * buffer which read from it
+ */
+void create_texture_buffer( GLuint& buffer,
+                            GLuint& texture,
+                            const GLenum format,
+                            const GLsizeiptr size )
+{
+    glGenBuffers( 1, &buffer );
+    glBindBuffer( GL_TEXTURE_BUFFER, buffer );
+    glBufferData( GL_TEXTURE_BUFFER, size, nullptr, GL_DYNAMIC_DRAW );
+    glGenTextures( 1, &texture );
+    glBindTexture( GL_TEXTURE_BUFFER, texture );
+    glTexBuffer( GL_TEXTURE_BUFFER, format, buffer );
+    glBindTexture( GL_TEXTURE_BUFFER, 0 );
+    glBindBuffer( GL_TEXTURE_BUFFER, 0 );
+}
+
+}
+
+Core_lighting::Core_lighting( const types::win_size& viewport,
+                              const glm::mat4& projection,
+                              const GLfloat near_plane,
+                              const GLfloat far_plane ) :
+    viewport{ viewport },
+    assignment_mode{ light_assignment::clustered },
+    clusters( projection, near_plane, far_plane ),
+    light_grid( light_grid_cell_size )
 {
     LOG3( "New Core_lighting" );
-    /*
-     * Hardcoded size! This allow to support
-     * something like 128 lights!
-     */
-    light_data_buffer.resize( 1024 ); //TODO, there should be one buffer for ALL, not many copies with identical data (see calculate_lighting)
-    LOG1( "Data buffer size: ", light_data_buffer.size() );
+    lights.reserve( max_number_of_lights );
+    uploaded_records.reserve( max_number_of_lights );
+    uploaded_versions.reserve( max_number_of_lights );
+    clusters.reserve( max_number_of_lights );
+    light_grid.reserve( max_number_of_lights );
+
+    create_texture_buffer( records_buffer,
+                           records_texture,
+                           GL_RGBA32F,
+                           max_number_of_lights * sizeof( Light_record ) );
+    create_texture_buffer( grid_buffer,
+                           grid_texture,
+                           GL_RG32UI,
+                           number_of_clusters * sizeof( Cluster_range ) );
+    create_texture_buffer( indices_buffer,
+                           indices_texture,
+                           GL_R16UI,
+                           max_number_of_lights * sizeof( light_index_t ) );
+    LOG1( "Light buffers ready, max number of lights: ",
+          max_number_of_lights );
+}
+
+Core_lighting::~Core_lighting()
+{
+    GLuint textures[] = { records_texture, grid_texture, indices_texture };
+    GLuint buffers[] = { records_buffer, grid_buffer, indices_buffer };
+    glDeleteTextures( 3, textures );
+    glDeleteBuffers( 3, buffers );
+}
+
+void Core_lighting::configure_shader( shaders::Shader::pointer& shader )
+{
+    if ( false == shader->set_uniform( shaders::uniforms::light_records, light_records_unit ) ||
+         false == shader->set_uniform( shaders::uniforms::cluster_grid, cluster_grid_unit ) ||
+         false == shader->set_uniform( shaders::uniforms::light_indices, light_indices_unit ) ) {
+        WARN1( "The shader does not use the light data!" );
+    }
 }
 
 /*
- * Calculate the ambient light color and intensity,
- * load to the proper uniforms the position,color and strength
- * of all the lights in the scene.
+ * Update the records of the lights which changed,
+ * assign the lights to the clusters and upload
+ * the cluster lists
  */
-void Core_lighting::calculate_lighting( shaders::Shader::pointer& shader )
-{
-    int light_cnt = 0;
-    std::size_t current_idx{ 0 };
-
-    for ( auto& light : lights ) {
-        auto light_data = light->get_light_data();
-        for ( auto& entry : light_data ) {
-            light_data_buffer[ current_idx++ ] = entry;
-            if ( current_idx >= 1024 ) {
-                ERR( "Too much light data to fit!" );
-                throw std::runtime_error( "light_data_buffer too small!!" );
-            }
-        }
-        ++light_cnt;
+void Core_lighting::calculate_lighting( shaders::Shader::pointer& shader,
+                                        const glm::mat4& view )
+{
+    clusters.begin_frame( view );
+    light_grid.clear();
+    upload_records();
+    clusters.build();
+    light_grid.build();
+    upload_clusters();
+
+    apply_to_shader( shader );
+
+    const std::pair< GLint, GLuint > bindings[] = {
+        { light_records_unit, records_texture },
+        { cluster_grid_unit, grid_texture },
+        { light_indices_unit, indices_texture }
+    };
+    for ( auto&& binding : bindings ) {
+        glActiveTexture( GL_TEXTURE0 + binding.first );
+        glBindTexture( GL_TEXTURE_BUFFER, binding.second );
     }
+    glActiveTexture( GL_TEXTURE0 );
+}
+
+void Core_lighting::apply_to_shader( shaders::Shader::pointer& shader ) const
+{
+    shader->set_uniform( shaders::uniforms::per_object_lights,
+                         static_cast< GLint >( light_assignment::per_object == assignment_mode ) );
+    shader->set_uniform( shaders::uniforms::global_light_count,
+                         static_cast< GLint >( clusters.global_light_count() ) );
+    shader->set_uniform( shaders::uniforms::cluster_scale,
+                         clusters.shader_params( viewport ) );
+}
+
+void Core_lighting::set_assignment_mode( const light_assignment mode )
+{
+    LOG1( "New light assignment mode: ",
+          ( light_assignment::clustered == mode ? "clustered" : "per object" ) );
+    assignment_mode = mode;
+}
+
+light_assignment Core_lighting::get_assignment_mode() const
+{
+    return assignment_mode;
+}
 
-    GLint nl = glGetUniformLocation( shader->get_program(),
-                                     "number_of_lights" );
+namespace {
 
-    if ( nl < 0 ) {
-        ERR( "Unable to load the uniform number_of_lights" );
+/*
+ * Rough intensity of the light at the given
+ * distance, same attenuation as the shader
+ * without the angular terms
+ */
+GLfloat light_influence( const Light_record& record,
+                         const GLfloat distance )
+{
+    const GLint type = static_cast< GLint >( record.position.w );
+    const GLfloat strength = record.direction.w;
+    GLfloat attenuation{ strength };
+    if ( type_of_light::Point_Light == type ) {
+        attenuation /= 1.0f + distance * 0.22f + distance * distance * 0.2f;
     } else {
-        glUniform1i( nl, lights.size() );
+        attenuation /= 1.0f + distance * 0.2f;
     }
+    const GLfloat ratio = distance / record.cutoff.z;
+    const GLfloat window = std::max( 1.0f - ratio * ratio * ratio * ratio, 0.0f );
+    return attenuation * window * window;
+}
 
-    GLint shader_light_buffer = glGetUniformLocation( shader->get_program(),
-                                "light_data" );
+}
 
-    if ( shader_light_buffer < 0 ) {
-        ERR( "Unable to load the uniform light_data" );
-    } else {
-        glUniform1fv( shader_light_buffer,
-                      current_idx,
-                      light_data_buffer.data() );
+void Core_lighting::assign_object_lights( shaders::Shader::pointer& shader,
+        const glm::vec3& center,
+        const GLfloat radius )
+{
+    /*
+     * Keep the most relevant lights sorted by
+     * influence, the distance is measured from
+     * the surface of the object sphere
+     */
+    GLint selected[ max_lights_per_object ];
+    GLfloat influence[ max_lights_per_object ];
+    std::size_t count{ 0 };
+    light_grid.query( center, radius,
+    [ & ]( const light_index_t light_idx ) {
+        const Light_record& record = uploaded_records[ light_idx ];
+        const GLfloat distance = std::max( glm::length( glm::vec3( record.position ) - center ) - radius,
+                                           0.0f );
+        const GLfloat value = light_influence( record, distance );
+        if ( count == max_lights_per_object &&
+             value <= influence[ count - 1 ] ) {
+            return;
+        }
+        std::size_t pos = std::min( count, max_lights_per_object - 1 );
+        while ( pos > 0 && influence[ pos - 1 ] < value ) {
+            selected[ pos ] = selected[ pos - 1 ];
+            influence[ pos ] = influence[ pos - 1 ];
+            --pos;
+        }
+        selected[ pos ] = light_idx;
+        influence[ pos ] = value;
+        count = std::min( count + 1, max_lights_per_object );
+    } );
+    shader->set_uniform( shaders::uniforms::object_light_count,
+                         static_cast< GLint >( count ) );
+    if ( count > 0 ) {
+        shader->set_uniform_array( shaders::uniforms::object_lights,
+                                   count,
+                                   selected );
     }
 }
 
+const std::vector< Light_record >& Core_lighting::light_records() const
+{
+    return uploaded_records;
+}
+
+/*
+ * Only the records whose light version changed
+ * are filled again, contiguous dirty records are
+ * uploaded with a single call. The clusters are fed
+ * from the cached records.
+ */
+void Core_lighting::upload_records()
+{
+    glBindBuffer( GL_TEXTURE_BUFFER, records_buffer );
+    std::size_t dirty_begin{ 0 };
+    bool dirty_range_open{ false };
+    for ( std::size_t idx{ 0 } ; idx < lights.size() ; ++idx ) {
+        const uint64_t version = lights[ idx ]->light_version();
+        const bool is_dirty = ( version != uploaded_versions[ idx ] );
+        if ( is_dirty ) {
+            lights[ idx ]->fill_light_record( uploaded_records[ idx ] );
+            uploaded_versions[ idx ] = version;
+            if ( false == dirty_range_open ) {
+                dirty_begin = idx;
+                dirty_range_open = true;
+            }
+        } else if ( dirty_range_open ) {
+            upload_record_range( dirty_begin, idx );
+            dirty_range_open = false;
+        }
+        const Light_record& record = uploaded_records[ idx ];
+        const GLfloat range = record.cutoff.z;
+        if ( range > 0.0f ) {
+            if ( light_assignment::clustered == assignment_mode ) {
+                clusters.add_light( idx, glm::vec3( record.position ), range );
+            } else {
+                light_grid.add_light( idx, glm::vec3( record.position ), range );
+            }
+        } else {
+            clusters.add_global_light( idx );
+        }
+    }
+    if ( dirty_range_open ) {
+        upload_record_range( dirty_begin, lights.size() );
+    }
+    glBindBuffer( GL_TEXTURE_BUFFER, 0 );
+}
+
+void Core_lighting::upload_record_range( const std::size_t first,
+        const std::size_t last ) const
+{
+    glBufferSubData( GL_TEXTURE_BUFFER,
+                     first * sizeof( Light_record ),
+                     ( last - first ) * sizeof( Light_record ),
+                     &uploaded_records[ first ] );
+}
+
+/*
+ * The cluster data is rebuilt every frame, the
+ * buffers are orphaned to avoid stalling on
+ * the previous frame
+ */
+void Core_lighting::upload_clusters()
+{
+    const auto& grid = clusters.grid();
+    glBindBuffer( GL_TEXTURE_BUFFER, grid_buffer );
+    glBufferData( GL_TEXTURE_BUFFER,
+                  grid.size() * sizeof( Cluster_range ),
+                  grid.data(),
+                  GL_DYNAMIC_DRAW );
+    const auto& indices = clusters.indices();
+    glBindBuffer( GL_TEXTURE_BUFFER, indices_buffer );
+    glBufferData( GL_TEXTURE_BUFFER,
+                  std::max< std::size_t >( indices.size(), 1 ) * sizeof( light_index_t ),
+                  indices.empty() ? nullptr : indices.data(),
+                  GL_DYNAMIC_DRAW );
+    glBindBuffer( GL_TEXTURE_BUFFER, 0 );
+}
+
 void Core_lighting::add_light( light_ptr obj )
 {
     LOG3( "Adding new light" );
+    if ( lights.size() >= max_number_of_lights ) {
+        ERR( "Not possible to add more than ",
+             max_number_of_lights, " lights!" );
+        return;
+    }
     lights.push_back( obj );
+    uploaded_records.emplace_back();
+    //Force the first upload
+    uploaded_versions.push_back( std::numeric_limits< uint64_t >::max() );
     LOG3( "Amount of lights: ", lights.size() );
 }
 
@@ -68,26 +351,18 @@ void Core_lighting::add_light( light_ptr obj )
 /// generic_light implementation
 /////////////////////////////////////
 
-std::size_t Generic_light::fill_common_light_data()
+void Generic_light::fill_common_light_record( Light_record& record,
+        const glm::vec3& position )
 {
-    light_data[0] = static_cast<int>( light_type() );
-    glm::vec3 pos = get_position();
-    light_data[1] = pos.x;
-    light_data[2] = pos.y;
-    light_data[3] = pos.z;
-    auto color_info = get_light_color();
-    light_data[4] = color_info.first.r;
-    light_data[5] = color_info.first.g;
-    light_data[6] = color_info.first.b;
-    light_data[7] = color_info.first.a;
-    light_data[8] = color_info.second;
-    return 9; //Next valid index
+    record.position = glm::vec4( position,
+                                 static_cast< GLfloat >( light_type() ) );
+    record.color = light_color;
+    record.direction = glm::vec4( 0.0f, 0.0f, 0.0f, color_strength );
+    record.cutoff = glm::vec4( 0.0f, 0.0f, get_range(), 0.0f );
 }
 
 Generic_light::Generic_light()
 {
-    //Setup the default size for a generic light
-    light_data.resize( light_data_size() );
 }
 
 Generic_light::Generic_light( glm::vec3 position,
@@ -98,8 +373,6 @@ Generic_light::Generic_light( glm::vec3 position,
 {
     set_position( position );
     set_scale( 0.5 );
-    //Setup the default size for a generic light
-    light_data.resize( light_data_size() );
 }
 
 Generic_light::~Generic_light()
@@ -114,6 +387,7 @@ GLfloat Generic_light::get_strength()
 void Generic_light::set_strength( GLfloat strength )
 {
     color_strength = strength;
+    light_changed();
 }
 
 std::pair<glm::vec4, GLfloat> Generic_light::get_light_color()
@@ -124,32 +398,51 @@ std::pair<glm::vec4, GLfloat> Generic_light::get_light_color()
 void Generic_light::set_light_color( const glm::vec4& new_color )
 {
     light_color = new_color;
+    light_changed();
 }
 
-std::size_t Generic_light::light_data_size()
+void Generic_light::set_range( GLfloat range )
 {
-    /*
-     * Those are the default values for a generic light
-     */
-    return 1 + //type
-           3 + //position
-           4 + //color
-           1;  //strength
+    light_range = range;
+    light_changed();
 }
 
-const std::vector<GLfloat>& Generic_light::get_light_data()
+void Generic_light::light_changed()
 {
-    /*
-     * The format of the data for a generic
-     * light is :
-     * light_type = 1 float (0)
-     * light_pos  = 3 float (x,y,z)
-     * light_color= 3 float (r,b,g)
-     * strength   = 1 float (s)
-     */
-    //TODO: Do not always update, just if needed
-    fill_common_light_data();
-    return light_data;
+    ++data_version;
+}
+
+/*
+ * Both the counters only grow, so does
+ * their sum
+ */
+uint64_t Generic_light::light_version()
+{
+    return data_version + transform_version();
+}
+
+GLfloat Generic_light::get_range()
+{
+    if ( light_range < 0.0f ) {
+        return default_range();
+    }
+    return light_range;
+}
+
+/*
+ * Distance at which the point light attenuation
+ * (see model_shader.frag) reach the threshold:
+ * strength / ( 1 + 0.22d + 0.2d^2 ) = threshold
+ */
+GLfloat Generic_light::default_range()
+{
+    const GLfloat ratio = std::max( color_strength / light_attenuation_threshold, 1.0f );
+    return ( -0.22f + std::sqrt( 0.22f * 0.22f + 0.8f * ( ratio - 1.0f ) ) ) / 0.4f;
+}
+
+void Generic_light::fill_light_record( Light_record& record )
+{
+    fill_common_light_record( record, get_position() );
 }
 
 
@@ -184,6 +477,12 @@ directional_light::directional_light( glm::vec3 direction,
     color_strength = strength;
 }
 
+//Directional lights affect the whole scene
+GLfloat directional_light::default_range()
+{
+    return 0.0f;
+}
+
 //////////////////////////////////////
 /// spot_light and flash_light implementation
 /////////////////////////////////////
@@ -210,49 +509,39 @@ spot_light::spot_light( glm::vec3 position,
     out_cutoff{ glm::cos( glm::radians( out_cutoff_angle ) ) }
 {
     LOG3( "Creating a new spot_light" );
-    light_data.resize( light_data_size() );
 }
 
-std::size_t spot_light::light_data_size()
+void spot_light::fill_light_record( Light_record& record )
 {
-    /*
-     * The additional elements are the light direction
-     * plus the two cutoff angles
-     */
-    return Generic_light::light_data_size() + 5;
+    if ( target_obj == nullptr ) {
+        fill_common_light_record( record, get_position() );
+    } else {
+        //Calculate the new position on the
+        //base of the target position
+        fill_common_light_record( record, target_obj->get_position() );
+    }
+    record.direction.x = light_direction.x;
+    record.direction.y = light_direction.y;
+    record.direction.z = light_direction.z;
+    record.cutoff.x = cut_off;
+    record.cutoff.y = out_cutoff;
 }
 
-const std::vector<GLfloat>& spot_light::get_light_data()
+uint64_t spot_light::light_version()
 {
-    std::size_t idx{ 0 };
     if ( target_obj == nullptr ) {
-        idx = fill_common_light_data();
-        light_data[ idx     ] = light_direction.x;
-        light_data[ idx + 1 ] = light_direction.y;
-        light_data[ idx + 2 ] = light_direction.z;
-        idx += 3;
-    } else {
-        //Calculate the new position and direction
-        //on the base of the target model-matrix
-        glm::vec3 pos = target_obj->get_position();
-        light_data[ idx     ] = static_cast<int>( light_type() );
-        light_data[ idx + 1 ] = pos.x;
-        light_data[ idx + 2 ] = pos.y;
-        light_data[ idx + 3 ] = pos.z;
-        auto color_info = get_light_color();
-        light_data[ idx + 4 ] = color_info.first.r;
-        light_data[ idx + 5 ] = color_info.first.g;
-        light_data[ idx + 6 ] = color_info.first.b;
-        light_data[ idx + 7 ] = color_info.first.a;
-        light_data[ idx + 8 ] = color_info.second;
-        light_data[ idx + 9 ] = light_direction.x;
-        light_data[ idx + 10 ] = light_direction.y;
-        light_data[ idx + 11 ] = light_direction.z;
-        idx += 12;
+        return Generic_light::light_version();
     }
-    light_data[ idx++ ] = cut_off;
-    light_data[ idx ] = out_cutoff;
-    return light_data;
+    return Generic_light::light_version() + target_obj->transform_version();
+}
+
+/*
+ * strength / ( 1 + 0.2d ) = threshold
+ */
+GLfloat spot_light::default_range()
+{
+    const GLfloat ratio = std::max( color_strength / light_attenuation_threshold, 1.0f );
+    return ( ratio - 1.0f ) / 0.2f;
 }
 
 
@@ -272,7 +561,7 @@ flash_light::flash_light( scene::Camera::pointer camera,
     LOG3( "Creating a new flash_light" );
 }
 
-const std::vector<GLfloat>& flash_light::get_light_data()
+void flash_light::fill_light_record( Light_record& record )
 {
     /*
      * Update the camera position and direction on the
@@ -282,7 +571,12 @@ const std::vector<GLfloat>& flash_light::get_light_data()
               new_direction = camera_ptr->get_camera_front();
     set_position( new_position );
     light_direction = new_direction;
-    return spot_light::get_light_data();
+    spot_light::fill_light_record( record );
+}
+
+uint64_t flash_light::light_version()
+{
+    return data_version + camera_ptr->transform_version();
 }
 
 }
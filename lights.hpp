@@ -2,6 +2,10 @@
 #include <shaders.hpp>
 #include <movable_object.hpp>
 #include "my_camera.hpp"
+#include <light_clusters.hpp>
+#include <light_grid.hpp>
+#include <cstddef>
+#include <limits>
 
 #ifndef LIGHTS_HPP
 #define LIGHTS_HPP
@@ -21,19 +25,168 @@ enum type_of_light {
     Flash_light
 };
 
+/*
+ * GPU side representation of a light. The records
+ * are stored in a texture buffer (RGBA32F), each
+ * vec4 member is one texel so that the C++ and
+ * the GLSL layouts are trivially identical.
+ */
+struct Light_record {
+    glm::vec4 position;  //xyz: position (direction for directional lights), w: light type
+    glm::vec4 color;     //rgba
+    glm::vec4 direction; //xyz: spot direction, w: strength
+    glm::vec4 cutoff;    //x: cut off angle, y: outer cut off angle, z: range
+};
+
+/*
+ * Description of the Light_record members, the
+ * GLSL declaration is generated from this table
+ */
+struct Light_record_field {
+    const char* glsl_type;
+    const char* name;
+    std::size_t offset;
+};
+
+constexpr Light_record_field light_record_layout[] = {
+    { "vec4", "position", offsetof( Light_record, position ) },
+    { "vec4", "color", offsetof( Light_record, color ) },
+    { "vec4", "direction", offsetof( Light_record, direction ) },
+    { "vec4", "cutoff", offsetof( Light_record, cutoff ) }
+};
+
+constexpr std::size_t light_record_texels{ sizeof( Light_record ) / sizeof( glm::vec4 ) };
+
+static_assert( sizeof( Light_record ) ==
+               sizeof( light_record_layout ) / sizeof( Light_record_field ) * sizeof( glm::vec4 ),
+               "Light_record members and light_record_layout do not match!" );
+
+/*
+ * The light indices in the cluster lists are
+ * 16 bits wide, plenty of room for this amount
+ * of lights. The record buffer is 512KB.
+ */
+constexpr std::size_t max_number_of_lights{ 8192 };
+static_assert( max_number_of_lights <= std::numeric_limits< light_index_t >::max(),
+               "light_index_t is too small for max_number_of_lights!" );
+
+/*
+ * Texture units reserved for the light data, far
+ * away from the units used by the model textures
+ */
+constexpr GLint light_records_unit{ 13 };
+constexpr GLint cluster_grid_unit{ 14 };
+constexpr GLint light_indices_unit{ 15 };
+constexpr const char* light_data_include{ "light_data.glsl" };
+
+/*
+ * Below this value the contribution of a light is
+ * considered negligible, used to calculate the
+ * default range of the lights
+ */
+constexpr GLfloat light_attenuation_threshold{ 0.02f };
+
+/*
+ * How the lights with a finite range are
+ * assigned to the fragments:
+ * clustered: per cluster light lists built every frame
+ * per_object: each renderable gets the list of its
+ *             max_lights_per_object most relevant lights
+ */
+enum class light_assignment {
+    clustered,
+    per_object
+};
+
+constexpr std::size_t max_lights_per_object{ 8 };
+//Size of the cells of the spatial lookup used by per_object
+constexpr GLfloat light_grid_cell_size{ 8.0f };
+
+/*
+ * Generate the GLSL declaration of the light
+ * data and the functions needed to access the
+ * light records and the clusters, to be included
+ * by the shaders
+ */
+std::string light_data_glsl();
+
 class Generic_light;
 
 using light_ptr = std::shared_ptr< Generic_light >;
 
+/*
+ * Own the light records and the light clusters,
+ * the content of the GPU buffers is refreshed
+ * at every frame by calculate_lighting
+ */
 class Core_lighting
 {
 public:
-    Core_lighting();
-    void calculate_lighting( shaders::Shader::pointer& shader );
+    Core_lighting( const types::win_size& viewport,
+                   const glm::mat4& projection,
+                   const GLfloat near_plane,
+                   const GLfloat far_plane );
+    ~Core_lighting();
+    /*
+     * Set the texture units of the light data samplers,
+     * to be called once after the shader is linked
+     */
+    void configure_shader( shaders::Shader::pointer& shader );
+    void calculate_lighting( shaders::Shader::pointer& shader,
+                             const glm::mat4& view );
+    /*
+     * Load the per frame light parameters to a shader
+     * other than the one used by calculate_lighting
+     */
+    void apply_to_shader( shaders::Shader::pointer& shader ) const;
+    /*
+     * Records uploaded by the last call
+     * to calculate_lighting
+     */
+    const std::vector< Light_record >& light_records() const;
     void add_light( light_ptr obj );
+    void set_assignment_mode( const light_assignment mode );
+    light_assignment get_assignment_mode() const;
+    /*
+     * Select the most relevant lights for the object
+     * contained in the given sphere and load them to the
+     * shader. Only for the per_object assignment mode.
+     */
+    void assign_object_lights( shaders::Shader::pointer& shader,
+                               const glm::vec3& center,
+                               const GLfloat radius );
 private:
+    void upload_records();
+    void upload_clusters();
+    void upload_record_range( const std::size_t first,
+                              const std::size_t last ) const;
     std::vector< light_ptr > lights;
-    std::vector< GLfloat > light_data_buffer;
+    types::win_size viewport;
+    light_assignment assignment_mode;
+    Light_clusters clusters;
+    Light_grid light_grid;
+    /*
+     * Buffer objects and the texture
+     * buffers which expose them to the shader
+     */
+    GLuint records_buffer;
+    GLuint records_texture;
+    GLuint grid_buffer;
+    GLuint grid_texture;
+    GLuint indices_buffer;
+    GLuint indices_texture;
+    /*
+     * Copy of the records as they are
+     * currently stored in the buffer object,
+     * only the records which changed are uploaded
+     */
+    std::vector< Light_record > uploaded_records;
+    /*
+     * Version of the light when its record was
+     * uploaded, a different version mark the
+     * record as dirty
+     */
+    std::vector< uint64_t > uploaded_versions;
 };
 
 using lighting_pointer = std::shared_ptr< Core_lighting >;
@@ -51,33 +204,50 @@ public:
     std::pair<glm::vec4, GLfloat> get_light_color();
     void set_light_color( const glm::vec4& new_color );
     /*
-     * get_light_data return a vector with
-     * all the information needed to manipulate/render
+     * Distance after which the light has no effect,
+     * zero means unlimited (the light affects all
+     * the clusters). If not set explicitly the range
+     * is calculated from the strength of the light.
+     */
+    void    set_range( GLfloat range );
+    GLfloat get_range();
+    /*
+     * Changes every time the record of the light
+     * need to be filled again: the light data or
+     * its position changed
+     */
+    virtual uint64_t light_version();
+    /*
+     * fill_light_record write in the record
+     * all the information needed to render
      * the light. Those informations are processed
      * by the fragment shader.
      *
-     * What does each light return in this vector
-     * depends on the light itself, but mostly contains
-     * stuff like: type,position,color &c.
-     */
-    virtual const std::vector<GLfloat>& get_light_data();
-    /*
-     * Each light might have a different data
-     * size since the amount of specific information
-     * might be different
+     * The common fields (type, position, color &c)
+     * are filled by the Generic_light, specialized
+     * lights fill the remaining ones.
      */
-    virtual std::size_t light_data_size();
+    virtual void fill_light_record( Light_record& record );
     virtual ~Generic_light();
 protected:
     glm::vec4 light_color;
     GLfloat   color_strength;
-    std::vector<GLfloat> light_data;
+    GLfloat   light_range{ -1.0f };
+    uint64_t  data_version{ 0 };
+    //Mark the light data as modified
+    void light_changed();
+    /*
+     * Range implied by the light attenuation,
+     * used when no range is set
+     */
+    virtual GLfloat default_range();
     /*
      * Certain light data like position, color &c
      * are commong whithin all the lights,
      * this function fill those common information
      */
-    std::size_t fill_common_light_data();
+    void fill_common_light_record( Light_record& record,
+                                   const glm::vec3& position );
 };
 
 /*
@@ -116,6 +286,8 @@ public:
     {
         return type_of_light::Directional_Light;
     }
+protected:
+    GLfloat default_range() override;
 };
 
 /*
@@ -144,8 +316,10 @@ public:
         return type_of_light::Spot_light;
     }
 
-    std::size_t light_data_size() override;
-    const std::vector<GLfloat>& get_light_data() override;
+    void fill_light_record( Light_record& record ) override;
+    uint64_t light_version() override;
+protected:
+    GLfloat default_range() override;
 };
 
 /*
@@ -169,7 +343,12 @@ public:
         return type_of_light::Flash_light;
     }
 
-    const std::vector<GLfloat>& get_light_data() override;
+    void fill_light_record( Light_record& record ) override;
+    /*
+     * Depends only on the camera, the position
+     * of the light is derived from it
+     */
+    uint64_t light_version() override;
 };
 
 template<typename LightT>
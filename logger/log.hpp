@@ -114,7 +114,7 @@ public:
 private:
     std::chrono::high_resolution_clock::time_point reference_epoch;
 
-    unsigned log_line_number;
+    std::atomic< unsigned > log_line_number;
     severity_type logging_level;
 
     //static std::stringstream log_stream;
@@ -132,6 +132,9 @@ private:
     void print_impl(std::stringstream&&,First&& parm1,Rest&&...parm);
 
     std::map<std::thread::id,std::string> thread_name;
+    //The worker threads might log concurrently
+    std::mutex thread_name_mutex;
+    std::string current_thread_name();
 };
 
 /*
@@ -149,9 +152,21 @@ void logger< log_policy >::terminate_logger()
 template< typename log_policy >
 void logger< log_policy >::set_thread_name( const std::string& name )
 {
+    std::lock_guard< std::mutex > lock( thread_name_mutex );
     thread_name[ std::this_thread::get_id() ] = name;
 }
 
+template< typename log_policy >
+std::string logger< log_policy >::current_thread_name()
+{
+    std::lock_guard< std::mutex > lock( thread_name_mutex );
+    auto it = thread_name.find( std::this_thread::get_id() );
+    if( it == thread_name.end() ){
+        return "";
+    }
+    return it->second;
+}
+
 template< typename log_policy >
 template< severity_type severity ,typename...Args >
 void logger< log_policy >::print(Args&&...args)
@@ -168,7 +183,7 @@ void logger< log_policy >::print(Args&&...args)
     date::operator << ( log_stream, now );
     log_stream << " ";
 
-    log_stream << thread_name[ std::this_thread::get_id() ] <<" ";
+    log_stream << current_thread_name() <<" ";
 
     switch( severity )
     {
@@ -0,0 +1,319 @@
+#include <map_file.hpp>
+#include <logger/logger.hpp>
+#include <thread_pool.hpp>
+#include <algorithm>
+#include <unordered_map>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+namespace game_terrains {
+
+namespace {
+
+constexpr char binary_map_magic[4] = { 'B', 'M', 'A', 'P' };
+
+template< typename T >
+void copy_to( std::vector< uint8_t >& buffer,
+              const std::size_t offset,
+              const T* data,
+              const std::size_t count )
+{
+    if ( count > 0 ) {
+        std::memcpy( buffer.data() + offset, data, count * sizeof( T ) );
+    }
+}
+
+uint64_t block_count( const Binary_map_header& header )
+{
+    const uint64_t blocks_x = ( static_cast< uint64_t >( header.width ) + header.block_size - 1 ) /
+                              header.block_size;
+    const uint64_t blocks_y = ( static_cast< uint64_t >( header.height ) + header.block_size - 1 ) /
+                              header.block_size;
+    return blocks_x * blocks_y;
+}
+
+}
+
+Binary_map::Binary_map( files::Mapped_file::pointer file,
+                        const Binary_map_header* header,
+                        const int64_t* palette ) :
+    file{ file },
+    file_header{ header },
+    palette{ palette },
+    blocks_per_row{ ( header->width + header->block_size - 1 ) / header->block_size }
+{
+}
+
+Binary_map::pointer Binary_map::open( const std::string& path )
+{
+    auto file = std::make_shared< files::Mapped_file >( path );
+    if ( false == file->is_valid() ) {
+        ERR( "Unable to map the terrain map ", path );
+        return nullptr;
+    }
+    const auto* header = file->at< Binary_map_header >( 0 );
+    if ( nullptr == header ||
+         0 != std::memcmp( header->magic, binary_map_magic, sizeof( binary_map_magic ) ) ||
+         header->version != binary_map_version ) {
+        ERR( "Not a terrain map or unsupported version: ", path );
+        return nullptr;
+    }
+    /*
+     * The tiles are not checked here, that would read
+     * the whole map: an index out of the palette is
+     * reported as no lot by terrain_id
+     */
+    const uint64_t tiles_per_block = static_cast< uint64_t >( header->block_size ) *
+                                     header->block_size;
+    const auto* palette = file->at< int64_t >( header->palette_offset,
+                          header->palette_size );
+    /*
+     * Up to 2^62 blocks, the size of the block
+     * section is checked without overflowing
+     */
+    const uint64_t blocks = block_count( *header );
+    if ( header->width == 0 || header->height == 0 ||
+         header->width > static_cast< uint32_t >( std::numeric_limits< int32_t >::max() ) ||
+         header->height > static_cast< uint32_t >( std::numeric_limits< int32_t >::max() ) ||
+         header->block_size == 0 || header->block_size > 4096 ||
+         ( header->tile_bits != 8 && header->tile_bits != 16 ) ||
+         nullptr == palette ||
+         header->block_stride < tiles_per_block * header->tile_bits / 8 ||
+         0 != header->blocks_offset % alignof( uint16_t ) ||
+         0 != header->block_stride % alignof( uint16_t ) ||
+         header->block_stride > file->size() ||
+         blocks > file->size() / header->block_stride ||
+         nullptr == file->at< uint8_t >( header->blocks_offset,
+                                         blocks * header->block_stride ) ) {
+        ERR( "Corrupted terrain map ", path );
+        return nullptr;
+    }
+    if ( header->attribute_size > 0 &&
+         ( header->attribute_block_stride < tiles_per_block * header->attribute_size ||
+           header->attribute_block_stride > file->size() ||
+           blocks > file->size() / header->attribute_block_stride ||
+           nullptr == file->at< uint8_t >( header->attributes_offset,
+                                           blocks * header->attribute_block_stride ) ) ) {
+        ERR( "Corrupted attributes in the terrain map ", path );
+        return nullptr;
+    }
+    LOG1( "Mapped terrain map ", path, ", size: ", header->width, "x", header->height,
+          ", palette: ", header->palette_size, ", file size: ", file->size() );
+    return std::make_shared< Binary_map >( file, header, palette );
+}
+
+bool Binary_map::block_position( const long x,
+                                 const long y,
+                                 std::size_t& block,
+                                 std::size_t& offset ) const
+{
+    const long map_x = x + file_header->central_x;
+    const long map_y = y + file_header->central_y;
+    if ( map_x < 0 || map_y < 0 ||
+         map_x >= static_cast< long >( file_header->width ) ||
+         map_y >= static_cast< long >( file_header->height ) ) {
+        return false;
+    }
+    const std::size_t size = file_header->block_size;
+    block = ( map_y / size ) * blocks_per_row + map_x / size;
+    offset = ( map_y % size ) * size + map_x % size;
+    return true;
+}
+
+long Binary_map::terrain_id( const long x, const long y ) const
+{
+    std::size_t block;
+    std::size_t offset;
+    if ( false == block_position( x, y, block, offset ) ) {
+        return -1;
+    }
+    const uint8_t* tiles = file->data() + file_header->blocks_offset +
+                           block * file_header->block_stride;
+    const uint32_t tile = file_header->tile_bits == 8 ? tiles[ offset ] :
+                          reinterpret_cast< const uint16_t* >( tiles )[ offset ];
+    if ( tile >= file_header->palette_size ) {
+        return -1;
+    }
+    return palette[ tile ];
+}
+
+const uint8_t* Binary_map::attributes( const long x, const long y ) const
+{
+    std::size_t block;
+    std::size_t offset;
+    if ( 0 == file_header->attribute_size ||
+         false == block_position( x, y, block, offset ) ) {
+        return nullptr;
+    }
+    return file->data() + file_header->attributes_offset +
+           block * file_header->attribute_block_stride +
+           offset * file_header->attribute_size;
+}
+
+const Binary_map_header& Binary_map::header() const
+{
+    return *file_header;
+}
+
+bool write_binary_map( const std::string& path,
+                       const std::size_t width,
+                       const std::size_t height,
+                       const glm::vec2 central_lot,
+                       const uint32_t block_size,
+                       const std::vector< int64_t >& palette,
+                       const uint32_t attribute_size,
+                       const binary_map_block_writer& writer )
+{
+    if ( width == 0 || height == 0 || block_size == 0 ||
+         palette.empty() || palette.size() > 65536 ) {
+        ERR( "Invalid terrain map size, block size or palette" );
+        return false;
+    }
+    Binary_map_header header;
+    std::memset( &header, 0, sizeof( header ) );
+    std::memcpy( header.magic, binary_map_magic, sizeof( binary_map_magic ) );
+    header.version = binary_map_version;
+    header.width = width;
+    header.height = height;
+    header.central_x = std::lround( central_lot.x );
+    header.central_y = std::lround( central_lot.y );
+    header.block_size = block_size;
+    header.attribute_size = attribute_size;
+    header.palette_size = palette.size();
+    header.tile_bits = palette.size() <= 256 ? 8 : 16;
+
+    /*
+     * Layout of the sections
+     */
+    const std::size_t tiles_per_block = static_cast< std::size_t >( block_size ) * block_size;
+    const std::size_t num_of_blocks = block_count( header );
+    std::size_t offset = files::align_offset( sizeof( header ), binary_map_alignment );
+    header.palette_offset = offset;
+    offset = files::align_offset( offset + palette.size() * sizeof( int64_t ),
+                                  binary_map_alignment );
+    header.blocks_offset = offset;
+    header.block_stride = files::align_offset( tiles_per_block * header.tile_bits / 8,
+                          binary_map_alignment );
+    offset += num_of_blocks * header.block_stride;
+    if ( attribute_size > 0 ) {
+        header.attributes_offset = offset;
+        header.attribute_block_stride = files::align_offset( tiles_per_block * attribute_size,
+                                        binary_map_alignment );
+        offset += num_of_blocks * header.attribute_block_stride;
+    }
+
+    std::vector< uint8_t > buffer( offset, 0 );
+    copy_to( buffer, 0, &header, 1 );
+    copy_to( buffer, header.palette_offset, palette.data(), palette.size() );
+    /*
+     * Each block is written in its own section of the
+     * buffer, the padding tiles of the edge blocks are
+     * zero and never read: they are outside the map
+     */
+    const std::size_t blocks_per_row = ( width + block_size - 1 ) / block_size;
+    workers::pool().parallel_for( num_of_blocks, 1,
+    [ & ]( const std::size_t begin, const std::size_t end ) {
+        std::vector< uint16_t > tiles( tiles_per_block );
+        for ( std::size_t block{ begin } ; block < end ; ++block ) {
+            std::fill( tiles.begin(), tiles.end(), 0 );
+            uint8_t* attributes = attribute_size == 0 ? nullptr :
+                                  buffer.data() + header.attributes_offset +
+                                  block * header.attribute_block_stride;
+            writer( block % blocks_per_row, block / blocks_per_row,
+                    tiles.data(), attributes );
+            uint8_t* output = buffer.data() + header.blocks_offset +
+                              block * header.block_stride;
+            if ( header.tile_bits == 8 ) {
+                std::copy( tiles.begin(), tiles.end(), output );
+            } else {
+                std::memcpy( output, tiles.data(), tiles_per_block * sizeof( uint16_t ) );
+            }
+        }
+    } );
+
+    const std::string temp_path = path + ".tmp";
+    {
+        std::ofstream output( temp_path, std::ios::binary | std::ios::trunc );
+        output.write( reinterpret_cast< const char* >( buffer.data() ),
+                      buffer.size() );
+        if ( !output ) {
+            ERR( "Unable to write the terrain map ", temp_path );
+            std::remove( temp_path.c_str() );
+            return false;
+        }
+    }
+    if ( 0 != std::rename( temp_path.c_str(), path.c_str() ) ) {
+        ERR( "Unable to rename ", temp_path, " to ", path );
+        std::remove( temp_path.c_str() );
+        return false;
+    }
+    LOG1( "Written the terrain map ", path, ", size: ", width, "x", height,
+          ", file size: ", buffer.size() );
+    return true;
+}
+
+bool write_binary_map( const std::string& path,
+                       const terrain_map_t& map,
+                       const glm::vec2 central_lot,
+                       const uint32_t block_size,
+                       const std::vector< uint8_t >& attributes,
+                       const uint32_t attribute_size )
+{
+    if ( map.empty() || map[0].empty() ) {
+        ERR( "The provided terrain map is empty!" );
+        return false;
+    }
+    const std::size_t width = map[0].size();
+    const std::size_t height = map.size();
+    for ( auto&& row : map ) {
+        if ( row.size() != width ) {
+            ERR( "The provided terrain map is not a quad!" );
+            return false;
+        }
+    }
+    if ( attributes.size() != width * height * attribute_size ) {
+        ERR( "Expected ", attribute_size, " bytes of attributes for each lot" );
+        return false;
+    }
+    std::vector< int64_t > palette;
+    std::unordered_map< long, uint16_t > palette_idx;
+    for ( auto&& row : map ) {
+        for ( auto id : row ) {
+            if ( palette_idx.find( id ) == palette_idx.end() ) {
+                if ( palette.size() == 65536 ) {
+                    ERR( "Too many terrain types in the map" );
+                    return false;
+                }
+                palette_idx[ id ] = palette.size();
+                palette.push_back( id );
+            }
+        }
+    }
+    return write_binary_map( path, width, height, central_lot, block_size,
+                             palette, attribute_size,
+                             [ & ]( const std::size_t block_x,
+                                    const std::size_t block_y,
+                                    uint16_t* tiles,
+    uint8_t* block_attributes ) {
+        const std::size_t first_x = block_x * block_size;
+        const std::size_t first_y = block_y * block_size;
+        const std::size_t last_x = std::min< std::size_t >( first_x + block_size, width );
+        const std::size_t last_y = std::min< std::size_t >( first_y + block_size, height );
+        for ( std::size_t y{ first_y } ; y < last_y ; ++y ) {
+            for ( std::size_t x{ first_x } ; x < last_x ; ++x ) {
+                const std::size_t tile = ( y - first_y ) * block_size + x - first_x;
+                tiles[ tile ] = palette_idx.find( map[ y ][ x ] )->second;
+                if ( nullptr != block_attributes ) {
+                    std::memcpy( block_attributes + tile * attribute_size,
+                                 attributes.data() + ( y * width + x ) * attribute_size,
+                                 attribute_size );
+                }
+            }
+        }
+    } );
+}
+
+}
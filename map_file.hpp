@@ -0,0 +1,137 @@
+#ifndef MAP_FILE_HPP
+#define MAP_FILE_HPP
+
+#include <terrain_sources.hpp>
+#include <mapped_file.hpp>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+namespace game_terrains {
+
+/*
+ * Binary terrain map format.
+ *
+ * The map is mapped in memory and read in place, the
+ * lots are grouped in square blocks stored one after
+ * the other: with the block size equal to the chunk
+ * size the chunk streaming touches only the pages of
+ * the chunks being built.
+ *
+ * Layout, all the sections are aligned to
+ * binary_map_alignment bytes:
+ *
+ * Binary_map_header
+ * palette: int64_t terrain ID[ palette_size ], -1 for no lot
+ * blocks: row-major blocks, each is block_size X block_size
+ *         row-major tiles of tile_bits (8 or 16), the
+ *         index in the palette. The blocks on the right
+ *         and bottom edges are padded to the full size
+ * attributes (optional): same block layout, attribute_size
+ *         bytes per lot
+ */
+constexpr uint32_t binary_map_version{ 1 };
+constexpr std::size_t binary_map_alignment{ 16 };
+const std::string binary_map_extension{ ".bmap" };
+
+struct Binary_map_header {
+    char     magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    //Map cell of the lot at coordinates 0,0
+    int32_t  central_x;
+    int32_t  central_y;
+    uint32_t block_size;
+    uint32_t tile_bits;
+    uint32_t palette_size;
+    uint32_t attribute_size;
+    uint64_t palette_offset;
+    uint64_t blocks_offset;
+    uint64_t block_stride;
+    uint64_t attributes_offset;
+    uint64_t attribute_block_stride;
+};
+
+/*
+ * Validated view of a binary map file, the
+ * mapping is kept alive as long as this
+ * object exists. Safe for concurrent reads
+ */
+class Binary_map : public Terrain_source
+{
+public:
+    using pointer = std::shared_ptr< Binary_map >;
+    /*
+     * nullptr if the file is missing or corrupted
+     */
+    static pointer open( const std::string& path );
+    Binary_map( files::Mapped_file::pointer file,
+                const Binary_map_header* header,
+                const int64_t* palette );
+
+    long terrain_id( const long x, const long y ) const override;
+    /*
+     * The attribute_size bytes of the lot at the
+     * given lot coordinates, nullptr if the map has no
+     * attributes or the lot is outside the map
+     */
+    const uint8_t* attributes( const long x, const long y ) const;
+    const Binary_map_header& header() const;
+private:
+    /*
+     * Offset of the lot in its block, false
+     * if outside the map
+     */
+    bool block_position( const long x,
+                         const long y,
+                         std::size_t& block,
+                         std::size_t& offset ) const;
+    files::Mapped_file::pointer file;
+    const Binary_map_header* file_header;
+    const int64_t* palette;
+    std::size_t blocks_per_row;
+};
+
+/*
+ * Fill the palette indexes of the block at block_x,
+ * block_y: block_size X block_size row-major tiles,
+ * and attribute_size bytes for each of them if the map
+ * has attributes (nullptr otherwise). The tiles
+ * outside the map are ignored
+ */
+using binary_map_block_writer = std::function< void( const std::size_t block_x,
+                                const std::size_t block_y,
+                                uint16_t* tiles,
+                                uint8_t* attributes ) >;
+
+/*
+ * Write a map of width X height lots in the binary
+ * format, the blocks are filled in parallel by the
+ * writer which shall be safe for that. The file is
+ * written to a temporary location and then renamed
+ */
+bool write_binary_map( const std::string& path,
+                       const std::size_t width,
+                       const std::size_t height,
+                       const glm::vec2 central_lot,
+                       const uint32_t block_size,
+                       const std::vector< int64_t >& palette,
+                       const uint32_t attribute_size,
+                       const binary_map_block_writer& writer );
+
+/*
+ * As above, from a terrain map. attributes is
+ * empty or contains attribute_size bytes for
+ * each lot, row-major
+ */
+bool write_binary_map( const std::string& path,
+                       const terrain_map_t& map,
+                       const glm::vec2 central_lot,
+                       const uint32_t block_size,
+                       const std::vector< uint8_t >& attributes = {},
+                       const uint32_t attribute_size = 0 );
+
+}
+
+#endif //MAP_FILE_HPP
@@ -0,0 +1,73 @@
+#include <mapped_file.hpp>
+#include <logger/logger.hpp>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace files {
+
+Mapped_file::Mapped_file( const std::string& path ) :
+    mapped_data{ nullptr },
+    mapped_size{ 0 }
+{
+    const int fd = open( path.c_str(), O_RDONLY );
+    if ( fd < 0 ) {
+        LOG1( "Unable to open ", path );
+        return;
+    }
+    struct stat file_stat;
+    if ( 0 == fstat( fd, &file_stat ) && file_stat.st_size > 0 ) {
+        void* mapping = mmap( nullptr,
+                              file_stat.st_size,
+                              PROT_READ,
+                              MAP_PRIVATE,
+                              fd,
+                              0 );
+        if ( MAP_FAILED == mapping ) {
+            ERR( "Unable to map ", path );
+        } else {
+            mapped_data = static_cast< const uint8_t* >( mapping );
+            mapped_size = file_stat.st_size;
+        }
+    }
+    //The mapping stays valid after close
+    close( fd );
+}
+
+Mapped_file::~Mapped_file()
+{
+    if ( nullptr != mapped_data ) {
+        munmap( const_cast< uint8_t* >( mapped_data ), mapped_size );
+    }
+}
+
+bool Mapped_file::is_valid() const
+{
+    return nullptr != mapped_data;
+}
+
+const uint8_t* Mapped_file::data() const
+{
+    return mapped_data;
+}
+
+std::size_t Mapped_file::size() const
+{
+    return mapped_size;
+}
+
+bool file_info( const std::string& path,
+                uint64_t& size,
+                int64_t& modification_time )
+{
+    struct stat file_stat;
+    if ( 0 != stat( path.c_str(), &file_stat ) ) {
+        return false;
+    }
+    size = file_stat.st_size;
+    modification_time = file_stat.st_mtime;
+    return true;
+}
+
+}
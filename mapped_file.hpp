@@ -0,0 +1,67 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <string>
+#include <memory>
+#include <cstdint>
+#include <cstddef>
+
+namespace files {
+
+/*
+ * Read only memory mapping of a whole file,
+ * the mapping is released by the destructor
+ */
+class Mapped_file
+{
+public:
+    using pointer = std::shared_ptr< Mapped_file >;
+    explicit Mapped_file( const std::string& path );
+    ~Mapped_file();
+    Mapped_file( const Mapped_file& ) = delete;
+    Mapped_file& operator=( const Mapped_file& ) = delete;
+    bool is_valid() const;
+    const uint8_t* data() const;
+    std::size_t size() const;
+    /*
+     * Pointer to count objects of type T at the given
+     * offset, or nullptr if the range exceed the
+     * file size or the offset is not properly aligned
+     */
+    template< typename T >
+    const T* at( const std::size_t offset,
+                 const std::size_t count = 1 ) const
+    {
+        if ( nullptr == mapped_data ||
+             offset > mapped_size ||
+             count > ( mapped_size - offset ) / sizeof( T ) ||
+             0 != offset % alignof( T ) ) {
+            return nullptr;
+        }
+        return reinterpret_cast< const T* >( mapped_data + offset );
+    }
+private:
+    const uint8_t* mapped_data;
+    std::size_t    mapped_size;
+};
+
+/*
+ * Size and modification time of a file,
+ * false if the file is not accessible
+ */
+bool file_info( const std::string& path,
+                uint64_t& size,
+                int64_t& modification_time );
+
+/*
+ * Round offset up to a multiple of alignment
+ */
+constexpr std::size_t align_offset( const std::size_t offset,
+                                    const std::size_t alignment )
+{
+    return ( offset + alignment - 1 ) / alignment * alignment;
+}
+
+}
+
+#endif //MAPPED_FILE_HPP
@@ -0,0 +1,432 @@
+#include <mesh_optimizer.hpp>
+#include <logger/logger.hpp>
+#include <unordered_map>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <cstring>
+#include <cmath>
+
+namespace models {
+
+namespace {
+
+constexpr GLuint invalid_index{ std::numeric_limits< GLuint >::max() };
+
+/*
+ * Forsyth scoring parameters
+ */
+constexpr GLfloat cache_decay_power{ 1.5f };
+constexpr GLfloat last_triangle_score{ 0.75f };
+constexpr GLfloat valence_boost_scale{ 2.0f };
+constexpr GLfloat valence_boost_power{ 0.5f };
+
+GLfloat vertex_score( const GLint cache_position,
+                      const std::size_t remaining_triangles )
+{
+    if ( remaining_triangles == 0 ) {
+        //No triangle left, never selected
+        return -1.0f;
+    }
+    GLfloat score{ 0.0f };
+    if ( cache_position >= 0 ) {
+        if ( cache_position < 3 ) {
+            /*
+             * Used by the last triangle, fixed score
+             * to not favor one of its edges
+             */
+            score = last_triangle_score;
+        } else {
+            const GLfloat scaler = 1.0f / ( optimizer_cache_size - 3 );
+            score = std::pow( 1.0f - ( cache_position - 3 ) * scaler,
+                              cache_decay_power );
+        }
+    }
+    //Prefer the vertices with few triangles left, to clear them out
+    score += valence_boost_scale *
+             std::pow( static_cast< GLfloat >( remaining_triangles ),
+                       -valence_boost_power );
+    return score;
+}
+
+/*
+ * FIFO vertex cache, a vertex is in the cache if less
+ * than cache_size vertices were inserted after it
+ */
+class Fifo_cache
+{
+public:
+    Fifo_cache( const std::size_t vertex_count,
+                const std::size_t cache_size ) :
+        timestamps( vertex_count, 0 ),
+        cache_size{ cache_size },
+        time{ cache_size + 1 }
+    {
+    }
+    //True on miss
+    bool access( const GLuint vertex )
+    {
+        if ( time - timestamps[ vertex ] > cache_size ) {
+            timestamps[ vertex ] = time++;
+            return true;
+        }
+        return false;
+    }
+private:
+    std::vector< std::size_t > timestamps;
+    std::size_t cache_size;
+    std::size_t time;
+};
+
+struct vertex_hash {
+    std::size_t operator()( const vertex_t* vertex ) const
+    {
+        //FNV-1a
+        const auto* bytes = reinterpret_cast< const uint8_t* >( vertex );
+        uint64_t hash{ 14695981039346656037ull };
+        for ( std::size_t idx{ 0 } ; idx < sizeof( vertex_t ) ; ++idx ) {
+            hash = ( hash ^ bytes[ idx ] ) * 1099511628211ull;
+        }
+        return static_cast< std::size_t >( hash );
+    }
+};
+
+struct vertex_equal {
+    bool operator()( const vertex_t* lhs, const vertex_t* rhs ) const
+    {
+        return 0 == std::memcmp( lhs, rhs, sizeof( vertex_t ) );
+    }
+};
+
+}
+
+Mesh_optimization_stats& Mesh_optimization_stats::operator += (
+    const Mesh_optimization_stats& other )
+{
+    triangles += other.triangles;
+    vertices_before += other.vertices_before;
+    vertices_after += other.vertices_after;
+    misses_before += other.misses_before;
+    misses_after += other.misses_after;
+    return *this;
+}
+
+std::size_t simulate_vertex_cache( const std::vector< GLuint >& indices,
+                                   const std::size_t vertex_count,
+                                   const std::size_t cache_size )
+{
+    Fifo_cache cache( vertex_count, cache_size );
+    std::size_t misses{ 0 };
+    for ( auto&& index : indices ) {
+        misses += cache.access( index );
+    }
+    return misses;
+}
+
+void weld_vertices( std::vector< vertex_t >& vertices,
+                    std::vector< GLuint >& indices )
+{
+    std::unordered_map< const vertex_t*, GLuint, vertex_hash, vertex_equal > unique_index;
+    unique_index.reserve( vertices.size() );
+    std::vector< vertex_t > unique_vertices;
+    unique_vertices.reserve( vertices.size() );
+    std::vector< GLuint > remap( vertices.size() );
+    for ( std::size_t idx{ 0 } ; idx < vertices.size() ; ++idx ) {
+        const auto inserted = unique_index.emplace( &vertices[ idx ],
+                              unique_vertices.size() );
+        if ( inserted.second ) {
+            unique_vertices.push_back( vertices[ idx ] );
+        }
+        remap[ idx ] = inserted.first->second;
+    }
+    for ( auto&& index : indices ) {
+        index = remap[ index ];
+    }
+    vertices.swap( unique_vertices );
+}
+
+void optimize_vertex_cache( std::vector< GLuint >& indices,
+                            const std::size_t vertex_count )
+{
+    const std::size_t triangle_count = indices.size() / 3;
+    if ( triangle_count == 0 ) {
+        return;
+    }
+    /*
+     * Triangles using each vertex, the first
+     * remaining[ vertex ] entries are the
+     * triangles not emitted yet
+     */
+    std::vector< GLuint > offsets( vertex_count + 1, 0 );
+    for ( auto&& index : indices ) {
+        ++offsets[ index + 1 ];
+    }
+    std::partial_sum( offsets.begin(), offsets.end(), offsets.begin() );
+    std::vector< GLuint > adjacency( indices.size() );
+    std::vector< GLuint > remaining( vertex_count, 0 );
+    for ( std::size_t idx{ 0 } ; idx < indices.size() ; ++idx ) {
+        const GLuint vertex = indices[ idx ];
+        adjacency[ offsets[ vertex ] + remaining[ vertex ]++ ] = idx / 3;
+    }
+
+    std::vector< GLint > cache_position( vertex_count, -1 );
+    std::vector< GLfloat > score( vertex_count );
+    for ( std::size_t vertex{ 0 } ; vertex < vertex_count ; ++vertex ) {
+        score[ vertex ] = vertex_score( -1, remaining[ vertex ] );
+    }
+    std::vector< GLfloat > triangle_score( triangle_count, 0.0f );
+    for ( std::size_t idx{ 0 } ; idx < indices.size() ; ++idx ) {
+        triangle_score[ idx / 3 ] += score[ indices[ idx ] ];
+    }
+    std::vector< bool > emitted( triangle_count, false );
+
+    std::vector< GLuint > cache;
+    std::vector< GLuint > new_cache;
+    std::vector< GLuint > result;
+    result.reserve( indices.size() );
+    std::size_t cursor{ 0 };
+    GLint best = std::distance( triangle_score.begin(),
+                                std::max_element( triangle_score.begin(),
+                                        triangle_score.end() ) );
+    while ( result.size() < indices.size() ) {
+        if ( best < 0 ) {
+            //Dead end, continue with the next triangle in the source order
+            while ( emitted[ cursor ] ) {
+                ++cursor;
+            }
+            best = cursor;
+        }
+        const GLuint* triangle = &indices[ best * 3 ];
+        emitted[ best ] = true;
+        result.insert( result.end(), triangle, triangle + 3 );
+
+        new_cache.clear();
+        for ( std::size_t corner{ 0 } ; corner < 3 ; ++corner ) {
+            const GLuint vertex = triangle[ corner ];
+            const auto begin = adjacency.begin() + offsets[ vertex ];
+            const auto end = begin + remaining[ vertex ];
+            std::iter_swap( std::find( begin, end, static_cast< GLuint >( best ) ),
+                            end - 1 );
+            --remaining[ vertex ];
+            if ( new_cache.end() == std::find( new_cache.begin(), new_cache.end(), vertex ) ) {
+                new_cache.push_back( vertex );
+            }
+        }
+        //LRU update, the vertices of the triangle move in front
+        const std::size_t triangle_vertices = new_cache.size();
+        for ( auto&& vertex : cache ) {
+            if ( new_cache.begin() + triangle_vertices ==
+                 std::find( new_cache.begin(), new_cache.begin() + triangle_vertices, vertex ) ) {
+                new_cache.push_back( vertex );
+            }
+        }
+        for ( std::size_t position{ optimizer_cache_size } ; position < new_cache.size() ; ++position ) {
+            cache_position[ new_cache[ position ] ] = -1;
+        }
+
+        /*
+         * Update the score of the vertices which moved
+         * in the cache and of their triangles, the next
+         * triangle is the best one using those vertices
+         */
+        best = -1;
+        GLfloat best_score{ -1.0f };
+        for ( std::size_t position{ 0 } ; position < new_cache.size() ; ++position ) {
+            const GLuint vertex = new_cache[ position ];
+            if ( position < optimizer_cache_size ) {
+                cache_position[ vertex ] = position;
+            }
+            const GLfloat new_score = vertex_score( cache_position[ vertex ],
+                                                    remaining[ vertex ] );
+            const GLfloat delta = new_score - score[ vertex ];
+            score[ vertex ] = new_score;
+            for ( GLuint adjacent{ offsets[ vertex ] } ;
+                  adjacent < offsets[ vertex ] + remaining[ vertex ] ; ++adjacent ) {
+                const GLuint candidate = adjacency[ adjacent ];
+                triangle_score[ candidate ] += delta;
+            }
+        }
+        for ( std::size_t position{ 0 } ;
+              position < std::min( new_cache.size(), optimizer_cache_size ) ; ++position ) {
+            const GLuint vertex = new_cache[ position ];
+            for ( GLuint adjacent{ offsets[ vertex ] } ;
+                  adjacent < offsets[ vertex ] + remaining[ vertex ] ; ++adjacent ) {
+                const GLuint candidate = adjacency[ adjacent ];
+                if ( triangle_score[ candidate ] > best_score ) {
+                    best_score = triangle_score[ candidate ];
+                    best = candidate;
+                }
+            }
+        }
+        new_cache.resize( std::min( new_cache.size(), optimizer_cache_size ) );
+        cache.swap( new_cache );
+    }
+    indices.swap( result );
+}
+
+void optimize_overdraw( std::vector< GLuint >& indices,
+                        const std::vector< vertex_t >& vertices,
+                        const GLfloat acmr_threshold )
+{
+    const std::size_t triangle_count = indices.size() / 3;
+    if ( triangle_count < 2 ) {
+        return;
+    }
+    /*
+     * A new cluster starts where the cache
+     * is restarted (all the vertices miss),
+     * reordering the clusters keeps most of
+     * the cache efficiency
+     */
+    std::vector< std::size_t > cluster_start;
+    Fifo_cache cache( vertices.size(), simulated_cache_size );
+    std::size_t misses_before{ 0 };
+    for ( std::size_t triangle{ 0 } ; triangle < triangle_count ; ++triangle ) {
+        std::size_t misses{ 0 };
+        for ( std::size_t corner{ 0 } ; corner < 3 ; ++corner ) {
+            misses += cache.access( indices[ triangle * 3 + corner ] );
+        }
+        if ( misses == 3 || triangle == 0 ) {
+            cluster_start.push_back( triangle );
+        }
+        misses_before += misses;
+    }
+    if ( cluster_start.size() < 2 ) {
+        return;
+    }
+    cluster_start.push_back( triangle_count );
+
+    /*
+     * Clusters far from the center and facing
+     * outward are likely to occlude the others,
+     * they are drawn first
+     */
+    const std::size_t cluster_count = cluster_start.size() - 1;
+    std::vector< glm::vec3 > cluster_centroid( cluster_count, glm::vec3( 0.0f ) );
+    std::vector< glm::vec3 > cluster_normal( cluster_count, glm::vec3( 0.0f ) );
+    std::vector< GLfloat > cluster_area( cluster_count, 0.0f );
+    glm::vec3 mesh_centroid( 0.0f );
+    GLfloat mesh_area{ 0.0f };
+    for ( std::size_t cluster{ 0 } ; cluster < cluster_count ; ++cluster ) {
+        for ( std::size_t triangle{ cluster_start[ cluster ] } ;
+              triangle < cluster_start[ cluster + 1 ] ; ++triangle ) {
+            const glm::vec3& a = vertices[ indices[ triangle * 3 ] ].coordinate;
+            const glm::vec3& b = vertices[ indices[ triangle * 3 + 1 ] ].coordinate;
+            const glm::vec3& c = vertices[ indices[ triangle * 3 + 2 ] ].coordinate;
+            const glm::vec3 normal = glm::cross( b - a, c - a );
+            const GLfloat area = glm::length( normal );
+            cluster_centroid[ cluster ] += ( a + b + c ) * ( area / 3.0f );
+            cluster_normal[ cluster ] += normal;
+            cluster_area[ cluster ] += area;
+        }
+        mesh_centroid += cluster_centroid[ cluster ];
+        mesh_area += cluster_area[ cluster ];
+        if ( cluster_area[ cluster ] > 0.0f ) {
+            cluster_centroid[ cluster ] /= cluster_area[ cluster ];
+        }
+    }
+    if ( mesh_area > 0.0f ) {
+        mesh_centroid /= mesh_area;
+    }
+    std::vector< GLfloat > sort_key( cluster_count, 0.0f );
+    for ( std::size_t cluster{ 0 } ; cluster < cluster_count ; ++cluster ) {
+        const GLfloat length = glm::length( cluster_normal[ cluster ] );
+        if ( length > 0.0f ) {
+            sort_key[ cluster ] = glm::dot( cluster_centroid[ cluster ] - mesh_centroid,
+                                            cluster_normal[ cluster ] / length );
+        }
+    }
+    std::vector< std::size_t > order( cluster_count );
+    std::iota( order.begin(), order.end(), 0 );
+    std::stable_sort( order.begin(), order.end(),
+    [ &sort_key ]( const std::size_t lhs, const std::size_t rhs ) {
+        return sort_key[ lhs ] > sort_key[ rhs ];
+    } );
+
+    std::vector< GLuint > result;
+    result.reserve( indices.size() );
+    for ( auto&& cluster : order ) {
+        result.insert( result.end(),
+                       indices.begin() + cluster_start[ cluster ] * 3,
+                       indices.begin() + cluster_start[ cluster + 1 ] * 3 );
+    }
+    //Keep the new order only if the vertex cache is not hurt too much
+    const std::size_t misses_after = simulate_vertex_cache( result, vertices.size() );
+    if ( misses_after <= misses_before * acmr_threshold ) {
+        indices.swap( result );
+    }
+}
+
+void optimize_vertex_fetch( std::vector< vertex_t >& vertices,
+                            std::vector< GLuint >& indices )
+{
+    std::vector< GLuint > remap( vertices.size(), invalid_index );
+    std::vector< vertex_t > reordered;
+    reordered.reserve( vertices.size() );
+    for ( auto&& index : indices ) {
+        if ( remap[ index ] == invalid_index ) {
+            remap[ index ] = reordered.size();
+            reordered.push_back( vertices[ index ] );
+        }
+        index = remap[ index ];
+    }
+    vertices.swap( reordered );
+}
+
+Mesh_optimization_stats optimize_mesh( std::vector< vertex_t >& vertices,
+                                       std::vector< GLuint >& indices )
+{
+    Mesh_optimization_stats stats;
+    stats.vertices_before = vertices.size();
+    stats.vertices_after = vertices.size();
+    /*
+     * Points and lines are left
+     * untouched, as well as broken meshes
+     */
+    const bool valid = indices.size() % 3 == 0 &&
+                       std::all_of( indices.begin(), indices.end(),
+    [ &vertices ]( const GLuint index ) {
+        return index < vertices.size();
+    } );
+    if ( false == valid ) {
+        WARN1( "Mesh not optimized, the index list is not a valid triangle list" );
+        return stats;
+    }
+    stats.triangles = indices.size() / 3;
+    stats.misses_before = simulate_vertex_cache( indices, vertices.size() );
+    weld_vertices( vertices, indices );
+    optimize_vertex_cache( indices, vertices.size() );
+    optimize_overdraw( indices, vertices );
+    optimize_vertex_fetch( vertices, indices );
+    stats.vertices_after = vertices.size();
+    stats.misses_after = simulate_vertex_cache( indices, vertices.size() );
+    return stats;
+}
+
+GLenum index_type_for( const std::size_t vertex_count )
+{
+    return vertex_count <= std::numeric_limits< GLushort >::max() ?
+           GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+std::size_t index_size( const GLenum index_type )
+{
+    return index_type == GL_UNSIGNED_SHORT ? sizeof( GLushort ) : sizeof( GLuint );
+}
+
+std::vector< GLushort > narrow_indices( const std::vector< GLuint >& indices )
+{
+    return std::vector< GLushort >( indices.begin(), indices.end() );
+}
+
+GLuint index_at( const void* indices,
+                 const GLenum index_type,
+                 const std::size_t idx )
+{
+    if ( index_type == GL_UNSIGNED_SHORT ) {
+        return static_cast< const GLushort* >( indices )[ idx ];
+    }
+    return static_cast< const GLuint* >( indices )[ idx ];
+}
+
+}
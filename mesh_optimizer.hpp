@@ -0,0 +1,107 @@
+#ifndef MESH_OPTIMIZER_HPP
+#define MESH_OPTIMIZER_HPP
+
+#include <headers.hpp>
+#include <vertex_layout.hpp>
+#include <vector>
+
+namespace models {
+
+/*
+ * Size of the FIFO vertex cache used to measure
+ * the ACMR, and of the LRU cache modeled by the
+ * triangle ordering
+ */
+constexpr std::size_t simulated_cache_size{ 16 };
+constexpr std::size_t optimizer_cache_size{ 32 };
+/*
+ * The overdraw ordering is rejected if it makes
+ * the ACMR worse than this ratio
+ */
+constexpr GLfloat overdraw_acmr_threshold{ 1.05f };
+
+/*
+ * Statistics of the mesh optimization, ACMR is
+ * the average number of vertex shader invocations
+ * (cache misses) per triangle
+ */
+struct Mesh_optimization_stats {
+    std::size_t triangles{ 0 };
+    std::size_t vertices_before{ 0 };
+    std::size_t vertices_after{ 0 };
+    std::size_t misses_before{ 0 };
+    std::size_t misses_after{ 0 };
+    GLfloat acmr_before() const
+    {
+        return triangles == 0 ? 0.0f :
+               static_cast< GLfloat >( misses_before ) / triangles;
+    }
+    GLfloat acmr_after() const
+    {
+        return triangles == 0 ? 0.0f :
+               static_cast< GLfloat >( misses_after ) / triangles;
+    }
+    Mesh_optimization_stats& operator += ( const Mesh_optimization_stats& other );
+};
+
+/*
+ * Number of misses of a FIFO cache of the given
+ * size when drawing the triangle list
+ */
+std::size_t simulate_vertex_cache( const std::vector< GLuint >& indices,
+                                   const std::size_t vertex_count,
+                                   const std::size_t cache_size = simulated_cache_size );
+
+/*
+ * Merge the bitwise identical vertices,
+ * the indices are remapped
+ */
+void weld_vertices( std::vector< vertex_t >& vertices,
+                    std::vector< GLuint >& indices );
+
+/*
+ * Reorder the triangles for the post transform
+ * vertex cache (Forsyth, linear speed vertex
+ * cache optimisation)
+ */
+void optimize_vertex_cache( std::vector< GLuint >& indices,
+                            const std::size_t vertex_count );
+
+/*
+ * Split the cache ordered triangles in clusters at
+ * the cache restarts and sort the clusters front to
+ * back from the outside of the mesh, to reduce the
+ * overdraw. The indices must be already optimized
+ * for the vertex cache.
+ */
+void optimize_overdraw( std::vector< GLuint >& indices,
+                        const std::vector< vertex_t >& vertices,
+                        const GLfloat acmr_threshold = overdraw_acmr_threshold );
+
+/*
+ * Reorder the vertices by first use in the index
+ * list, the unreferenced vertices are dropped
+ */
+void optimize_vertex_fetch( std::vector< vertex_t >& vertices,
+                            std::vector< GLuint >& indices );
+
+/*
+ * All the passes above, in order
+ */
+Mesh_optimization_stats optimize_mesh( std::vector< vertex_t >& vertices,
+                                       std::vector< GLuint >& indices );
+
+/*
+ * Index type for the given number of vertices,
+ * GL_UNSIGNED_SHORT whenever possible
+ */
+GLenum index_type_for( const std::size_t vertex_count );
+std::size_t index_size( const GLenum index_type );
+std::vector< GLushort > narrow_indices( const std::vector< GLuint >& indices );
+GLuint index_at( const void* indices,
+                 const GLenum index_type,
+                 const std::size_t idx );
+
+}
+
+#endif //MESH_OPTIMIZER_HPP
@@ -0,0 +1,267 @@
+#include <model_cache.hpp>
+#include <logger/logger.hpp>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+namespace models {
+
+namespace {
+
+constexpr char binary_model_magic[4] = { 'B', 'M', 'D', 'L' };
+
+bool valid_range( const uint64_t offset,
+                  const uint64_t length,
+                  const uint64_t size )
+{
+    return offset <= size && length <= size - offset;
+}
+
+template< typename T >
+void copy_to( std::vector< uint8_t >& buffer,
+              const std::size_t offset,
+              const T* data,
+              const std::size_t count )
+{
+    if ( count > 0 ) {
+        std::memcpy( buffer.data() + offset, data, count * sizeof( T ) );
+    }
+}
+
+}
+
+Binary_model::Binary_model( files::Mapped_file::pointer file,
+                            const Binary_model_header* header,
+                            const Binary_mesh_record* meshes,
+                            const Binary_texture_record* textures,
+                            const char* paths ) :
+    file{ file },
+    file_header{ header },
+    mesh_table{ meshes },
+    texture_table{ textures },
+    paths{ paths }
+{
+}
+
+Binary_model::pointer Binary_model::open( const std::string& source_path,
+        const bool revert_z )
+{
+    const std::string path = source_path + binary_model_extension;
+    uint64_t binary_size;
+    int64_t binary_mtime;
+    if ( false == files::file_info( path, binary_size, binary_mtime ) ) {
+        return nullptr;
+    }
+    auto file = std::make_shared< files::Mapped_file >( path );
+    if ( false == file->is_valid() ) {
+        return nullptr;
+    }
+    const auto* header = file->at< Binary_model_header >( 0 );
+    if ( nullptr == header ||
+         0 != std::memcmp( header->magic, binary_model_magic, sizeof( binary_model_magic ) ) ||
+         header->version != binary_model_version ||
+         header->vertex_size != sizeof( vertex_t ) ||
+         header->revert_z != static_cast< uint32_t >( revert_z ) ) {
+        LOG1( "Outdated binary model ", path );
+        return nullptr;
+    }
+    /*
+     * A missing source is fine, the binary
+     * models can be shipped alone
+     */
+    uint64_t source_size;
+    int64_t source_mtime;
+    if ( files::file_info( source_path, source_size, source_mtime ) &&
+         ( source_size != header->source_size ||
+           source_mtime != header->source_mtime ) ) {
+        LOG1( "The source model changed, ", path, " is outdated" );
+        return nullptr;
+    }
+
+    const auto* meshes = file->at< Binary_mesh_record >( header->mesh_table_offset,
+                         header->mesh_count );
+    const auto* textures = file->at< Binary_texture_record >( header->texture_table_offset,
+                           header->texture_count );
+    const auto* paths = file->at< char >( header->paths_offset,
+                                          header->paths_size );
+    if ( nullptr == meshes || nullptr == textures || nullptr == paths ) {
+        ERR( "Corrupted binary model ", path );
+        return nullptr;
+    }
+    for ( std::size_t idx{ 0 } ; idx < header->texture_count ; ++idx ) {
+        if ( false == valid_range( textures[ idx ].path_offset,
+                                   textures[ idx ].path_length,
+                                   header->paths_size ) ) {
+            ERR( "Corrupted texture table in ", path );
+            return nullptr;
+        }
+    }
+    for ( std::size_t idx{ 0 } ; idx < header->mesh_count ; ++idx ) {
+        const auto& mesh = meshes[ idx ];
+        if ( mesh.vertex_format > static_cast< uint32_t >( vertex_format::packed ) ||
+             0 != mesh.vertex_offset % alignof( vertex_t ) ||
+             nullptr == file->at< uint8_t >( mesh.vertex_offset,
+                                             mesh.vertex_count *
+                                             vertex_stride( static_cast< vertex_format >( mesh.vertex_format ) ) ) ||
+             ( mesh.index_type != GL_UNSIGNED_SHORT && mesh.index_type != GL_UNSIGNED_INT ) ||
+             0 != mesh.index_offset % index_size( mesh.index_type ) ||
+             nullptr == file->at< uint8_t >( mesh.index_offset,
+                                             mesh.index_count * index_size( mesh.index_type ) ) ||
+             false == valid_range( mesh.first_texture,
+                                   mesh.texture_count,
+                                   header->texture_count ) ) {
+            ERR( "Corrupted mesh table in ", path );
+            return nullptr;
+        }
+    }
+    LOG3( "Mapped binary model ", path, ", size: ", file->size() );
+    return std::make_shared< Binary_model >( file,
+            header,
+            meshes,
+            textures,
+            paths );
+}
+
+const Binary_model_header& Binary_model::header() const
+{
+    return *file_header;
+}
+
+const Binary_mesh_record& Binary_model::mesh( const std::size_t idx ) const
+{
+    return mesh_table[ idx ];
+}
+
+const void* Binary_model::vertices( const std::size_t mesh_idx ) const
+{
+    return file->data() + mesh_table[ mesh_idx ].vertex_offset;
+}
+
+const void* Binary_model::indices( const std::size_t mesh_idx ) const
+{
+    return file->data() + mesh_table[ mesh_idx ].index_offset;
+}
+
+texture_type Binary_model::get_texture_type( const std::size_t texture_idx ) const
+{
+    return static_cast< texture_type >( texture_table[ texture_idx ].type );
+}
+
+std::string Binary_model::texture_path( const std::size_t texture_idx ) const
+{
+    return std::string( paths + texture_table[ texture_idx ].path_offset,
+                        texture_table[ texture_idx ].path_length );
+}
+
+bool write_binary_model( const std::string& source_path,
+                         const bool revert_z,
+                         const GLfloat model_height,
+                         const GLfloat model_radius,
+                         const std::vector< imported_mesh >& meshes )
+{
+    const std::string path = source_path + binary_model_extension;
+    Binary_model_header header;
+    std::memset( &header, 0, sizeof( header ) );
+    std::memcpy( header.magic, binary_model_magic, sizeof( binary_model_magic ) );
+    header.version = binary_model_version;
+    header.vertex_size = sizeof( vertex_t );
+    header.revert_z = static_cast< uint32_t >( revert_z );
+    header.model_height = model_height;
+    header.model_radius = model_radius;
+    if ( false == files::file_info( source_path,
+                                    header.source_size,
+                                    header.source_mtime ) ) {
+        ERR( "Unable to access the source model ", source_path );
+        return false;
+    }
+
+    std::vector< Binary_mesh_record > mesh_table;
+    std::vector< Binary_texture_record > texture_table;
+    std::string paths;
+    for ( auto&& mesh : meshes ) {
+        Binary_mesh_record record;
+        std::memset( &record, 0, sizeof( record ) );
+        record.vertex_count = mesh.vertex_count;
+        record.index_count = mesh.index_count;
+        record.first_texture = texture_table.size();
+        record.vertex_format = static_cast< uint32_t >( mesh.format );
+        record.index_type = mesh.index_type;
+        for ( std::size_t axis{ 0 } ; axis < 3 ; ++axis ) {
+            record.bounds_min[ axis ] = mesh.bounds_min[ axis ];
+            record.bounds_max[ axis ] = mesh.bounds_max[ axis ];
+            record.position_offset[ axis ] = mesh.dequantization.offset[ axis ];
+            record.position_scale[ axis ] = mesh.dequantization.scale[ axis ];
+        }
+        for ( auto&& texture : mesh.textures ) {
+            Binary_texture_record texture_record;
+            texture_record.type = static_cast< uint32_t >( texture.type );
+            texture_record.path_offset = paths.size();
+            texture_record.path_length = texture.path.size();
+            paths += texture.path;
+            texture_table.push_back( texture_record );
+        }
+        record.texture_count = texture_table.size() - record.first_texture;
+        mesh_table.push_back( record );
+    }
+    header.mesh_count = mesh_table.size();
+    header.texture_count = texture_table.size();
+
+    /*
+     * Layout of the blobs
+     */
+    std::size_t offset = files::align_offset( sizeof( header ), binary_model_alignment );
+    header.mesh_table_offset = offset;
+    offset = files::align_offset( offset + mesh_table.size() * sizeof( Binary_mesh_record ),
+                                  binary_model_alignment );
+    header.texture_table_offset = offset;
+    offset = files::align_offset( offset + texture_table.size() * sizeof( Binary_texture_record ),
+                                  binary_model_alignment );
+    header.paths_offset = offset;
+    header.paths_size = paths.size();
+    offset = files::align_offset( offset + paths.size(), binary_model_alignment );
+    for ( auto&& record : mesh_table ) {
+        record.vertex_offset = offset;
+        offset = files::align_offset( offset + record.vertex_count *
+                                      vertex_stride( static_cast< vertex_format >( record.vertex_format ) ),
+                                      binary_model_alignment );
+        record.index_offset = offset;
+        offset = files::align_offset( offset + record.index_count * index_size( record.index_type ),
+                                      binary_model_alignment );
+    }
+
+    std::vector< uint8_t > buffer( offset, 0 );
+    copy_to( buffer, 0, &header, 1 );
+    copy_to( buffer, header.mesh_table_offset, mesh_table.data(), mesh_table.size() );
+    copy_to( buffer, header.texture_table_offset, texture_table.data(), texture_table.size() );
+    copy_to( buffer, header.paths_offset, paths.data(), paths.size() );
+    for ( std::size_t idx{ 0 } ; idx < meshes.size() ; ++idx ) {
+        copy_to( buffer, mesh_table[ idx ].vertex_offset,
+                 static_cast< const uint8_t* >( meshes[ idx ].vertex_data ),
+                 mesh_table[ idx ].vertex_count * vertex_stride( meshes[ idx ].format ) );
+        copy_to( buffer, mesh_table[ idx ].index_offset,
+                 static_cast< const uint8_t* >( meshes[ idx ].index_data ),
+                 mesh_table[ idx ].index_count * index_size( meshes[ idx ].index_type ) );
+    }
+
+    const std::string temp_path = path + ".tmp";
+    {
+        std::ofstream output( temp_path, std::ios::binary | std::ios::trunc );
+        output.write( reinterpret_cast< const char* >( buffer.data() ),
+                      buffer.size() );
+        if ( !output ) {
+            ERR( "Unable to write the binary model ", temp_path );
+            std::remove( temp_path.c_str() );
+            return false;
+        }
+    }
+    if ( 0 != std::rename( temp_path.c_str(), path.c_str() ) ) {
+        ERR( "Unable to rename ", temp_path, " to ", path );
+        std::remove( temp_path.c_str() );
+        return false;
+    }
+    LOG1( "Written the binary model ", path, ", size: ", buffer.size() );
+    return true;
+}
+
+}
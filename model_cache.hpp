@@ -0,0 +1,123 @@
+#ifndef MODEL_CACHE_HPP
+#define MODEL_CACHE_HPP
+
+#include <models.hpp>
+#include <mapped_file.hpp>
+#include <cstdint>
+
+namespace models {
+
+/*
+ * Precompiled binary model format.
+ *
+ * The result of the Assimp import is stored next to
+ * the source model (<model>.bmdl) the first time the
+ * model is loaded, the following loads map the file
+ * in memory and pass the vertex and index blobs
+ * directly to OpenGL, without parsing.
+ *
+ * Layout, all the blobs are aligned to
+ * binary_model_alignment bytes:
+ *
+ * Binary_model_header
+ * Binary_mesh_record[ mesh_count ]
+ * Binary_texture_record[ texture_count ]
+ * texture paths (not null terminated)
+ * for each mesh: vertices in the mesh vertex_format,
+ *                indices of index_type[ index_count ]
+ *
+ * The file is rebuilt whenever the version, the
+ * vertex layout, the source file or the import
+ * options do not match.
+ */
+constexpr uint32_t binary_model_version{ 4 };
+constexpr std::size_t binary_model_alignment{ 16 };
+const std::string binary_model_extension{ ".bmdl" };
+
+struct Binary_model_header {
+    char     magic[4];
+    uint32_t version;
+    uint32_t vertex_size;
+    uint32_t revert_z;
+    uint64_t source_size;
+    int64_t  source_mtime;
+    GLfloat  model_height;
+    GLfloat  model_radius;
+    uint32_t mesh_count;
+    uint32_t texture_count;
+    uint64_t mesh_table_offset;
+    uint64_t texture_table_offset;
+    uint64_t paths_offset;
+    uint64_t paths_size;
+};
+
+struct Binary_mesh_record {
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t first_texture;
+    uint32_t texture_count;
+    GLfloat  bounds_min[3];
+    GLfloat  bounds_max[3];
+    uint32_t vertex_format;
+    GLfloat  position_offset[3];
+    GLfloat  position_scale[3];
+    uint32_t index_type;
+};
+
+struct Binary_texture_record {
+    uint32_t type;
+    uint32_t path_length;
+    uint64_t path_offset;
+};
+
+/*
+ * Validated view of a binary model file,
+ * the mapping is kept alive as long as
+ * this object exists
+ */
+class Binary_model
+{
+public:
+    using pointer = std::shared_ptr< Binary_model >;
+    /*
+     * nullptr if the binary file is missing,
+     * corrupted or outdated
+     */
+    static pointer open( const std::string& source_path,
+                         const bool revert_z );
+    const Binary_model_header& header() const;
+    const Binary_mesh_record& mesh( const std::size_t idx ) const;
+    const void* vertices( const std::size_t mesh_idx ) const;
+    const void* indices( const std::size_t mesh_idx ) const;
+    texture_type get_texture_type( const std::size_t texture_idx ) const;
+    std::string texture_path( const std::size_t texture_idx ) const;
+    Binary_model( files::Mapped_file::pointer file,
+                  const Binary_model_header* header,
+                  const Binary_mesh_record* meshes,
+                  const Binary_texture_record* textures,
+                  const char* paths );
+private:
+    files::Mapped_file::pointer file;
+    const Binary_model_header* file_header;
+    const Binary_mesh_record* mesh_table;
+    const Binary_texture_record* texture_table;
+    const char* paths;
+};
+
+/*
+ * Compile the loaded meshes in the binary format,
+ * the file is written to a temporary location and
+ * then renamed, a partially written model is
+ * never visible to the loader
+ */
+bool write_binary_model( const std::string& source_path,
+                         const bool revert_z,
+                         const GLfloat model_height,
+                         const GLfloat model_radius,
+                         const std::vector< imported_mesh >& meshes );
+
+}
+
+#endif //MODEL_CACHE_HPP
@@ -2,21 +2,39 @@
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec2 tex_coord;
 layout (location = 2) in vec3 normal_vec;
+//Texture array layers + 1 (diffuse, specular), 0 if none
+layout (location = 3) in vec2 texture_layers;
+//Picking color of the vertex, see per_vertex_color
+layout (location = 4) in vec4 picking_color;
 
 out vec2 texture_coords;
 out vec3 normal;
 out vec3 frag_pos;
 out vec3 camera_pos;
+out float view_depth;
+flat out vec2 layers;
+flat out vec4 vertex_color;
 
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+/*
+ * Dequantization of the packed positions,
+ * identity for the full precision vertices
+ */
+uniform vec4 position_offset;
+uniform vec4 position_scale;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(position, 1.0);
+    vec3 local_pos = position * position_scale.xyz + position_offset.xyz;
+    gl_Position = projection * view * model * vec4(local_pos, 1.0);
     normal = mat3(transpose(inverse(model))) * normal_vec;
     texture_coords = tex_coord;
-    frag_pos = vec3( model * vec4(position, 1.0f) );
+    layers = texture_layers;
+    vertex_color = picking_color;
+    frag_pos = vec3( model * vec4(local_pos, 1.0f) );
     camera_pos = inverse(view)[3].xyz;
+    //Used to find the light cluster of the fragment
+    view_depth = -( view * model * vec4(local_pos, 1.0f) ).z;
 }
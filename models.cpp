@@ -1,10 +1,13 @@
 #include <models.hpp>
+#include <model_cache.hpp>
 #include <logger/logger.hpp>
 #include <thread>
 #include <future>
 #include <functional>
 #include <chrono>
 #include <mutex>
+#include <limits>
+#include <algorithm>
 
 namespace models {
 
@@ -14,19 +17,58 @@ namespace models {
 
 my_mesh::my_mesh( vertices_ptr vertx,
                   indices_ptr indx,
-                  textures_ptr texts ) :
-    vertices{ std::move( vertx ) },
-    indices{ std::move( indx ) },
+                  textures_ptr texts,
+                  const mesh_retention retention ) :
+    index_type{ index_type_for( vertx->size() ) },
+    format{ vertex_format::full },
+    retention{ retention },
     textures{ std::move( texts ) }
 {
     LOG1( "Creating my_mesh. VRTX:",
-          vertices->size(), ", IDX:", indices->size(),
+          vertx->size(), ", IDX:", indx->size(),
           ", TXT", textures->size() );
-    setup_mesh();
+    if ( index_type == GL_UNSIGNED_SHORT ) {
+        const std::vector< GLushort > short_indices = narrow_indices( *indx );
+        setup_mesh( vertx->data(), vertx->size(),
+                    short_indices.data(), short_indices.size() );
+        retain_data( vertx->data(), vertx->size(),
+                     short_indices.data(), short_indices.size() );
+    } else {
+        setup_mesh( vertx->data(), vertx->size(),
+                    indx->data(), indx->size() );
+        retain_data( vertx->data(), vertx->size(),
+                     indx->data(), indx->size() );
+    }
+}
+
+my_mesh::my_mesh( const void* vertx,
+                  const vertex_format format,
+                  const position_dequantization& dequantization,
+                  const std::size_t vertex_count,
+                  const void* indx,
+                  const GLenum index_type,
+                  const std::size_t index_count,
+                  textures_ptr texts,
+                  const mesh_retention retention ) :
+    index_type{ index_type },
+    format{ format },
+    dequantization( dequantization ),
+    retention{ retention },
+    textures{ std::move( texts ) }
+{
+    LOG1( "Creating my_mesh from memory. VRTX:",
+          vertex_count, ", IDX:", index_count,
+          ", TXT", textures->size() );
+    setup_mesh( vertx, vertex_count, indx, index_count );
+    retain_data( vertx, vertex_count, indx, index_count );
 }
 
-void my_mesh::setup_mesh()
+void my_mesh::setup_mesh( const void* vertx,
+                          const std::size_t vertex_count,
+                          const void* indx,
+                          const std::size_t num_of_indices )
 {
+    index_count = num_of_indices;
     LOG3( "Setup of all the OpenGL buffers" );
     glGenVertexArrays( 1, &VAO );
     glGenBuffers( 1, &VBO );
@@ -36,88 +78,176 @@ void my_mesh::setup_mesh()
     glBindBuffer( GL_ARRAY_BUFFER, VBO );
 
     glBufferData( GL_ARRAY_BUFFER,
-                  vertices->size() * sizeof( vertex_t ),
-                  &vertices->at( 0 ),
+                  vertex_count * vertex_stride( format ),
+                  vertx,
                   GL_STATIC_DRAW );
 
     glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, EBO );
     glBufferData( GL_ELEMENT_ARRAY_BUFFER,
-                  indices->size() * sizeof( GLuint ),
-                  &indices->at( 0 ),
+                  num_of_indices * index_size( index_type ),
+                  indx,
                   GL_STATIC_DRAW );
 
-    // Vertex Positions
-    glEnableVertexAttribArray( 0 );
-    glVertexAttribPointer( 0, 3, GL_FLOAT, GL_FALSE, sizeof( vertex_t ),
-                           ( GLvoid* )0 );
-    // Vertex Texture Coords
-    glEnableVertexAttribArray( 1 );
-    glVertexAttribPointer( 1, 2, GL_FLOAT, GL_FALSE, sizeof( vertex_t ),
-                           ( GLvoid* )offsetof( vertex_t, texture_coord ) );
-    // Vertex Normals
-    glEnableVertexAttribArray( 2 );
-    glVertexAttribPointer( 2, 3, GL_FLOAT, GL_FALSE, sizeof( vertex_t ),
-                           ( GLvoid* )offsetof( vertex_t, normal ) );
+    // Positions, texture coordinates and normals
+    setup_vertex_attributes( format );
+
+    /*
+     * Texture array layers, the same for all the
+     * vertices of the mesh: the attribute array stays
+     * disabled and the layers are set as constant
+     * attribute while rendering. Stored as layer + 1,
+     * zero means no layer
+     */
+    for ( auto& current_tex : *textures ) {
+        if ( current_tex.layer < 0 ) {
+            continue;
+        }
+        if ( current_tex.type == texture_type::diffuse && layers.x == 0.0f ) {
+            layers.x = current_tex.layer + 1;
+            diffuse_array = current_tex.id;
+        } else if ( current_tex.type == texture_type::specular && layers.y == 0.0f ) {
+            layers.y = current_tex.layer + 1;
+            specular_array = current_tex.id;
+        }
+    }
 
     glBindBuffer( GL_ARRAY_BUFFER, 0 );
     glBindVertexArray( 0 );
 }
 
+void my_mesh::retain_data( const void* vertx,
+                           const std::size_t vertex_count,
+                           const void* indx,
+                           const std::size_t num_of_indices )
+{
+    const std::size_t vertex_bytes = vertex_count * vertex_stride( format );
+    const std::size_t index_bytes = num_of_indices * index_size( index_type );
+    uploaded_bytes = vertex_bytes + index_bytes;
+    switch ( retention ) {
+    case mesh_retention::everything:
+        vertex_data.assign( static_cast< const uint8_t* >( vertx ),
+                            static_cast< const uint8_t* >( vertx ) + vertex_bytes );
+        index_data.assign( static_cast< const uint8_t* >( indx ),
+                           static_cast< const uint8_t* >( indx ) + index_bytes );
+        break;
+    case mesh_retention::positions:
+        positions.reserve( vertex_count );
+        for ( std::size_t idx{ 0 } ; idx < vertex_count ; ++idx ) {
+            positions.push_back( vertex_position( vertx, format, dequantization, idx ) );
+        }
+        position_indices.reserve( num_of_indices );
+        for ( std::size_t idx{ 0 } ; idx < num_of_indices ; ++idx ) {
+            position_indices.push_back( index_at( indx, index_type, idx ) );
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+const std::vector< glm::vec3 >& my_mesh::get_positions() const
+{
+    return positions;
+}
+
+const std::vector< GLuint >& my_mesh::get_position_indices() const
+{
+    return position_indices;
+}
+
+const std::vector< uint8_t >& my_mesh::get_vertex_data() const
+{
+    return vertex_data;
+}
+
+const std::vector< uint8_t >& my_mesh::get_index_data() const
+{
+    return index_data;
+}
+
+vertex_format my_mesh::get_vertex_format() const
+{
+    return format;
+}
+
+const position_dequantization& my_mesh::get_dequantization() const
+{
+    return dequantization;
+}
+
+GLenum my_mesh::get_index_type() const
+{
+    return index_type;
+}
+
+glm::vec2 my_mesh::get_texture_layers() const
+{
+    return layers;
+}
+
+GLuint my_mesh::get_diffuse_array() const
+{
+    return diffuse_array;
+}
+
+GLuint my_mesh::get_specular_array() const
+{
+    return specular_array;
+}
+
+const std::vector< texture_t >& my_mesh::get_textures() const
+{
+    return *textures;
+}
+
+Mesh_memory_stats my_mesh::get_memory_stats() const
+{
+    Mesh_memory_stats stats;
+    stats.uploaded_bytes = uploaded_bytes;
+    stats.retained_bytes = vertex_data.size() + index_data.size() +
+                           positions.size() * sizeof( glm::vec3 ) +
+                           position_indices.size() * sizeof( GLuint );
+    return stats;
+}
+
 my_mesh::~my_mesh()
 {
     glDeleteBuffers( 1, &EBO );
     glDeleteBuffers( 1, &VBO );
-    glDeleteBuffers( 1, &VAO );
+    glDeleteVertexArrays( 1, &VAO );
 }
 
 bool my_mesh::render( shaders::Shader* shader ) const
 {
     glBindVertexArray( VAO );
-    GLuint current_unit = 0;
-    GLuint diffuse_nr = 0;
-    GLuint specular_nr = 0;
-
-    static const char* texture_sampler_name[2][3] = {
-        {
-            "loaded_texture1",
-            "loaded_texture2",
-            "loaded_texture3"
-        },
-        {
-            "loaded_texture_specular_map1",
-            "loaded_texture_specular_map2",
-            "loaded_texture_specular_map3"
-        }
-    };
-
-    uint_fast8_t texture_type{ 0 }, texture_nr{ 0 };
-    for ( auto& current_tex : *textures ) {
-        glActiveTexture( GL_TEXTURE0 + current_unit );
-        if ( current_tex.type == texture_type::diffuse ) {
-            texture_type = 0;
-            texture_nr = diffuse_nr++;
-        } else if ( current_tex.type == texture_type::specular ) {
-            texture_type = 1;
-            texture_nr = specular_nr++;
-        }
-        const char* name = texture_sampler_name[ texture_type ][ texture_nr ];
-        GLint map = glGetUniformLocation( shader->get_program(),
-                                          name );
-        if ( map >= 0 ) {
-            glUniform1f( map, current_unit );
-        } else {
-            ERR( "Unable to setup the texture unit! ",
-                 name );
-            glBindVertexArray( 0 );
-            return false;
-        }
-
-        glBindTexture( GL_TEXTURE_2D, current_tex.id );
-        ++current_unit;
+    /*
+     * The layers are a constant vertex attribute, the
+     * arrays are rebound only when they change
+     */
+    glVertexAttrib2f( texture_layers_attribute, layers.x, layers.y );
+    if ( diffuse_array != 0 ) {
+        arrays().bind( diffuse_array_unit, diffuse_array );
+    }
+    if ( specular_array != 0 ) {
+        arrays().bind( specular_array_unit, specular_array );
     }
-    glActiveTexture( GL_TEXTURE0 );
 
-    glDrawElements( GL_TRIANGLES, indices->size(), GL_UNSIGNED_INT, 0 );
+    if ( format == vertex_format::packed ) {
+        shader->set_uniform( shaders::uniforms::position_offset,
+                             glm::vec4( dequantization.offset, 0.0f ) );
+        shader->set_uniform( shaders::uniforms::position_scale,
+                             glm::vec4( dequantization.scale, 1.0f ) );
+    }
+    glDrawElements( GL_TRIANGLES, index_count, index_type, 0 );
+    if ( format == vertex_format::packed ) {
+        //Back to the identity, for the full precision vertices
+        shader->set_uniform( shaders::uniforms::position_offset,
+                             glm::vec4( 0.0f ) );
+        shader->set_uniform( shaders::uniforms::position_scale,
+                             glm::vec4( 1.0f ) );
+    }
+    //Back to no layers, for the objects without the attribute
+    glVertexAttrib2f( texture_layers_attribute, 0.0f, 0.0f );
     glBindVertexArray( 0 );
     return true;
 }
@@ -127,17 +257,129 @@ bool my_mesh::render( shaders::Shader* shader ) const
 /////////////////////////////////////
 
 model_loader::model_loader( const std::string& path,
-                            z_axis revert_z ) :
+                            z_axis revert_z,
+                            mesh_retention retention ) :
     model_path{ path },
     revert_z_axis{ revert_z == z_axis::normal  },
-    model_height{ 0 }
+    model_height{ 0 },
+    model_radius{ 0 },
+    next_upload{ 0 },
+    retention{ retention }
 {
 }
 
 bool model_loader::load_model()
 {
-    LOG3( "Loading: ",
+    if ( false == import_model() ) {
+        return false;
+    }
+    std::size_t budget = std::numeric_limits< std::size_t >::max();
+    return upload_model( budget );
+}
+
+bool model_loader::import_model()
+{
+    LOG3( "Importing: ",
           model_path.c_str() );
+    model_directory = model_path.substr( 0, model_path.find_last_of( '/' ) );
+    texture_stats = Texture_cache_stats();
+    optimization_stats = Mesh_optimization_stats();
+    memory_stats = Mesh_memory_stats();
+    if ( false == import_binary_model() ) {
+        if ( false == import_assimp_model() ) {
+            return false;
+        }
+        write_binary_model( model_path,
+                            revert_z_axis,
+                            model_height,
+                            model_radius,
+                            imported_meshes );
+    }
+    LOG1( "Textures of ", model_path, ", requests: ", texture_stats.requests,
+          ", cache hit rate: ", texture_stats.hit_rate(),
+          ", bytes saved: ", texture_stats.bytes_saved );
+    return true;
+}
+
+bool model_loader::upload_model( std::size_t& budget )
+{
+    while ( next_upload < imported_meshes.size() && budget > 0 ) {
+        auto& mesh = imported_meshes[ next_upload++ ];
+        my_mesh::textures_ptr textures = std::make_unique<std::vector<texture_t>>();
+        for ( auto&& imported : mesh.textures ) {
+            const Texture_layer layer = imported.texture->upload();
+            texture_t texture;
+            texture.id = layer.array;
+            texture.layer = layer.layer;
+            texture.resource = imported.texture;
+            texture.type = imported.type;
+            texture.path = imported.path;
+            textures->push_back( texture );
+        }
+        meshes.push_back( std::make_unique<my_mesh>( mesh.vertex_data,
+                          mesh.format,
+                          mesh.dequantization,
+                          mesh.vertex_count,
+                          mesh.index_data,
+                          mesh.index_type,
+                          mesh.index_count,
+                          std::move( textures ),
+                          retention ) );
+        memory_stats += meshes.back()->get_memory_stats();
+        budget -= std::min( budget, 1 + mesh.textures.size() );
+    }
+    if ( next_upload < imported_meshes.size() ) {
+        return false;
+    }
+    //Everything is on the GPU, release the imported data
+    LOG1( "Uploaded ", model_path, ", mesh bytes: ", memory_stats.uploaded_bytes,
+          ", retained: ", memory_stats.retained_bytes,
+          ", reclaimed: ", memory_stats.reclaimed_bytes() );
+    imported_meshes.clear();
+    next_upload = 0;
+    binary_model = nullptr;
+    return true;
+}
+
+bool model_loader::import_binary_model()
+{
+    binary_model = Binary_model::open( model_path, revert_z_axis );
+    if ( nullptr == binary_model ) {
+        return false;
+    }
+    const auto& header = binary_model->header();
+    model_height = header.model_height;
+    model_radius = header.model_radius;
+    for ( std::size_t idx{ 0 } ; idx < header.mesh_count ; ++idx ) {
+        const auto& record = binary_model->mesh( idx );
+        imported_mesh mesh;
+        mesh.vertex_data = binary_model->vertices( idx );
+        mesh.vertex_count = record.vertex_count;
+        mesh.format = static_cast< vertex_format >( record.vertex_format );
+        mesh.dequantization.offset = glm::vec3( record.position_offset[0],
+                                                record.position_offset[1],
+                                                record.position_offset[2] );
+        mesh.dequantization.scale = glm::vec3( record.position_scale[0],
+                                               record.position_scale[1],
+                                               record.position_scale[2] );
+        mesh.index_data = binary_model->indices( idx );
+        mesh.index_type = record.index_type;
+        mesh.index_count = record.index_count;
+        for ( std::size_t tex{ record.first_texture } ;
+              tex < record.first_texture + record.texture_count ; ++tex ) {
+            mesh.textures.push_back( import_model_texture( binary_model->texture_path( tex ),
+                                     binary_model->get_texture_type( tex ),
+                                     texture_stats ) );
+        }
+        imported_meshes.push_back( std::move( mesh ) );
+    }
+    LOG1( "Imported the binary model for ", model_path, ", meshes: ",
+          imported_meshes.size() );
+    return true;
+}
+
+bool model_loader::import_assimp_model()
+{
     Assimp::Importer import;
     const aiScene* scene = import.ReadFile( model_path,
                                             aiProcess_Triangulate | //Transform all model primitives to triangles
@@ -148,9 +390,29 @@ bool model_loader::load_model()
              import.GetErrorString() );
         return false;
     }
-    model_directory = model_path.substr( 0, model_path.find_last_of( '/' ) );
 
-    process_model( scene->mRootNode, scene );
+    /*
+     * The node hierarchy is flattened and the meshes sharing
+     * a material are merged, one draw for each material
+     */
+    std::vector< material_batch > batches( scene->mNumMaterials );
+    process_model( scene->mRootNode, scene, glm::mat4( 1.0f ), batches );
+    std::size_t source_meshes{ 0 };
+    for ( std::size_t material{ 0 } ; material < batches.size() ; ++material ) {
+        source_meshes += batches[ material ].source_meshes;
+        if ( false == batches[ material ].indices.empty() ) {
+            imported_meshes.push_back( process_batch( batches[ material ],
+                                       scene->mMaterials[ material ] ) );
+        }
+    }
+    LOG1( "Merged ", source_meshes, " meshes of ", model_path,
+          " in ", imported_meshes.size(), " material batches" );
+    LOG1( "Optimized the meshes of ", model_path,
+          ", triangles: ", optimization_stats.triangles,
+          ", vertices: ", optimization_stats.vertices_before,
+          " -> ", optimization_stats.vertices_after,
+          ", ACMR: ", optimization_stats.acmr_before(),
+          " -> ", optimization_stats.acmr_after() );
     return true;
 }
 
@@ -164,46 +426,93 @@ GLfloat model_loader::get_model_height()
     return model_height;
 }
 
+GLfloat model_loader::get_model_radius()
+{
+    return model_radius;
+}
+
+Mesh_memory_stats model_loader::get_memory_stats()
+{
+    return memory_stats;
+}
+
+std::vector< std::shared_ptr< Cached_texture > > model_loader::get_cached_textures() const
+{
+    std::vector< std::shared_ptr< Cached_texture > > result;
+    for ( auto&& mesh : meshes ) {
+        for ( auto&& texture : mesh->get_textures() ) {
+            if ( nullptr != texture.resource &&
+                 std::find( result.begin(), result.end(),
+                            texture.resource ) == result.end() ) {
+                result.push_back( texture.resource );
+            }
+        }
+    }
+    return result;
+}
+
 
 void model_loader::process_model( aiNode* node,
-                                  const aiScene* scene )
+                                  const aiScene* scene,
+                                  const glm::mat4& parent_transform,
+                                  std::vector< material_batch >& batches )
 {
     LOG3( "Processing loaded model, ",
           model_path.c_str() );
+    const aiMatrix4x4& local = node->mTransformation;
+    //Assimp matrices are row major
+    const glm::mat4 transform = parent_transform * glm::mat4(
+                                    local.a1, local.b1, local.c1, local.d1,
+                                    local.a2, local.b2, local.c2, local.d2,
+                                    local.a3, local.b3, local.c3, local.d3,
+                                    local.a4, local.b4, local.c4, local.d4 );
     // Process all the node's meshes (if any)
     for ( GLuint i = 0; i < node->mNumMeshes; i++ ) {
         aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-        // Create a new my_mesh
-        mesh_ptr new_mesh = process_mesh( mesh, scene );
-        meshes.push_back( std::forward<mesh_ptr>( new_mesh ) );
+        process_mesh( mesh, transform, batches[ mesh->mMaterialIndex ] );
     }
     // Then do the same for each of its children
     LOG3( "Processing childs: ", node->mNumChildren );
     for ( GLuint i = 0; i < node->mNumChildren; i++ ) {
-        process_model( node->mChildren[i], scene );
+        process_model( node->mChildren[i], scene, transform, batches );
     }
 }
 
-mesh_ptr model_loader::process_mesh( aiMesh* mesh,
-                                     const aiScene* scene )
+void model_loader::process_mesh( aiMesh* mesh,
+                                 const glm::mat4& transform,
+                                 material_batch& batch )
 {
-    my_mesh::vertices_ptr vertices = std::make_unique<std::vector<vertex_t>>();
-    my_mesh::indices_ptr  indices = std::make_unique<std::vector<GLuint>>();
-    my_mesh::textures_ptr textures;
+    const glm::mat3 normal_transform = glm::transpose( glm::inverse( glm::mat3( transform ) ) );
+    const GLuint first_vertex = batch.vertices.size();
+    ++batch.source_meshes;
 
     // Walk through each of the mesh's vertices
     for ( GLuint i = 0; i < mesh->mNumVertices; i++ ) {
         vertex_t vertex;
-        // Positions
-        vertex.coordinate.x = mesh->mVertices[i].x;
-        vertex.coordinate.y = mesh->mVertices[i].z;
-        vertex.coordinate.z = -( revert_z_axis ? -1 : 1 ) * mesh->mVertices[i].y;
+        // Positions, in the model space
+        const glm::vec3 position( transform * glm::vec4( mesh->mVertices[i].x,
+                                  mesh->mVertices[i].y,
+                                  mesh->mVertices[i].z,
+                                  1.0f ) );
+        vertex.coordinate.x = position.x;
+        vertex.coordinate.y = position.z;
+        vertex.coordinate.z = -( revert_z_axis ? -1 : 1 ) * position.y;
         model_height = std::max( model_height, vertex.coordinate.z );
+        model_radius = std::max( model_radius, glm::length( vertex.coordinate ) );
         // Normals
         if ( mesh->mNormals ) {
-            vertex.normal.x = mesh->mNormals[i].x;
-            vertex.normal.y = mesh->mNormals[i].z;
-            vertex.normal.z = -( revert_z_axis ? -1 : 1 ) * mesh->mNormals[i].y;
+            glm::vec3 normal = normal_transform * glm::vec3( mesh->mNormals[i].x,
+                               mesh->mNormals[i].y,
+                               mesh->mNormals[i].z );
+            const GLfloat length = glm::length( normal );
+            if ( length > 0.0f ) {
+                normal /= length;
+            }
+            vertex.normal.x = normal.x;
+            vertex.normal.y = normal.z;
+            vertex.normal.z = -( revert_z_axis ? -1 : 1 ) * normal.y;
+        } else {
+            vertex.normal = glm::vec3( 0.0f );
         }
         // Texture Coordinates
         if ( mesh->mTextureCoords[0] ) { // Does the mesh contain texture coordinates?
@@ -214,59 +523,113 @@ mesh_ptr model_loader::process_mesh( aiMesh* mesh,
         } else {
             vertex.texture_coord = glm::vec2( 0.0f, 0.0f );
         }
-        vertices->push_back( vertex );
+        batch.vertices.push_back( vertex );
     }
 
-    // Now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+    /*
+     * Now walk through each of the mesh's faces and retrieve the corresponding
+     * vertex indices. Points and lines left by the triangulation are not drawn
+     */
     for ( GLuint i = 0; i < mesh->mNumFaces; i++ ) {
-        aiFace face = mesh->mFaces[i];
-        // Retrieve all indices of the face and store them in the indices vector
+        const aiFace& face = mesh->mFaces[i];
+        if ( face.mNumIndices != 3 ) {
+            continue;
+        }
         for ( GLuint j = 0; j < face.mNumIndices; j++ ) {
-            indices->push_back( face.mIndices[j] );
+            batch.indices.push_back( first_vertex + face.mIndices[j] );
         }
     }
+}
 
-    // Process materials
-    if ( mesh->mMaterialIndex >= 0 ) {
-        const aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
-
-        auto diffuse_maps = process_texture( material,
-                                             aiTextureType_DIFFUSE );
-        auto specular_maps = process_texture( material,
-                                              aiTextureType_SPECULAR );
-
-        diffuse_maps->insert( diffuse_maps->end(),
-                              specular_maps->begin(),
-                              specular_maps->end() );
-        textures = std::move( diffuse_maps );
+imported_mesh model_loader::process_batch( material_batch& batch,
+        const aiMaterial* material )
+{
+    my_mesh::vertices_ptr vertices = std::make_unique<std::vector<vertex_t>>();
+    my_mesh::indices_ptr  indices = std::make_unique<std::vector<GLuint>>();
+    vertices->swap( batch.vertices );
+    indices->swap( batch.indices );
+    imported_mesh result;
+
+    process_texture( material,
+                     aiTextureType_DIFFUSE,
+                     result.textures );
+    process_texture( material,
+                     aiTextureType_SPECULAR,
+                     result.textures );
+    /*
+     * Weld the duplicated vertices, reorder the triangles
+     * for the vertex cache and the overdraw and the
+     * vertices for the fetch locality
+     */
+    optimization_stats += optimize_mesh( *vertices, *indices );
+
+    // The mesh data is uploaded later by upload_model
+    result.bounds_min = glm::vec3( std::numeric_limits< GLfloat >::max() );
+    result.bounds_max = glm::vec3( std::numeric_limits< GLfloat >::lowest() );
+    for ( auto&& vertex : *vertices ) {
+        result.bounds_min = glm::min( result.bounds_min, vertex.coordinate );
+        result.bounds_max = glm::max( result.bounds_max, vertex.coordinate );
     }
-    // Return a mesh object created from the extracted mesh data
-    return std::make_unique<my_mesh>( std::forward<my_mesh::vertices_ptr>( vertices ),
-                                      std::forward<my_mesh::indices_ptr>( indices ),
-                                      std::forward<my_mesh::textures_ptr>( textures ) );
-    return nullptr;
+    result.vertex_count = vertices->size();
+    result.index_type = index_type_for( vertices->size() );
+    result.index_count = indices->size();
+    if ( result.index_type == GL_UNSIGNED_SHORT ) {
+        result.short_indices = narrow_indices( *indices );
+        result.index_data = result.short_indices.data();
+    } else {
+        result.index_data = indices->data();
+    }
+    /*
+     * Use the compact vertex format when the
+     * quantization error is acceptable
+     */
+    if ( false == vertices->empty() &&
+         pack_vertices( vertices->data(),
+                        vertices->size(),
+                        result.bounds_min,
+                        result.bounds_max,
+                        result.packed_vertices,
+                        result.dequantization ) ) {
+        result.format = vertex_format::packed;
+        result.vertex_data = result.packed_vertices.data();
+    } else {
+        result.format = vertex_format::full;
+        result.vertex_data = vertices->data();
+        result.vertices = std::move( vertices );
+    }
+    result.indices = std::move( indices );
+    return result;
 }
 
-my_mesh::textures_ptr model_loader::process_texture( const aiMaterial* material,
-        aiTextureType type )
+void model_loader::process_texture( const aiMaterial* material,
+                                    aiTextureType type,
+                                    std::vector< imported_texture >& textures )
 {
-    my_mesh::textures_ptr textures = std::make_unique<std::vector<texture_t>>();
     for ( GLuint i{ 0 } ; i < material->GetTextureCount( type ) ; ++i ) {
-        texture_t texture;
         aiString path;
         material->GetTexture( type, i, &path );
-        texture.type = map_texture_type( type );
-        std::string filename = path.C_Str();
-        std::size_t pos = filename.find_last_of( "\\/" );
-        if ( pos != std::string::npos ) {
-            filename = filename.substr( pos + 1 );
-        }
-        texture.id = load_texture(
-                         "../models/textures/" + filename );
-        texture.path = path.C_Str();
-        textures->push_back( texture );
+        textures.push_back( import_model_texture( path.C_Str(),
+                            map_texture_type( type ),
+                            texture_stats ) );
+    }
+}
+
+imported_texture import_model_texture( const std::string& path,
+                                       const texture_type type,
+                                       Texture_cache_stats& stats )
+{
+    std::string filename = path;
+    std::size_t pos = filename.find_last_of( "\\/" );
+    if ( pos != std::string::npos ) {
+        filename = filename.substr( pos + 1 );
     }
-    return std::move( textures );
+    imported_texture texture;
+    texture.texture = cache().acquire( "../models/textures/" + filename,
+                                       GL_REPEAT,
+                                       stats );
+    texture.type = type;
+    texture.path = path;
+    return texture;
 }
 
 my_model::my_model( const std::string& model_path,
@@ -5,7 +5,10 @@
 #include <shaders.hpp>
 #include <renderable_object.hpp>
 #include <textures.hpp>
+#include <texture_cache.hpp>
 #include <lights.hpp>
+#include <vertex_layout.hpp>
+#include <mesh_optimizer.hpp>
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
@@ -13,13 +16,41 @@
 
 namespace models {
 
-struct vertex_t {
-    glm::vec3 coordinate;
-    glm::vec2 texture_coord;
-    glm::vec3 normal;
+using namespace textures;
+
+/*
+ * Mesh data kept on the CPU after the upload
+ * to the GPU
+ */
+enum class mesh_retention {
+    //Nothing, the data lives only on the GPU
+    release,
+    //Model space positions and triangle indices, for picking and collision
+    positions,
+    //The vertices and indices as uploaded
+    everything
 };
 
-using namespace textures;
+/*
+ * Memory used by the meshes, reclaimed is
+ * the amount of uploaded data not kept
+ * on the CPU
+ */
+struct Mesh_memory_stats {
+    uint64_t uploaded_bytes{ 0 };
+    uint64_t retained_bytes{ 0 };
+    uint64_t reclaimed_bytes() const
+    {
+        return uploaded_bytes > retained_bytes ?
+               uploaded_bytes - retained_bytes : 0;
+    }
+    Mesh_memory_stats& operator += ( const Mesh_memory_stats& other )
+    {
+        uploaded_bytes += other.uploaded_bytes;
+        retained_bytes += other.retained_bytes;
+        return *this;
+    }
+};
 
 /*
  * Responsible for loading, storing, drawing
@@ -36,19 +67,78 @@ public:
     /*
      * my_mesh takes ownership of those data
      * structures! Make sure to not share this
-     * stuff with others!
+     * stuff with others! After the upload only
+     * what the retention policy requires is kept
      */
     my_mesh( vertices_ptr vertx,
              indices_ptr indx,
-             textures_ptr texts );
+             textures_ptr texts,
+             const mesh_retention retention );
+    /*
+     * Upload the vertices and indices directly
+     * from the given memory (like a mapped binary
+     * model), no CPU copy is kept. index_type is
+     * GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+     */
+    my_mesh( const void* vertx,
+             const vertex_format format,
+             const position_dequantization& dequantization,
+             const std::size_t vertex_count,
+             const void* indx,
+             const GLenum index_type,
+             const std::size_t index_count,
+             textures_ptr texts,
+             const mesh_retention retention );
     ~my_mesh();
     bool render( shaders::Shader* shader ) const;
+    /*
+     * Available with mesh_retention::positions
+     */
+    const std::vector< glm::vec3 >& get_positions() const;
+    const std::vector< GLuint >& get_position_indices() const;
+    /*
+     * Available with mesh_retention::everything, in
+     * the vertex format and index type of the mesh
+     */
+    const std::vector< uint8_t >& get_vertex_data() const;
+    const std::vector< uint8_t >& get_index_data() const;
+    vertex_format get_vertex_format() const;
+    const position_dequantization& get_dequantization() const;
+    GLenum get_index_type() const;
+    /*
+     * Texture array layers + 1 (diffuse, specular),
+     * zero if none, and the arrays they belong to
+     */
+    glm::vec2 get_texture_layers() const;
+    GLuint get_diffuse_array() const;
+    GLuint get_specular_array() const;
+    const std::vector< texture_t >& get_textures() const;
+    Mesh_memory_stats get_memory_stats() const;
 private:
-    void setup_mesh();
+    void setup_mesh( const void* vertx,
+                     const std::size_t vertex_count,
+                     const void* indx,
+                     const std::size_t index_count );
+    void retain_data( const void* vertx,
+                      const std::size_t vertex_count,
+                      const void* indx,
+                      const std::size_t index_count );
 private:
     GLuint VAO, VBO, EBO;
-    vertices_ptr vertices;
-    indices_ptr  indices; //For EBO
+    GLuint diffuse_array{ 0 };
+    GLuint specular_array{ 0 };
+    glm::vec2 layers{ 0.0f };
+    GLsizei index_count;
+    GLenum index_type;
+    vertex_format format;
+    position_dequantization dequantization;
+    mesh_retention retention;
+    std::vector< uint8_t > vertex_data;
+    std::vector< uint8_t > index_data;
+    std::vector< glm::vec3 > positions;
+    std::vector< GLuint > position_indices;
+    uint64_t uploaded_bytes;
+    //Keep the texture layers referenced
     textures_ptr textures;
 };
 
@@ -63,6 +153,59 @@ enum class z_axis {
 
 using mesh_ptr = std::unique_ptr<my_mesh>;
 
+class Binary_model;
+
+/*
+ * Texture requested during the import
+ * of a model, waiting for the upload
+ */
+struct imported_texture {
+    texture_type type;
+    std::string  path;
+    texture_ref  texture;
+};
+
+/*
+ * Mesh data produced by the import stage, the
+ * vertices and indices are either owned (Assimp
+ * import) or point to the mapped binary model
+ */
+struct imported_mesh {
+    my_mesh::vertices_ptr vertices;
+    std::vector< packed_vertex_t > packed_vertices;
+    my_mesh::indices_ptr  indices;
+    std::vector< GLushort > short_indices;
+    const void*     vertex_data;
+    std::size_t     vertex_count;
+    vertex_format   format;
+    position_dequantization dequantization;
+    const void*     index_data;
+    GLenum          index_type;
+    std::size_t     index_count;
+    glm::vec3       bounds_min;
+    glm::vec3       bounds_max;
+    std::vector< imported_texture > textures;
+};
+
+/*
+ * Geometry of all the meshes of a model which
+ * share one material, merged during the import
+ */
+struct material_batch {
+    std::vector< vertex_t > vertices;
+    std::vector< GLuint >   indices;
+    std::size_t source_meshes{ 0 };
+};
+
+/*
+ * Request from the texture cache one of the textures
+ * referenced by a model, path is the reference stored
+ * in the model file
+ */
+imported_texture import_model_texture( const std::string& path,
+                                       const texture_type type,
+                                       Texture_cache_stats& stats );
+
 /*
  * Responsible for loading models and creating
  * all the meshes data structure which then are
@@ -77,33 +220,95 @@ class model_loader
     /*
      * process_model is the function which traverse the
      * scene generated by Assimp and extract all the
-     * mesh information
+     * mesh information, transform is the transformation
+     * of the parent node
      */
-    void process_model( aiNode* node, const aiScene* scene );
+    void process_model( aiNode* node,
+                        const aiScene* scene,
+                        const glm::mat4& parent_transform,
+                        std::vector< material_batch >& batches );
     /*
-     * For each mesh in the model, generate
-     * the relative my_mesh
+     * Append the mesh, transformed in the model
+     * space, to the batch of its material
      */
-    mesh_ptr process_mesh( aiMesh* mesh, const aiScene* scene );
+    void process_mesh( aiMesh* mesh,
+                       const glm::mat4& transform,
+                       material_batch& batch );
+    /*
+     * Generate the mesh drawing all the
+     * geometry of one material
+     */
+    imported_mesh process_batch( material_batch& batch,
+                                 const aiMaterial* material );
     /*
      * Extract the texture information for
      * the mesh
      */
-    my_mesh::textures_ptr process_texture( const aiMaterial* material,
-                                           aiTextureType type );
+    void process_texture( const aiMaterial* material,
+                          aiTextureType type,
+                          std::vector< imported_texture >& textures );
+    /*
+     * Import the meshes from the precompiled
+     * binary model, if available and up to date
+     */
+    bool import_binary_model();
+    bool import_assimp_model();
 public:
     using pointer = std::shared_ptr< model_loader >;
-    model_loader( const std::string& path, z_axis revert_z = models::z_axis::normal );
+    model_loader( const std::string& path,
+                  z_axis revert_z = models::z_axis::normal,
+                  mesh_retention retention = mesh_retention::release );
+    /*
+     * Import and upload the model, from
+     * the thread which own the GL context
+     */
     bool load_model();
+    /*
+     * Parse the model and decode its textures, no
+     * OpenGL call is performed: safe to be called
+     * from a worker thread
+     */
+    bool import_model();
+    /*
+     * Create the GL objects for the imported
+     * meshes, each mesh and texture consume one
+     * unit of budget. Return true when the whole
+     * model is uploaded
+     */
+    bool upload_model( std::size_t& budget );
     my_mesh::meshes& get_mesh();
     GLfloat get_model_height();
+    /*
+     * Distance of the farthest vertex
+     * from the model origin
+     */
+    GLfloat get_model_radius();
+    /*
+     * Memory of the uploaded meshes
+     */
+    Mesh_memory_stats get_memory_stats();
+    /*
+     * The cached textures used by the
+     * meshes, each of them once
+     */
+    std::vector< std::shared_ptr< Cached_texture > > get_cached_textures() const;
 private:
     std::string model_path;
     std::string model_directory;
     my_mesh::meshes meshes;
     GLfloat model_height;
+    GLfloat model_radius;
+    std::vector< imported_mesh > imported_meshes;
+    std::size_t next_upload;
+    std::shared_ptr< Binary_model > binary_model;
+    //Texture cache usage of the last import
+    Texture_cache_stats texture_stats;
+    //Mesh optimization of the last Assimp import
+    Mesh_optimization_stats optimization_stats;
     //For models which are 'reverted'
     bool revert_z_axis;
+    mesh_retention retention;
+    Mesh_memory_stats memory_stats;
 };
 
 /*
@@ -9,6 +9,7 @@ namespace scene {
 /////////////////////////////////////
 
 Movable::Movable() :
+    current_transform_version{ 0 },
     model{ glm::mat4() },
     current_position{ glm::vec3() },
     current_yaw{ 0 },
@@ -25,6 +26,7 @@ void Movable::set_position( const glm::vec3& position )
     model = glm::translate( model,
                             translation_vector );
     current_position = position;
+    transform_changed();
 }
 
 glm::vec3 Movable::get_position()
@@ -53,6 +55,7 @@ void Movable::set_roll( GLfloat roll )
 void Movable::set_scale( GLfloat scale )
 {
     current_scale = scale;
+    transform_changed();
 }
 
 GLfloat Movable::get_yaw()
@@ -94,6 +97,7 @@ void Movable::modify_angle( movement::angle angle,
     default:
         ERR( "modify_angle: Unknow angle!" );
     }
+    transform_changed();
 }
 
 
@@ -132,6 +136,7 @@ bool Movable::move( movement::direction direction,
         model = glm::translate( model,
                                 translation_vector );
         current_position = glm::vec3( model[3].x, model[3].y, model[3].z );
+        transform_changed();
     }
     return ret;
 }
@@ -146,6 +151,16 @@ movement_mapping& Movable::get_movement_setup()
     return movement_setup;
 }
 
+uint64_t Movable::transform_version() const
+{
+    return current_transform_version;
+}
+
+void Movable::transform_changed()
+{
+    ++current_transform_version;
+}
+
 //////////////////////////////////////
 /// object_movement_processor implementation
 /////////////////////////////////////
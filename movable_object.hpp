@@ -115,7 +115,16 @@ public:
     virtual bool move( movement::direction direction, GLfloat amount );
     virtual void rotate_around( GLfloat amount );
     movement_mapping& get_movement_setup();
+    /*
+     * Incremented at every change of the position,
+     * the angles or the scale. Used to find out
+     * whether data derived from the object (light
+     * records &c) need to be updated.
+     */
+    uint64_t transform_version() const;
 protected:
+    void transform_changed();
+    uint64_t current_transform_version;
     glm::mat4 model;
     glm::vec3 current_position;
     GLfloat current_yaw,
@@ -0,0 +1,387 @@
+#include <movement_table.hpp>
+#include <thread_pool.hpp>
+#include <logger/logger.hpp>
+#include <atomic>
+#include <chrono>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace game_units {
+
+namespace {
+
+/*
+ * sin( x * pi / 2 ) for x in [0,1], Taylor series
+ * up to the ninth power: the error is below 1e-5
+ */
+inline GLfloat quarter_sin( const GLfloat x )
+{
+    const GLfloat x2 = x * x;
+    return x * ( 1.5707963f + x2 * ( -0.6459641f + x2 * ( 0.0796926f +
+                                     x2 * ( -0.0046818f + x2 * 0.0001604f ) ) ) );
+}
+
+/*
+ * Emulate the acceleration and deceleration of a moving
+ * unit, when you start the movement you accelerate till
+ * a certain speed, then the unit slow down till it stops
+ */
+inline GLfloat speed_function( const GLfloat x )
+{
+    const GLfloat s = quarter_sin( x );
+    return ( 2.0f * x - x * x ) * s * s;
+}
+
+inline GLfloat seconds( const types::timestamp& time )
+{
+    return static_cast< GLfloat >( time.count() ) / 1000000.0f;
+}
+
+}
+
+void Movements::change_unit_heading(
+    Unit::pointer& unit,
+    const game_terrains::Terrain_lot::pointer& target
+)
+{
+    const GLfloat new_heading = calculate_heading(
+                                    unit->rendering_data.position,
+                                    target->rendering_data.update_pos_from_model_matrix() );
+    unit->rendering_data.model_matrix = glm::rotate(
+                                            unit->rendering_data.model_matrix,
+                                            new_heading - unit->rendering_data.heading,
+                                            glm::vec3( 0.0f, 0.0f, 1.0f ) );
+    unit->rendering_data.heading = new_heading;
+}
+
+void Movements::place_unit_on_lot(
+    Unit::pointer& unit,
+    const game_terrains::Terrain_lot::pointer& lot )
+{
+    const glm::mat4 lot_mod_matx = lot->rendering_data.model_matrix;
+    unit->rendering_data.model_matrix = lot_mod_matx;
+    /*
+     * In order to avoid units to be 'inside'
+     * the terrain model, we need to translate the
+     * model matrix of an amount equal to the 'altitude'
+     * of the terrain'
+     */
+    unit->rendering_data.model_matrix = glm::translate(
+                                            unit->rendering_data.model_matrix,
+                                            glm::vec3(
+                                                    0.0,
+                                                    0.0,
+                                                    lot->altitude
+                                            ) );
+    /*
+     * Account for the heading as well
+     */
+    unit->rendering_data.model_matrix = glm::rotate(
+                                            unit->rendering_data.model_matrix,
+                                            unit->rendering_data.heading,
+                                            glm::vec3( 0.0f, 0.0f, 1.0f ) );
+    unit->rendering_data.update_pos_from_model_matrix();
+}
+
+GLfloat Movements::calculate_heading(
+    const types::point& source,
+    const types::point& target ) const
+{
+    if ( source == target ) {
+        return 0.0f;
+    }
+    return std::atan2( target.y - source.y,
+                       target.x - source.x ) + glm::half_pi<GLfloat>();
+}
+
+template< typename Func >
+void Movement_table::for_each_column( Func&& func )
+{
+    func( units );
+    func( target_lots );
+    func( paths );
+    func( path_distances );
+    func( segments );
+    func( headings );
+    func( unit_ids );
+    func( rendering );
+    func( start_times );
+    func( arrival_times );
+    func( last_steps );
+    func( inv_durations );
+    func( distances );
+    func( radiuses );
+    func( segment_begins );
+    func( segment_ends );
+    func( origins_x );
+    func( origins_y );
+    func( origins_z );
+    func( directions_x );
+    func( directions_y );
+    func( directions_z );
+    func( headings_cos );
+    func( headings_sin );
+    func( positions_x );
+    func( positions_y );
+    func( planned_x );
+    func( planned_y );
+    func( velocities_x );
+    func( velocities_y );
+    func( planned_velocities_x );
+    func( planned_velocities_y );
+    func( offsets_x );
+    func( offsets_y );
+    func( completed_rows );
+}
+
+void Movement_table::add( Unit::pointer unit,
+                          game_terrains::Terrain_lot::pointer lot,
+                          const std::vector< glm::vec2 >& waypoints,
+                          const types::timestamp& start )
+{
+    const std::size_t row = unit_ids.size();
+    for_each_column( []( auto & column ) {
+        column.emplace_back();
+    } );
+    const types::point from = unit->rendering_data.position;
+    const types::point to = glm::vec3(
+                                lot->rendering_data.position.x,
+                                lot->rendering_data.position.y,
+                                lot->altitude );
+    auto& path = paths[ row ];
+    path.push_back( from );
+    for ( auto&& waypoint : waypoints ) {
+        if ( glm::distance( glm::vec2( path.back() ), waypoint ) > 0.001f &&
+             glm::distance( glm::vec2( to ), waypoint ) > 0.001f ) {
+            path.push_back( glm::vec3( waypoint, 0.0f ) );
+        }
+    }
+    path.push_back( to );
+    /*
+     * The altitude changes linearly along
+     * the path, from the unit to the lot
+     */
+    std::vector< GLfloat > flat_distance{ 0.0f };
+    for ( std::size_t idx{ 1 } ; idx < path.size() ; ++idx ) {
+        flat_distance.push_back( flat_distance.back() +
+                                 glm::distance( glm::vec2( path[ idx - 1 ] ),
+                                                glm::vec2( path[ idx ] ) ) );
+    }
+    auto& path_distance = path_distances[ row ];
+    path_distance.push_back( 0.0f );
+    for ( std::size_t idx{ 1 } ; idx < path.size() ; ++idx ) {
+        if ( flat_distance.back() > 0.0f ) {
+            path[ idx ].z = from.z + ( to.z - from.z ) *
+                            flat_distance[ idx ] / flat_distance.back();
+        }
+        path_distance.push_back( path_distance.back() +
+                                 glm::distance( path[ idx - 1 ], path[ idx ] ) );
+    }
+    const types::timestamp duration = std::chrono::duration_cast< types::timestamp >(
+                                          std::chrono::seconds( static_cast< long int >(
+                                                  glm::ceil( path_distance.back() / unit_movement_speed ) ) ) );
+    units[ row ] = unit;
+    target_lots[ row ] = lot;
+    unit_ids[ row ] = unit->id;
+    rendering[ row ] = &unit->rendering_data;
+    start_times[ row ] = start;
+    arrival_times[ row ] = start + duration;
+    last_steps[ row ] = start;
+    inv_durations[ row ] = duration.count() > 0 ? 1.0f / static_cast< GLfloat >( duration.count() ) : 0.0f;
+    distances[ row ] = path_distance.back();
+    radiuses[ row ] = unit->rendering_data.bounding_radius;
+    positions_x[ row ] = planned_x[ row ] = from.x;
+    positions_y[ row ] = planned_y[ row ] = from.y;
+    enter_segment( row, 0 );
+}
+
+void Movement_table::enter_segment( const std::size_t row,
+                                    const std::size_t segment )
+{
+    const auto& path = paths[ row ];
+    const auto& path_distance = path_distances[ row ];
+    const GLfloat length = path_distance[ segment + 1 ] - path_distance[ segment ];
+    const glm::vec3 direction = length > 0.0f ?
+                                ( path[ segment + 1 ] - path[ segment ] ) / length :
+                                glm::vec3( 0.0f );
+    segments[ row ] = segment;
+    segment_begins[ row ] = path_distance[ segment ];
+    segment_ends[ row ] = path_distance[ segment + 1 ];
+    origins_x[ row ] = path[ segment ].x;
+    origins_y[ row ] = path[ segment ].y;
+    origins_z[ row ] = path[ segment ].z;
+    directions_x[ row ] = direction.x;
+    directions_y[ row ] = direction.y;
+    directions_z[ row ] = direction.z;
+    headings[ row ] = movement_impl.calculate_heading( path[ segment ], path[ segment + 1 ] );
+    headings_cos[ row ] = std::cos( headings[ row ] );
+    headings_sin[ row ] = std::sin( headings[ row ] );
+}
+
+void Movement_table::step( const types::timestamp& current,
+                           const std::vector< glm::vec2 >& corrections )
+{
+    const auto start = std::chrono::steady_clock::now();
+    std::atomic< std::size_t > completed{ 0 };
+    workers::pool().parallel_for( unit_ids.size(), movement_step_range,
+    [ & ]( const std::size_t begin, const std::size_t end ) {
+        std::size_t range_completed{ 0 };
+        for ( std::size_t row{ begin } ; row < end ; ++row ) {
+#ifdef __SSE2__
+            /*
+             * The rendering data of the units is scattered in
+             * memory, load it before writing the matrices
+             */
+            if ( row + movement_prefetch_distance < end ) {
+                const renderer::Renderable_data* next = rendering[ row + movement_prefetch_distance ];
+                _mm_prefetch( reinterpret_cast< const char* >( &next->model_matrix ), _MM_HINT_T0 );
+                _mm_prefetch( reinterpret_cast< const char* >( &next->position ), _MM_HINT_T0 );
+            }
+#endif
+            const GLfloat elapsed = static_cast< GLfloat >( ( current - start_times[ row ] ).count() );
+            const GLfloat progress = speed_function( std::min( elapsed * inv_durations[ row ], 1.0f ) );
+            const GLfloat travelled = progress * distances[ row ];
+            if ( travelled > segment_ends[ row ] &&
+                 segments[ row ] + 2 < paths[ row ].size() ) {
+                //Next segment, maybe more than one
+                std::size_t segment = segments[ row ] + 1;
+                while ( segment + 2 < paths[ row ].size() &&
+                        travelled > path_distances[ row ][ segment + 1 ] ) {
+                    ++segment;
+                }
+                enter_segment( row, segment );
+            }
+            const GLfloat along = std::min( travelled, segment_ends[ row ] ) - segment_begins[ row ];
+            const GLfloat new_x = origins_x[ row ] + directions_x[ row ] * along;
+            const GLfloat new_y = origins_y[ row ] + directions_y[ row ] * along;
+            const GLfloat new_z = origins_z[ row ] + directions_z[ row ] * along;
+            /*
+             * The avoidance pushes the unit away from the path,
+             * when there's nothing to avoid the offset decays.
+             * Can't be larger than the distance left, to
+             * arrive exactly on the lot
+             */
+            const GLfloat step_time = seconds( current - last_steps[ row ] );
+            last_steps[ row ] = current;
+            const glm::vec2 correction = row < corrections.size() ? corrections[ row ] : glm::vec2( 0.0f );
+            GLfloat offset_x = offsets_x[ row ];
+            GLfloat offset_y = offsets_y[ row ];
+            if ( correction.x != 0.0f || correction.y != 0.0f ) {
+                offset_x += correction.x * step_time;
+                offset_y += correction.y * step_time;
+            } else {
+                const GLfloat decay = std::max( 0.0f, 1.0f - avoidance_offset_decay * step_time );
+                offset_x *= decay;
+                offset_y *= decay;
+            }
+            const GLfloat max_offset = std::min( 2.0f * radiuses[ row ],
+                                                 std::max( 0.0f, distances[ row ] - travelled ) );
+            const GLfloat offset_sq = offset_x * offset_x + offset_y * offset_y;
+            if ( offset_sq > max_offset * max_offset ) {
+                const GLfloat scale = max_offset / std::sqrt( offset_sq );
+                offset_x *= scale;
+                offset_y *= scale;
+            }
+            offsets_x[ row ] = offset_x;
+            offsets_y[ row ] = offset_y;
+            if ( step_time > 0.0f ) {
+                const GLfloat inv_step = 1.0f / step_time;
+                planned_velocities_x[ row ] = ( new_x - planned_x[ row ] ) * inv_step;
+                planned_velocities_y[ row ] = ( new_y - planned_y[ row ] ) * inv_step;
+                velocities_x[ row ] = ( new_x + offset_x - positions_x[ row ] ) * inv_step;
+                velocities_y[ row ] = ( new_y + offset_y - positions_y[ row ] ) * inv_step;
+            }
+            planned_x[ row ] = new_x;
+            planned_y[ row ] = new_y;
+            positions_x[ row ] = new_x + offset_x;
+            positions_y[ row ] = new_y + offset_y;
+            /*
+             * Translation and rotation around Z, the
+             * same of glm::rotate( glm::translate( .. ) .. )
+             */
+            const GLfloat heading_cos = headings_cos[ row ];
+            const GLfloat heading_sin = headings_sin[ row ];
+            renderer::Renderable_data& data = *rendering[ row ];
+            data.model_matrix[ 0 ] = glm::vec4( heading_cos, heading_sin, 0.0f, 0.0f );
+            data.model_matrix[ 1 ] = glm::vec4( -heading_sin, heading_cos, 0.0f, 0.0f );
+            data.model_matrix[ 2 ] = glm::vec4( 0.0f, 0.0f, 1.0f, 0.0f );
+            data.model_matrix[ 3 ] = glm::vec4( positions_x[ row ], positions_y[ row ], new_z, 1.0f );
+            data.position = glm::vec3( positions_x[ row ], positions_y[ row ], new_z );
+            if ( current > arrival_times[ row ] ) {
+                completed_rows[ row ] = 1;
+                ++range_completed;
+            }
+        }
+        completed += range_completed;
+    } );
+    stats.movers = unit_ids.size();
+    stats.completed = completed;
+    stats.elapsed = std::chrono::duration_cast< std::chrono::microseconds >(
+                        std::chrono::steady_clock::now() - start ).count();
+}
+
+void Movement_table::avoidance_agents( std::vector< Avoidance_agent >& agents ) const
+{
+    agents.resize( unit_ids.size() );
+    for ( std::size_t row{ 0 } ; row < unit_ids.size() ; ++row ) {
+        agents[ row ] = Avoidance_agent{ unit_ids[ row ],
+                                         glm::vec2( positions_x[ row ], positions_y[ row ] ),
+                                         glm::vec2( planned_velocities_x[ row ], planned_velocities_y[ row ] ),
+                                         radiuses[ row ] };
+    }
+}
+
+void Movement_table::update_positions( Spatial_hash& hash ) const
+{
+    for ( std::size_t row{ 0 } ; row < unit_ids.size() ; ++row ) {
+        hash.update( unit_ids[ row ],
+                     glm::vec2( positions_x[ row ], positions_y[ row ] ),
+                     glm::vec2( velocities_x[ row ], velocities_y[ row ] ),
+                     radiuses[ row ] );
+    }
+}
+
+void Movement_table::remove_completed( std::vector< types::id_type >& completed )
+{
+    completed.clear();
+    if ( 0 == stats.completed ) {
+        return;
+    }
+    std::size_t row{ 0 };
+    while ( row < unit_ids.size() ) {
+        if ( 0 == completed_rows[ row ] ) {
+            ++row;
+            continue;
+        }
+        completed.push_back( unit_ids[ row ] );
+        units[ row ]->rendering_data.heading = headings[ row ];
+        movement_impl.place_unit_on_lot( units[ row ], target_lots[ row ] );
+        //Swap with the last one, which is checked next
+        for_each_column( [ row ]( auto & column ) {
+            if ( row + 1 != column.size() ) {
+                column[ row ] = std::move( column.back() );
+            }
+            column.pop_back();
+        } );
+    }
+    LOG1( "Completed ", completed.size(), " movements, ",
+          unit_ids.size(), " in progress" );
+}
+
+std::size_t Movement_table::size() const
+{
+    return unit_ids.size();
+}
+
+bool Movement_table::empty() const
+{
+    return unit_ids.empty();
+}
+
+Movement_stats Movement_table::get_stats() const
+{
+    return stats;
+}
+
+}
@@ -0,0 +1,153 @@
+#ifndef MOVEMENT_TABLE_HPP
+#define MOVEMENT_TABLE_HPP
+
+#include <headers.hpp>
+#include <units.hpp>
+#include <terrains.hpp>
+#include <spatial_hash.hpp>
+#include <vector>
+
+namespace game_units {
+
+/*
+ * The movements are stepped in parallel
+ * in ranges of this amount of units
+ */
+constexpr std::size_t movement_step_range{ 4096 };
+//Rows ahead whose rendering data is loaded in the cache
+constexpr std::size_t movement_prefetch_distance{ 16 };
+//World units per second
+constexpr GLfloat unit_movement_speed{ 4.0f };
+
+struct Movement_stats {
+    std::size_t movers{ 0 };
+    std::size_t completed{ 0 };
+    //Microseconds
+    uint64_t    elapsed{ 0 };
+};
+
+/*
+ * Here we have some utility functions
+ * mostly needed for "animation" purpose
+ */
+class Movements
+{
+public:
+    GLfloat calculate_heading( const types::point& source,
+                               const types::point& target ) const;
+    /* The unit will point in the direction of the
+    * given terrain
+    */
+    void change_unit_heading( Unit::pointer& unit,
+                              const game_terrains::Terrain_lot::pointer& target );
+    /*
+     * Update the model matrix for the unit in order
+     * to make sure that it is placed on the given
+     * lot
+     */
+    void place_unit_on_lot( Unit::pointer& unit,
+                            const game_terrains::Terrain_lot::pointer& lot );
+};
+
+/*
+ * All the movements in progress, one column for
+ * each property and one row for each moving unit.
+ * The step goes through the columns, the path of
+ * the unit is read only when it reaches the end of
+ * the current segment. The completed movements
+ * are removed swapping them with the last one,
+ * the rows are not stable
+ */
+class Movement_table
+{
+public:
+    /*
+     * The unit goes through the waypoints (world XY)
+     * before reaching the lot, in straight lines
+     */
+    void add( Unit::pointer unit,
+              game_terrains::Terrain_lot::pointer lot,
+              const std::vector< glm::vec2 >& waypoints,
+              const types::timestamp& start );
+    /*
+     * Move the units and write their model matrix. The
+     * avoidance corrections (velocity, one for each row)
+     * move the units away from the path, the offset
+     * decays and is zero at the arrival
+     */
+    void step( const types::timestamp& current,
+               const std::vector< glm::vec2 >& corrections );
+    /*
+     * Position and velocity along the path of each
+     * row, for compute_avoidance
+     */
+    void avoidance_agents( std::vector< Avoidance_agent >& agents ) const;
+    void update_positions( Spatial_hash& hash ) const;
+    /*
+     * Place the units whose movement is completed on
+     * their lot, remove them and provide their IDs
+     */
+    void remove_completed( std::vector< types::id_type >& completed );
+    std::size_t size() const;
+    bool empty() const;
+    Movement_stats get_stats() const;
+private:
+    void enter_segment( const std::size_t row,
+                        const std::size_t segment );
+    /*
+     * Call func( column ) for each column
+     */
+    template< typename Func >
+    void for_each_column( Func&& func );
+
+    Movements movement_impl;
+    Movement_stats stats;
+    //Cold data, used when the segment changes
+    std::vector< Unit::pointer > units;
+    std::vector< game_terrains::Terrain_lot::pointer > target_lots;
+    /*
+     * The points of the path, the first is the
+     * original position, and the distance along the
+     * path of each of them
+     */
+    std::vector< std::vector< types::point > > paths;
+    std::vector< std::vector< GLfloat > > path_distances;
+    std::vector< std::size_t > segments;
+    std::vector< GLfloat > headings;
+    //Hot data, used by each step
+    std::vector< types::id_type > unit_ids;
+    std::vector< renderer::Renderable_data* > rendering;
+    std::vector< types::timestamp > start_times;
+    std::vector< types::timestamp > arrival_times;
+    std::vector< types::timestamp > last_steps;
+    std::vector< GLfloat > inv_durations;
+    std::vector< GLfloat > distances;
+    std::vector< GLfloat > radiuses;
+    //Current segment
+    std::vector< GLfloat > segment_begins;
+    std::vector< GLfloat > segment_ends;
+    std::vector< GLfloat > origins_x;
+    std::vector< GLfloat > origins_y;
+    std::vector< GLfloat > origins_z;
+    std::vector< GLfloat > directions_x;
+    std::vector< GLfloat > directions_y;
+    std::vector< GLfloat > directions_z;
+    std::vector< GLfloat > headings_cos;
+    std::vector< GLfloat > headings_sin;
+    //XY, with and without the avoidance offset
+    std::vector< GLfloat > positions_x;
+    std::vector< GLfloat > positions_y;
+    std::vector< GLfloat > planned_x;
+    std::vector< GLfloat > planned_y;
+    std::vector< GLfloat > velocities_x;
+    std::vector< GLfloat > velocities_y;
+    std::vector< GLfloat > planned_velocities_x;
+    std::vector< GLfloat > planned_velocities_y;
+    std::vector< GLfloat > offsets_x;
+    std::vector< GLfloat > offsets_y;
+    std::vector< uint8_t > completed_rows;
+};
+
+}
+
+#endif //MOVEMENT_TABLE_HPP
@@ -104,6 +104,7 @@ void Camera::rotate_around( GLfloat amount )
 void Camera::update_view_matrix()
 {
     view = glm::lookAt( current_position, current_position + vectors.front, vectors.up );
+    transform_changed();
 }
 
 bool Camera::move( movement::direction direction, GLfloat amount )
@@ -338,6 +339,12 @@ void Frustum::update()
 }
 
 GLfloat Frustum::is_inside( const point& pt ) const
+{
+    return is_inside( pt, 0.0f );
+}
+
+GLfloat Frustum::is_inside( const point& pt,
+                            const GLfloat radius ) const
 {
     GLfloat min_dist{ 0 };
     /*
@@ -349,7 +356,7 @@ GLfloat Frustum::is_inside( const point& pt ) const
         -0.8f, -2.0f, -1.2f, -1.2f, 0.0f, 0.0f
     };
     for ( int i{ 0 } ; i < 6 ; ++i ) {
-        const GLfloat dist = geometry.planes[ i ].distance( pt );
+        const GLfloat dist = geometry.planes[ i ].distance( pt ) + radius;
         if ( dist < plane_threshold_dist[ i ] ) {
             return dist;
         } else {
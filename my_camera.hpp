@@ -148,6 +148,12 @@ public:
      * of the point from a frustum plane
      */
     GLfloat is_inside( const types::point& pt ) const;
+    /*
+     * As above, for the sphere of the given
+     * radius centered in pt
+     */
+    GLfloat is_inside( const types::point& pt,
+                       const GLfloat radius ) const;
 private:
     Camera::pointer camera;
     Frustum_geometry geometry;
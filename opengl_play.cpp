@@ -136,6 +136,19 @@ void opengl_ui::ui_keyboard_press( GLint button,
         if ( button ==  GLFW_KEY_SPACE ) {
             renderer->picking()->unpick();
         }
+        if ( button == GLFW_KEY_F2 && action == GLFW_PRESS ) {
+            //Switch between forward and deferred rendering
+            renderer->set_rendering_path(
+                renderer->get_rendering_path() == renderer::rendering_path::forward ?
+                renderer::rendering_path::deferred : renderer::rendering_path::forward );
+        }
+        if ( button == GLFW_KEY_F3 && action == GLFW_PRESS ) {
+            //Switch between clustered and per object light assignment
+            auto lights = renderer->scene_lights();
+            lights->set_assignment_mode(
+                lights->get_assignment_mode() == lighting::light_assignment::clustered ?
+                lighting::light_assignment::per_object : lighting::light_assignment::clustered );
+        }
     } else if ( action == GLFW_RELEASE ) {
         key_status[ button ] = key_status_t::not_pressed;
     }
@@ -225,6 +238,7 @@ opengl_ui::opengl_ui( int win_width,
              glewGetErrorString( glew_init_status ) );
         throw std::runtime_error( "GLEW Init failed!" );
     }
+    textures::cache().set_compression( textures::s3tc_supported() );
 
     camera = factory< scene::Camera >::create(
                  glm::vec3( 4.0, 4.0, 8 ),
@@ -336,32 +350,53 @@ void opengl_ui::setup_scene()
     game_terrain->load_highres_terrain( "../models/Forest/Forest_complex.obj",
                                         forest_id );
 
+    units = factory< game_units::Units >::create(
+                renderer::Core_renderer_proxy( renderer ) );
 
-    //Generate random terrain map
-    const int map_size_x{ 100 };
-    const int map_size_y{ 100 };
-
-    std::random_device rd;
-    std::mt19937_64 eng( rd() );
-    std::uniform_int_distribution<long> dist( 1, 4 );
-
-    game_terrains::terrain_map_t terrain_map;
-    terrain_map.resize( map_size_y );
-    for ( int y{ 0 } ; y < map_size_y ; ++y ) {
-        terrain_map[ y ].resize( map_size_x );
-        for ( int x{ 0 } ; x < map_size_x ; ++x ) {
-            terrain_map[ y ][ x ] = dist( eng );
-        }
+    /*
+     * All the models are being imported in parallel,
+     * wait for the whole set before building the map
+     */
+    auto loading = game_terrain->loading_assets();
+    auto units_loading = units->loading_assets();
+    loading.insert( loading.end(),
+                    units_loading.begin(),
+                    units_loading.end() );
+    if ( false == assets::loader().wait( loading ) ) {
+        PANIC( "Not able to load the game models!" );
     }
 
 
-    game_terrain->load_terrain_map( terrain_map,
-                                    2,
-                                    glm::vec2( map_size_x / 2,
-                                            map_size_y / 2 ) );
-
-    units = factory< game_units::Units >::create(
-                renderer::Core_renderer_proxy( renderer ) );
+    /*
+     * Unbounded procedural terrain, the chunks around
+     * the camera are streamed in by update_residency.
+     * Mountain ranges on the ridges of the elevation,
+     * forests where the moisture is high
+     */
+    std::random_device rd;
+    game_terrains::Generator_settings terrain_settings;
+    terrain_settings.seed = ( static_cast< uint64_t >( rd() ) << 32 ) | rd();
+    terrain_settings.elevation.ridged = true;
+    terrain_settings.moisture.frequency = 1.0f / 96.0f;
+    terrain_settings.biomes = {
+        { mountain_id, { 0.7f, 1.01f }, { 0.0f, 1.01f } },
+        { forest_id, { 0.0f, 0.7f }, { 0.6f, 1.01f } },
+        { 2, { 0.45f, 0.7f }, { 0.0f, 1.01f } },
+        { 1, { 0.0f, 1.01f }, { 0.0f, 1.01f } }
+    };
+    game_terrain->load_terrain_source(
+        factory< game_terrains::Noise_terrain_source >::create( terrain_settings ),
+        2 );
+    /*
+     * The units prefer to walk around the mountains
+     * and the forests, impassable mountains would
+     * split the ridged terrain in many regions
+     */
+    units->movements().set_pathfinder(
+        game_terrain->create_pathfinder( {
+        { mountain_id, 4.0f },
+        { forest_id, 2.0f }
+    } ) );
 
     auto list_of_units = units->buildable_units();
     unit_id = list_of_units.front().id;
@@ -394,6 +429,8 @@ void opengl_ui::enter_main_loop()
     while ( !glfwWindowShouldClose( window_ctx ) ) {
         ++current_fps;
         glfwPollEvents();
+        assets::loader().process_uploads();
+        game_terrain->update_residency( camera->get_position() );
         evaluate_key_status();
         movement_processor.process_movements();
         units->movements().process_movements();
@@ -423,7 +460,9 @@ void opengl_ui::enter_main_loop()
         std::stringstream ss;
         ss << current_fps_string << " - " << std::setprecision( 2 ) << std::fixed << "yaw:" << yaw << ", pitch:" << pitch << ", roll:" << roll
            << ". x:" << pos.x << ",y:" << pos.y << ",z:" << pos.z << ", rendr cycles:"
-           << num_of_rendering_cycles << ", Sel: " << pointed_id;
+           << num_of_rendering_cycles << ", Sel: " << pointed_id
+           << ( renderer->get_rendering_path() == renderer::rendering_path::deferred ?
+                ", deferred" : ", forward" );
 
         info_string->set_text( ss.str() );
 
@@ -8,9 +8,12 @@
 #include <random>
 #include <models.hpp>
 #include <terrains.hpp>
+#include <terrain_generator.hpp>
 #include <types.hpp>
 #include <framebuffers.hpp>
 #include <units_manager.hpp>
+#include <assets.hpp>
+#include <texture_cache.hpp>
 
 namespace opengl_play {
 
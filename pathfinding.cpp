@@ -0,0 +1,799 @@
+#include <pathfinding.hpp>
+#include <thread_pool.hpp>
+#include <logger/logger.hpp>
+#include <algorithm>
+#include <limits>
+#include <queue>
+#include <cmath>
+
+namespace pathfinding {
+
+namespace {
+
+constexpr GLfloat diagonal_step{ 1.41421356f };
+constexpr GLfloat no_path{ std::numeric_limits< GLfloat >::infinity() };
+constexpr uint32_t no_parent{ std::numeric_limits< uint32_t >::max() };
+
+uint64_t lot_key( const long x, const long y )
+{
+    return ( static_cast< uint64_t >( static_cast< uint32_t >( x ) ) << 32 ) |
+           static_cast< uint32_t >( y );
+}
+
+long key_x( const uint64_t key )
+{
+    return static_cast< int32_t >( key >> 32 );
+}
+
+long key_y( const uint64_t key )
+{
+    return static_cast< int32_t >( key & 0xFFFFFFFF );
+}
+
+long floor_div( const long value, const long divisor )
+{
+    return value >= 0 ? value / divisor : -( ( -value + divisor - 1 ) / divisor );
+}
+
+//Shortest distance with 8 connected moves
+GLfloat octile_distance( const long dx, const long dy )
+{
+    const GLfloat ax = std::abs( dx );
+    const GLfloat ay = std::abs( dy );
+    return std::max( ax, ay ) + ( diagonal_step - 1.0f ) * std::min( ax, ay );
+}
+
+/*
+ * Dijkstra from the source to all the lots of a
+ * width X height region, 8 connected. The diagonal
+ * steps are allowed only if both the orthogonal lots
+ * are passable, the units do not cut the corners
+ */
+void local_search( const std::vector< GLfloat >& costs,
+                   const long width,
+                   const long height,
+                   const uint32_t source,
+                   std::vector< GLfloat >& distances,
+                   std::vector< uint32_t >& parents )
+{
+    distances.assign( costs.size(), no_path );
+    parents.assign( costs.size(), no_parent );
+    using entry = std::pair< GLfloat, uint32_t >;
+    std::priority_queue< entry, std::vector< entry >, std::greater< entry > > open;
+    distances[ source ] = 0.0f;
+    open.emplace( 0.0f, source );
+    while ( false == open.empty() ) {
+        const entry current = open.top();
+        open.pop();
+        const uint32_t idx = current.second;
+        if ( current.first > distances[ idx ] ) {
+            continue;
+        }
+        const long x = idx % width;
+        const long y = idx / width;
+        for ( long dy{ -1 } ; dy <= 1 ; ++dy ) {
+            for ( long dx{ -1 } ; dx <= 1 ; ++dx ) {
+                const long nx = x + dx;
+                const long ny = y + dy;
+                if ( ( dx == 0 && dy == 0 ) ||
+                     nx < 0 || ny < 0 || nx >= width || ny >= height ) {
+                    continue;
+                }
+                const uint32_t next = ny * width + nx;
+                if ( costs[ next ] <= 0.0f ) {
+                    continue;
+                }
+                const bool diagonal = dx != 0 && dy != 0;
+                if ( diagonal && ( costs[ y * width + nx ] <= 0.0f ||
+                                   costs[ ny * width + x ] <= 0.0f ) ) {
+                    continue;
+                }
+                const GLfloat distance = current.first +
+                                         ( costs[ idx ] + costs[ next ] ) * 0.5f *
+                                         ( diagonal ? diagonal_step : 1.0f );
+                if ( distance < distances[ next ] ) {
+                    distances[ next ] = distance;
+                    parents[ next ] = idx;
+                    open.emplace( distance, next );
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Keep only the lots where the direction
+ * changes, in world coordinates
+ */
+Path make_path( const Cluster_graph::lot_path& lots,
+                const GLfloat cost,
+                const GLfloat lot_size )
+{
+    Path path;
+    path.found = true;
+    path.cost = cost;
+    for ( std::size_t idx{ 1 } ; idx < lots.size() ; ++idx ) {
+        const bool last = idx + 1 == lots.size();
+        if ( last ||
+             lots[ idx ].first - lots[ idx - 1 ].first !=
+             lots[ idx + 1 ].first - lots[ idx ].first ||
+             lots[ idx ].second - lots[ idx - 1 ].second !=
+             lots[ idx + 1 ].second - lots[ idx ].second ) {
+            path.waypoints.emplace_back( lots[ idx ].first * lot_size,
+                                         lots[ idx ].second * lot_size );
+        }
+    }
+    return path;
+}
+
+}
+
+Cluster_graph::Cluster_graph( game_terrains::Terrain_source::pointer source,
+                              const terrain_costs& costs,
+                              const std::size_t cluster_size ) :
+    source{ source },
+    costs{ costs },
+    min_cost{ default_lot_cost },
+    size{ static_cast< long >( std::max< std::size_t >( cluster_size, 2 ) ) }
+{
+    for ( auto&& cost : costs ) {
+        if ( cost.second > 0.0f ) {
+            min_cost = std::min( min_cost, cost.second );
+        }
+    }
+    LOG3( "New cluster graph, cluster size: ", size,
+          ", terrain costs: ", costs.size() );
+}
+
+GLfloat Cluster_graph::lot_cost( const long terrain_id ) const
+{
+    if ( terrain_id < 0 ) {
+        return 0.0f;
+    }
+    auto it = costs.find( terrain_id );
+    return it == costs.end() ? default_lot_cost : it->second;
+}
+
+void Cluster_graph::add_transitions( Cluster& cluster,
+                                     const long first_x,
+                                     const long first_y,
+                                     const long step_x,
+                                     const long step_y,
+                                     const long out_x,
+                                     const long out_y ) const
+{
+    std::vector< long > outside( size );
+    source->terrain_ids( first_x + out_x, first_y + out_y,
+                         step_x != 0 ? size : 1,
+                         step_y != 0 ? size : 1,
+                         outside.data() );
+    const long origin_x = cluster.cluster_x * size;
+    const long origin_y = cluster.cluster_y * size;
+    auto inside_idx = [ & ]( const long i ) {
+        return static_cast< uint32_t >( ( first_y + step_y * i - origin_y ) * size +
+                                        first_x + step_x * i - origin_x );
+    };
+    auto add = [ & ]( const long i ) {
+        const uint32_t inside = inside_idx( i );
+        cluster.transitions.push_back( {
+            inside,
+            first_x + step_x * i + out_x,
+            first_y + step_y * i + out_y,
+            ( cluster.costs[ inside ] + lot_cost( outside[ i ] ) ) * 0.5f
+        } );
+    };
+    /*
+     * One transition in the middle of the short runs of
+     * passable lots, two at the ends of the long ones.
+     * The neighbor cluster finds the same transitions
+     */
+    long run_begin{ -1 };
+    for ( long i{ 0 } ; i <= size ; ++i ) {
+        const bool passable = i < size &&
+                              cluster.costs[ inside_idx( i ) ] > 0.0f &&
+                              lot_cost( outside[ i ] ) > 0.0f;
+        if ( passable && run_begin < 0 ) {
+            run_begin = i;
+        } else if ( false == passable && run_begin >= 0 ) {
+            if ( i - run_begin < 6 ) {
+                add( ( run_begin + i - 1 ) / 2 );
+            } else {
+                add( run_begin );
+                add( i - 1 );
+            }
+            run_begin = -1;
+        }
+    }
+}
+
+Cluster_graph::cluster_ptr Cluster_graph::build_cluster( const long cluster_x,
+        const long cluster_y ) const
+{
+    auto cluster = std::make_shared< Cluster >();
+    cluster->cluster_x = cluster_x;
+    cluster->cluster_y = cluster_y;
+    const long origin_x = cluster_x * size;
+    const long origin_y = cluster_y * size;
+    std::vector< long > ids( size * size );
+    source->terrain_ids( origin_x, origin_y, size, size, ids.data() );
+    cluster->costs.resize( ids.size() );
+    std::transform( ids.begin(), ids.end(), cluster->costs.begin(),
+    [ this ]( const long id ) {
+        return lot_cost( id );
+    } );
+    //West, east, south and north sides
+    add_transitions( *cluster, origin_x, origin_y, 0, 1, -1, 0 );
+    add_transitions( *cluster, origin_x + size - 1, origin_y, 0, 1, 1, 0 );
+    add_transitions( *cluster, origin_x, origin_y, 1, 0, 0, -1 );
+    add_transitions( *cluster, origin_x, origin_y + size - 1, 1, 0, 0, 1 );
+
+    cluster->entrance_idx.assign( ids.size(), -1 );
+    for ( auto&& transition : cluster->transitions ) {
+        if ( cluster->entrance_idx[ transition.inside ] < 0 ) {
+            cluster->entrance_idx[ transition.inside ] = cluster->entrances.size();
+            cluster->entrances.push_back( transition.inside );
+        }
+    }
+    cluster->distances.resize( cluster->entrances.size() );
+    cluster->parents.resize( cluster->entrances.size() );
+    for ( std::size_t idx{ 0 } ; idx < cluster->entrances.size() ; ++idx ) {
+        local_search( cluster->costs, size, size, cluster->entrances[ idx ],
+                      cluster->distances[ idx ], cluster->parents[ idx ] );
+    }
+    return cluster;
+}
+
+Cluster_graph::cluster_ptr Cluster_graph::get_cluster( const long cluster_x,
+        const long cluster_y )
+{
+    const uint64_t key = lot_key( cluster_x, cluster_y );
+    {
+        std::lock_guard< std::mutex > lock( clusters_mutex );
+        auto it = clusters.find( key );
+        if ( it != clusters.end() ) {
+            return it->second;
+        }
+    }
+    //Built without the lock, concurrent builds give the same result
+    cluster_ptr cluster = build_cluster( cluster_x, cluster_y );
+    std::lock_guard< std::mutex > lock( clusters_mutex );
+    if ( clusters.size() >= max_cached_clusters ) {
+        LOG1( "Dropping ", clusters.size(), " cached clusters" );
+        clusters.clear();
+    }
+    return clusters.emplace( key, cluster ).first->second;
+}
+
+std::size_t Cluster_graph::cluster_count()
+{
+    std::lock_guard< std::mutex > lock( clusters_mutex );
+    return clusters.size();
+}
+
+void Cluster_graph::clear()
+{
+    std::lock_guard< std::mutex > lock( clusters_mutex );
+    clusters.clear();
+}
+
+void Cluster_graph::region_costs( const long x,
+                                  const long y,
+                                  const long width,
+                                  const long height,
+                                  std::vector< GLfloat >& costs ) const
+{
+    std::vector< long > ids( width * height );
+    costs.resize( ids.size() );
+    workers::pool().parallel_for( height, size,
+    [ & ]( const std::size_t begin, const std::size_t end ) {
+        source->terrain_ids( x, y + static_cast< long >( begin ),
+                             width, end - begin, &ids[ begin * width ] );
+        for ( std::size_t idx{ begin * width } ; idx < end * width ; ++idx ) {
+            costs[ idx ] = lot_cost( ids[ idx ] );
+        }
+    } );
+}
+
+bool Cluster_graph::find_path( const long start_x,
+                               const long start_y,
+                               const long goal_x,
+                               const long goal_y,
+                               lot_path& path,
+                               GLfloat& cost )
+{
+    path.clear();
+    cost = 0.0f;
+    if ( start_x == goal_x && start_y == goal_y ) {
+        path.emplace_back( start_x, start_y );
+        return true;
+    }
+    const long start_cx = floor_div( start_x, size );
+    const long start_cy = floor_div( start_y, size );
+    const long goal_cx = floor_div( goal_x, size );
+    const long goal_cy = floor_div( goal_y, size );
+    auto local_idx = [ this ]( const long x, const long y ) {
+        return static_cast< uint32_t >( ( y - floor_div( y, size ) * size ) * size +
+                                        x - floor_div( x, size ) * size );
+    };
+    const uint32_t start_local = local_idx( start_x, start_y );
+    const uint32_t goal_local = local_idx( goal_x, goal_y );
+    const cluster_ptr start_cluster = get_cluster( start_cx, start_cy );
+    const cluster_ptr goal_cluster = get_cluster( goal_cx, goal_cy );
+    if ( goal_cluster->costs[ goal_local ] <= 0.0f ) {
+        return false;
+    }
+    /*
+     * Connect the start and the goal to the entrances
+     * of their clusters. A unit standing on an impassable
+     * lot is allowed to leave it
+     */
+    std::vector< GLfloat > start_costs = start_cluster->costs;
+    if ( start_costs[ start_local ] <= 0.0f ) {
+        start_costs[ start_local ] = default_lot_cost;
+    }
+    std::vector< GLfloat > start_distances, goal_distances;
+    std::vector< uint32_t > start_parents, goal_parents;
+    local_search( start_costs, size, size, start_local,
+                  start_distances, start_parents );
+    local_search( goal_cluster->costs, size, size, goal_local,
+                  goal_distances, goal_parents );
+    const bool same_cluster = start_cluster == goal_cluster;
+
+    const long min_cx = std::min( start_cx, goal_cx ) - search_margin;
+    const long max_cx = std::max( start_cx, goal_cx ) + search_margin;
+    const long min_cy = std::min( start_cy, goal_cy ) - search_margin;
+    const long max_cy = std::max( start_cy, goal_cy ) + search_margin;
+
+    /*
+     * A* over the abstract graph, the nodes are
+     * identified by the lot coordinates
+     */
+    struct Node {
+        GLfloat  cost;
+        uint64_t parent;
+        bool     closed;
+    };
+    const uint64_t start_key = lot_key( start_x, start_y );
+    const uint64_t goal_key = lot_key( goal_x, goal_y );
+    std::unordered_map< uint64_t, Node > nodes;
+    using entry = std::pair< GLfloat, uint64_t >;
+    std::priority_queue< entry, std::vector< entry >, std::greater< entry > > open;
+    nodes[ start_key ] = Node{ 0.0f, start_key, false };
+    open.emplace( 0.0f, start_key );
+    bool found{ false };
+    std::size_t expanded{ 0 };
+    while ( false == open.empty() && expanded < max_search_nodes ) {
+        const uint64_t key = open.top().second;
+        open.pop();
+        Node& node = nodes[ key ];
+        if ( node.closed ) {
+            continue;
+        }
+        node.closed = true;
+        if ( key == goal_key ) {
+            found = true;
+            break;
+        }
+        ++expanded;
+        const GLfloat node_cost = node.cost;
+        auto relax = [ & ]( const uint64_t next, const GLfloat step_cost ) {
+            if ( next == key || std::isinf( step_cost ) ) {
+                return;
+            }
+            const GLfloat next_cost = node_cost + step_cost;
+            auto it = nodes.find( next );
+            if ( it == nodes.end() ) {
+                it = nodes.emplace( next, Node{ next_cost, key, false } ).first;
+            } else if ( it->second.closed || next_cost >= it->second.cost ) {
+                return;
+            } else {
+                it->second.cost = next_cost;
+                it->second.parent = key;
+            }
+            open.emplace( next_cost + min_cost * octile_distance( goal_x - key_x( next ),
+                          goal_y - key_y( next ) ),
+                          next );
+        };
+        const long x = key_x( key );
+        const long y = key_y( key );
+        const long cx = floor_div( x, size );
+        const long cy = floor_div( y, size );
+        const cluster_ptr cluster = get_cluster( cx, cy );
+        const uint32_t local = local_idx( x, y );
+        const long origin_x = cx * size;
+        const long origin_y = cy * size;
+        if ( key == start_key ) {
+            for ( auto entrance : start_cluster->entrances ) {
+                relax( lot_key( origin_x + entrance % size, origin_y + entrance / size ),
+                       start_distances[ entrance ] );
+            }
+            if ( same_cluster ) {
+                relax( goal_key, start_distances[ goal_local ] );
+            }
+        }
+        const int32_t entrance = cluster->entrance_idx[ local ];
+        if ( entrance < 0 ) {
+            continue;
+        }
+        const auto& distances = cluster->distances[ entrance ];
+        for ( auto other : cluster->entrances ) {
+            relax( lot_key( origin_x + other % size, origin_y + other / size ),
+                   distances[ other ] );
+        }
+        for ( auto&& transition : cluster->transitions ) {
+            const long out_cx = floor_div( transition.outside_x, size );
+            const long out_cy = floor_div( transition.outside_y, size );
+            if ( transition.inside == local &&
+                 out_cx >= min_cx && out_cx <= max_cx &&
+                 out_cy >= min_cy && out_cy <= max_cy ) {
+                relax( lot_key( transition.outside_x, transition.outside_y ),
+                       transition.cost );
+            }
+        }
+        if ( cx == goal_cx && cy == goal_cy ) {
+            relax( goal_key, goal_distances[ local ] );
+        }
+    }
+    if ( false == found ) {
+        return false;
+    }
+    cost = nodes[ goal_key ].cost;
+
+    std::vector< uint64_t > abstract_path{ goal_key };
+    while ( abstract_path.back() != start_key ) {
+        abstract_path.push_back( nodes[ abstract_path.back() ].parent );
+    }
+    std::reverse( abstract_path.begin(), abstract_path.end() );
+
+    /*
+     * Refine the abstract path with the
+     * lots of the local shortest paths
+     */
+    path.emplace_back( start_x, start_y );
+    for ( std::size_t idx{ 1 } ; idx < abstract_path.size() ; ++idx ) {
+        const uint64_t from = abstract_path[ idx - 1 ];
+        const uint64_t to = abstract_path[ idx ];
+        const long from_cx = floor_div( key_x( from ), size );
+        const long from_cy = floor_div( key_y( from ), size );
+        const long origin_x = from_cx * size;
+        const long origin_y = from_cy * size;
+        if ( from_cx != floor_div( key_x( to ), size ) ||
+             from_cy != floor_div( key_y( to ), size ) ) {
+            //A transition to the neighbor cluster
+            path.emplace_back( key_x( to ), key_y( to ) );
+            continue;
+        }
+        const uint32_t from_local = local_idx( key_x( from ), key_y( from ) );
+        const uint32_t to_local = local_idx( key_x( to ), key_y( to ) );
+        if ( to == goal_key && from != start_key ) {
+            //The goal tree goes from the lot to the goal
+            for ( uint32_t lot = goal_parents[ from_local ] ; lot != no_parent ;
+                  lot = goal_parents[ lot ] ) {
+                path.emplace_back( origin_x + lot % size, origin_y + lot / size );
+            }
+            continue;
+        }
+        const cluster_ptr cluster = get_cluster( from_cx, from_cy );
+        const std::vector< uint32_t >& parents = from == start_key ? start_parents :
+                cluster->parents[ cluster->entrance_idx[ from_local ] ];
+        lot_path segment;
+        for ( uint32_t lot = to_local ; lot != from_local ; lot = parents[ lot ] ) {
+            segment.emplace_back( origin_x + lot % size, origin_y + lot / size );
+        }
+        path.insert( path.end(), segment.rbegin(), segment.rend() );
+    }
+    return true;
+}
+
+Flow_field::Flow_field( const long origin_x,
+                        const long origin_y,
+                        const long width,
+                        const long height,
+                        const long target_x,
+                        const long target_y,
+                        const GLfloat lot_size,
+                        const std::vector< GLfloat >& costs ) :
+    origin_x{ origin_x },
+    origin_y{ origin_y },
+    width{ width },
+    height{ height },
+    target_x{ target_x },
+    target_y{ target_y },
+    lot_size{ lot_size }
+{
+    /*
+     * The costs of the steps are symmetric, the
+     * shortest paths from the target are the
+     * shortest paths toward the target
+     */
+    const uint32_t target_idx = ( target_y - origin_y ) * width + target_x - origin_x;
+    if ( contains( target_x, target_y ) && costs[ target_idx ] > 0.0f ) {
+        local_search( costs, width, height, target_idx, distances, parents );
+    } else {
+        distances.assign( costs.size(), no_path );
+        parents.assign( costs.size(), no_parent );
+    }
+}
+
+bool Flow_field::contains( const long x, const long y ) const
+{
+    return x >= origin_x && y >= origin_y &&
+           x < origin_x + width && y < origin_y + height;
+}
+
+bool Flow_field::has_target( const long x, const long y ) const
+{
+    return x == target_x && y == target_y;
+}
+
+bool Flow_field::next_lot( long& x, long& y ) const
+{
+    if ( false == contains( x, y ) || has_target( x, y ) ) {
+        return false;
+    }
+    const uint32_t parent = parents[ ( y - origin_y ) * width + x - origin_x ];
+    if ( parent == no_parent ) {
+        return false;
+    }
+    x = origin_x + parent % width;
+    y = origin_y + parent / width;
+    return true;
+}
+
+Path Flow_field::path_from( const glm::vec2 start ) const
+{
+    long x = std::lround( start.x );
+    long y = std::lround( start.y );
+    if ( false == contains( x, y ) ||
+         std::isinf( distances[ ( y - origin_y ) * width + x - origin_x ] ) ) {
+        return Path();
+    }
+    Cluster_graph::lot_path lots;
+    lots.emplace_back( x, y );
+    while ( next_lot( x, y ) ) {
+        lots.emplace_back( x, y );
+    }
+    return make_path( lots,
+                      distances[ ( lots.front().second - origin_y ) * width +
+                                 lots.front().first - origin_x ],
+                      lot_size );
+}
+
+long Flow_field::get_origin_x() const
+{
+    return origin_x;
+}
+
+long Flow_field::get_origin_y() const
+{
+    return origin_y;
+}
+
+long Flow_field::get_width() const
+{
+    return width;
+}
+
+long Flow_field::get_height() const
+{
+    return height;
+}
+
+Pathfinder::Search_state::Search_state( game_terrains::Terrain_source::pointer source,
+                                        const terrain_costs& costs,
+                                        const GLfloat lot_size,
+                                        const std::size_t cluster_size ) :
+    graph( source, costs, cluster_size ),
+    lot_size{ lot_size },
+    requests{ 0 },
+    cache_hits{ 0 },
+    failures{ 0 },
+    flow_fields{ 0 },
+    flow_field_hits{ 0 }
+{
+}
+
+Pathfinder::Pathfinder( game_terrains::Terrain_source::pointer source,
+                        const terrain_costs& costs,
+                        const GLfloat lot_size,
+                        const std::size_t cluster_size ) :
+    state{ std::make_shared< Search_state >( source, costs, lot_size, cluster_size ) }
+{
+    LOG3( "New pathfinder, lot size: ", lot_size );
+}
+
+std::future< Path > Pathfinder::request_path( const glm::vec2 start,
+        const glm::vec2 goal )
+{
+    //The task keeps the state alive
+    auto search_state = state;
+    return workers::pool().submit( [ search_state, start, goal ]() {
+        return search( *search_state, start, goal );
+    } );
+}
+
+Path Pathfinder::find_path( const glm::vec2 start,
+                            const glm::vec2 goal )
+{
+    return search( *state, start, goal );
+}
+
+Path Pathfinder::search( Search_state& state,
+                         const glm::vec2 start,
+                         const glm::vec2 goal )
+{
+    ++state.requests;
+    const long start_x = std::lround( start.x );
+    const long start_y = std::lround( start.y );
+    const long goal_x = std::lround( goal.x );
+    const long goal_y = std::lround( goal.y );
+    const auto cache_key = std::make_pair( lot_key( start_x, start_y ),
+                                           lot_key( goal_x, goal_y ) );
+    {
+        std::lock_guard< std::mutex > lock( state.cache_mutex );
+        auto it = state.cache_index.find( cache_key );
+        if ( it != state.cache_index.end() ) {
+            ++state.cache_hits;
+            state.cache.splice( state.cache.begin(), state.cache, it->second );
+            return it->second->second;
+        }
+    }
+
+    Path path;
+    Cluster_graph::lot_path lots;
+    GLfloat cost;
+    if ( state.graph.find_path( start_x, start_y, goal_x, goal_y,
+                                lots, cost ) ) {
+        path = make_path( lots, cost, state.lot_size );
+    } else {
+        ++state.failures;
+        LOG1( "No path from ", start, " to ", goal );
+    }
+
+    std::lock_guard< std::mutex > lock( state.cache_mutex );
+    if ( state.cache_index.find( cache_key ) == state.cache_index.end() ) {
+        state.cache.emplace_front( cache_key, path );
+        state.cache_index[ cache_key ] = state.cache.begin();
+        if ( state.cache.size() > path_cache_size ) {
+            state.cache_index.erase( state.cache.back().first );
+            state.cache.pop_back();
+        }
+    }
+    return path;
+}
+
+std::future< Flow_field::pointer > Pathfinder::request_flow_field(
+    const glm::vec2 target,
+    const std::vector< glm::vec2 >& starts )
+{
+    auto search_state = state;
+    return workers::pool().submit( [ search_state, target, starts ]() {
+        return flow_field( *search_state, target, starts );
+    } );
+}
+
+std::future< std::vector< Path > > Pathfinder::request_group_paths(
+    const glm::vec2 target,
+    const std::vector< glm::vec2 >& starts )
+{
+    auto search_state = state;
+    return workers::pool().submit( [ search_state, target, starts ]() {
+        std::vector< Path > paths( starts.size() );
+        auto field = flow_field( *search_state, target, starts );
+        if ( nullptr != field ) {
+            workers::pool().parallel_for( starts.size(), 256,
+            [ & ]( const std::size_t begin, const std::size_t end ) {
+                for ( std::size_t idx{ begin } ; idx < end ; ++idx ) {
+                    paths[ idx ] = field->path_from( starts[ idx ] );
+                }
+            } );
+        }
+        return paths;
+    } );
+}
+
+Flow_field::pointer Pathfinder::get_flow_field( const glm::vec2 target,
+        const std::vector< glm::vec2 >& starts )
+{
+    return flow_field( *state, target, starts );
+}
+
+Flow_field::pointer Pathfinder::flow_field( Search_state& state,
+        const glm::vec2 target,
+        const std::vector< glm::vec2 >& starts )
+{
+    const long target_x = std::lround( target.x );
+    const long target_y = std::lround( target.y );
+    long min_x{ target_x }, max_x{ target_x };
+    long min_y{ target_y }, max_y{ target_y };
+    for ( auto&& start : starts ) {
+        min_x = std::min( min_x, std::lround( start.x ) );
+        max_x = std::max( max_x, std::lround( start.x ) );
+        min_y = std::min( min_y, std::lround( start.y ) );
+        max_y = std::max( max_y, std::lround( start.y ) );
+    }
+    {
+        std::lock_guard< std::mutex > lock( state.fields_mutex );
+        for ( auto it = state.fields.begin() ; it != state.fields.end() ; ++it ) {
+            const Flow_field& field = **it;
+            if ( false == field.has_target( target_x, target_y ) ) {
+                continue;
+            }
+            if ( field.contains( min_x, min_y ) && field.contains( max_x, max_y ) ) {
+                ++state.flow_field_hits;
+                state.fields.splice( state.fields.begin(), state.fields, it );
+                return state.fields.front();
+            }
+            /*
+             * Not covering the group, the new field
+             * covers the old region as well
+             */
+            min_x = std::min( min_x, field.get_origin_x() + flow_field_margin );
+            min_y = std::min( min_y, field.get_origin_y() + flow_field_margin );
+            max_x = std::max( max_x, field.get_origin_x() + field.get_width() -
+                              1 - flow_field_margin );
+            max_y = std::max( max_y, field.get_origin_y() + field.get_height() -
+                              1 - flow_field_margin );
+            break;
+        }
+    }
+    const long origin_x = min_x - flow_field_margin;
+    const long origin_y = min_y - flow_field_margin;
+    const long width = max_x - min_x + 1 + 2 * flow_field_margin;
+    const long height = max_y - min_y + 1 + 2 * flow_field_margin;
+    if ( static_cast< std::size_t >( width ) * height > max_flow_field_lots ) {
+        LOG1( "Flow field toward ", target, " too large: ", width, "x", height );
+        return nullptr;
+    }
+    std::vector< GLfloat > costs;
+    state.graph.region_costs( origin_x, origin_y, width, height, costs );
+    //As for the paths, the units can leave the impassable lots
+    for ( auto&& start : starts ) {
+        GLfloat& cost = costs[ ( std::lround( start.y ) - origin_y ) * width +
+                               std::lround( start.x ) - origin_x ];
+        if ( cost <= 0.0f ) {
+            cost = default_lot_cost;
+        }
+    }
+    auto field = std::make_shared< Flow_field >( origin_x, origin_y, width, height,
+                 target_x, target_y, state.lot_size, costs );
+    ++state.flow_fields;
+    LOG1( "New flow field toward ", target, ", size: ", width, "x", height );
+
+    std::lock_guard< std::mutex > lock( state.fields_mutex );
+    state.fields.remove_if( [ & ]( const Flow_field::pointer & cached ) {
+        return cached->has_target( target_x, target_y );
+    } );
+    state.fields.push_front( field );
+    if ( state.fields.size() > flow_field_cache_size ) {
+        state.fields.pop_back();
+    }
+    return field;
+}
+
+void Pathfinder::invalidate()
+{
+    LOG1( "Invalidating the pathfinding data" );
+    state->graph.clear();
+    {
+        std::lock_guard< std::mutex > lock( state->cache_mutex );
+        state->cache.clear();
+        state->cache_index.clear();
+    }
+    std::lock_guard< std::mutex > lock( state->fields_mutex );
+    state->fields.clear();
+}
+
+Path_stats Pathfinder::get_stats() const
+{
+    Path_stats stats;
+    stats.requests = state->requests;
+    stats.cache_hits = state->cache_hits;
+    stats.failures = state->failures;
+    stats.clusters = state->graph.cluster_count();
+    stats.flow_fields = state->flow_fields;
+    stats.flow_field_hits = state->flow_field_hits;
+    return stats;
+}
+
+}
@@ -0,0 +1,311 @@
+#ifndef PATHFINDING_HPP
+#define PATHFINDING_HPP
+
+#include <headers.hpp>
+#include <terrain_sources.hpp>
+#include <unordered_map>
+#include <future>
+#include <atomic>
+#include <mutex>
+#include <list>
+#include <map>
+#include <vector>
+
+namespace pathfinding {
+
+/*
+ * Side of the clusters, in lots
+ */
+constexpr std::size_t default_cluster_size{ 16 };
+/*
+ * The abstract search is bounded to the clusters in the
+ * rectangle containing the start and the goal, extended
+ * by this amount of clusters: the world might be unbounded
+ */
+constexpr long search_margin{ 4 };
+constexpr std::size_t max_search_nodes{ 1 << 16 };
+/*
+ * When exceeded the cache of the clusters is dropped,
+ * the clusters are rebuilt on demand
+ */
+constexpr std::size_t max_cached_clusters{ 1 << 14 };
+constexpr std::size_t path_cache_size{ 4096 };
+//For the terrains without a cost
+constexpr GLfloat default_lot_cost{ 1.0f };
+/*
+ * The flow fields cover the rectangle containing the
+ * units and the target, extended by this margin. Larger
+ * fields are not built, the units of the group search
+ * their own path
+ */
+constexpr long flow_field_margin{ 32 };
+constexpr std::size_t max_flow_field_lots{ 1 << 20 };
+constexpr std::size_t flow_field_cache_size{ 16 };
+
+/*
+ * Cost of walking through a lot with the given terrain
+ * ID, a cost <= 0 makes the terrain impassable. The
+ * lots without terrain (ID -1) are impassable
+ */
+using terrain_costs = std::unordered_map< long, GLfloat >;
+
+struct Path {
+    bool found{ false };
+    GLfloat cost{ 0.0f };
+    /*
+     * World XY position of the lots where the
+     * direction changes, the start excluded
+     * and the goal included
+     */
+    std::vector< glm::vec2 > waypoints;
+};
+
+struct Path_stats {
+    std::size_t requests{ 0 };
+    std::size_t cache_hits{ 0 };
+    std::size_t failures{ 0 };
+    std::size_t clusters{ 0 };
+    std::size_t flow_fields{ 0 };
+    std::size_t flow_field_hits{ 0 };
+};
+
+/*
+ * The abstract graph of HPA*: the lots are grouped in
+ * square clusters, the nodes of the graph are the lots
+ * on the borders of the clusters where the units can
+ * pass to the neighbor cluster (the entrances). Inside a
+ * cluster the entrances are connected by the precomputed
+ * shortest paths, neighbor clusters by one step.
+ *
+ * The clusters are built on demand and never change,
+ * safe to be used from many threads.
+ */
+class Cluster_graph
+{
+public:
+    using pointer = std::shared_ptr< Cluster_graph >;
+    using lot_path = std::vector< std::pair< long, long > >;
+    Cluster_graph( game_terrains::Terrain_source::pointer source,
+                   const terrain_costs& costs,
+                   const std::size_t cluster_size );
+    /*
+     * The lots of the path from start to goal, both
+     * included. False if there's no path in the
+     * search bounds. The start is always passable
+     */
+    bool find_path( const long start_x,
+                    const long start_y,
+                    const long goal_x,
+                    const long goal_y,
+                    lot_path& path,
+                    GLfloat& cost );
+    std::size_t cluster_count();
+    /*
+     * The cost of the lots of the region, row-major.
+     * The lots are read in parallel
+     */
+    void region_costs( const long x,
+                       const long y,
+                       const long width,
+                       const long height,
+                       std::vector< GLfloat >& costs ) const;
+    /*
+     * Drop the clusters, when the terrain changes
+     */
+    void clear();
+private:
+    struct Transition {
+        //Local index of the lot in the cluster
+        uint32_t inside;
+        //Lot coordinates in the neighbor cluster
+        long     outside_x;
+        long     outside_y;
+        GLfloat  cost;
+    };
+    struct Cluster {
+        long cluster_x;
+        long cluster_y;
+        //Row-major, <= 0 if impassable
+        std::vector< GLfloat > costs;
+        std::vector< uint32_t > entrances;
+        //For each lot, the index in entrances or -1
+        std::vector< int32_t > entrance_idx;
+        std::vector< Transition > transitions;
+        /*
+         * Shortest paths from each entrance to all the
+         * lots of the cluster, distances and parents
+         */
+        std::vector< std::vector< GLfloat > > distances;
+        std::vector< std::vector< uint32_t > > parents;
+    };
+    using cluster_ptr = std::shared_ptr< const Cluster >;
+    cluster_ptr get_cluster( const long cluster_x,
+                             const long cluster_y );
+    cluster_ptr build_cluster( const long cluster_x,
+                               const long cluster_y ) const;
+    GLfloat lot_cost( const long terrain_id ) const;
+    /*
+     * Transitions over one of the sides of the cluster,
+     * from the lots inside to the neighbor lots outside
+     */
+    void add_transitions( Cluster& cluster,
+                          const long first_x,
+                          const long first_y,
+                          const long step_x,
+                          const long step_y,
+                          const long out_x,
+                          const long out_y ) const;
+
+    game_terrains::Terrain_source::pointer source;
+    terrain_costs costs;
+    //Lower bound of the cost of a step, for the heuristic
+    GLfloat min_cost;
+    long    size;
+    std::mutex clusters_mutex;
+    std::unordered_map< uint64_t, cluster_ptr > clusters;
+};
+
+/*
+ * Integration field toward a target lot over a rectangle
+ * of lots: the cost of the shortest path to the target
+ * from each lot, and the next lot of that path. Any
+ * number of units reach the target by following the
+ * field, without a search for each of them
+ */
+class Flow_field
+{
+public:
+    using pointer = std::shared_ptr< Flow_field >;
+    /*
+     * costs are the costs of the width X height lots
+     * starting at origin_x, origin_y, row-major
+     */
+    Flow_field( const long origin_x,
+                const long origin_y,
+                const long width,
+                const long height,
+                const long target_x,
+                const long target_y,
+                const GLfloat lot_size,
+                const std::vector< GLfloat >& costs );
+    bool contains( const long x, const long y ) const;
+    bool has_target( const long x, const long y ) const;
+    /*
+     * Move to the next lot toward the target. False if
+     * the lot is the target, outside of the field or
+     * the target is not reachable from there
+     */
+    bool next_lot( long& x, long& y ) const;
+    /*
+     * Follow the field from the lot (lot coordinates)
+     */
+    Path path_from( const glm::vec2 start ) const;
+    long get_origin_x() const;
+    long get_origin_y() const;
+    long get_width() const;
+    long get_height() const;
+private:
+    long origin_x;
+    long origin_y;
+    long width;
+    long height;
+    long target_x;
+    long target_y;
+    GLfloat lot_size;
+    std::vector< GLfloat > distances;
+    std::vector< uint32_t > parents;
+};
+
+/*
+ * Pathfinding service over the lots: the queries run
+ * on the worker threads, the results are cached
+ */
+class Pathfinder
+{
+public:
+    using pointer = std::shared_ptr< Pathfinder >;
+    Pathfinder( game_terrains::Terrain_source::pointer source,
+                const terrain_costs& costs,
+                const GLfloat lot_size,
+                const std::size_t cluster_size = default_cluster_size );
+    /*
+     * Queue the search of a path between two lots (lot
+     * coordinates), the future provide the result.
+     * The Pathfinder might be destroyed before the
+     * completion of the request
+     */
+    std::future< Path > request_path( const glm::vec2 start,
+                                      const glm::vec2 goal );
+    /*
+     * Synchronous version, from any thread
+     */
+    Path find_path( const glm::vec2 start,
+                    const glm::vec2 goal );
+    /*
+     * Queue the computation of the flow field toward the
+     * target (lot coordinates) covering the start lots of
+     * a group of units. The fields are cached by target
+     * and grown when a group is not covered. The future
+     * provide null if the field would be too large
+     */
+    std::future< Flow_field::pointer > request_flow_field(
+        const glm::vec2 target,
+        const std::vector< glm::vec2 >& starts );
+    /*
+     * Queue the computation of the paths of a group of
+     * units: the flow field toward the target and the
+     * path of each unit following it. The paths of the
+     * units not covered are not found
+     */
+    std::future< std::vector< Path > > request_group_paths(
+        const glm::vec2 target,
+        const std::vector< glm::vec2 >& starts );
+    /*
+     * Synchronous version of request_flow_field, from any thread
+     */
+    Flow_field::pointer get_flow_field( const glm::vec2 target,
+                                        const std::vector< glm::vec2 >& starts );
+    /*
+     * Drop the clusters, the cached paths and the
+     * flow fields. To be called when the terrain changes
+     */
+    void invalidate();
+    Path_stats get_stats() const;
+private:
+    /*
+     * The data used by the requests, shared with
+     * the tasks on the worker threads
+     */
+    struct Search_state {
+        Cluster_graph graph;
+        GLfloat lot_size;
+        std::mutex cache_mutex;
+        //Most recently used first
+        std::list< std::pair< std::pair< uint64_t, uint64_t >, Path > > cache;
+        std::map< std::pair< uint64_t, uint64_t >,
+            decltype( cache )::iterator > cache_index;
+        std::mutex fields_mutex;
+        //Most recently used first
+        std::list< Flow_field::pointer > fields;
+        std::atomic< std::size_t > requests;
+        std::atomic< std::size_t > cache_hits;
+        std::atomic< std::size_t > failures;
+        std::atomic< std::size_t > flow_fields;
+        std::atomic< std::size_t > flow_field_hits;
+        Search_state( game_terrains::Terrain_source::pointer source,
+                      const terrain_costs& costs,
+                      const GLfloat lot_size,
+                      const std::size_t cluster_size );
+    };
+    static Path search( Search_state& state,
+                        const glm::vec2 start,
+                        const glm::vec2 goal );
+    static Flow_field::pointer flow_field( Search_state& state,
+                                           const glm::vec2 target,
+                                           const std::vector< glm::vec2 >& starts );
+    std::shared_ptr< Search_state > state;
+};
+
+}
+
+#endif //PATHFINDING_HPP
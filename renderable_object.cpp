@@ -3,12 +3,31 @@
 #include <iostream>
 #include <logger/logger.hpp>
 #include <factory.hpp>
+#include <texture_arrays.hpp>
 
 namespace renderer {
 
 constexpr std::size_t RENDR_BUF_CONTENT_SIZE{ 100000 };
 constexpr std::size_t RENDR_BUF_DEFAULT_HEAD_POS{ 90000 };
 
+namespace {
+
+/*
+ * The clip planes of a perspective projection,
+ * the lighting slices the depth between them
+ */
+GLfloat near_plane_of( const glm::mat4& proj )
+{
+    return proj[3][2] / ( proj[2][2] - 1.0f );
+}
+
+GLfloat far_plane_of( const glm::mat4& proj )
+{
+    return proj[3][2] / ( proj[2][2] + 1.0f );
+}
+
+}
+
 
 Renderable::Renderable()
 {
@@ -63,7 +82,8 @@ void Rendr_data_buffer::add_new_rendr( Rendr::pointer& rendr )
             //Just shift the buffer or whatever else..
             PANIC( "No more buffer space at the head." );
         }
-        rendr_content[ --buffer_head ] = rendr.get();
+        rendr->buffer_idx = --buffer_head;
+        rendr_content[ buffer_head ] = rendr.get();
     } else {
         LOG0( "Adding new rendr with ID:",
               rendr->id, " at the TAIL of the buffer, IDX:",
@@ -71,22 +91,47 @@ void Rendr_data_buffer::add_new_rendr( Rendr::pointer& rendr )
         if ( buffer_tail == RENDR_BUF_CONTENT_SIZE - 1 ) {
             PANIC( "No more buffer space at the tail!" );
         }
-        rendr_content[ ++buffer_tail ] = rendr.get();
+        rendr->buffer_idx = ++buffer_tail;
+        rendr_content[ buffer_tail ] = rendr.get();
     }
 }
 
+void Rendr_data_buffer::remove_rendr( Rendr::pointer& rendr )
+{
+    const std::size_t idx = rendr->buffer_idx;
+    if ( idx < buffer_head || idx > buffer_tail ||
+         rendr_content[ idx ] != rendr.get() ) {
+        ERR( "The rendr with ID:", rendr->id, " is not in the buffer!" );
+        return;
+    }
+    //The world space objects are before the default head position
+    std::size_t last_idx;
+    if ( idx <= RENDR_BUF_DEFAULT_HEAD_POS ) {
+        last_idx = buffer_head++;
+    } else {
+        last_idx = buffer_tail--;
+    }
+    rendr_content[ idx ] = rendr_content[ last_idx ];
+    rendr_content[ idx ]->buffer_idx = idx;
+}
+
 Core_renderer::Core_renderer( const types::win_size& window,
                               const glm::mat4& proj,
                               const glm::mat4& def_ortho,
                               const scene::Camera::pointer cam ) :
     config( window ),
-    camera{ cam }
+    camera{ cam },
+    current_path{ rendering_path::forward }
 {
     LOG3( "Creating the core renderer!" );
     config.projection = proj;
     config.ortho = def_ortho;
     shader = factory< shaders::Shader >::create();
 
+    shader->add_include( lighting::light_data_include,
+                         lighting::light_data_glsl() );
+    shader->add_include( "lighting.glsl",
+                         shader->read_shader_body( "../lighting.glsl" ) );
     shader->load_fragment_shader( shader->read_shader_body(
                                       "../model_shader.frag" ) );
     shader->load_vertex_shader( shader->read_shader_body(
@@ -97,20 +142,38 @@ Core_renderer::Core_renderer( const types::win_size& window,
     }
 
     shader->use_shaders();
-
-    config.view_loc = shader->load_location( "view" );
-    config.projection_loc = shader->load_location( "projection" );
+    game_lights = std::make_shared< lighting::Core_lighting >( window,
+                  proj,
+                  near_plane_of( proj ),
+                  far_plane_of( proj ) );
+    game_lights->configure_shader( shader );
+    shader->set_uniform( shaders::uniforms::diffuse_array,
+                         textures::diffuse_array_unit );
+    shader->set_uniform( shaders::uniforms::specular_array,
+                         textures::specular_array_unit );
+    shader->set_uniform( shaders::uniforms::position_offset,
+                         glm::vec4( 0.0f ) );
+    shader->set_uniform( shaders::uniforms::position_scale,
+                         glm::vec4( 1.0f ) );
+    shader->set_uniform( shaders::uniforms::per_vertex_color,
+                         static_cast< GLint >( 0 ) );
+
+    config.view_loc = shader->slot( shaders::uniforms::view );
+    config.projection_loc = shader->slot( shaders::uniforms::projection );
+    config.model_loc = shader->slot( shaders::uniforms::model );
+    config.color_loc = shader->slot( shaders::uniforms::object_color );
+    if ( false == config.view_loc.valid() ||
+         false == config.projection_loc.valid() ||
+         false == config.model_loc.valid() ||
+         false == config.color_loc.valid() ) {
+        PANIC( "Unable to load the transformation or color uniforms!" );
+    }
 
     config.cur_perspective = perspective_type::projection;
-    glUniformMatrix4fv( config.projection_loc, 1,
-                        GL_FALSE, glm::value_ptr( config.projection ) );
-
-    config.model_loc = shader->load_location( "model" );
-    config.color_loc = shader->load_location( "object_color" );
+    shader->set_uniform( config.projection_loc, config.projection );
 
     framebuffers = factory< buffers::Framebuffers >::create(
                        window );
-    game_lights = std::make_shared< lighting::Core_lighting >();
     model_picking = factory< Model_picking >::create( shader, framebuffers );
 
     frustum = factory< scene::Frustum >::create( camera,
@@ -133,7 +196,7 @@ types::id_type Core_renderer::add_renderable( Renderable::pointer object )
     Rendr::pointer new_rendr = factory< Rendr >::create();
     new_rendr->object = object.get();
     new_rendr->object->set_shader( shader.get() );
-    renderables[ new_rendr->id ] = new_rendr;
+    renderables[ object->id ] = new_rendr;
     LOG0( "Assigned ID: ", new_rendr->id );
     /*
      * object with view mode set to camera_space_coord
@@ -150,16 +213,44 @@ types::id_type Core_renderer::add_renderable( Renderable::pointer object )
     return new_rendr->id;
 }
 
+bool Core_renderer::remove_renderable( const Renderable::pointer& object )
+{
+    if ( nullptr == object ) {
+        ERR( "Invalid renderable provided" );
+        return false;
+    }
+    auto it = renderables.find( object->id );
+    if ( it == renderables.end() ) {
+        WARN1( "The renderable ID ", object->id, " is not registered" );
+        return false;
+    }
+    LOG0( "Removing renderable, ID ", object->id );
+    rendr_data.remove_rendr( it->second );
+    renderables.erase( it );
+    model_picking->remove_model( object );
+    return true;
+}
+
 long Core_renderer::render()
 {
     long num_of_render_op{ 0 };
-    game_lights->calculate_lighting( shader );
     frustum->update();
     config.view_matrix = camera->get_view();
+    game_lights->calculate_lighting( shader, config.view_matrix );
 
     config.is_def_view_matrix_loaded = true;
-    glUniformMatrix4fv( config.view_loc, 1,
-                        GL_FALSE, glm::value_ptr( config.view_matrix ) );
+    shader->set_uniform( config.view_loc, config.view_matrix );
+
+    /*
+     * With the deferred path the world space objects
+     * are rendered in the G-buffer, the geometry pass
+     * ends with the first camera space object.
+     */
+    bool geometry_pass_active{ false };
+    if ( rendering_path::deferred == current_path ) {
+        deferred->begin_geometry_pass( shader );
+        geometry_pass_active = true;
+    }
 
     /*
      * The rendering loop is performed twice,
@@ -180,8 +271,13 @@ long Core_renderer::render()
          * We need all those variables only in the first rendering loop
          */
         const bool is_camera_space = cur->object->view_configuration.is_camera_space();
+        if ( geometry_pass_active && is_camera_space ) {
+            deferred->end_geometry_pass( shader, config.view_matrix );
+            geometry_pass_active = false;
+        }
         if ( false == is_camera_space &&
-                frustum_raw_ptr->is_inside( cur->object->rendering_data.position ) < 0.0f ) {
+                frustum_raw_ptr->is_inside( cur->object->rendering_data.position,
+                                            cur->object->rendering_data.bounding_radius ) < 0.0f ) {
             continue;
         }
         prepare_for_rendering( cur );
@@ -192,10 +288,16 @@ long Core_renderer::render()
         if ( buffer_idx_cnt >= RENDR_CTX_BUF_SIZE ) {
             ERR( "Rendering context buffer size exhausted! Current size: ",
                  RENDR_CTX_BUF_SIZE, ", Interrupting the rendering!" );
+            if ( geometry_pass_active ) {
+                deferred->end_geometry_pass( shader, config.view_matrix );
+            }
             return num_of_render_op;
         }
         rendering_content_idx_buffer[ buffer_idx_cnt++ ] = idx;
         prepare_rendr_color( cur );
+        if ( false == geometry_pass_active ) {
+            prepare_rendr_lights( cur );
+        }
         if ( false == cur->object->render( ) ) {
             ERR( "Rendering error for renderable ID:", cur->object->id,
                  ", disabling rendering for this renderable!" );
@@ -205,6 +307,9 @@ long Core_renderer::render()
         cur->object->clean_after_render( );
         ++num_of_render_op;
     }
+    if ( geometry_pass_active ) {
+        deferred->end_geometry_pass( shader, config.view_matrix );
+    }
     /*
      * Second loop.
      */
@@ -230,6 +335,27 @@ Model_picking::pointer Core_renderer::picking()
     return model_picking;
 }
 
+void Core_renderer::set_rendering_path( const rendering_path path )
+{
+    if ( rendering_path::deferred == path && nullptr == deferred ) {
+        deferred = factory< Deferred_renderer >::create( config.viewport_size,
+                   config.projection,
+                   near_plane_of( config.projection ),
+                   framebuffers,
+                   game_lights );
+        shader->use_shaders();
+    }
+    LOG1( "Selected the ",
+          ( rendering_path::deferred == path ? "deferred" : "forward" ),
+          " rendering path" );
+    current_path = path;
+}
+
+rendering_path Core_renderer::get_rendering_path() const
+{
+    return current_path;
+}
+
 void Core_renderer::clear()
 {
     framebuffers->clear();
@@ -241,17 +367,14 @@ bool Core_renderer::prepare_for_rendering( Rendr::raw_pointer cur )
 
     switch_proper_perspective( cur->object );
 
-    glUniformMatrix4fv( config.model_loc, 1, GL_FALSE,
-                        glm::value_ptr( cur->object->rendering_data.model_matrix ) );
+    shader->set_uniform( config.model_loc,
+                         cur->object->rendering_data.model_matrix );
     if ( is_camera_space ) {
-        glUniformMatrix4fv( config.view_loc, 1,
-                            GL_FALSE, glm::value_ptr(
-                                cur->object->rendering_data.model_matrix
-                            ) );
+        shader->set_uniform( config.view_loc,
+                             cur->object->rendering_data.model_matrix );
         config.is_def_view_matrix_loaded = false;
     } else if ( false == config.is_def_view_matrix_loaded ) {
-        glUniformMatrix4fv( config.view_loc, 1,
-                            GL_FALSE, glm::value_ptr( config.view_matrix ) );
+        shader->set_uniform( config.view_loc, config.view_matrix );
         config.is_def_view_matrix_loaded = true;
     }
 
@@ -261,13 +384,18 @@ bool Core_renderer::prepare_for_rendering( Rendr::raw_pointer cur )
 
 void Core_renderer::prepare_rendr_color( Rendr::raw_pointer cur ) const
 {
-    types::color color = cur->object->rendering_data.default_color;
+    shader->set_uniform( config.color_loc,
+                         cur->object->rendering_data.default_color );
+}
 
-    glUniform4f( config.color_loc,
-                 color.r,
-                 color.g,
-                 color.b,
-                 color.a );
+void Core_renderer::prepare_rendr_lights( Rendr::raw_pointer cur )
+{
+    if ( lighting::light_assignment::per_object == game_lights->get_assignment_mode() &&
+         cur->object->view_configuration.is_world_space() ) {
+        game_lights->assign_object_lights( shader,
+                                           cur->object->rendering_data.position,
+                                           cur->object->rendering_data.bounding_radius );
+    }
 }
 
 void Core_renderer::switch_proper_perspective(
@@ -279,16 +407,14 @@ void Core_renderer::switch_proper_perspective(
         /*
          * Need to switch from projection to ortho
          */
-        glUniformMatrix4fv( config.projection_loc, 1,
-                            GL_FALSE, glm::value_ptr( config.ortho ) );
+        shader->set_uniform( config.projection_loc, config.ortho );
         config.cur_perspective = perspective_type::ortho;
     } else if ( obj->view_configuration.is_world_space() &&
                 perspective_type::ortho == config.cur_perspective ) {
         /*
          * Need to switch from ortho to projection
          */
-        glUniformMatrix4fv( config.projection_loc, 1,
-                            GL_FALSE, glm::value_ptr( config.projection ) );
+        shader->set_uniform( config.projection_loc, config.projection );
         config.cur_perspective = perspective_type::projection;
     }
 }
@@ -304,7 +430,10 @@ Model_picking::Model_picking( shaders::Shader::pointer shader,
 {
     LOG3( "Creating a new Model_picking object" );
     picking_buffer_id = framebuffers->create_buffer();
-    shader_color_loc = game_shader->load_location( "object_color" );
+    shader_color_loc = game_shader->slot( shaders::uniforms::object_color );
+    if ( false == shader_color_loc.valid() ) {
+        PANIC( "Unable to load the uniform object_color" );
+    }
 }
 
 types::color Model_picking::add_model(
@@ -325,6 +454,25 @@ types::color Model_picking::add_model(
     return assigned_color;
 }
 
+void Model_picking::remove_model( const Renderable::pointer& object )
+{
+    auto it = rendrid_to_color.find( object->id );
+    if ( it == rendrid_to_color.end() ) {
+        return;
+    }
+    selected.remove( object );
+    if ( pointed_model.pointed == object ) {
+        pointed_model.pointed = nullptr;
+    }
+    if ( pointed == object ) {
+        pointed = nullptr;
+    }
+    color_to_rendr.erase( it->second );
+    color_operations.release_color( color_operations.normalize_color(
+                                        color_operations.get_color_rgba( it->second ) ) );
+    rendrid_to_color.erase( it );
+}
+
 std::size_t Model_picking::pick(
     const GLuint x,
     const GLuint y )
@@ -382,14 +530,22 @@ void Model_picking::update(
         auto color = color_operations.get_color_rgba( it->second );
         color = color_operations.normalize_color( color );
 
-        glUniform4f( shader_color_loc,
-                     color.r,
-                     color.g,
-                     color.b,
-                     color.a );
+        game_shader->set_uniform( shader_color_loc, color );
+
+        object->render_picking( );
+    }
+}
 
-        object->render( );
+types::color Model_picking::picking_color(
+    const Renderable::raw_pointer object
+) const
+{
+    const auto it = rendrid_to_color.find( object->id );
+    if ( rendrid_to_color.end() == it ) {
+        return types::color( 0.0f );
     }
+    return color_operations.normalize_color(
+               color_operations.get_color_rgba( it->second ) );
 }
 
 void Model_picking::prepare_to_update()
@@ -510,6 +666,11 @@ Color_creator::Color_creator( const GLfloat step ) :
 
 types::color Color_creator::get_color()
 {
+    if ( false == released_colors.empty() ) {
+        const auto color = released_colors.back();
+        released_colors.pop_back();
+        return color;
+    }
     if ( num_of_colors >= max_num_of_colors ) {
         PANIC( "No more available colors, limit:",
                max_num_of_colors );
@@ -538,6 +699,11 @@ types::color Color_creator::get_color()
     return color;
 }
 
+void Color_creator::release_color( const types::color& color )
+{
+    released_colors.push_back( color );
+}
+
 types::color Color_creator::denormalize_color( types::color color ) const
 {
     for ( int i {0}; i < 3; ++i ) {
@@ -643,4 +809,9 @@ Renderable::pointer Core_renderer_proxy::pointed_model() const
     return core_renderer->picking()->get_pointed_model();
 }
 
+types::color Core_renderer_proxy::picking_color( const Renderable::pointer& object ) const
+{
+    return core_renderer->picking()->picking_color( object.get() );
+}
+
 }
@@ -9,6 +9,7 @@
 #include <my_camera.hpp>
 #include <lights.hpp>
 #include <framebuffers.hpp>
+#include <deferred_renderer.hpp>
 #include <types.hpp>
 #include <factory.hpp>
 
@@ -143,10 +144,16 @@ struct Renderable_data {
      * Default color applicable to the model
      */
     types::color default_color;
+    /*
+     * Radius of the sphere centered in position
+     * which contains the renderable
+     */
+    GLfloat bounding_radius;
 
     Renderable_data() :
         model_matrix{ glm::mat4() },
-        heading{ 0 }
+        heading{ 0 },
+        bounding_radius{ 1.0f }
     {}
     /*
      * Utility functions
@@ -176,6 +183,16 @@ public:
     void set_shader( shaders::Shader::raw_poiner shader );
     virtual void prepare_for_render( ) {}
     virtual bool render( ) {}
+    /*
+     * Rendering for the model picking, with the picking
+     * color of the object already loaded. The renderables
+     * drawing the geometry of other renderables provide
+     * their picking colors per vertex
+     */
+    virtual bool render_picking( )
+    {
+        return render( );
+    }
     virtual void clean_after_render( ) {}
 
     virtual std::string nice_name();
@@ -195,6 +212,8 @@ struct Rendr {
     using raw_pointer = Rendr*;
     id_factory< Rendr > id;
     Renderable::raw_pointer object;
+    //Position in the Rendr_data_buffer
+    std::size_t buffer_idx;
 
     Rendr() = default;
 };
@@ -223,6 +242,11 @@ public:
      * 0.0 = 0.0 , 1.0 = 255
      */
     types::color get_color();
+    /*
+     * The color is not used anymore, it
+     * is returned by the next get_color
+     */
+    void release_color( const types::color& color );
     /*
      * Convert the RGB range from 0.0-1.0
      * to 0.0-255.0
@@ -244,6 +268,7 @@ private:
     GLfloat color_step;
     uint64_t num_of_colors;
     uint64_t max_num_of_colors;
+    std::vector< types::color > released_colors;
 };
 
 /*
@@ -333,6 +358,12 @@ public:
      * to the model.
      */
     types::color add_model( Renderable::pointer object );
+    /*
+     * The object is not pickable anymore, if selected
+     * or pointed it is unselected. Its color might
+     * be assigned to the next added model
+     */
+    void remove_model( const Renderable::pointer& object );
     /*
      * Return the model at position x,y
      */
@@ -367,6 +398,11 @@ public:
      * Update the picking information for the provided model
      */
     void update( const Renderable::raw_pointer object ) const;
+    /*
+     * Normalized picking color of the object,
+     * alpha is zero if the object is unknown
+     */
+    types::color picking_color( const Renderable::raw_pointer object ) const;
     /*
      * Two functions which ask Model_picking to be ready
      * for rendering next, or to cleanup after the rendering
@@ -376,7 +412,7 @@ public:
     void complete_update();
 private:
     shaders::Shader::pointer           game_shader;
-    GLuint                             shader_color_loc;
+    shaders::Uniform_slot              shader_color_loc;
     buffers::Framebuffers::pointer     framebuffers;
     buffers::Framebuffers::buffer_id_t picking_buffer_id;
     /*
@@ -414,10 +450,10 @@ struct Core_renderer_config {
     perspective_type cur_perspective;
     glm::mat4        projection;
     glm::mat4        ortho;
-    GLint            color_loc;
-    GLint            view_loc;
-    GLint            projection_loc;
-    GLint            model_loc;
+    shaders::Uniform_slot color_loc;
+    shaders::Uniform_slot view_loc;
+    shaders::Uniform_slot projection_loc;
+    shaders::Uniform_slot model_loc;
 
     Core_renderer_config( types::win_size win_size ) :
         is_def_view_matrix_loaded{ false },
@@ -448,6 +484,11 @@ public:
      * of the current set of renderables in the buffer.
      */
     void add_new_rendr( Rendr::pointer& rendr );
+    /*
+     * The last rendr of the same part of the
+     * buffer takes the place of the removed one
+     */
+    void remove_rendr( Rendr::pointer& rendr );
     /*
      * Used for rendering the rendr objects based
      * on their priority (head first, tail last)
@@ -473,9 +514,21 @@ public:
         const glm::mat4& def_ortho,
         const scene::Camera::pointer cam );
     types::id_type add_renderable( Renderable::pointer object );
+    /*
+     * The renderer does not own the renderables,
+     * remove them before they are destroyed
+     */
+    bool remove_renderable( const Renderable::pointer& object );
     long render();
     lighting::lighting_pointer scene_lights();
     Model_picking::pointer     picking();
+    /*
+     * Select the forward or the deferred
+     * rendering path, the change is effective
+     * from the next frame
+     */
+    void set_rendering_path( const rendering_path path );
+    rendering_path get_rendering_path() const;
     /*
      * Clean the rendering buffers
      */
@@ -496,6 +549,11 @@ private:
      * load it to the shader
      */
     void prepare_rendr_color( Rendr::raw_pointer cur ) const;
+    /*
+     * Select the lights for the Renderable, only
+     * with the per object light assignment
+     */
+    void prepare_rendr_lights( Rendr::raw_pointer cur );
     Core_renderer_config     config;
     shaders::Shader::pointer shader;
     scene::Camera::pointer   camera;
@@ -503,10 +561,16 @@ private:
     scene::Frustum::raw_pointer frustum_raw_ptr;//Save some performance.
     lighting::lighting_pointer     game_lights;
     buffers::Framebuffers::pointer framebuffers;
+    rendering_path                 current_path;
+    /*
+     * Created the first time the deferred
+     * path is selected
+     */
+    Deferred_renderer::pointer     deferred;
     Rendr_data_buffer rendr_data;
     /*
-     * For fast retrieval of renderable objects
-     * by their ID
+     * For fast retrieval of the Rendr of
+     * the renderable objects by their ID
      */
     std::unordered_map< types::id_type, Rendr::pointer > renderables;
     /*
@@ -539,11 +603,16 @@ public:
     {
         return core_renderer->add_renderable( std::forward< Renderable::pointer >( object ) );
     }
+    bool remove_renderable( const Renderable::pointer& object )
+    {
+        return core_renderer->remove_renderable( object );
+    }
     /*
      * The pointed mode is everything which is
      * currently 'under' the mouse
      */
     Renderable::pointer pointed_model() const;
+    types::color picking_color( const Renderable::pointer& object ) const;
 
 private:
     Core_renderer::pointer core_renderer;
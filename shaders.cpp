@@ -1,4 +1,6 @@
 #include "shaders.hpp"
+#include <algorithm>
+#include <cstring>
 
 namespace shaders {
 
@@ -6,7 +8,8 @@ void Shader::load_shader_generic( GLuint& shader_target,
                                   const std::string& body,
                                   GLenum shader_type )
 {
-    const char* body_ptr = body.c_str();
+    const std::string full_body = resolve_includes( body );
+    const char* body_ptr = full_body.c_str();
     LOG3( "Compiling shader: ",
           shader_type );
     shader_target = glCreateShader( shader_type );
@@ -77,6 +80,43 @@ std::string Shader::read_shader_body( const std::string& filename )
     return shader_body;
 }
 
+void Shader::add_include( const std::string& name,
+                          const std::string& body )
+{
+    LOG1( "New shader include: ", name, ", size: ", body.size() );
+    includes[ name ] = body;
+}
+
+std::string Shader::resolve_includes( const std::string& body ) const
+{
+    static const std::string directive{ "#include \"" };
+    std::string result;
+    std::size_t line_begin{ 0 };
+    while ( line_begin < body.size() ) {
+        std::size_t line_end = body.find( '\n', line_begin );
+        if ( line_end == std::string::npos ) {
+            line_end = body.size();
+        }
+        const std::string line = body.substr( line_begin, line_end - line_begin );
+        const std::size_t pos = line.find( directive );
+        if ( pos != std::string::npos ) {
+            const std::size_t name_begin = pos + directive.size();
+            const std::string name = line.substr( name_begin,
+                                                  line.find( '"', name_begin ) - name_begin );
+            auto it = includes.find( name );
+            if ( it == includes.end() ) {
+                PANIC( "Unknown shader include: ", name );
+            }
+            result += it->second;
+        } else {
+            result += line;
+        }
+        result += '\n';
+        line_begin = line_end + 1;
+    }
+    return result;
+}
+
 bool Shader::create_shader_program()
 {
     LOG3( "Creating the shader program" );
@@ -103,11 +143,106 @@ bool Shader::create_shader_program()
         return false;
     }
 
-    light_calc_uniform = load_location( "skip_light_calculations" );
-    tex_calc_uniform = load_location( "skip_texture_calculations" );
+    build_uniform_table();
+    light_calc_uniform = slot( uniforms::skip_light_calculations );
+    tex_calc_uniform = slot( uniforms::skip_texture_calculations );
     return true;
 }
 
+void Shader::build_uniform_table()
+{
+    uniform_table.clear();
+    uniform_block_table.clear();
+
+    GLint uniform_count{ 0 },
+          max_name_length{ 0 };
+    glGetProgramiv( shader_program,
+                    GL_ACTIVE_UNIFORMS,
+                    &uniform_count );
+    glGetProgramiv( shader_program,
+                    GL_ACTIVE_UNIFORM_MAX_LENGTH,
+                    &max_name_length );
+    std::vector< GLchar > name_buffer( max_name_length + 1 );
+    for ( GLint idx{ 0 } ; idx < uniform_count ; ++idx ) {
+        Uniform_info info;
+        GLsizei name_length{ 0 };
+        glGetActiveUniform( shader_program,
+                            idx,
+                            name_buffer.size(),
+                            &name_length,
+                            &info.size,
+                            &info.type,
+                            name_buffer.data() );
+        info.name.assign( name_buffer.data(), name_length );
+        /*
+         * Arrays are reported as 'name[0]', the
+         * table is addressed using the plain name
+         */
+        const auto bracket = info.name.find( '[' );
+        if ( bracket != std::string::npos ) {
+            info.name.resize( bracket );
+        }
+        info.location = glGetUniformLocation( shader_program,
+                                              info.name.c_str() );
+        if ( info.location < 0 ) {
+            //Member of an uniform block
+            continue;
+        }
+        info.hash = hash_uniform_name( info.name.c_str() );
+        info.value_cached = false;
+        LOG1( "Active uniform: ", info.name, ", location: ",
+              info.location, ", size: ", info.size );
+        uniform_table.push_back( info );
+    }
+
+    GLint block_count{ 0 };
+    glGetProgramiv( shader_program,
+                    GL_ACTIVE_UNIFORM_BLOCKS,
+                    &block_count );
+    glGetProgramiv( shader_program,
+                    GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH,
+                    &max_name_length );
+    name_buffer.resize( max_name_length + 1 );
+    for ( GLint idx{ 0 } ; idx < block_count ; ++idx ) {
+        Uniform_block_info info;
+        GLsizei name_length{ 0 };
+        glGetActiveUniformBlockName( shader_program,
+                                     idx,
+                                     name_buffer.size(),
+                                     &name_length,
+                                     name_buffer.data() );
+        info.name.assign( name_buffer.data(), name_length );
+        info.index = idx;
+        glGetActiveUniformBlockiv( shader_program,
+                                   idx,
+                                   GL_UNIFORM_BLOCK_DATA_SIZE,
+                                   &info.data_size );
+        info.hash = hash_uniform_name( info.name.c_str() );
+        LOG1( "Active uniform block: ", info.name, ", size: ",
+              info.data_size );
+        uniform_block_table.push_back( info );
+    }
+
+    auto by_hash = []( const auto & lhs, const auto & rhs ) {
+        return lhs.hash < rhs.hash;
+    };
+    auto same_hash = []( const auto & lhs, const auto & rhs ) {
+        return lhs.hash == rhs.hash;
+    };
+    std::sort( uniform_table.begin(), uniform_table.end(), by_hash );
+    std::sort( uniform_block_table.begin(), uniform_block_table.end(), by_hash );
+    if ( std::adjacent_find( uniform_table.begin(),
+                             uniform_table.end(),
+                             same_hash ) != uniform_table.end() ||
+         std::adjacent_find( uniform_block_table.begin(),
+                             uniform_block_table.end(),
+                             same_hash ) != uniform_block_table.end() ) {
+        PANIC( "Hash collision between uniform names, rename the uniforms!" );
+    }
+    LOG3( "Uniform table ready, uniforms: ", uniform_table.size(),
+          ", blocks: ", uniform_block_table.size() );
+}
+
 void Shader::use_shaders()
 {
     glUseProgram( shader_program );
@@ -121,32 +256,158 @@ GLuint Shader::get_program( ) const
 GLint Shader::load_location( const std::string& loc_name )
 {
     LOG1( "Loading location: ", loc_name );
-    GLint loc = glGetUniformLocation( shader_program,
-                                      loc_name.c_str() );
-    if ( loc < 0 ) {
+    const Uniform_slot loc = slot( hash_uniform_name( loc_name.c_str() ) );
+    if ( false == loc.valid() ) {
         PANIC( "Unable to load the shader uniform: " + loc_name );
     }
-    return loc;
+    return uniform_table[ loc.idx ].location;
+}
+
+Uniform_slot Shader::slot( const uniform_hash hash ) const
+{
+    Uniform_slot ret;
+    auto it = std::lower_bound( uniform_table.begin(),
+                                uniform_table.end(),
+                                hash,
+    []( const Uniform_info & info, const uniform_hash value ) {
+        return info.hash < value;
+    } );
+    if ( it != uniform_table.end() && it->hash == hash ) {
+        ret.idx = std::distance( uniform_table.begin(), it );
+    }
+    return ret;
+}
+
+bool Shader::update_cache( const Uniform_slot slot,
+                           const void* value,
+                           const std::size_t size )
+{
+    if ( false == slot.valid() ) {
+        return false;
+    }
+    Uniform_info& info = uniform_table[ slot.idx ];
+    if ( info.value_cached &&
+         0 == std::memcmp( info.last_value, value, size ) ) {
+        return false;
+    }
+    std::memcpy( info.last_value, value, size );
+    info.value_cached = true;
+    return true;
+}
+
+void Shader::set_uniform( const Uniform_slot slot, const GLint value )
+{
+    if ( update_cache( slot, &value, sizeof( value ) ) ) {
+        glUniform1i( uniform_table[ slot.idx ].location, value );
+    }
+}
+
+void Shader::set_uniform( const Uniform_slot slot, const GLfloat value )
+{
+    if ( update_cache( slot, &value, sizeof( value ) ) ) {
+        glUniform1f( uniform_table[ slot.idx ].location, value );
+    }
+}
+
+void Shader::set_uniform( const Uniform_slot slot, const glm::vec4& value )
+{
+    if ( update_cache( slot, glm::value_ptr( value ), sizeof( GLfloat ) * 4 ) ) {
+        glUniform4fv( uniform_table[ slot.idx ].location, 1,
+                      glm::value_ptr( value ) );
+    }
+}
+
+void Shader::set_uniform( const Uniform_slot slot, const glm::mat4& value )
+{
+    if ( update_cache( slot, glm::value_ptr( value ), sizeof( GLfloat ) * 16 ) ) {
+        glUniformMatrix4fv( uniform_table[ slot.idx ].location, 1,
+                            GL_FALSE, glm::value_ptr( value ) );
+    }
+}
+
+bool Shader::set_uniform_array( const uniform_hash hash,
+                                const GLsizei count,
+                                const GLfloat* values )
+{
+    const Uniform_slot target = slot( hash );
+    if ( false == target.valid() ) {
+        return false;
+    }
+    glUniform1fv( uniform_table[ target.idx ].location,
+                  count,
+                  values );
+    return true;
+}
+
+bool Shader::set_uniform_array( const uniform_hash hash,
+                                const GLsizei count,
+                                const GLint* values )
+{
+    const Uniform_slot target = slot( hash );
+    if ( false == target.valid() ) {
+        return false;
+    }
+    glUniform1iv( uniform_table[ target.idx ].location,
+                  count,
+                  values );
+    return true;
+}
+
+const Uniform_block_info* Shader::uniform_block( const uniform_hash hash ) const
+{
+    auto it = std::lower_bound( uniform_block_table.begin(),
+                                uniform_block_table.end(),
+                                hash,
+    []( const Uniform_block_info & info, const uniform_hash value ) {
+        return info.hash < value;
+    } );
+    if ( it != uniform_block_table.end() && it->hash == hash ) {
+        return &( *it );
+    }
+    return nullptr;
+}
+
+bool Shader::bind_uniform_block( const uniform_hash hash,
+                                 const GLuint binding_point )
+{
+    const Uniform_block_info* block = uniform_block( hash );
+    if ( nullptr == block ) {
+        ERR( "Uniform block not active in the program!" );
+        return false;
+    }
+    LOG1( "Binding the uniform block ", block->name,
+          " to the binding point ", binding_point );
+    glUniformBlockBinding( shader_program,
+                           block->index,
+                           binding_point );
+    return true;
+}
+
+void Shader::invalidate_uniform_cache()
+{
+    for ( auto&& info : uniform_table ) {
+        info.value_cached = false;
+    }
 }
 
 void Shader::enable_light_calculations()
 {
-    glUniform1i( light_calc_uniform, 0 );
+    set_uniform( light_calc_uniform, 0 );
 }
 
 void Shader::disable_light_calculations()
 {
-    glUniform1i( light_calc_uniform, 1 );
+    set_uniform( light_calc_uniform, 1 );
 }
 
 void Shader::enable_texture_calculations()
 {
-    glUniform1i( tex_calc_uniform, 0 );
+    set_uniform( tex_calc_uniform, 0 );
 }
 
 void Shader::disable_texture_calculations()
 {
-    glUniform1i( tex_calc_uniform, 1 );
+    set_uniform( tex_calc_uniform, 1 );
 }
 
 
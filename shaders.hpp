@@ -12,9 +12,110 @@
 #include <string>
 #include "logger/logger.hpp"
 #include <memory>
+#include <vector>
+#include <unordered_map>
 
 namespace shaders {
 
+using uniform_hash = uint32_t;
+
+/*
+ * FNV-1a hash of an uniform name, when used
+ * with string literals the hash is calculated
+ * at compile time. The uniform table of the shader
+ * is addressed by those hashes.
+ */
+constexpr uniform_hash hash_uniform_name( const char* name,
+        uniform_hash hash = 2166136261u )
+{
+    return ( *name == '\0' ) ? hash :
+           hash_uniform_name( name + 1,
+                              ( hash ^ static_cast< uint8_t >( *name ) ) * 16777619u );
+}
+
+/*
+ * Names of the uniforms and uniform blocks
+ * used by the game shaders
+ */
+namespace uniforms {
+constexpr uniform_hash model = hash_uniform_name( "model" );
+constexpr uniform_hash view = hash_uniform_name( "view" );
+constexpr uniform_hash projection = hash_uniform_name( "projection" );
+constexpr uniform_hash object_color = hash_uniform_name( "object_color" );
+constexpr uniform_hash skip_light_calculations = hash_uniform_name( "skip_light_calculations" );
+constexpr uniform_hash skip_texture_calculations = hash_uniform_name( "skip_texture_calculations" );
+constexpr uniform_hash loaded_texture1 = hash_uniform_name( "loaded_texture1" );
+constexpr uniform_hash loaded_texture2 = hash_uniform_name( "loaded_texture2" );
+constexpr uniform_hash loaded_texture3 = hash_uniform_name( "loaded_texture3" );
+constexpr uniform_hash loaded_texture_specular_map1 = hash_uniform_name( "loaded_texture_specular_map1" );
+constexpr uniform_hash loaded_texture_specular_map2 = hash_uniform_name( "loaded_texture_specular_map2" );
+constexpr uniform_hash loaded_texture_specular_map3 = hash_uniform_name( "loaded_texture_specular_map3" );
+constexpr uniform_hash position_offset = hash_uniform_name( "position_offset" );
+constexpr uniform_hash position_scale = hash_uniform_name( "position_scale" );
+constexpr uniform_hash diffuse_array = hash_uniform_name( "diffuse_array" );
+constexpr uniform_hash specular_array = hash_uniform_name( "specular_array" );
+constexpr uniform_hash light_records = hash_uniform_name( "light_records" );
+constexpr uniform_hash cluster_grid = hash_uniform_name( "cluster_grid" );
+constexpr uniform_hash light_indices = hash_uniform_name( "light_indices" );
+constexpr uniform_hash global_light_count = hash_uniform_name( "global_light_count" );
+constexpr uniform_hash cluster_scale = hash_uniform_name( "cluster_scale" );
+constexpr uniform_hash geometry_pass = hash_uniform_name( "geometry_pass" );
+constexpr uniform_hash per_vertex_color = hash_uniform_name( "per_vertex_color" );
+constexpr uniform_hash per_object_lights = hash_uniform_name( "per_object_lights" );
+constexpr uniform_hash object_lights = hash_uniform_name( "object_lights" );
+constexpr uniform_hash object_light_count = hash_uniform_name( "object_light_count" );
+constexpr uniform_hash gbuffer_albedo = hash_uniform_name( "gbuffer_albedo" );
+constexpr uniform_hash gbuffer_normal = hash_uniform_name( "gbuffer_normal" );
+constexpr uniform_hash gbuffer_specular = hash_uniform_name( "gbuffer_specular" );
+constexpr uniform_hash gbuffer_depth = hash_uniform_name( "gbuffer_depth" );
+constexpr uniform_hash inverse_view_projection = hash_uniform_name( "inverse_view_projection" );
+constexpr uniform_hash camera_position = hash_uniform_name( "camera_position" );
+constexpr uniform_hash light_accumulation = hash_uniform_name( "light_accumulation" );
+}
+
+/*
+ * Entry of the uniform table, built
+ * once after the program is linked.
+ */
+struct Uniform_info {
+    uniform_hash hash;
+    std::string  name;
+    GLint        location;
+    GLenum       type;
+    GLint        size; //Number of elements for arrays
+    /*
+     * Last value uploaded to this uniform,
+     * identical uploads are skipped. Big enough
+     * for a mat4
+     */
+    bool         value_cached;
+    GLfloat      last_value[ 16 ];
+};
+
+/*
+ * Same as Uniform_info but for the
+ * uniform blocks
+ */
+struct Uniform_block_info {
+    uniform_hash hash;
+    std::string  name;
+    GLuint       index;
+    GLint        data_size;
+};
+
+/*
+ * Index in the uniform table, resolve it
+ * once with Shader::slot and then use it
+ * to upload the values
+ */
+struct Uniform_slot {
+    GLint idx{ -1 };
+    bool valid() const
+    {
+        return idx >= 0;
+    }
+};
+
 class Shader
 {
 public:
@@ -24,6 +125,14 @@ public:
     void load_vertex_shader( const std::string& body );
     void load_fragment_shader( const std::string& body );
     std::string read_shader_body( const std::string& filename );
+    /*
+     * Register a piece of GLSL code which replaces
+     * the lines '#include "name"' in the shader bodies
+     * loaded after this call. Used for code generated
+     * at runtime, like the light data structures.
+     */
+    void add_include( const std::string& name,
+                      const std::string& body );
     bool create_shader_program();
     void use_shaders();
     GLuint get_program() const;
@@ -38,6 +147,60 @@ public:
      * or raise an error
      */
     GLint load_location( const std::string& loc_name );
+    /*
+     * Return the slot in the uniform table for
+     * the given uniform, or an invalid slot
+     * if the uniform is not active
+     */
+    Uniform_slot slot( const uniform_hash hash ) const;
+    /*
+     * Upload a new value for the uniform, if the
+     * value is the same as the last uploaded one
+     * then the GL call is skipped.
+     *
+     * Do not mix those calls with direct glUniform*
+     * calls on the same uniforms, the cache would
+     * not notice the change.
+     */
+    void set_uniform( const Uniform_slot slot, const GLint value );
+    void set_uniform( const Uniform_slot slot, const GLfloat value );
+    void set_uniform( const Uniform_slot slot, const glm::vec4& value );
+    void set_uniform( const Uniform_slot slot, const glm::mat4& value );
+    /*
+     * Same as above but the uniform is looked up by
+     * hash, return false if the uniform is not active
+     */
+    template< typename T >
+    bool set_uniform( const uniform_hash hash, const T& value )
+    {
+        const Uniform_slot target = slot( hash );
+        if ( false == target.valid() ) {
+            return false;
+        }
+        set_uniform( target, value );
+        return true;
+    }
+    /*
+     * Arrays are always uploaded, no caching
+     */
+    bool set_uniform_array( const uniform_hash hash,
+                            const GLsizei count,
+                            const GLfloat* values );
+    bool set_uniform_array( const uniform_hash hash,
+                            const GLsizei count,
+                            const GLint* values );
+    /*
+     * Return the information about the uniform block,
+     * or nullptr if the block is not active
+     */
+    const Uniform_block_info* uniform_block( const uniform_hash hash ) const;
+    bool bind_uniform_block( const uniform_hash hash,
+                             const GLuint binding_point );
+    /*
+     * Forget all the cached values, the next
+     * upload will reach the driver
+     */
+    void invalidate_uniform_cache();
 
     void enable_light_calculations();
     void disable_light_calculations();
@@ -47,12 +210,25 @@ private:
     GLuint vertex_shader,
            fragment_shader,
            shader_program;
-    GLuint light_calc_uniform;
-    GLuint tex_calc_uniform;
+    Uniform_slot light_calc_uniform;
+    Uniform_slot tex_calc_uniform;
     GLchar log_buffer[512];
     void load_shader_generic( GLuint& shader_target,
                               const std::string& body,
                               GLenum shader_type );
+    std::string resolve_includes( const std::string& body ) const;
+    std::unordered_map< std::string, std::string > includes;
+    /*
+     * Enumerate the active uniforms and uniform blocks
+     * of the linked program. Both the tables are
+     * sorted by hash.
+     */
+    void build_uniform_table();
+    bool update_cache( const Uniform_slot slot,
+                       const void* value,
+                       const std::size_t size );
+    std::vector< Uniform_info > uniform_table;
+    std::vector< Uniform_block_info > uniform_block_table;
 };
 
 }
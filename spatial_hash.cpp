@@ -0,0 +1,274 @@
+#include <spatial_hash.hpp>
+#include <thread_pool.hpp>
+#include <logger/logger.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <queue>
+
+namespace game_units {
+
+Spatial_hash::Spatial_hash( const GLfloat cell_size ) :
+    cell_size{ cell_size },
+    inv_cell_size{ 1.0f / cell_size },
+    buckets( initial_unit_buckets )
+{
+    LOG3( "New spatial hash, cell size: ", cell_size );
+}
+
+void Spatial_hash::update( const types::id_type id,
+                           const glm::vec2 position,
+                           const glm::vec2 velocity,
+                           const GLfloat radius )
+{
+    const int32_t cell_x = cell_coord( position.x );
+    const int32_t cell_y = cell_coord( position.y );
+    auto it = locations.find( id );
+    if ( it != locations.end() ) {
+        Entry& entry = buckets[ it->second.bucket ][ it->second.idx ];
+        if ( entry.cell_x == cell_x && entry.cell_y == cell_y ) {
+            entry.position = position;
+            entry.velocity = velocity;
+            entry.radius = radius;
+            return;
+        }
+        remove( id );
+    } else if ( locations.size() >= 2 * buckets.size() ) {
+        grow();
+    }
+    const std::size_t bucket = bucket_idx( cell_x, cell_y );
+    locations[ id ] = Location{ bucket, buckets[ bucket ].size() };
+    buckets[ bucket ].push_back( Entry{ id, position, velocity, radius, cell_x, cell_y } );
+}
+
+void Spatial_hash::remove( const types::id_type id )
+{
+    auto it = locations.find( id );
+    if ( it == locations.end() ) {
+        return;
+    }
+    auto& entries = buckets[ it->second.bucket ];
+    const std::size_t idx = it->second.idx;
+    //Swap with the last one
+    if ( idx + 1 != entries.size() ) {
+        entries[ idx ] = entries.back();
+        locations[ entries[ idx ].id ].idx = idx;
+    }
+    entries.pop_back();
+    locations.erase( it );
+}
+
+const Spatial_hash::Entry* Spatial_hash::find( const types::id_type id ) const
+{
+    auto it = locations.find( id );
+    if ( it == locations.end() ) {
+        return nullptr;
+    }
+    return &buckets[ it->second.bucket ][ it->second.idx ];
+}
+
+void Spatial_hash::grow()
+{
+    std::vector< std::vector< Entry > > old_buckets( buckets.size() * 2 );
+    old_buckets.swap( buckets );
+    LOG1( "Growing the spatial hash to ", buckets.size(), " buckets" );
+    for ( auto&& entries : old_buckets ) {
+        for ( auto&& entry : entries ) {
+            const std::size_t bucket = bucket_idx( entry.cell_x, entry.cell_y );
+            locations[ entry.id ] = Location{ bucket, buckets[ bucket ].size() };
+            buckets[ bucket ].push_back( entry );
+        }
+    }
+}
+
+void Spatial_hash::query_radius( const glm::vec2 center,
+                                 const GLfloat radius,
+                                 std::vector< types::id_type >& result ) const
+{
+    result.clear();
+    for_each_in_radius( center, radius, [ &result ]( const Entry & entry ) {
+        result.push_back( entry.id );
+    } );
+}
+
+void Spatial_hash::query_nearest( const glm::vec2 center,
+                                  const std::size_t k,
+                                  const GLfloat max_radius,
+                                  std::vector< types::id_type >& result ) const
+{
+    result.clear();
+    if ( k == 0 ) {
+        return;
+    }
+    /*
+     * Visit the rings of cells around the center one
+     * by one. After the ring r all the units closer than
+     * r cells have been seen: stop when the k nearest
+     * found so far are all closer than that
+     */
+    using candidate = std::pair< GLfloat, types::id_type >;
+    std::priority_queue< candidate > nearest;
+    const GLfloat max_radius_sq = max_radius * max_radius;
+    const int32_t center_x = cell_coord( center.x );
+    const int32_t center_y = cell_coord( center.y );
+    const int32_t max_ring = static_cast< int32_t >( std::ceil( max_radius * inv_cell_size ) ) + 1;
+    auto visit_cell = [ & ]( const int32_t x, const int32_t y ) {
+        for ( auto&& entry : buckets[ bucket_idx( x, y ) ] ) {
+            if ( entry.cell_x != x || entry.cell_y != y ) {
+                continue;
+            }
+            const glm::vec2 delta = entry.position - center;
+            const GLfloat distance_sq = delta.x * delta.x + delta.y * delta.y;
+            if ( distance_sq > max_radius_sq ) {
+                continue;
+            }
+            if ( nearest.size() < k ) {
+                nearest.emplace( distance_sq, entry.id );
+            } else if ( distance_sq < nearest.top().first ) {
+                nearest.pop();
+                nearest.emplace( distance_sq, entry.id );
+            }
+        }
+    };
+    for ( int32_t ring{ 0 } ; ring <= max_ring ; ++ring ) {
+        if ( ring == 0 ) {
+            visit_cell( center_x, center_y );
+        } else {
+            for ( int32_t offset{ -ring } ; offset <= ring ; ++offset ) {
+                visit_cell( center_x + offset, center_y - ring );
+                visit_cell( center_x + offset, center_y + ring );
+            }
+            for ( int32_t offset{ -ring + 1 } ; offset < ring ; ++offset ) {
+                visit_cell( center_x - ring, center_y + offset );
+                visit_cell( center_x + ring, center_y + offset );
+            }
+        }
+        const GLfloat covered = ring * cell_size;
+        if ( nearest.size() == k && nearest.top().first <= covered * covered ) {
+            break;
+        }
+        if ( locations.size() == nearest.size() ) {
+            //All the units seen
+            break;
+        }
+    }
+    result.resize( nearest.size() );
+    for ( auto it = result.rbegin() ; it != result.rend() ; ++it ) {
+        *it = nearest.top().second;
+        nearest.pop();
+    }
+}
+
+std::size_t Spatial_hash::size() const
+{
+    return locations.size();
+}
+
+GLfloat Spatial_hash::get_cell_size() const
+{
+    return cell_size;
+}
+
+void compute_avoidance( const Spatial_hash& hash,
+                        const std::vector< Avoidance_agent >& agents,
+                        std::vector< glm::vec2 >& corrections,
+                        Avoidance_stats& stats )
+{
+    const auto start = std::chrono::steady_clock::now();
+    corrections.assign( agents.size(), glm::vec2( 0.0f ) );
+    /*
+     * Process the agents row by row of cells, the
+     * neighbors of consecutive agents are the same
+     * and stay in the cache
+     */
+    std::vector< std::pair< uint64_t, uint32_t > > order( agents.size() );
+    const GLfloat inv_cell_size = 1.0f / hash.get_cell_size();
+    for ( std::size_t idx{ 0 } ; idx < agents.size() ; ++idx ) {
+        const uint32_t row = static_cast< uint32_t >( static_cast< int32_t >(
+                                 std::floor( agents[ idx ].position.y * inv_cell_size ) ) ) ^ 0x80000000u;
+        const uint32_t column = static_cast< uint32_t >( static_cast< int32_t >(
+                                    std::floor( agents[ idx ].position.x * inv_cell_size ) ) ) ^ 0x80000000u;
+        order[ idx ] = { ( static_cast< uint64_t >( row ) << 32 ) | column,
+                         static_cast< uint32_t >( idx )
+                       };
+    }
+    std::sort( order.begin(), order.end() );
+    std::atomic< std::size_t > neighbors{ 0 };
+    std::atomic< std::size_t > avoiding{ 0 };
+    workers::pool().parallel_for( agents.size(), 256,
+    [ & ]( const std::size_t begin, const std::size_t end ) {
+        std::size_t range_neighbors{ 0 };
+        std::size_t range_avoiding{ 0 };
+        for ( std::size_t ordered{ begin } ; ordered < end ; ++ordered ) {
+            const std::size_t idx = order[ ordered ].second;
+            const Avoidance_agent& agent = agents[ idx ];
+            const GLfloat speed = glm::length( agent.velocity );
+            //Both moving toward each other at the same speed
+            const GLfloat range = 2.0f * ( agent.radius + speed * avoidance_time_horizon );
+            glm::vec2 correction( 0.0f );
+            std::size_t count{ 0 };
+            hash.for_each_in_radius( agent.position, range,
+            [ & ]( const Spatial_hash::Entry & other ) {
+                if ( other.id == agent.id || count >= max_avoidance_neighbors ) {
+                    return;
+                }
+                ++count;
+                const glm::vec2 offset = other.position - agent.position;
+                const GLfloat combined = agent.radius + other.radius;
+                const bool moving = other.velocity.x != 0.0f || other.velocity.y != 0.0f;
+                const GLfloat share = moving ? 0.5f : 1.0f;
+                const GLfloat distance = glm::length( offset );
+                if ( distance < combined ) {
+                    //Already overlapping, push apart
+                    const glm::vec2 away = distance > 0.0001f ? -offset / distance :
+                                           glm::vec2( agent.id < other.id ? -1.0f : 1.0f, 0.0f );
+                    correction += away * ( combined - distance ) * share / avoidance_time_horizon;
+                    return;
+                }
+                const glm::vec2 relative = agent.velocity - other.velocity;
+                const GLfloat relative_sq = glm::dot( relative, relative );
+                if ( relative_sq < 0.000001f ) {
+                    return;
+                }
+                const GLfloat time = glm::dot( offset, relative ) / relative_sq;
+                if ( time <= 0.0f || time > avoidance_time_horizon ) {
+                    return;
+                }
+                const glm::vec2 closest = offset - relative * time;
+                const GLfloat closest_distance = glm::length( closest );
+                if ( closest_distance >= combined ) {
+                    return;
+                }
+                /*
+                 * Sidestep away from the closest approach, on a
+                 * head on collision both the units keep their
+                 * right hand side
+                 */
+                const glm::vec2 away = closest_distance > 0.0001f ?
+                                       -closest / closest_distance :
+                                       glm::vec2( relative.y, -relative.x ) / std::sqrt( relative_sq );
+                correction += away * ( combined - closest_distance ) * share / time;
+            } );
+            range_neighbors += count;
+            if ( correction.x != 0.0f || correction.y != 0.0f ) {
+                ++range_avoiding;
+                //No faster than the unit itself
+                const GLfloat max_speed = std::max( speed, agent.radius );
+                const GLfloat length = glm::length( correction );
+                if ( length > max_speed ) {
+                    correction *= max_speed / length;
+                }
+            }
+            corrections[ idx ] = correction;
+        }
+        neighbors += range_neighbors;
+        avoiding += range_avoiding;
+    } );
+    stats.agents = agents.size();
+    stats.neighbors = neighbors;
+    stats.avoiding = avoiding;
+    stats.elapsed = std::chrono::duration_cast< std::chrono::microseconds >(
+                        std::chrono::steady_clock::now() - start ).count();
+}
+
+}
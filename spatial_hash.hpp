@@ -0,0 +1,163 @@
+#ifndef SPATIAL_HASH_HPP
+#define SPATIAL_HASH_HPP
+
+#include <headers.hpp>
+#include <types.hpp>
+#include <unordered_map>
+#include <vector>
+#include <cmath>
+
+namespace game_units {
+
+/*
+ * Side of the cells of the hash, world units. The
+ * queries are fastest when the radius is up to half
+ * of the cell size: at most 2x2 cells are visited
+ */
+constexpr GLfloat default_unit_cell_size{ 4.0f };
+constexpr std::size_t initial_unit_buckets{ 1 << 12 };
+/*
+ * Local avoidance: the collisions are predicted up to
+ * the time horizon (seconds), each unit considers up
+ * to max_avoidance_neighbors neighbors. When there's
+ * nothing to avoid the offset from the path returns
+ * to zero at the decay rate
+ */
+constexpr GLfloat avoidance_time_horizon{ 0.5f };
+constexpr std::size_t max_avoidance_neighbors{ 16 };
+constexpr GLfloat avoidance_offset_decay{ 1.5f };
+
+/*
+ * Uniform grid over the XY plane, each cell contains
+ * the units whose position is inside the cell. The
+ * units are moved between the cells only when they
+ * cross the border. Not thread safe, many concurrent
+ * queries are allowed while there are no updates
+ */
+class Spatial_hash
+{
+public:
+    struct Entry {
+        types::id_type id;
+        glm::vec2      position;
+        glm::vec2      velocity;
+        GLfloat        radius;
+        int32_t        cell_x;
+        int32_t        cell_y;
+    };
+    explicit Spatial_hash( const GLfloat cell_size = default_unit_cell_size );
+    /*
+     * Add the unit or update its position
+     */
+    void update( const types::id_type id,
+                 const glm::vec2 position,
+                 const glm::vec2 velocity,
+                 const GLfloat radius );
+    void remove( const types::id_type id );
+    const Entry* find( const types::id_type id ) const;
+    /*
+     * Call func( const Entry& ) for each unit
+     * within radius from the center
+     */
+    template< typename Func >
+    void for_each_in_radius( const glm::vec2 center,
+                             const GLfloat radius,
+                             Func&& func ) const
+    {
+        const int32_t min_x = cell_coord( center.x - radius );
+        const int32_t max_x = cell_coord( center.x + radius );
+        const int32_t min_y = cell_coord( center.y - radius );
+        const int32_t max_y = cell_coord( center.y + radius );
+        const GLfloat radius_sq = radius * radius;
+        for ( int32_t y{ min_y } ; y <= max_y ; ++y ) {
+            for ( int32_t x{ min_x } ; x <= max_x ; ++x ) {
+                for ( auto&& entry : buckets[ bucket_idx( x, y ) ] ) {
+                    //Other cells might share the bucket
+                    if ( entry.cell_x != x || entry.cell_y != y ) {
+                        continue;
+                    }
+                    const glm::vec2 delta = entry.position - center;
+                    if ( delta.x * delta.x + delta.y * delta.y <= radius_sq ) {
+                        func( entry );
+                    }
+                }
+            }
+        }
+    }
+    void query_radius( const glm::vec2 center,
+                       const GLfloat radius,
+                       std::vector< types::id_type >& result ) const;
+    /*
+     * The k units closest to the center and within
+     * max_radius, the closest first
+     */
+    void query_nearest( const glm::vec2 center,
+                        const std::size_t k,
+                        const GLfloat max_radius,
+                        std::vector< types::id_type >& result ) const;
+    std::size_t size() const;
+    GLfloat get_cell_size() const;
+private:
+    int32_t cell_coord( const GLfloat value ) const
+    {
+        return static_cast< int32_t >( std::floor( value * inv_cell_size ) );
+    }
+    std::size_t bucket_idx( const int32_t x, const int32_t y ) const
+    {
+        const uint32_t hash = ( static_cast< uint32_t >( x ) * 73856093u ) ^
+                              ( static_cast< uint32_t >( y ) * 19349663u );
+        return hash & ( buckets.size() - 1 );
+    }
+    /*
+     * Double the buckets when the units
+     * are more than twice their number
+     */
+    void grow();
+    struct Location {
+        std::size_t bucket;
+        std::size_t idx;
+    };
+    GLfloat cell_size;
+    GLfloat inv_cell_size;
+    /*
+     * The cells are mapped to a power of two number of
+     * buckets, many cells might share the same bucket
+     */
+    std::vector< std::vector< Entry > > buckets;
+    std::unordered_map< types::id_type, Location > locations;
+};
+
+struct Avoidance_agent {
+    types::id_type id;
+    glm::vec2      position;
+    //Along the path, without the avoidance
+    glm::vec2      velocity;
+    GLfloat        radius;
+};
+
+struct Avoidance_stats {
+    std::size_t agents{ 0 };
+    std::size_t neighbors{ 0 };
+    std::size_t avoiding{ 0 };
+    //Microseconds
+    uint64_t    elapsed{ 0 };
+};
+
+/*
+ * Reciprocal velocity obstacles, simplified: each agent
+ * predicts the closest approach with its neighbors (the
+ * units in the hash, moving or not) within the time
+ * horizon, and takes its share of the velocity change
+ * needed to keep the distance: half of it for a moving
+ * neighbor, which does the same, all of it otherwise.
+ * The corrections are computed in parallel, the hash
+ * must not change in the meanwhile
+ */
+void compute_avoidance( const Spatial_hash& hash,
+                        const std::vector< Avoidance_agent >& agents,
+                        std::vector< glm::vec2 >& corrections,
+                        Avoidance_stats& stats );
+
+}
+
+#endif //SPATIAL_HASH_HPP
@@ -0,0 +1,342 @@
+#include <terrain_chunks.hpp>
+#include <terrains.hpp>
+#include <mesh_optimizer.hpp>
+#include <texture_arrays.hpp>
+#include <logger/logger.hpp>
+#include <limits>
+#include <algorithm>
+
+namespace game_terrains {
+
+bool decode_chunk_source( models::model_loader& model,
+                          std::vector< Chunk_source_mesh >& meshes )
+{
+    meshes.clear();
+    for ( auto&& mesh : model.get_mesh() ) {
+        const auto& vertex_data = mesh->get_vertex_data();
+        const auto& index_data = mesh->get_index_data();
+        if ( vertex_data.empty() || index_data.empty() ) {
+            return false;
+        }
+        Chunk_source_mesh source;
+        source.diffuse_array = mesh->get_diffuse_array();
+        source.specular_array = mesh->get_specular_array();
+        source.layers = mesh->get_texture_layers();
+        const std::size_t vertex_count = vertex_data.size() /
+                                         models::vertex_stride( mesh->get_vertex_format() );
+        source.vertices.reserve( vertex_count );
+        for ( std::size_t idx{ 0 } ; idx < vertex_count ; ++idx ) {
+            source.vertices.push_back( models::unpack_vertex( vertex_data.data(),
+                                       mesh->get_vertex_format(),
+                                       mesh->get_dequantization(),
+                                       idx ) );
+        }
+        const std::size_t index_count = index_data.size() /
+                                        models::index_size( mesh->get_index_type() );
+        source.indices.reserve( index_count );
+        for ( std::size_t idx{ 0 } ; idx < index_count ; ++idx ) {
+            source.indices.push_back( models::index_at( index_data.data(),
+                                      mesh->get_index_type(),
+                                      idx ) );
+        }
+        meshes.push_back( std::move( source ) );
+    }
+    return true;
+}
+
+namespace {
+
+uint32_t pack_color( const types::color& color )
+{
+    uint32_t packed{ 0 };
+    for ( int i{ 3 } ; i >= 0 ; --i ) {
+        const GLfloat value = glm::clamp( color[ i ], 0.0f, 1.0f );
+        packed = packed << 8 | static_cast< uint32_t >( std::round( value * 255.0f ) );
+    }
+    return packed;
+}
+
+Chunk_batch_geometry& find_batch( Chunk_geometry& geometry,
+                                  const Chunk_source_mesh& mesh )
+{
+    for ( auto&& batch : geometry.batches ) {
+        if ( batch.diffuse_array == mesh.diffuse_array &&
+             batch.specular_array == mesh.specular_array ) {
+            return batch;
+        }
+    }
+    geometry.batches.emplace_back();
+    auto& batch = geometry.batches.back();
+    batch.diffuse_array = mesh.diffuse_array;
+    batch.specular_array = mesh.specular_array;
+    return batch;
+}
+
+}
+
+Chunk_geometry bake_chunk( const std::vector< std::shared_ptr< Terrain_lot > >& lots,
+                           const chunk_sources& sources )
+{
+    Chunk_geometry geometry;
+    for ( auto&& lot : lots ) {
+        if ( nullptr == lot ) {
+            continue;
+        }
+        auto source = sources.find( lot->terrain_model_id );
+        if ( source == sources.end() ) {
+            continue;
+        }
+        //The lot model matrix is a translation
+        const glm::vec3 offset( lot->rendering_data.model_matrix[3] );
+        for ( auto&& mesh : source->second ) {
+            auto& batch = find_batch( geometry, mesh );
+            const GLuint base_vertex = batch.vertices.size();
+            if ( batch.lots.empty() || batch.lots.back().lot != lot ) {
+                batch.lots.push_back( { lot,
+                                        static_cast< GLuint >( batch.indices.size() ),
+                                        0,
+                                        base_vertex,
+                                        0
+                                      } );
+            }
+            for ( auto vertex : mesh.vertices ) {
+                vertex.coordinate += offset;
+                batch.vertices.push_back( vertex );
+            }
+            batch.layers.insert( batch.layers.end(), mesh.vertices.size(), mesh.layers );
+            for ( auto index : mesh.indices ) {
+                batch.indices.push_back( base_vertex + index );
+            }
+            batch.lots.back().index_count += mesh.indices.size();
+            batch.lots.back().vertex_count += mesh.vertices.size();
+        }
+    }
+    return geometry;
+}
+
+void set_picking_colors( Chunk_geometry& geometry,
+                         const renderer::Core_renderer_proxy& renderer )
+{
+    for ( auto&& batch : geometry.batches ) {
+        batch.picking_colors.resize( batch.vertices.size() );
+        for ( auto&& range : batch.lots ) {
+            const uint32_t color = pack_color( renderer.picking_color( range.lot ) );
+            std::fill_n( batch.picking_colors.begin() + range.first_vertex,
+                         range.vertex_count, color );
+        }
+    }
+}
+
+Terrain_chunk::Terrain_chunk( Chunk_geometry&& geometry ) :
+    baked_bytes{ 0 }
+{
+    glm::vec3 bounds_min( std::numeric_limits< GLfloat >::max() );
+    glm::vec3 bounds_max( std::numeric_limits< GLfloat >::lowest() );
+    for ( auto&& batch : geometry.batches ) {
+        for ( auto&& vertex : batch.vertices ) {
+            bounds_min = glm::min( bounds_min, vertex.coordinate );
+            bounds_max = glm::max( bounds_max, vertex.coordinate );
+        }
+    }
+    for ( auto&& batch : geometry.batches ) {
+        if ( false == batch.indices.empty() ) {
+            upload_batch( batch );
+        }
+    }
+    if ( false == batches.empty() ) {
+        //The geometry is in world space, identity model matrix
+        rendering_data.position = ( bounds_min + bounds_max ) / 2.0f;
+        rendering_data.bounding_radius = glm::length( bounds_max - bounds_min ) / 2.0f;
+    }
+    LOG0( "New terrain chunk, batches: ", batches.size(),
+          ", bytes: ", baked_bytes );
+}
+
+Terrain_chunk::~Terrain_chunk()
+{
+    for ( auto&& batch : batches ) {
+        glDeleteBuffers( 1, &batch.CBO );
+        glDeleteBuffers( 1, &batch.LBO );
+        glDeleteBuffers( 1, &batch.EBO );
+        glDeleteBuffers( 1, &batch.VBO );
+        glDeleteVertexArrays( 1, &batch.VAO );
+    }
+}
+
+void Terrain_chunk::upload_batch( Chunk_batch_geometry& geometry )
+{
+    Batch batch;
+    batch.diffuse_array = geometry.diffuse_array;
+    batch.specular_array = geometry.specular_array;
+    batch.lots = std::move( geometry.lots );
+    batch.index_type = models::index_type_for( geometry.vertices.size() );
+    batch.format = models::vertex_format::full;
+
+    glm::vec3 bounds_min( std::numeric_limits< GLfloat >::max() );
+    glm::vec3 bounds_max( std::numeric_limits< GLfloat >::lowest() );
+    for ( auto&& vertex : geometry.vertices ) {
+        bounds_min = glm::min( bounds_min, vertex.coordinate );
+        bounds_max = glm::max( bounds_max, vertex.coordinate );
+    }
+    std::vector< models::packed_vertex_t > packed;
+    const void* vertex_data = geometry.vertices.data();
+    if ( models::pack_vertices( geometry.vertices.data(), geometry.vertices.size(),
+                                bounds_min, bounds_max,
+                                packed, batch.dequantization ) ) {
+        batch.format = models::vertex_format::packed;
+        vertex_data = packed.data();
+    }
+    std::vector< GLushort > short_indices;
+    const void* index_data = geometry.indices.data();
+    if ( batch.index_type == GL_UNSIGNED_SHORT ) {
+        short_indices = models::narrow_indices( geometry.indices );
+        index_data = short_indices.data();
+    }
+    const std::size_t vertex_bytes = geometry.vertices.size() *
+                                     models::vertex_stride( batch.format );
+    const std::size_t index_bytes = geometry.indices.size() *
+                                    models::index_size( batch.index_type );
+    const std::size_t layer_bytes = geometry.layers.size() * sizeof( glm::vec2 );
+    const std::size_t color_bytes = geometry.picking_colors.size() * sizeof( uint32_t );
+
+    glGenVertexArrays( 1, &batch.VAO );
+    glGenBuffers( 1, &batch.VBO );
+    glGenBuffers( 1, &batch.EBO );
+    glGenBuffers( 1, &batch.LBO );
+    glGenBuffers( 1, &batch.CBO );
+
+    glBindVertexArray( batch.VAO );
+    glBindBuffer( GL_ARRAY_BUFFER, batch.VBO );
+    glBufferData( GL_ARRAY_BUFFER, vertex_bytes, vertex_data, GL_STATIC_DRAW );
+    models::setup_vertex_attributes( batch.format );
+
+    glBindBuffer( GL_ELEMENT_ARRAY_BUFFER, batch.EBO );
+    glBufferData( GL_ELEMENT_ARRAY_BUFFER, index_bytes, index_data, GL_STATIC_DRAW );
+
+    glBindBuffer( GL_ARRAY_BUFFER, batch.LBO );
+    glBufferData( GL_ARRAY_BUFFER, layer_bytes, geometry.layers.data(), GL_STATIC_DRAW );
+    glEnableVertexAttribArray( models::texture_layers_attribute );
+    glVertexAttribPointer( models::texture_layers_attribute, 2, GL_FLOAT, GL_FALSE, sizeof( glm::vec2 ),
+                           ( GLvoid* )0 );
+
+    glBindBuffer( GL_ARRAY_BUFFER, batch.CBO );
+    glBufferData( GL_ARRAY_BUFFER, color_bytes, geometry.picking_colors.data(),
+                  GL_STATIC_DRAW );
+    glEnableVertexAttribArray( 4 );
+    glVertexAttribPointer( 4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof( uint32_t ),
+                           ( GLvoid* )0 );
+
+    glBindBuffer( GL_ARRAY_BUFFER, 0 );
+    glBindVertexArray( 0 );
+
+    baked_bytes += vertex_bytes + index_bytes + layer_bytes + color_bytes;
+    batches.push_back( std::move( batch ) );
+}
+
+void Terrain_chunk::bind_batch( const Batch& batch ) const
+{
+    glBindVertexArray( batch.VAO );
+    if ( batch.diffuse_array != 0 ) {
+        textures::arrays().bind( textures::diffuse_array_unit, batch.diffuse_array );
+    }
+    if ( batch.specular_array != 0 ) {
+        textures::arrays().bind( textures::specular_array_unit, batch.specular_array );
+    }
+    if ( batch.format == models::vertex_format::packed ) {
+        rendering_data.shader->set_uniform( shaders::uniforms::position_offset,
+                                            glm::vec4( batch.dequantization.offset, 0.0f ) );
+        rendering_data.shader->set_uniform( shaders::uniforms::position_scale,
+                                            glm::vec4( batch.dequantization.scale, 1.0f ) );
+    }
+}
+
+void Terrain_chunk::unbind_batch( const Batch& batch ) const
+{
+    if ( batch.format == models::vertex_format::packed ) {
+        //Back to the identity, for the full precision vertices
+        rendering_data.shader->set_uniform( shaders::uniforms::position_offset,
+                                            glm::vec4( 0.0f ) );
+        rendering_data.shader->set_uniform( shaders::uniforms::position_scale,
+                                            glm::vec4( 1.0f ) );
+    }
+    glBindVertexArray( 0 );
+}
+
+void Terrain_chunk::draw_runs( const Batch& batch,
+                               const bool split_by_color ) const
+{
+    const std::size_t index_bytes = models::index_size( batch.index_type );
+    GLuint run_first{ 0 };
+    GLuint run_end{ 0 };
+    const types::color* run_color{ nullptr };
+    auto flush = [&]() {
+        if ( run_end == run_first ) {
+            return;
+        }
+        if ( split_by_color ) {
+            rendering_data.shader->set_uniform( shaders::uniforms::object_color,
+                                                *run_color );
+        }
+        glDrawElements( GL_TRIANGLES,
+                        run_end - run_first,
+                        batch.index_type,
+                        ( GLvoid* )( run_first * index_bytes ) );
+    };
+    for ( auto&& range : batch.lots ) {
+        //The enabled lots are rendered by themselves
+        if ( renderer::Rendering_state::states::rendering_enabled ==
+             range.lot->rendering_state.current() ) {
+            continue;
+        }
+        const types::color& color = range.lot->rendering_data.default_color;
+        if ( nullptr == run_color || range.first_index != run_end ||
+             ( split_by_color && color != *run_color ) ) {
+            flush();
+            run_first = range.first_index;
+        }
+        run_end = range.first_index + range.index_count;
+        run_color = &color;
+    }
+    flush();
+}
+
+bool Terrain_chunk::render( )
+{
+    for ( auto&& batch : batches ) {
+        bind_batch( batch );
+        draw_runs( batch, true );
+        unbind_batch( batch );
+    }
+    return true;
+}
+
+bool Terrain_chunk::render_picking( )
+{
+    rendering_data.shader->set_uniform( shaders::uniforms::per_vertex_color,
+                                        static_cast< GLint >( 1 ) );
+    for ( auto&& batch : batches ) {
+        bind_batch( batch );
+        draw_runs( batch, false );
+        unbind_batch( batch );
+    }
+    rendering_data.shader->set_uniform( shaders::uniforms::per_vertex_color,
+                                        static_cast< GLint >( 0 ) );
+    return true;
+}
+
+std::string Terrain_chunk::nice_name()
+{
+    return "Terrain_chunk";
+}
+
+uint64_t Terrain_chunk::get_baked_bytes() const
+{
+    return baked_bytes;
+}
+
+std::size_t Terrain_chunk::get_batch_count() const
+{
+    return batches.size();
+}
+
+}
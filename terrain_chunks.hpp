@@ -0,0 +1,167 @@
+#ifndef TERRAIN_CHUNKS_HPP
+#define TERRAIN_CHUNKS_HPP
+
+#include <headers.hpp>
+#include <renderable_object.hpp>
+#include <vertex_layout.hpp>
+#include <models.hpp>
+#include <types.hpp>
+#include <unordered_map>
+#include <vector>
+
+namespace game_terrains {
+
+class Terrain_lot;
+
+/*
+ * Side of the chunks, in lots
+ */
+constexpr std::size_t default_chunk_size{ 16 };
+/*
+ * The chunks closer than the distance from the
+ * camera (world units) are streamed in, and
+ * released beyond distance * release factor
+ */
+constexpr GLfloat default_chunk_distance{ 100.0f };
+constexpr GLfloat chunk_release_factor{ 1.25f };
+/*
+ * Built chunks registered and uploaded per update,
+ * bounds the cost of the streaming on the frame
+ */
+constexpr std::size_t max_chunk_uploads_per_update{ 2 };
+
+struct Chunk_stream_stats {
+    std::size_t resident_chunks{ 0 };
+    std::size_t pending_chunks{ 0 };
+    std::size_t resident_lots{ 0 };
+    std::size_t stream_ins{ 0 };
+    std::size_t releases{ 0 };
+    uint64_t    baked_bytes{ 0 };
+};
+
+/*
+ * One mesh of the low res model of a terrain,
+ * decoded once for the baking of all the chunks
+ */
+struct Chunk_source_mesh {
+    GLuint diffuse_array{ 0 };
+    GLuint specular_array{ 0 };
+    glm::vec2 layers{ 0.0f };
+    std::vector< models::vertex_t > vertices;
+    std::vector< GLuint > indices;
+};
+
+/*
+ * Map a terrain ID to the meshes of its low res model
+ */
+using chunk_sources = std::unordered_map< long, std::vector< Chunk_source_mesh > >;
+
+/*
+ * Decode the meshes of the model, which must
+ * be loaded with mesh_retention::everything.
+ * False if the CPU copy of the data is missing
+ */
+bool decode_chunk_source( models::model_loader& model,
+                          std::vector< Chunk_source_mesh >& meshes );
+
+/*
+ * Index and vertex ranges of a lot
+ * in the buffers of a chunk batch
+ */
+struct Chunk_lot_range {
+    std::shared_ptr< Terrain_lot > lot;
+    GLuint first_index;
+    GLuint index_count;
+    GLuint first_vertex;
+    GLuint vertex_count;
+};
+
+/*
+ * The geometry of the lots using the same texture
+ * arrays, pre-transformed in world space
+ */
+struct Chunk_batch_geometry {
+    GLuint diffuse_array{ 0 };
+    GLuint specular_array{ 0 };
+    std::vector< models::vertex_t > vertices;
+    std::vector< glm::vec2 > layers;
+    //RGBA8 picking color of the lot owning the vertex
+    std::vector< uint32_t > picking_colors;
+    std::vector< GLuint > indices;
+    //In the order of the index buffer
+    std::vector< Chunk_lot_range > lots;
+};
+
+struct Chunk_geometry {
+    std::vector< Chunk_batch_geometry > batches;
+};
+
+/*
+ * Build the geometry of the chunk, no GL calls
+ * are performed: safe from the worker threads.
+ * The picking colors are set later, by the
+ * thread which registers the lots
+ */
+Chunk_geometry bake_chunk( const std::vector< std::shared_ptr< Terrain_lot > >& lots,
+                           const chunk_sources& sources );
+void set_picking_colors( Chunk_geometry& geometry,
+                         const renderer::Core_renderer_proxy& renderer );
+
+/*
+ * Static geometry of a square of lots, drawn with one
+ * draw call for each texture array pair instead of
+ * one per lot and mesh.
+ *
+ * The lots stay registered in the renderer, for the
+ * picking, but are disabled: a lot which is enabled
+ * (like the lots rendered with the high res model)
+ * draws itself and is skipped by the chunk. The draws
+ * are split only where the color of the lots
+ * changes, like for the selected lots.
+ */
+class Terrain_chunk : public renderer::Renderable
+{
+public:
+    using pointer = std::shared_ptr< Terrain_chunk >;
+    /*
+     * Upload the baked geometry, from
+     * the thread owning the GL context
+     */
+    explicit Terrain_chunk( Chunk_geometry&& geometry );
+    ~Terrain_chunk();
+
+    bool render( ) override;
+    bool render_picking( ) override;
+    std::string nice_name() override;
+
+    uint64_t get_baked_bytes() const;
+    std::size_t get_batch_count() const;
+private:
+    struct Batch {
+        GLuint VAO, VBO, EBO;
+        //Texture array layers and picking colors
+        GLuint LBO, CBO;
+        GLuint diffuse_array;
+        GLuint specular_array;
+        GLenum index_type;
+        models::vertex_format format;
+        models::position_dequantization dequantization;
+        std::vector< Chunk_lot_range > lots;
+    };
+    void upload_batch( Chunk_batch_geometry& geometry );
+    void bind_batch( const Batch& batch ) const;
+    void unbind_batch( const Batch& batch ) const;
+    /*
+     * Draw the lots not rendered by themselves, in
+     * runs of consecutive lots. With split_by_color
+     * a run contains only lots of the same color
+     */
+    void draw_runs( const Batch& batch,
+                    const bool split_by_color ) const;
+    std::vector< Batch > batches;
+    uint64_t baked_bytes;
+};
+
+}
+
+#endif //TERRAIN_CHUNKS_HPP
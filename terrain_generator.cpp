@@ -0,0 +1,353 @@
+#include <terrain_generator.hpp>
+#include <map_file.hpp>
+#include <thread_pool.hpp>
+#include <logger/logger.hpp>
+#include <algorithm>
+#include <cmath>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace game_terrains {
+
+namespace {
+
+/*
+ * Lattice hash, the SSE2 version below
+ * must give the same results
+ */
+constexpr uint32_t hash_prime_x{ 0x27D4EB2Du };
+constexpr uint32_t hash_prime_y{ 0x165667B1u };
+constexpr uint32_t hash_mix_1{ 0x2C1B3C6Du };
+constexpr uint32_t hash_mix_2{ 0x297A2D39u };
+constexpr uint32_t octave_seed_step{ 0x9E3779B9u };
+constexpr GLfloat  lattice_value_scale{ 2.0f / 16777215.0f };
+
+uint32_t lattice_hash( const int32_t x,
+                       const int32_t y,
+                       const uint32_t seed )
+{
+    uint32_t hash = static_cast< uint32_t >( x ) * hash_prime_x +
+                    static_cast< uint32_t >( y ) * hash_prime_y + seed;
+    hash ^= hash >> 15;
+    hash *= hash_mix_1;
+    hash ^= hash >> 12;
+    hash *= hash_mix_2;
+    hash ^= hash >> 15;
+    return hash;
+}
+
+//In [-1,1]
+GLfloat lattice_value( const int32_t x,
+                       const int32_t y,
+                       const uint32_t seed )
+{
+    return static_cast< GLfloat >( static_cast< int32_t >( lattice_hash( x, y, seed ) >> 8 ) ) *
+           lattice_value_scale - 1.0f;
+}
+
+//Quintic, continuous second derivative
+GLfloat fade( const GLfloat t )
+{
+    return t * t * t * ( t * ( t * 6.0f - 15.0f ) + 10.0f );
+}
+
+GLfloat value_noise( const GLfloat px,
+                     const GLfloat py,
+                     const uint32_t seed )
+{
+    const GLfloat fx = std::floor( px );
+    const GLfloat fy = std::floor( py );
+    const int32_t ix = static_cast< int32_t >( fx );
+    const int32_t iy = static_cast< int32_t >( fy );
+    const GLfloat u = fade( px - fx );
+    const GLfloat v = fade( py - fy );
+    const GLfloat v00 = lattice_value( ix, iy, seed );
+    const GLfloat v10 = lattice_value( ix + 1, iy, seed );
+    const GLfloat v01 = lattice_value( ix, iy + 1, seed );
+    const GLfloat v11 = lattice_value( ix + 1, iy + 1, seed );
+    const GLfloat bottom = v00 + ( v10 - v00 ) * u;
+    const GLfloat top = v01 + ( v11 - v01 ) * u;
+    return bottom + ( top - bottom ) * v;
+}
+
+GLfloat fractal_noise( const Noise_parameters& params,
+                       const uint32_t seed,
+                       const GLfloat x,
+                       const GLfloat y )
+{
+    GLfloat sum{ 0.0f };
+    GLfloat amplitude{ 1.0f };
+    GLfloat total_amplitude{ 0.0f };
+    GLfloat frequency = params.frequency;
+    uint32_t octave_seed = seed;
+    for ( std::size_t octave{ 0 } ; octave < params.octaves ; ++octave ) {
+        GLfloat value = value_noise( x * frequency, y * frequency, octave_seed );
+        if ( params.ridged ) {
+            value = 1.0f - 2.0f * std::fabs( value );
+        }
+        sum += value * amplitude;
+        total_amplitude += amplitude;
+        amplitude *= params.gain;
+        frequency *= params.lacunarity;
+        octave_seed += octave_seed_step;
+    }
+    if ( total_amplitude <= 0.0f ) {
+        return 0.5f;
+    }
+    //As the SSE2 version, same rounding
+    return sum * ( 0.5f / total_amplitude ) + 0.5f;
+}
+
+#ifdef __SSE2__
+
+//SSE2 has no 32 bit multiplication, see _mm_mullo_epi32 in SSE4.1
+__m128i mullo_epi32( const __m128i a, const __m128i b )
+{
+    const __m128i even = _mm_mul_epu32( a, b );
+    const __m128i odd = _mm_mul_epu32( _mm_srli_si128( a, 4 ), _mm_srli_si128( b, 4 ) );
+    return _mm_unpacklo_epi32( _mm_shuffle_epi32( even, _MM_SHUFFLE( 0, 0, 2, 0 ) ),
+                               _mm_shuffle_epi32( odd, _MM_SHUFFLE( 0, 0, 2, 0 ) ) );
+}
+
+__m128 lattice_value4( const __m128i x,
+                       const __m128i y,
+                       const __m128i seed )
+{
+    __m128i hash = _mm_add_epi32( _mm_add_epi32( mullo_epi32( x, _mm_set1_epi32( hash_prime_x ) ),
+                                  mullo_epi32( y, _mm_set1_epi32( hash_prime_y ) ) ),
+                                  seed );
+    hash = _mm_xor_si128( hash, _mm_srli_epi32( hash, 15 ) );
+    hash = mullo_epi32( hash, _mm_set1_epi32( hash_mix_1 ) );
+    hash = _mm_xor_si128( hash, _mm_srli_epi32( hash, 12 ) );
+    hash = mullo_epi32( hash, _mm_set1_epi32( hash_mix_2 ) );
+    hash = _mm_xor_si128( hash, _mm_srli_epi32( hash, 15 ) );
+    return _mm_sub_ps( _mm_mul_ps( _mm_cvtepi32_ps( _mm_srli_epi32( hash, 8 ) ),
+                                   _mm_set1_ps( lattice_value_scale ) ),
+                       _mm_set1_ps( 1.0f ) );
+}
+
+__m128 fade4( const __m128 t )
+{
+    const __m128 inner = _mm_add_ps( _mm_mul_ps( t, _mm_sub_ps( _mm_mul_ps( t, _mm_set1_ps( 6.0f ) ),
+                                     _mm_set1_ps( 15.0f ) ) ),
+                                     _mm_set1_ps( 10.0f ) );
+    return _mm_mul_ps( _mm_mul_ps( _mm_mul_ps( t, t ), t ), inner );
+}
+
+//Integer floor and its float value, no SSE4.1 _mm_floor_ps
+__m128i floor4( const __m128 value, __m128& floored )
+{
+    const __m128i truncated = _mm_cvttps_epi32( value );
+    //The mask is -1 where the truncation rounded up
+    const __m128 rounded_up = _mm_cmpgt_ps( _mm_cvtepi32_ps( truncated ), value );
+    const __m128i result = _mm_add_epi32( truncated, _mm_castps_si128( rounded_up ) );
+    floored = _mm_cvtepi32_ps( result );
+    return result;
+}
+
+__m128 value_noise4( const __m128 px,
+                     const __m128 py,
+                     const __m128i seed )
+{
+    __m128 fx, fy;
+    const __m128i ix = floor4( px, fx );
+    const __m128i iy = floor4( py, fy );
+    const __m128i one = _mm_set1_epi32( 1 );
+    const __m128 u = fade4( _mm_sub_ps( px, fx ) );
+    const __m128 v = fade4( _mm_sub_ps( py, fy ) );
+    const __m128 v00 = lattice_value4( ix, iy, seed );
+    const __m128 v10 = lattice_value4( _mm_add_epi32( ix, one ), iy, seed );
+    const __m128 v01 = lattice_value4( ix, _mm_add_epi32( iy, one ), seed );
+    const __m128 v11 = lattice_value4( _mm_add_epi32( ix, one ), _mm_add_epi32( iy, one ), seed );
+    const __m128 bottom = _mm_add_ps( v00, _mm_mul_ps( _mm_sub_ps( v10, v00 ), u ) );
+    const __m128 top = _mm_add_ps( v01, _mm_mul_ps( _mm_sub_ps( v11, v01 ), u ) );
+    return _mm_add_ps( bottom, _mm_mul_ps( _mm_sub_ps( top, bottom ), v ) );
+}
+
+#endif
+
+}
+
+void fractal_noise_row( const Noise_parameters& params,
+                        const uint32_t seed,
+                        const long x,
+                        const long y,
+                        const std::size_t count,
+                        GLfloat* samples )
+{
+    const GLfloat sample_y = static_cast< GLfloat >( y );
+    std::size_t idx{ 0 };
+#ifdef __SSE2__
+    GLfloat total_amplitude{ 0.0f };
+    GLfloat amplitude{ 1.0f };
+    for ( std::size_t octave{ 0 } ; octave < params.octaves ; ++octave ) {
+        total_amplitude += amplitude;
+        amplitude *= params.gain;
+    }
+    if ( total_amplitude > 0.0f ) {
+        const __m128 lane_offsets = _mm_set_ps( 3.0f, 2.0f, 1.0f, 0.0f );
+        const __m128 sign_mask = _mm_set1_ps( -0.0f );
+        const __m128 scale = _mm_set1_ps( 0.5f / total_amplitude );
+        const __m128 half = _mm_set1_ps( 0.5f );
+        for ( ; idx + 4 <= count ; idx += 4 ) {
+            const GLfloat first_x = static_cast< GLfloat >( x + static_cast< long >( idx ) );
+            const __m128 lanes_x = _mm_add_ps( _mm_set1_ps( first_x ), lane_offsets );
+            const __m128 lanes_y = _mm_set1_ps( sample_y );
+            __m128 sum = _mm_setzero_ps();
+            GLfloat amplitude{ 1.0f };
+            GLfloat frequency = params.frequency;
+            uint32_t octave_seed = seed;
+            for ( std::size_t octave{ 0 } ; octave < params.octaves ; ++octave ) {
+                const __m128 freq = _mm_set1_ps( frequency );
+                __m128 value = value_noise4( _mm_mul_ps( lanes_x, freq ),
+                                             _mm_mul_ps( lanes_y, freq ),
+                                             _mm_set1_epi32( octave_seed ) );
+                if ( params.ridged ) {
+                    value = _mm_sub_ps( _mm_set1_ps( 1.0f ),
+                                        _mm_mul_ps( _mm_set1_ps( 2.0f ),
+                                                    _mm_andnot_ps( sign_mask, value ) ) );
+                }
+                sum = _mm_add_ps( sum, _mm_mul_ps( value, _mm_set1_ps( amplitude ) ) );
+                amplitude *= params.gain;
+                frequency *= params.lacunarity;
+                octave_seed += octave_seed_step;
+            }
+            _mm_storeu_ps( &samples[ idx ], _mm_add_ps( _mm_mul_ps( sum, scale ), half ) );
+        }
+    }
+#endif
+    for ( ; idx < count ; ++idx ) {
+        samples[ idx ] = fractal_noise( params, seed,
+                                        static_cast< GLfloat >( x + static_cast< long >( idx ) ),
+                                        sample_y );
+    }
+}
+
+Noise_terrain_source::Noise_terrain_source( const Generator_settings& settings ) :
+    settings{ settings },
+    elevation_seed{ static_cast< uint32_t >( settings.seed ^ ( settings.seed >> 32 ) ) },
+    moisture_seed{ lattice_hash( static_cast< int32_t >( settings.seed ),
+                                 static_cast< int32_t >( settings.seed >> 32 ),
+                                 octave_seed_step ) }
+{
+    if ( settings.biomes.empty() ) {
+        PANIC( "No biomes for the generated terrain!" );
+    }
+    LOG3( "New noise terrain source, biomes: ",
+          settings.biomes.size(), ", seed: ", settings.seed );
+}
+
+long Noise_terrain_source::biome_terrain( const GLfloat elevation,
+        const GLfloat moisture ) const
+{
+    for ( auto&& biome : settings.biomes ) {
+        if ( elevation >= biome.elevation.x && elevation < biome.elevation.y &&
+             moisture >= biome.moisture.x && moisture < biome.moisture.y ) {
+            return biome.terrain_id;
+        }
+    }
+    return -1;
+}
+
+long Noise_terrain_source::terrain_id( const long x, const long y ) const
+{
+    long id;
+    terrain_ids( x, y, 1, 1, &id );
+    return id;
+}
+
+void Noise_terrain_source::terrain_ids( const long x,
+                                        const long y,
+                                        const std::size_t width,
+                                        const std::size_t height,
+                                        long* ids ) const
+{
+    std::vector< GLfloat > elevation( width );
+    std::vector< GLfloat > moisture( width );
+    for ( std::size_t row{ 0 } ; row < height ; ++row ) {
+        fractal_noise_row( settings.elevation, elevation_seed,
+                           x, y + static_cast< long >( row ), width, elevation.data() );
+        fractal_noise_row( settings.moisture, moisture_seed,
+                           x, y + static_cast< long >( row ), width, moisture.data() );
+        for ( std::size_t col{ 0 } ; col < width ; ++col ) {
+            *ids++ = biome_terrain( elevation[ col ], moisture[ col ] );
+        }
+    }
+}
+
+terrain_map_t generate_terrain_map( const Generator_settings& settings,
+                                    const std::size_t width,
+                                    const std::size_t height,
+                                    const std::size_t chunk_size )
+{
+    terrain_map_t map( height, std::vector< long >( width ) );
+    const std::size_t size = std::max< std::size_t >( chunk_size, 1 );
+    const std::size_t chunks_x = ( width + size - 1 ) / size;
+    const std::size_t chunks_y = ( height + size - 1 ) / size;
+    const Noise_terrain_source source( settings );
+    workers::pool().parallel_for( chunks_x * chunks_y, 1,
+    [ & ]( const std::size_t begin, const std::size_t end ) {
+        std::vector< long > ids( size * size );
+        for ( std::size_t chunk{ begin } ; chunk < end ; ++chunk ) {
+            const std::size_t first_x = ( chunk % chunks_x ) * size;
+            const std::size_t first_y = ( chunk / chunks_x ) * size;
+            const std::size_t chunk_width = std::min( size, width - first_x );
+            const std::size_t chunk_height = std::min( size, height - first_y );
+            source.terrain_ids( first_x, first_y, chunk_width, chunk_height, ids.data() );
+            for ( std::size_t y{ 0 } ; y < chunk_height ; ++y ) {
+                std::copy( ids.begin() + y * chunk_width,
+                           ids.begin() + ( y + 1 ) * chunk_width,
+                           map[ first_y + y ].begin() + first_x );
+            }
+        }
+    } );
+    LOG1( "Generated a terrain map, size: ", width, "x", height );
+    return map;
+}
+
+bool generate_binary_map( const std::string& path,
+                          const Generator_settings& settings,
+                          const std::size_t width,
+                          const std::size_t height,
+                          const glm::vec2 central_lot,
+                          const uint32_t block_size )
+{
+    /*
+     * The palette contains the terrain of each biome,
+     * and -1 for the lots not matching any of them
+     */
+    std::vector< int64_t > palette{ -1 };
+    for ( auto&& biome : settings.biomes ) {
+        if ( std::find( palette.begin(), palette.end(), biome.terrain_id ) == palette.end() ) {
+            palette.push_back( biome.terrain_id );
+        }
+    }
+    if ( block_size == 0 || palette.size() > 65536 ) {
+        ERR( "Invalid block size or too many biomes" );
+        return false;
+    }
+    const Noise_terrain_source source( settings );
+    return write_binary_map( path, width, height, central_lot, block_size,
+                             palette, 0,
+                             [ & ]( const std::size_t block_x,
+                                    const std::size_t block_y,
+                                    uint16_t* tiles,
+    uint8_t* ) {
+        const std::size_t first_x = block_x * block_size;
+        const std::size_t first_y = block_y * block_size;
+        const std::size_t block_width = std::min< std::size_t >( block_size, width - first_x );
+        const std::size_t block_height = std::min< std::size_t >( block_size, height - first_y );
+        std::vector< long > ids( block_width * block_height );
+        source.terrain_ids( first_x, first_y, block_width, block_height, ids.data() );
+        for ( std::size_t y{ 0 } ; y < block_height ; ++y ) {
+            for ( std::size_t x{ 0 } ; x < block_width ; ++x ) {
+                const long id = ids[ y * block_width + x ];
+                tiles[ y * block_size + x ] = std::find( palette.begin(), palette.end(), id ) -
+                                              palette.begin();
+            }
+        }
+    } );
+}
+
+}
@@ -0,0 +1,102 @@
+#ifndef TERRAIN_GENERATOR_HPP
+#define TERRAIN_GENERATOR_HPP
+
+#include <terrain_sources.hpp>
+#include <terrain_chunks.hpp>
+#include <string>
+
+namespace game_terrains {
+
+/*
+ * Fractal (fBm) value noise, frequency is in cycles
+ * per lot. Each octave multiply the frequency by the
+ * lacunarity and the amplitude by the gain. The ridged
+ * noise folds each octave, for mountain ranges
+ */
+struct Noise_parameters {
+    GLfloat     frequency{ 1.0f / 64.0f };
+    std::size_t octaves{ 5 };
+    GLfloat     lacunarity{ 2.0f };
+    GLfloat     gain{ 0.5f };
+    bool        ridged{ false };
+};
+
+/*
+ * A terrain used where the elevation and the moisture
+ * (both in [0,1]) are in the given [min,max) ranges
+ */
+struct Biome {
+    long      terrain_id;
+    glm::vec2 elevation{ 0.0f, 1.0f };
+    glm::vec2 moisture{ 0.0f, 1.0f };
+};
+
+struct Generator_settings {
+    uint64_t         seed{ 0 };
+    Noise_parameters elevation;
+    Noise_parameters moisture;
+    //The first matching biome is used, no lot if none match
+    std::vector< Biome > biomes;
+};
+
+/*
+ * Compute count fBm samples of the noise along the x
+ * axis, starting from the lot x,y. The samples are in
+ * [0,1]. Four samples at once with SSE2
+ */
+void fractal_noise_row( const Noise_parameters& params,
+                        const uint32_t seed,
+                        const long x,
+                        const long y,
+                        const std::size_t count,
+                        GLfloat* samples );
+
+/*
+ * Unbounded procedural terrain. The noise is a pure
+ * function of the seed and of the lot coordinates,
+ * any chunk is generated independently from the others
+ * and in any order, without seams on the borders
+ */
+class Noise_terrain_source : public Terrain_source
+{
+public:
+    using pointer = std::shared_ptr< Noise_terrain_source >;
+    explicit Noise_terrain_source( const Generator_settings& settings );
+    long terrain_id( const long x, const long y ) const override;
+    void terrain_ids( const long x,
+                      const long y,
+                      const std::size_t width,
+                      const std::size_t height,
+                      long* ids ) const override;
+private:
+    long biome_terrain( const GLfloat elevation,
+                        const GLfloat moisture ) const;
+    Generator_settings settings;
+    uint32_t elevation_seed;
+    uint32_t moisture_seed;
+};
+
+/*
+ * Generate the width X height lots starting at 0,0,
+ * one chunk_size X chunk_size square per task on the
+ * worker threads
+ */
+terrain_map_t generate_terrain_map( const Generator_settings& settings,
+                                    const std::size_t width,
+                                    const std::size_t height,
+                                    const std::size_t chunk_size = default_chunk_size );
+
+/*
+ * As above, the lots are written directly in the
+ * blocks of a binary map (see map_file.hpp)
+ */
+bool generate_binary_map( const std::string& path,
+                          const Generator_settings& settings,
+                          const std::size_t width,
+                          const std::size_t height,
+                          const glm::vec2 central_lot,
+                          const uint32_t block_size = default_chunk_size );
+
+}
+
+#endif //TERRAIN_GENERATOR_HPP
@@ -0,0 +1,71 @@
+#include <terrain_sources.hpp>
+#include <logger/logger.hpp>
+
+namespace game_terrains {
+
+void Terrain_source::terrain_ids( const long x,
+                                  const long y,
+                                  const std::size_t width,
+                                  const std::size_t height,
+                                  long* ids ) const
+{
+    for ( std::size_t row{ 0 } ; row < height ; ++row ) {
+        for ( std::size_t col{ 0 } ; col < width ; ++col ) {
+            *ids++ = terrain_id( x + static_cast< long >( col ),
+                                 y + static_cast< long >( row ) );
+        }
+    }
+}
+
+Map_terrain_source::Map_terrain_source( const terrain_map_t& map,
+                                        const glm::vec2 central_lot ) :
+    width{ map.empty() ? 0 : static_cast< long >( map[0].size() ) },
+    height{ static_cast< long >( map.size() ) },
+    origin_x{ std::lround( central_lot.x ) },
+    origin_y{ std::lround( central_lot.y ) }
+{
+    ids.reserve( width * height );
+    for ( auto&& row : map ) {
+        if ( static_cast< long >( row.size() ) != width ) {
+            PANIC( "The provided terrain map is not a quad!" );
+        }
+        ids.insert( ids.end(), row.begin(), row.end() );
+    }
+    LOG3( "New map terrain source, size: ", width, "x", height );
+}
+
+long Map_terrain_source::terrain_id( const long x, const long y ) const
+{
+    const long map_x = x + origin_x;
+    const long map_y = y + origin_y;
+    if ( map_x < 0 || map_y < 0 || map_x >= width || map_y >= height ) {
+        return -1;
+    }
+    return ids[ map_y * width + map_x ];
+}
+
+Generated_terrain_source::Generated_terrain_source(
+    const std::vector< long >& terrain_ids,
+    const uint64_t seed ) :
+    terrain_ids{ terrain_ids },
+    seed{ seed }
+{
+    if ( terrain_ids.empty() ) {
+        PANIC( "No terrain IDs for the generated terrain!" );
+    }
+    LOG3( "New generated terrain source, terrains: ",
+          terrain_ids.size(), ", seed: ", seed );
+}
+
+long Generated_terrain_source::terrain_id( const long x, const long y ) const
+{
+    //splitmix64 finalizer
+    uint64_t hash = seed ^ ( static_cast< uint64_t >( x ) * 0x9E3779B97F4A7C15ull ) ^
+                    ( static_cast< uint64_t >( y ) * 0xC2B2AE3D27D4EB4Full );
+    hash = ( hash ^ ( hash >> 30 ) ) * 0xBF58476D1CE4E5B9ull;
+    hash = ( hash ^ ( hash >> 27 ) ) * 0x94D049BB133111EBull;
+    hash ^= hash >> 31;
+    return terrain_ids[ hash % terrain_ids.size() ];
+}
+
+}
@@ -0,0 +1,83 @@
+#ifndef TERRAIN_SOURCES_HPP
+#define TERRAIN_SOURCES_HPP
+
+#include <headers.hpp>
+#include <memory>
+#include <vector>
+
+namespace game_terrains {
+
+template<typename T>
+using vec_of_vecs = std::vector< std::vector< T > >;
+/*
+ * This is the type of the matrix which
+ * define a 2D map in terms of terrain ID's
+ */
+using terrain_map_t = vec_of_vecs< long >;
+
+/*
+ * Provide the terrain ID of the lot at the given
+ * lot coordinates. Called concurrently by the
+ * worker threads which build the chunks, the
+ * implementations must be safe for that
+ */
+class Terrain_source
+{
+public:
+    using pointer = std::shared_ptr< Terrain_source >;
+    /*
+     * The terrain ID, -1 if there's no lot
+     */
+    virtual long terrain_id( const long x, const long y ) const = 0;
+    /*
+     * The terrain ID's of the width X height lots
+     * starting at x,y, row-major. Called once per
+     * chunk, the default calls terrain_id for each lot
+     */
+    virtual void terrain_ids( const long x,
+                              const long y,
+                              const std::size_t width,
+                              const std::size_t height,
+                              long* ids ) const;
+    virtual ~Terrain_source() {}
+};
+
+/*
+ * A finite map, central_lot is the map
+ * cell of the lot at coordinates 0,0
+ */
+class Map_terrain_source : public Terrain_source
+{
+public:
+    using pointer = std::shared_ptr< Map_terrain_source >;
+    Map_terrain_source( const terrain_map_t& map,
+                        const glm::vec2 central_lot );
+    long terrain_id( const long x, const long y ) const override;
+private:
+    //Row-major
+    std::vector< long > ids;
+    long width;
+    long height;
+    long origin_x;
+    long origin_y;
+};
+
+/*
+ * Unbounded world, the terrain of each lot is
+ * picked by hashing its coordinates with the seed
+ */
+class Generated_terrain_source : public Terrain_source
+{
+public:
+    using pointer = std::shared_ptr< Generated_terrain_source >;
+    Generated_terrain_source( const std::vector< long >& terrain_ids,
+                              const uint64_t seed );
+    long terrain_id( const long x, const long y ) const override;
+private:
+    std::vector< long > terrain_ids;
+    uint64_t seed;
+};
+
+}
+
+#endif //TERRAIN_SOURCES_HPP
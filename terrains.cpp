@@ -1,13 +1,24 @@
 #include <terrains.hpp>
 #include <logger/logger.hpp>
 #include <factory.hpp>
+#include <thread_pool.hpp>
+#include <algorithm>
 
 namespace game_terrains {
 
-Terrains::Terrains( renderer::Core_renderer_proxy renderer ) :
-    renderer{ renderer }
+Terrains::Terrains( renderer::Core_renderer_proxy renderer,
+                    const GLfloat highres_distance,
+                    const uint64_t highres_budget,
+                    const std::size_t chunk_size,
+                    const GLfloat chunk_distance ) :
+    renderer{ renderer },
+    chunk_size{ std::max< std::size_t >( chunk_size, 1 ) },
+    chunk_distance{ chunk_distance },
+    lot_size{ 0 }
 {
     LOG3( "Creating terrains::terrains" );
+    highres_residency = factory< Highres_residency >::create( highres_distance,
+                        highres_budget );
 }
 
 long Terrains::load_terrain( const std::string& model_filename,
@@ -18,22 +29,25 @@ long Terrains::load_terrain( const std::string& model_filename,
           model_filename,
           ". Provided ID: ",
           terrain_id );
+    /*
+     * The low resolution lots keep their vertices,
+     * which are baked in the terrain chunks
+     */
     auto new_model = factory< models::model_loader >::create(
-                         model_filename );
-    if ( false == new_model->load_model() ) {
-        PANIC( "Not able to load the selected terrain!" );
-    }
+                         model_filename,
+                         models::z_axis::normal,
+                         models::mesh_retention::everything );
     if ( terrain_id < 0 ) {
         terrain_id = ids< Terrain_lot >::create();
     }
-    auto it = terrain_map.find( terrain_id );
-    if ( it != terrain_map.end() ) {
-        ERR( "A terrain lot with ID ", terrain_id, " already Exist!" );
+    auto it = terrain_container.find( terrain_id );
+    if ( it != terrain_container.end() ) {
+        ERR( "A terrain with ID ", terrain_id, " already Exist!" );
         terrain_id = -1;
     }
     if ( terrain_id > 0 ) {
+        terrain_assets.push_back( assets::loader().load_model( new_model ) );
         terrain_container[ terrain_id ].low_res_model = new_model;
-        terrain_container[ terrain_id ].high_res_model = new_model;
         terrain_container[ terrain_id ].default_color = color;
         LOG3( "New terrain loaded, id: ", terrain_id,
               ". Amount of terrains: ", terrain_container.size() );
@@ -58,12 +72,8 @@ long Terrains::load_highres_terrain( const std::string& model_filename,
              ". Not possible to load the highres model.." );
         return -1;
     }
-    auto new_model = factory< models::model_loader >::create(
-                         model_filename );
-    if ( false == new_model->load_model() ) {
-        PANIC( "Not able to load the highres terrain!" );
-    }
-    it->second.high_res_model = new_model;
+    it->second.high_res_path = model_filename;
+    highres_residency->register_model( terrain_id, model_filename );
     return terrain_id;
 }
 
@@ -71,106 +81,411 @@ bool Terrains::load_terrain_map( const terrain_map_t& map,
                                  GLfloat lot_size,
                                  glm::vec2 central_lot )
 {
-    if ( lot_size <= 0 ) {
-        ERR( "Lot size couldn't be zero!" );
-        return false;
-    }
     if ( map.empty() || map[0].empty() ) {
         ERR( "The provided terrain map is empty!" );
         return false;
     }
-    this->lot_size = lot_size;
-    origins_lot = central_lot;
-    /*
-     * Process the provided terrain map and
-     * generate the proper internal reppresentation
-     */
-    std::size_t x_size = map[0].size();
-    for ( std::size_t y{ 0 } ; y < map.size() ; ++y ) {
-        if ( x_size != map[ y ].size() ) {
+    for ( auto&& row : map ) {
+        if ( map[0].size() != row.size() ) {
             //Should be equal for all,the map should be a quad
             ERR( "The provided terrain map is not a quad!" );
             return false;
         }
-        for ( std::size_t x{ 0 } ; x < map[y].size() ; ++x ) {
-            long id = map[ y ][ x ];
+    }
+    return load_terrain_source( factory< Map_terrain_source >::create( map, central_lot ),
+                                lot_size );
+}
+
+bool Terrains::load_terrain_map( const std::string& map_path,
+                                 GLfloat lot_size )
+{
+    auto map = Binary_map::open( map_path );
+    if ( nullptr == map ) {
+        ERR( "Unable to load the terrain map ", map_path );
+        return false;
+    }
+    if ( map->header().block_size != chunk_size ) {
+        WARN1( "The blocks of the terrain map are ", map->header().block_size,
+               " lots wide, the chunks ", chunk_size );
+    }
+    return load_terrain_source( map, lot_size );
+}
+
+bool Terrains::load_terrain_source( Terrain_source::pointer source,
+                                    GLfloat lot_size )
+{
+    if ( lot_size <= 0 ) {
+        ERR( "Lot size couldn't be zero!" );
+        return false;
+    }
+    if ( nullptr == source ) {
+        ERR( "Invalid terrain source provided" );
+        return false;
+    }
+    if ( nullptr != build_context ) {
+        ERR( "The terrain map is already loaded!" );
+        return false;
+    }
+    this->lot_size = lot_size;
+    auto context = std::make_shared< Chunk_build_context >();
+    context->source = source;
+    context->terrains = terrain_container;
+    context->chunk_size = chunk_size;
+    context->lot_size = lot_size;
+    for ( auto&& terrain : terrain_container ) {
+        std::vector< Chunk_source_mesh > meshes;
+        if ( decode_chunk_source( *terrain.second.low_res_model, meshes ) ) {
+            context->meshes[ terrain.first ] = std::move( meshes );
+        } else {
+            WARN1( "The low res model of the terrain ", terrain.first,
+                   " has no CPU data, the lots are not baked" );
+        }
+    }
+    build_context = context;
+    LOG1( "Terrain source loaded, chunks of ", chunk_size, "x", chunk_size,
+          " lots streamed within ", chunk_distance, " from the camera" );
+    return true;
+}
+
+namespace {
+
+long floor_div( const long value, const long divisor )
+{
+    return value >= 0 ? value / divisor : -( ( -value + divisor - 1 ) / divisor );
+}
+
+uint64_t chunk_key( const long chunk_x, const long chunk_y )
+{
+    return static_cast< uint64_t >( static_cast< uint32_t >( chunk_x ) ) << 32 |
+           static_cast< uint32_t >( chunk_y );
+}
+
+glm::mat4 lot_model_matrix( const glm::vec2& pos, const GLfloat lot_size )
+{
+    glm::mat4 model;
+    return glm::translate( model,
+                           glm::vec3( pos.x * lot_size,
+                                      pos.y * lot_size,
+                                      0.0 ) );
+}
+
+}
+
+Terrains::Chunk_build Terrains::build_chunk( const Chunk_build_context& context,
+        const long chunk_x,
+        const long chunk_y )
+{
+    const long size = context.chunk_size;
+    Chunk_build build;
+    build.lots.resize( size * size );
+    std::vector< long > ids( size * size );
+    context.source->terrain_ids( chunk_x * size, chunk_y * size,
+                                 size, size, ids.data() );
+    for ( long y{ 0 } ; y < size ; ++y ) {
+        for ( long x{ 0 } ; x < size ; ++x ) {
+            const glm::vec2 position( chunk_x * size + x, chunk_y * size + y );
+            const long id = ids[ y * size + x ];
+            if ( id < 0 ) {
+                continue;
+            }
             /*
             * Is the lot model available?
             */
-            auto it = terrain_container.find( id );
-            if ( it == terrain_container.end() ) {
-                PANIC( "The model for the terrain ID: ",
-                       id, " is not loaded.." );
+            auto it = context.terrains.find( id );
+            if ( it == context.terrains.end() ) {
+                ERR( "The model for the terrain ID: ",
+                     id, " is not loaded.." );
+                continue;
             }
-
             Terrain_lot::pointer new_lot = factory< Terrain_lot >::create(
                                                id,
-                                               glm::vec2( x - central_lot.x, y - central_lot.y ),
+                                               position,
                                                it->second.low_res_model->get_model_height()
                                            );
-
-            new_lot->rendering_data.model_matrix = get_lot_model_matrix( new_lot->position );
+            new_lot->rendering_data.model_matrix = lot_model_matrix( position, context.lot_size );
             new_lot->rendering_data.update_pos_from_model_matrix();
-            new_lot->rendering_data.default_color = terrain_container[ new_lot->terrain_model_id ].default_color;
+            new_lot->rendering_data.default_color = it->second.default_color;
+            new_lot->rendering_data.bounding_radius = it->second.low_res_model->get_model_radius();
             new_lot->textures = it->second;
+            new_lot->baked = context.meshes.find( id ) != context.meshes.end();
+            build.lots[ y * size + x ] = new_lot;
+        }
+    }
+    build.geometry = bake_chunk( build.lots, context.meshes );
+    return build;
+}
 
-            long lot_idx = get_position_idx( new_lot->position );
-            if ( terrain_map.find( lot_idx ) != terrain_map.end() ) {
-                ERR( "Attempt to add twice a lot at the same idx: ",
-                     lot_idx, " number of loaded lots: ", terrain_map.size() );
-            } else {
-                renderer.add_renderable( new_lot );
-                new_lot->rendering_state.set_enable();
-                long idx = get_position_idx( new_lot->position );
-                terrain_map[ idx ] = new_lot;
-                rendr_id_to_idx[ new_lot->id ] = idx;
+void Terrains::update_chunks( const glm::vec3& camera_position )
+{
+    /*
+     * Register the built chunks, a limited amount
+     * per update: the upload is done here
+     */
+    std::size_t uploads{ 0 };
+    for ( auto&& item : resident_chunks ) {
+        auto& resident = item.second;
+        if ( uploads >= max_chunk_uploads_per_update ) {
+            break;
+        }
+        if ( resident.ready || resident.pending.wait_for( std::chrono::seconds( 0 ) ) !=
+             std::future_status::ready ) {
+            continue;
+        }
+        try {
+            complete_chunk( resident, resident.pending.get() );
+        } catch ( std::exception& ex ) {
+            //Not requested again until released
+            ERR( "Unable to build the chunk ", resident.chunk_x, ",",
+                 resident.chunk_y, ": ", ex.what() );
+            resident.ready = true;
+            --chunk_stats.pending_chunks;
+        }
+        ++uploads;
+    }
+    /*
+     * Release the far chunks, unless some unit is
+     * located on their lots or is going to move there
+     */
+    const GLfloat release_distance = chunk_distance * chunk_release_factor;
+    for ( auto it = resident_chunks.begin() ; it != resident_chunks.end() ; ) {
+        auto& resident = it->second;
+        const bool in_use = std::any_of( resident.lots.begin(), resident.lots.end(),
+        []( const Terrain_lot::pointer & lot ) {
+            return nullptr != lot && lot->in_use();
+        } );
+        if ( false == resident.ready || in_use ||
+             chunk_distance_from( resident.chunk_x, resident.chunk_y,
+                                  camera_position ) <= release_distance ) {
+            ++it;
+            continue;
+        }
+        release_chunk( resident );
+        it = resident_chunks.erase( it );
+    }
+    /*
+     * Request the missing chunks in range,
+     * the closest first
+     */
+    const long size = chunk_size;
+    const long camera_x = floor_div( std::lround( camera_position.x / lot_size ), size );
+    const long camera_y = floor_div( std::lround( camera_position.y / lot_size ), size );
+    const long range = static_cast< long >( std::ceil( chunk_distance / ( size * lot_size ) ) );
+    std::vector< std::pair< GLfloat, glm::ivec2 > > requests;
+    for ( long y{ camera_y - range } ; y <= camera_y + range ; ++y ) {
+        for ( long x{ camera_x - range } ; x <= camera_x + range ; ++x ) {
+            if ( resident_chunks.find( chunk_key( x, y ) ) != resident_chunks.end() ) {
+                continue;
+            }
+            const GLfloat distance = chunk_distance_from( x, y, camera_position );
+            if ( distance <= chunk_distance ) {
+                requests.push_back( { distance, glm::ivec2( x, y ) } );
             }
         }
     }
-    return true;
+    std::sort( requests.begin(), requests.end(),
+               []( const std::pair< GLfloat, glm::ivec2 >& lhs,
+    const std::pair< GLfloat, glm::ivec2 >& rhs ) {
+        return lhs.first < rhs.first;
+    } );
+    for ( auto&& request : requests ) {
+        const long x = request.second.x;
+        const long y = request.second.y;
+        auto& resident = resident_chunks[ chunk_key( x, y ) ];
+        resident.chunk_x = x;
+        resident.chunk_y = y;
+        auto context = build_context;
+        resident.pending = workers::pool().submit( [ context, x, y ]() {
+            return build_chunk( *context, x, y );
+        } );
+        ++chunk_stats.pending_chunks;
+    }
+}
+
+void Terrains::complete_chunk( Resident_chunk& resident, Chunk_build&& build )
+{
+    resident.lots = std::move( build.lots );
+    /*
+     * Registered for the picking, the lot is
+     * enabled only if not baked in the chunk
+     */
+    std::size_t lot_count{ 0 };
+    for ( auto&& lot : resident.lots ) {
+        if ( nullptr == lot ) {
+            continue;
+        }
+        renderer.add_renderable( lot );
+        if ( false == lot->baked ) {
+            lot->rendering_state.set_enable();
+        }
+        ++lot_count;
+    }
+    set_picking_colors( build.geometry, renderer );
+    resident.chunk = factory< Terrain_chunk >::create( std::move( build.geometry ) );
+    if ( resident.chunk->get_batch_count() > 0 ) {
+        renderer.add_renderable( resident.chunk );
+        resident.chunk->rendering_state.set_enable();
+        chunk_stats.baked_bytes += resident.chunk->get_baked_bytes();
+    } else {
+        resident.chunk = nullptr;
+    }
+    resident.ready = true;
+    --chunk_stats.pending_chunks;
+    ++chunk_stats.resident_chunks;
+    ++chunk_stats.stream_ins;
+    chunk_stats.resident_lots += lot_count;
+    LOG1( "Chunk ", resident.chunk_x, ",", resident.chunk_y, " streamed in, lots: ",
+          lot_count, ", resident chunks: ", chunk_stats.resident_chunks,
+          ", baked bytes: ", chunk_stats.baked_bytes );
+}
+
+void Terrains::release_chunk( Resident_chunk& resident )
+{
+    /*
+     * The lots state is all derived from the source,
+     * the chunk is built again when needed
+     */
+    if ( nullptr != resident.chunk ) {
+        renderer.remove_renderable( resident.chunk );
+        chunk_stats.baked_bytes -= resident.chunk->get_baked_bytes();
+        resident.chunk = nullptr;
+    }
+    std::size_t lot_count{ 0 };
+    for ( auto&& lot : resident.lots ) {
+        if ( nullptr != lot ) {
+            renderer.remove_renderable( lot );
+            ++lot_count;
+        }
+    }
+    resident.lots.clear();
+    if ( resident.ready ) {
+        --chunk_stats.resident_chunks;
+        chunk_stats.resident_lots -= lot_count;
+        ++chunk_stats.releases;
+    }
+    LOG1( "Chunk ", resident.chunk_x, ",", resident.chunk_y, " released, resident chunks: ",
+          chunk_stats.resident_chunks, ", baked bytes: ", chunk_stats.baked_bytes );
+}
+
+GLfloat Terrains::chunk_distance_from( const long chunk_x,
+                                       const long chunk_y,
+                                       const glm::vec3& position ) const
+{
+    //The lots are centered on their position
+    const GLfloat chunk_world_size = chunk_size * lot_size;
+    const glm::vec2 min( chunk_x * chunk_world_size - lot_size / 2.0f,
+                         chunk_y * chunk_world_size - lot_size / 2.0f );
+    const glm::vec2 max = min + glm::vec2( chunk_world_size );
+    const glm::vec2 point( position.x, position.y );
+    return glm::length( point - glm::clamp( point, min, max ) );
 }
 
 Terrain_lot::pointer Terrains::find_lot( const glm::vec2 coord )
 {
-    long pos_idx = get_position_idx( coord );
-    auto it = terrain_map.find( pos_idx );
-    if ( terrain_map.end() == it ) {
+    auto lot = lot_at( std::lround( coord.x ), std::lround( coord.y ) );
+    if ( nullptr == lot ) {
         ERR( "Lot at position ", coord, " not found!" );
-        return nullptr;
     }
-    return it->second;
+    return lot;
 }
 
 Terrain_lot::pointer Terrains::find_lot(
     const renderer::Renderable::pointer& rendr
 )
 {
-    auto it = rendr_id_to_idx.find( rendr->id );
-    if ( it == rendr_id_to_idx.end() ) {
+    auto lot = std::dynamic_pointer_cast< Terrain_lot >( rendr );
+    if ( nullptr == lot ) {
         return nullptr;
     }
-    return terrain_map[ it->second ];
+    //Might be a lot of another terrain, or released
+    auto found = lot_at( std::lround( lot->position.x ),
+                         std::lround( lot->position.y ) );
+    return found == lot ? lot : nullptr;
 }
 
-glm::mat4 Terrains::get_lot_model_matrix( const glm::vec2& pos ) const
+const assets::Model_asset::container& Terrains::loading_assets() const
 {
-    glm::mat4 model;
-    return glm::translate( model,
-                           glm::vec3( pos.x * lot_size,
-                                      pos.y * lot_size,
-                                      0.0 ) );
+    return terrain_assets;
 }
 
-long Terrains::get_position_idx( const glm::vec2& pos ) const
+void Terrains::update_residency( const glm::vec3& camera_position )
 {
+    for ( auto&& lot : highres_lots ) {
+        lot->high_res_model = nullptr;
+        if ( lot->baked ) {
+            //Back to the chunk
+            lot->rendering_state.set_disable();
+        }
+    }
+    highres_lots.clear();
+    if ( nullptr == build_context ) {
+        return;
+    }
+    update_chunks( camera_position );
+    highres_residency->begin_update();
     /*
-     * Cantor Pairing function.
-     * Make sure to not calculate the index
-     * using negative values
+     * Only the lots in the square around the
+     * camera are checked
      */
-    const long x = pos.x + origins_lot.x + 5;
-    const long y = pos.y + origins_lot.y + 5;
-    return ( 1.0f / 2.0f ) * ( x + y ) * ( x + y + 1 ) + y;
+    const GLfloat distance = highres_residency->get_stream_in_distance();
+    const long camera_x = std::lround( camera_position.x / lot_size );
+    const long camera_y = std::lround( camera_position.y / lot_size );
+    const long range = static_cast< long >( std::ceil( distance / lot_size ) );
+    for ( long y{ camera_y - range } ; y <= camera_y + range ; ++y ) {
+        for ( long x{ camera_x - range } ; x <= camera_x + range ; ++x ) {
+            auto lot = lot_at( x, y );
+            if ( nullptr == lot || lot->textures.high_res_path.empty() ) {
+                continue;
+            }
+            const glm::vec3 lot_center( lot->position.x * lot_size,
+                                        lot->position.y * lot_size,
+                                        lot->altitude );
+            if ( glm::distance( lot_center, camera_position ) > distance ) {
+                continue;
+            }
+            lot->high_res_model = highres_residency->request( lot->terrain_model_id );
+            if ( nullptr != lot->high_res_model ) {
+                //Rendered by itself, skipped by the chunk
+                lot->rendering_state.set_enable();
+                highres_lots.push_back( lot );
+            }
+        }
+    }
+    highres_residency->end_update();
+}
+
+Residency_stats Terrains::get_residency_stats() const
+{
+    return highres_residency->get_stats();
+}
+
+pathfinding::Pathfinder::pointer Terrains::create_pathfinder(
+    const pathfinding::terrain_costs& costs ) const
+{
+    if ( nullptr == build_context ) {
+        ERR( "No terrain loaded, not possible to create the pathfinder" );
+        return nullptr;
+    }
+    return factory< pathfinding::Pathfinder >::create( build_context->source,
+            costs,
+            build_context->lot_size,
+            build_context->chunk_size );
+}
+
+Chunk_stream_stats Terrains::get_chunk_stats() const
+{
+    return chunk_stats;
+}
+
+Terrain_lot::pointer Terrains::lot_at( const long x, const long y ) const
+{
+    const long size = chunk_size;
+    const long chunk_x = floor_div( x, size );
+    const long chunk_y = floor_div( y, size );
+    auto it = resident_chunks.find( chunk_key( chunk_x, chunk_y ) );
+    if ( it == resident_chunks.end() || it->second.lots.empty() ) {
+        return nullptr;
+    }
+    return it->second.lots[ ( y - chunk_y * size ) * size + ( x - chunk_x * size ) ];
 }
 
 Terrain_lot::Terrain_lot( const long model_id,
@@ -178,15 +493,52 @@ Terrain_lot::Terrain_lot( const long model_id,
                           const GLfloat lot_altitude ) :
     terrain_model_id{ model_id },
     position{ unique_position },
-    altitude{ lot_altitude }
+    altitude{ lot_altitude },
+    baked{ false },
+    pins{ 0 }
 {
     LOG0( "New lot created, ID:", id );
-    units = factory< game_units::Units_container >::create();
+}
+
+game_units::Units_container::pointer Terrain_lot::units()
+{
+    //Most of the lots never host a unit
+    if ( nullptr == units_container ) {
+        units_container = factory< game_units::Units_container >::create();
+    }
+    return units_container;
+}
+
+bool Terrain_lot::has_units() const
+{
+    return nullptr != units_container && units_container->size() > 0;
+}
+
+void Terrain_lot::pin()
+{
+    ++pins;
+}
+
+void Terrain_lot::unpin()
+{
+    if ( pins == 0 ) {
+        ERR( "Unpinning the lotID:", id, " which is not pinned!" );
+        return;
+    }
+    --pins;
+}
+
+bool Terrain_lot::in_use() const
+{
+    return pins > 0 || has_units();
 }
 
 bool Terrain_lot::render( )
 {
-    for ( auto&& mesh : textures.high_res_model->get_mesh() ) {
+    //The low res model is the fallback while the high res is not resident
+    const auto& model = nullptr != high_res_model ?
+                        high_res_model : textures.low_res_model;
+    for ( auto&& mesh : model->get_mesh() ) {
         if ( false == mesh->render( rendering_data.shader ) ) {
             return false;
         }
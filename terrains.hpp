@@ -11,33 +11,32 @@
 #include <types.hpp>
 #include <renderable_object.hpp>
 #include <units.hpp>
+#include <assets.hpp>
+#include <highres_residency.hpp>
+#include <terrain_chunks.hpp>
+#include <terrain_sources.hpp>
+#include <map_file.hpp>
+#include <pathfinding.hpp>
+#include <future>
 
 namespace game_terrains {
 
 /*
  * For each lot we store up to two
  * models, one low res (normal res) one high res).
- * For closeup scenes 'terrains' will load the high
- * res model
+ * For closeup scenes 'terrains' will stream in the
+ * high res model
  */
 struct Lot_model_textures {
     types::color default_color;
+    models::model_loader::pointer low_res_model;
     /*
-     * If not provided, the high_res_model is the
-     * same as the low res..
+     * Empty if there's no high res model, which
+     * is loaded only when needed
      */
-    models::model_loader::pointer low_res_model;
-    models::model_loader::pointer high_res_model;
+    std::string high_res_path;
 };
 
-template<typename T>
-using vec_of_vecs = std::vector< std::vector< T > >;
-/*
- * This is the type of the matrix which
- * define a 2D map in terms of terrain ID's
- */
-using terrain_map_t = vec_of_vecs< long >;
-
 /*
  * Internal reppresentation of a terrain lot
  */
@@ -70,26 +69,62 @@ public:
      */
     const GLfloat      altitude;
     Lot_model_textures textures;
-    game_units::Units_container::pointer units;
+    /*
+     * Set while the lot is close to the camera
+     * and the high res model is resident
+     */
+    models::model_loader::pointer high_res_model;
+    /*
+     * Set if the low res model is
+     * drawn by a terrain chunk
+     */
+    bool baked;
+    /*
+     * The units on the lot, the container
+     * is allocated on the first access
+     */
+    game_units::Units_container::pointer units();
+    bool has_units() const;
+    /*
+     * The chunk of a pinned lot is not released, the
+     * lot is the target of a pending path request
+     */
+    void pin();
+    void unpin();
+    /*
+     * Pinned or hosting some unit
+     */
+    bool in_use() const;
 
     /*
      * Rendering function
      */
     bool render( ) override;
+private:
+    game_units::Units_container::pointer units_container;
+    std::size_t pins;
 };
 
 /*
  * Handle the game map, which is a matrix of lots
- * of differnet kinds.
+ * of differnet kinds. Only the chunks of lots close
+ * to the camera exist, they are built by the worker
+ * threads from the terrain source and released when
+ * the camera moves away
  */
 class Terrains
 {
 public:
     using pointer = std::shared_ptr< Terrains >;
-    Terrains( renderer::Core_renderer_proxy renderer );
+    Terrains( renderer::Core_renderer_proxy renderer,
+              const GLfloat highres_distance = default_highres_distance,
+              const uint64_t highres_budget = default_highres_budget,
+              const std::size_t chunk_size = default_chunk_size,
+              const GLfloat chunk_distance = default_chunk_distance );
     /*
      * Load a terrain model, the user might provide its
-     * own identificator. If not, a new unique one will be created
+     * own identificator. If not, a new unique one will be created.
+     * The model is loaded asynchronously, see loading_assets
      */
     long load_terrain( const std::string& model_filename,
                        const glm::vec4& color,
@@ -97,7 +132,8 @@ public:
     /*
      * To load the highres model first the lowres need to be loaded,
      * the code will use the generated terrain_id from load_terrain
-     * to upload the highres model
+     * to register the highres model, which is streamed in when the
+     * camera gets close to the lots using it
      */
     long load_highres_terrain( const std::string& model_filename,
                                long terrain_id );
@@ -110,7 +146,20 @@ public:
                            GLfloat lot_size, //Each lot is a square: lot_size X lot_size
                            glm::vec2 central_lot ); //Position of the lot at the center (0,0)
     /*
-     * Return the lot at the give coordinates
+     * As above, from a binary map file (see map_file.hpp)
+     * which is read in place through a memory mapping
+     */
+    bool load_terrain_map( const std::string& map_path,
+                           GLfloat lot_size );
+    /*
+     * As above, the terrain ID's are provided by the
+     * source. The world might be unbounded
+     */
+    bool load_terrain_source( Terrain_source::pointer source,
+                              GLfloat lot_size );
+    /*
+     * Return the lot at the give coordinates,
+     * null if the lot is not resident
      */
     Terrain_lot::pointer find_lot( const glm::vec2 coord );
     /*
@@ -118,33 +167,87 @@ public:
      * provided renderable, or null
      */
     Terrain_lot::pointer find_lot( const renderer::Renderable::pointer& rendr );
-private:
-    renderer::Core_renderer_proxy renderer;
-
-    std::unordered_map< long, Lot_model_textures > terrain_container;
-
-    GLfloat lot_size;
-    long get_position_idx( const glm::vec2& pos ) const;
     /*
-     * Map a position index to a Terrain_lot
+     * The terrain models being loaded, they shall be
+     * ready before calling load_terrain_map
      */
-    std::unordered_map< long, Terrain_lot::pointer > terrain_map;
+    const assets::Model_asset::container& loading_assets() const;
     /*
-     * Map a renderable ID to a position index
+     * To be called once per frame from the GL thread,
+     * stream the chunks in and out, select the lots
+     * rendered with the high res model and stream
+     * the models in or out
      */
-    std::unordered_map< long, long > rendr_id_to_idx;
-    glm::vec2 view_center;
+    void update_residency( const glm::vec3& camera_position );
+    /*
+     * Pathfinding over the lots of the loaded terrain,
+     * the chunks are the clusters of the search. The
+     * lots need not to be resident. Null if no terrain
+     * is loaded
+     */
+    pathfinding::Pathfinder::pointer create_pathfinder(
+        const pathfinding::terrain_costs& costs ) const;
+    Residency_stats get_residency_stats() const;
+    Chunk_stream_stats get_chunk_stats() const;
+private:
+    renderer::Core_renderer_proxy renderer;
     /*
-     * The origins lot is the lot from which
-     * the coordinate numbering starts
+     * What the workers need to build the chunks,
+     * immutable once the source is loaded
      */
-    glm::vec2 origins_lot;
+    struct Chunk_build_context {
+        Terrain_source::pointer source;
+        std::unordered_map< long, Lot_model_textures > terrains;
+        chunk_sources meshes;
+        std::size_t chunk_size;
+        GLfloat lot_size;
+    };
+    struct Chunk_build {
+        //Row-major, chunk_size X chunk_size
+        std::vector< Terrain_lot::pointer > lots;
+        Chunk_geometry geometry;
+    };
+    struct Resident_chunk {
+        long chunk_x;
+        long chunk_y;
+        /*
+         * Row-major, chunk_size X chunk_size,
+         * null where there's no lot
+         */
+        std::vector< Terrain_lot::pointer > lots;
+        Terrain_chunk::pointer chunk;
+        std::future< Chunk_build > pending;
+        bool ready{ false };
+    };
+    static Chunk_build build_chunk( const Chunk_build_context& context,
+                                    const long chunk_x,
+                                    const long chunk_y );
+    void update_chunks( const glm::vec3& camera_position );
+    void complete_chunk( Resident_chunk& resident, Chunk_build&& build );
+    void release_chunk( Resident_chunk& resident );
+    //Distance on the XY plane
+    GLfloat chunk_distance_from( const long chunk_x,
+                                 const long chunk_y,
+                                 const glm::vec3& position ) const;
+    std::size_t chunk_size;
+    GLfloat chunk_distance;
+    std::shared_ptr< const Chunk_build_context > build_context;
+    std::unordered_map< uint64_t, Resident_chunk > resident_chunks;
+    Chunk_stream_stats chunk_stats;
 
+    std::unordered_map< long, Lot_model_textures > terrain_container;
+    assets::Model_asset::container terrain_assets;
+    Highres_residency::pointer highres_residency;
+    //Lots currently rendered with the high res model
+    std::vector< Terrain_lot::pointer > highres_lots;
+
+    GLfloat lot_size;
     /*
-     * Return the model matrix for the lot
-     * at position pos
+     * The lot at the given lot coordinates,
+     * null if its chunk is not resident
      */
-    glm::mat4 get_lot_model_matrix( const glm::vec2& pos ) const;
+    Terrain_lot::pointer lot_at( const long x, const long y ) const;
+    glm::vec2 view_center;
 };
 
 }
@@ -0,0 +1,271 @@
+#include <texture_arrays.hpp>
+#include <logger/logger.hpp>
+#include <algorithm>
+
+namespace textures {
+
+namespace {
+
+GLenum internal_format( const compiled_format format )
+{
+    switch ( format ) {
+    case compiled_format::bc1:
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case compiled_format::bc3:
+        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    default:
+        break;
+    }
+    return GL_RGBA8;
+}
+
+}
+
+bool Texture_arrays::Size_class::operator==( const Size_class& other ) const
+{
+    return format == other.format &&
+           width == other.width &&
+           height == other.height &&
+           levels == other.levels &&
+           wrapping_method == other.wrapping_method;
+}
+
+Texture_layer Texture_arrays::allocate( const Compiled_texture& texture,
+                                        const GLint wrapping_method,
+                                        const std::string& source_path )
+{
+    const Size_class size_class{ texture.format(),
+                                 texture.width(),
+                                 texture.height(),
+                                 texture.levels(),
+                                 wrapping_method };
+    Array& array = array_for( size_class, texture );
+
+    Texture_layer layer;
+    layer.array = array.handle;
+    layer.layer = std::find( array.layer_sources.begin(),
+                             array.layer_sources.end(),
+                             std::string() ) - array.layer_sources.begin();
+    array.layer_sources[ layer.layer ] = source_path;
+    ++array.used;
+    upload_layer( array.id, texture, layer.layer );
+    LOG1( "Texture allocated in array ", layer.array, ", layer ", layer.layer,
+          ", used layers: ", array.used, "/", array.layer_sources.size() );
+    return layer;
+}
+
+void Texture_arrays::release( const Texture_layer& layer )
+{
+    auto it = std::find_if( arrays.begin(), arrays.end(),
+    [ &layer ]( const Array & array ) {
+        return array.handle == layer.array;
+    } );
+    if ( it == arrays.end() || it->layer_sources[ layer.layer ].empty() ) {
+        ERR( "Attempt to release an unknown texture layer!" );
+        return;
+    }
+    it->layer_sources[ layer.layer ].clear();
+    if ( --it->used == 0 ) {
+        LOG1( "Deleting the texture array ", it->handle );
+        for ( auto&& bound : bound_arrays ) {
+            if ( bound == it->handle ) {
+                bound = 0;
+            }
+        }
+        glDeleteTextures( 1, &it->id );
+        arrays.erase( it );
+    }
+}
+
+void Texture_arrays::bind( const GLint unit, const GLuint array )
+{
+    GLuint& bound = bound_arrays[ unit == diffuse_array_unit ? 0 : 1 ];
+    if ( bound == array ) {
+        return;
+    }
+    auto it = std::find_if( arrays.begin(), arrays.end(),
+    [ array ]( const Array & candidate ) {
+        return candidate.handle == array;
+    } );
+    if ( it == arrays.end() ) {
+        ERR( "Attempt to bind the unknown texture array ", array );
+        return;
+    }
+    glActiveTexture( GL_TEXTURE0 + unit );
+    glBindTexture( GL_TEXTURE_2D_ARRAY, it->id );
+    glActiveTexture( GL_TEXTURE0 );
+    bound = array;
+}
+
+Texture_arrays::Array& Texture_arrays::array_for( const Size_class& size_class,
+        const Compiled_texture& texture )
+{
+    Array* growable{ nullptr };
+    for ( auto&& array : arrays ) {
+        if ( false == ( array.size_class == size_class ) ) {
+            continue;
+        }
+        if ( array.used < array.layer_sources.size() ) {
+            return array;
+        }
+        if ( array.layer_sources.size() < array.max_layers ) {
+            growable = &array;
+        }
+    }
+    if ( nullptr != growable ) {
+        grow_array( *growable, texture );
+        return *growable;
+    }
+    //The first array of the class, or all of them are at the limit
+    return create_array( size_class, texture );
+}
+
+Texture_arrays::Array& Texture_arrays::create_array( const Size_class& size_class,
+        const Compiled_texture& texture )
+{
+    if ( max_layers == 0 ) {
+        glGetIntegerv( GL_MAX_ARRAY_TEXTURE_LAYERS, &max_layers );
+    }
+    /*
+     * The array starts with one layer and grows with the
+     * textures of its class, the handle does not change:
+     * all the meshes using the class share the same
+     * array and the same draw batch
+     */
+    Array array;
+    array.handle = next_handle++;
+    array.size_class = size_class;
+    array.layer_sources.resize( 1 );
+    array.used = 0;
+    array.max_layers = std::max< uint64_t >( 1,
+                       std::min< uint64_t >( max_layers,
+                                             max_array_size_in_bytes / texture.size_in_bytes() ) );
+    array.id = create_storage( size_class, texture, 1 );
+    LOG3( "New texture array ", array.handle, ", size: ", size_class.width,
+          "/", size_class.height, ", levels: ", size_class.levels,
+          ", max layers: ", array.max_layers );
+    arrays.push_back( std::move( array ) );
+    return arrays.back();
+}
+
+void Texture_arrays::grow_array( Array& array,
+                                 const Compiled_texture& texture )
+{
+    const std::size_t layers = std::min( array.max_layers,
+                                         array.layer_sources.size() * 2 );
+    const GLuint id = create_storage( array.size_class, texture, layers );
+    /*
+     * Only the compressed textures are compiled as
+     * BC1/BC3, the class format tells which setting
+     * was used for the sources
+     */
+    const bool allow_compression = array.size_class.format != compiled_format::rgba8;
+    for ( std::size_t idx{ 0 } ; idx < array.layer_sources.size() ; ++idx ) {
+        const std::string& source = array.layer_sources[ idx ];
+        if ( source.empty() ) {
+            continue;
+        }
+        auto compiled = Compiled_texture::load( source, allow_compression );
+        if ( nullptr == compiled ||
+             compiled->format() != array.size_class.format ||
+             compiled->width() != array.size_class.width ||
+             compiled->height() != array.size_class.height ||
+             compiled->levels() != array.size_class.levels ) {
+            ERR( "Unable to reload the texture ", source,
+                 " in the array ", array.handle );
+            continue;
+        }
+        upload_layer( id, *compiled, idx );
+    }
+    glDeleteTextures( 1, &array.id );
+    array.id = id;
+    array.layer_sources.resize( layers );
+    //The handle is the same but the GL texture is not
+    for ( auto&& bound : bound_arrays ) {
+        if ( bound == array.handle ) {
+            bound = 0;
+        }
+    }
+    LOG3( "Texture array ", array.handle, " grown to ", layers,
+          " layers, used: ", array.used );
+}
+
+GLuint Texture_arrays::create_storage( const Size_class& size_class,
+                                       const Compiled_texture& texture,
+                                       const std::size_t layers )
+{
+    GLuint id;
+    glGenTextures( 1, &id );
+    glBindTexture( GL_TEXTURE_2D_ARRAY, id );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY,
+                     GL_TEXTURE_WRAP_S, size_class.wrapping_method );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY,
+                     GL_TEXTURE_WRAP_T, size_class.wrapping_method );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY,
+                     GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY,
+                     GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+    glTexParameteri( GL_TEXTURE_2D_ARRAY,
+                     GL_TEXTURE_MAX_LEVEL, texture.levels() - 1 );
+    for ( std::size_t idx{ 0 } ; idx < texture.levels() ; ++idx ) {
+        const auto& lvl = texture.level( idx );
+        if ( texture.format() == compiled_format::rgba8 ) {
+            glTexImage3D( GL_TEXTURE_2D_ARRAY,
+                          idx,
+                          GL_RGBA8,
+                          lvl.width, lvl.height, layers,
+                          0,
+                          GL_RGBA,
+                          GL_UNSIGNED_BYTE,
+                          nullptr );
+        } else {
+            glCompressedTexImage3D( GL_TEXTURE_2D_ARRAY,
+                                    idx,
+                                    internal_format( texture.format() ),
+                                    lvl.width, lvl.height, layers,
+                                    0,
+                                    lvl.size * layers,
+                                    nullptr );
+        }
+    }
+    glBindTexture( GL_TEXTURE_2D_ARRAY, 0 );
+    return id;
+}
+
+void Texture_arrays::upload_layer( const GLuint id,
+                                   const Compiled_texture& texture,
+                                   const GLint layer )
+{
+    glBindTexture( GL_TEXTURE_2D_ARRAY, id );
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 1 );
+    for ( std::size_t idx{ 0 } ; idx < texture.levels() ; ++idx ) {
+        const auto& lvl = texture.level( idx );
+        if ( texture.format() == compiled_format::rgba8 ) {
+            glTexSubImage3D( GL_TEXTURE_2D_ARRAY,
+                             idx,
+                             0, 0, layer,
+                             lvl.width, lvl.height, 1,
+                             GL_RGBA,
+                             GL_UNSIGNED_BYTE,
+                             texture.level_data( idx ) );
+        } else {
+            glCompressedTexSubImage3D( GL_TEXTURE_2D_ARRAY,
+                                       idx,
+                                       0, 0, layer,
+                                       lvl.width, lvl.height, 1,
+                                       internal_format( texture.format() ),
+                                       lvl.size,
+                                       texture.level_data( idx ) );
+        }
+    }
+    glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+    glBindTexture( GL_TEXTURE_2D_ARRAY, 0 );
+}
+
+Texture_arrays& arrays()
+{
+    static Texture_arrays instance;
+    return instance;
+}
+
+}
@@ -0,0 +1,115 @@
+#ifndef TEXTURE_ARRAYS_HPP
+#define TEXTURE_ARRAYS_HPP
+
+#include <texture_compiler.hpp>
+#include <vector>
+#include <string>
+
+namespace textures {
+
+/*
+ * Texture units of the diffuse and
+ * specular texture arrays
+ */
+constexpr GLint diffuse_array_unit{ 4 };
+constexpr GLint specular_array_unit{ 5 };
+
+/*
+ * Upper limit for the memory of a single array, the
+ * arrays grow with the textures of their size
+ * class and never exceed this limit
+ */
+constexpr uint64_t max_array_size_in_bytes{ 64 * 1024 * 1024 };
+
+/*
+ * Position of a texture in one of the arrays, array
+ * is the handle of the array (not the GL texture,
+ * which changes when the array grows) to be
+ * passed to Texture_arrays::bind
+ */
+struct Texture_layer {
+    GLuint array{ 0 };
+    GLint  layer{ -1 };
+};
+
+/*
+ * Pack the textures in GL_TEXTURE_2D_ARRAY objects,
+ * one array for each size class (format, size, mip
+ * levels and sampler parameters) unless the class
+ * exceeds the array limits. The meshes using textures
+ * from the same arrays are drawn without any texture
+ * rebinding, the layer is a vertex attribute.
+ * GL thread only.
+ */
+class Texture_arrays
+{
+public:
+    /*
+     * source_path is the image of the compiled
+     * texture, loaded again if the array grows
+     */
+    Texture_layer allocate( const Compiled_texture& texture,
+                            const GLint wrapping_method,
+                            const std::string& source_path );
+    void release( const Texture_layer& layer );
+    /*
+     * Bind the array to the unit, skipped
+     * if already bound
+     */
+    void bind( const GLint unit, const GLuint array );
+private:
+    struct Size_class {
+        compiled_format format;
+        GLint width;
+        GLint height;
+        std::size_t levels;
+        GLint wrapping_method;
+        bool operator==( const Size_class& other ) const;
+    };
+    struct Array {
+        GLuint handle;
+        GLuint id;
+        Size_class size_class;
+        //The source of each layer, empty if not used
+        std::vector< std::string > layer_sources;
+        std::size_t used;
+        std::size_t max_layers;
+    };
+    /*
+     * The array of the class with a free layer,
+     * grown or created if needed
+     */
+    Array& array_for( const Size_class& size_class,
+                      const Compiled_texture& texture );
+    Array& create_array( const Size_class& size_class,
+                         const Compiled_texture& texture );
+    /*
+     * Move the array to a new texture with twice the
+     * layers, the used layers are loaded again from
+     * their compiled files (GL 3.3 cannot copy
+     * the compressed formats on the GPU)
+     */
+    void grow_array( Array& array,
+                     const Compiled_texture& texture );
+    GLuint create_storage( const Size_class& size_class,
+                           const Compiled_texture& texture,
+                           const std::size_t layers );
+    void upload_layer( const GLuint id,
+                       const Compiled_texture& texture,
+                       const GLint layer );
+    std::vector< Array > arrays;
+    GLuint next_handle{ 1 };
+    GLint max_layers{ 0 };
+    //Handles
+    GLuint bound_arrays[ 2 ]{ 0, 0 };
+};
+
+/*
+ * The arrays used by the game,
+ * created at the first call
+ */
+Texture_arrays& arrays();
+
+}
+
+#endif //TEXTURE_ARRAYS_HPP
@@ -0,0 +1,167 @@
+#include <texture_cache.hpp>
+#include <logger/logger.hpp>
+#include <cstdlib>
+#include <climits>
+
+namespace textures {
+
+namespace {
+
+std::string canonical_path( const std::string& filename )
+{
+    char resolved[ PATH_MAX ];
+    if ( nullptr == realpath( filename.c_str(), resolved ) ) {
+        return filename;
+    }
+    return resolved;
+}
+
+}
+
+Cached_texture::Cached_texture( const std::string& filename,
+                                const std::string& key,
+                                const GLint wrapping_method,
+                                const bool allow_compression ) :
+    filename{ filename },
+    key{ key },
+    wrapping_method{ wrapping_method },
+    allow_compression{ allow_compression },
+    texture_size{ 0 }
+{
+}
+
+Cached_texture::~Cached_texture()
+{
+    LOG1( "Releasing the texture ", filename );
+    cache().release( key, texture_layer );
+}
+
+void Cached_texture::decode()
+{
+    std::lock_guard< std::mutex > lock( texture_mutex );
+    if ( texture_layer.array != 0 || nullptr != compiled ) {
+        return;
+    }
+    compiled = Compiled_texture::load( filename, allow_compression );
+    if ( nullptr == compiled ) {
+        PANIC( "Unable to load the texture! ", filename );
+    }
+    texture_size = compiled->size_in_bytes();
+}
+
+Texture_layer Cached_texture::upload()
+{
+    std::lock_guard< std::mutex > lock( texture_mutex );
+    if ( texture_layer.array == 0 ) {
+        if ( nullptr == compiled ) {
+            compiled = Compiled_texture::load( filename, allow_compression );
+            if ( nullptr == compiled ) {
+                PANIC( "Unable to load the texture! ", filename );
+            }
+            texture_size = compiled->size_in_bytes();
+        }
+        texture_layer = arrays().allocate( *compiled, wrapping_method, filename );
+        //The mapping is not needed anymore
+        compiled = nullptr;
+    }
+    return texture_layer;
+}
+
+uint64_t Cached_texture::size_in_bytes()
+{
+    std::lock_guard< std::mutex > lock( texture_mutex );
+    return texture_size;
+}
+
+const std::string& Cached_texture::get_filename() const
+{
+    return filename;
+}
+
+texture_ref Texture_cache::acquire( const std::string& filename,
+                                    const GLint wrapping_method,
+                                    Texture_cache_stats& load_stats )
+{
+    const std::string key = canonical_path( filename ) + "#" +
+                            std::to_string( wrapping_method );
+    texture_ref texture;
+    bool hit{ false };
+    {
+        std::lock_guard< std::mutex > lock( cache_mutex );
+        auto& entry = cache[ key ];
+        texture = entry.lock();
+        if ( nullptr == texture ) {
+            texture = std::make_shared< Cached_texture >( filename,
+                      key,
+                      wrapping_method,
+                      compression_enabled.load() );
+            entry = texture;
+        } else {
+            hit = true;
+        }
+    }
+    /*
+     * Decode outside the cache lock, the concurrent
+     * requests for the same image wait for the
+     * first decoding to complete
+     */
+    texture->decode();
+    const uint64_t saved = hit ? texture->size_in_bytes() : 0;
+    ++load_stats.requests;
+    load_stats.hits += hit;
+    load_stats.bytes_saved += saved;
+    std::lock_guard< std::mutex > lock( cache_mutex );
+    ++stats.requests;
+    stats.hits += hit;
+    stats.bytes_saved += saved;
+    return texture;
+}
+
+Texture_cache_stats Texture_cache::get_stats()
+{
+    std::lock_guard< std::mutex > lock( cache_mutex );
+    return stats;
+}
+
+void Texture_cache::set_compression( const bool enabled )
+{
+    LOG3( "Texture compression enabled: ", enabled );
+    compression_enabled = enabled;
+}
+
+void Texture_cache::release( const std::string& key,
+                             const Texture_layer& layer )
+{
+    {
+        std::lock_guard< std::mutex > lock( cache_mutex );
+        auto it = cache.find( key );
+        //Might be already replaced by a new texture
+        if ( it != cache.end() && it->second.expired() ) {
+            cache.erase( it );
+        }
+    }
+    if ( layer.array != 0 ) {
+        std::lock_guard< std::mutex > lock( release_mutex );
+        pending_releases.push_back( layer );
+    }
+}
+
+void Texture_cache::process_releases()
+{
+    std::vector< Texture_layer > layers;
+    {
+        std::lock_guard< std::mutex > lock( release_mutex );
+        layers.swap( pending_releases );
+    }
+    for ( auto&& layer : layers ) {
+        arrays().release( layer );
+    }
+}
+
+Texture_cache& cache()
+{
+    static Texture_cache instance;
+    return instance;
+}
+
+}
@@ -0,0 +1,127 @@
+#ifndef TEXTURE_CACHE_HPP
+#define TEXTURE_CACHE_HPP
+
+#include <textures.hpp>
+#include <texture_compiler.hpp>
+#include <texture_arrays.hpp>
+#include <atomic>
+#include <unordered_map>
+#include <mutex>
+#include <memory>
+#include <vector>
+
+namespace textures {
+
+/*
+ * Texture shared by all the users which
+ * requested the same image with the same
+ * sampler parameters. The texture array layer
+ * is released with the last reference, on the
+ * GL thread (see Texture_cache::process_releases)
+ */
+class Cached_texture
+{
+public:
+    using pointer = std::shared_ptr< Cached_texture >;
+    Cached_texture( const std::string& filename,
+                    const std::string& key,
+                    const GLint wrapping_method,
+                    const bool allow_compression );
+    ~Cached_texture();
+    Cached_texture( const Cached_texture& ) = delete;
+    Cached_texture& operator=( const Cached_texture& ) = delete;
+    /*
+     * Load (or compile) the mip chain if not done
+     * yet, safe to be called from any thread
+     */
+    void decode();
+    /*
+     * Return the array layer of the texture, uploading
+     * the image at the first call. GL thread only
+     */
+    Texture_layer upload();
+    /*
+     * GPU memory used by the texture,
+     * mipmaps included
+     */
+    uint64_t size_in_bytes();
+    const std::string& get_filename() const;
+private:
+    const std::string filename;
+    //In the texture cache
+    const std::string key;
+    const GLint wrapping_method;
+    const bool allow_compression;
+    std::mutex texture_mutex;
+    Compiled_texture::pointer compiled;
+    Texture_layer texture_layer;
+    uint64_t texture_size;
+};
+
+using texture_ref = Cached_texture::pointer;
+
+struct Texture_cache_stats {
+    std::size_t requests{ 0 };
+    std::size_t hits{ 0 };
+    uint64_t    bytes_saved{ 0 };
+    GLfloat hit_rate() const
+    {
+        return requests == 0 ? 0.0f :
+               static_cast< GLfloat >( hits ) / requests;
+    }
+};
+
+/*
+ * Process wide cache of the textures, keyed by the
+ * canonical path of the image and the sampler
+ * parameters. Only weak references are stored:
+ * the cache does not keep the textures alive.
+ */
+class Texture_cache
+{
+public:
+    /*
+     * Return the shared texture for the image, decoded.
+     * Safe to be called from any thread, the
+     * request is accounted in load_stats as well
+     */
+    texture_ref acquire( const std::string& filename,
+                         const GLint wrapping_method,
+                         Texture_cache_stats& load_stats );
+    Texture_cache_stats get_stats();
+    /*
+     * Enable the block compressed formats, to be
+     * set according to the context capabilities
+     * before loading any texture
+     */
+    void set_compression( const bool enabled );
+    /*
+     * Drop the entry of the released texture and queue
+     * the release of its layer, from any thread
+     */
+    void release( const std::string& key,
+                  const Texture_layer& layer );
+    /*
+     * Release the queued texture layers, the last
+     * reference might be dropped by a worker
+     * thread. GL thread only
+     */
+    void process_releases();
+private:
+    std::atomic< bool > compression_enabled{ false };
+    std::mutex cache_mutex;
+    std::unordered_map< std::string, std::weak_ptr< Cached_texture > > cache;
+    Texture_cache_stats stats;
+    std::mutex release_mutex;
+    std::vector< Texture_layer > pending_releases;
+};
+
+/*
+ * The texture cache used by the game,
+ * created at the first call
+ */
+Texture_cache& cache();
+
+}
+
+#endif //TEXTURE_CACHE_HPP
@@ -0,0 +1,452 @@
+#include <texture_compiler.hpp>
+#include <logger/logger.hpp>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <cstdlib>
+
+namespace textures {
+
+namespace {
+
+constexpr char compiled_texture_magic[4] = { 'B', 'T', 'E', 'X' };
+
+using rgba_t = std::array< uint8_t, 4 >;
+
+/*
+ * Next level of the mip chain, 2x2 box filter.
+ * Odd sizes clamp to the last row/column
+ */
+std::vector< uint8_t > downsample( const std::vector< uint8_t >& src,
+                                   const uint32_t width,
+                                   const uint32_t height )
+{
+    const uint32_t new_width = std::max< uint32_t >( 1, width / 2 );
+    const uint32_t new_height = std::max< uint32_t >( 1, height / 2 );
+    std::vector< uint8_t > dst( new_width * new_height * 4 );
+    for ( uint32_t y{ 0 } ; y < new_height ; ++y ) {
+        const uint32_t y0 = std::min( y * 2, height - 1 ),
+                       y1 = std::min( y * 2 + 1, height - 1 );
+        for ( uint32_t x{ 0 } ; x < new_width ; ++x ) {
+            const uint32_t x0 = std::min( x * 2, width - 1 ),
+                           x1 = std::min( x * 2 + 1, width - 1 );
+            for ( uint32_t c{ 0 } ; c < 4 ; ++c ) {
+                const uint32_t sum = src[ ( y0 * width + x0 ) * 4 + c ] +
+                                     src[ ( y0 * width + x1 ) * 4 + c ] +
+                                     src[ ( y1 * width + x0 ) * 4 + c ] +
+                                     src[ ( y1 * width + x1 ) * 4 + c ];
+                dst[ ( y * new_width + x ) * 4 + c ] = ( sum + 2 ) / 4;
+            }
+        }
+    }
+    return dst;
+}
+
+/*
+ * Read the 4x4 block at bx,by, the pixels outside
+ * the image replicate the border
+ */
+void fetch_block( const std::vector< uint8_t >& src,
+                  const uint32_t width,
+                  const uint32_t height,
+                  const uint32_t bx,
+                  const uint32_t by,
+                  rgba_t ( &block )[16] )
+{
+    for ( uint32_t y{ 0 } ; y < 4 ; ++y ) {
+        const uint32_t sy = std::min( by * 4 + y, height - 1 );
+        for ( uint32_t x{ 0 } ; x < 4 ; ++x ) {
+            const uint32_t sx = std::min( bx * 4 + x, width - 1 );
+            std::memcpy( block[ y * 4 + x ].data(),
+                         &src[ ( sy * width + sx ) * 4 ], 4 );
+        }
+    }
+}
+
+uint16_t to_565( const int r, const int g, const int b )
+{
+    return ( ( r * 31 + 127 ) / 255 ) << 11 |
+           ( ( g * 63 + 127 ) / 255 ) << 5 |
+           ( ( b * 31 + 127 ) / 255 );
+}
+
+rgba_t from_565( const uint16_t color )
+{
+    const int r = ( color >> 11 ) & 31,
+              g = ( color >> 5 ) & 63,
+              b = color & 31;
+    return { static_cast< uint8_t >( ( r << 3 ) | ( r >> 2 ) ),
+             static_cast< uint8_t >( ( g << 2 ) | ( g >> 4 ) ),
+             static_cast< uint8_t >( ( b << 3 ) | ( b >> 2 ) ),
+             255 };
+}
+
+/*
+ * BC1 color block, always in the four colors
+ * mode: the end points are the inset bounding
+ * box of the block colors
+ */
+void encode_color_block( const rgba_t ( &block )[16],
+                         uint8_t* output )
+{
+    int min_c[3] = { 255, 255, 255 }, max_c[3] = { 0, 0, 0 };
+    for ( auto&& pixel : block ) {
+        for ( int c{ 0 } ; c < 3 ; ++c ) {
+            min_c[ c ] = std::min< int >( min_c[ c ], pixel[ c ] );
+            max_c[ c ] = std::max< int >( max_c[ c ], pixel[ c ] );
+        }
+    }
+    for ( int c{ 0 } ; c < 3 ; ++c ) {
+        const int inset = ( max_c[ c ] - min_c[ c ] ) / 16;
+        min_c[ c ] += inset;
+        max_c[ c ] -= inset;
+    }
+    uint16_t color0 = to_565( max_c[0], max_c[1], max_c[2] ),
+             color1 = to_565( min_c[0], min_c[1], min_c[2] );
+    if ( color0 < color1 ) {
+        std::swap( color0, color1 );
+    }
+    uint32_t indices{ 0 };
+    if ( color0 != color1 ) {
+        const rgba_t c0 = from_565( color0 ), c1 = from_565( color1 );
+        int palette[4][3];
+        for ( int c{ 0 } ; c < 3 ; ++c ) {
+            palette[0][ c ] = c0[ c ];
+            palette[1][ c ] = c1[ c ];
+            palette[2][ c ] = ( 2 * c0[ c ] + c1[ c ] ) / 3;
+            palette[3][ c ] = ( c0[ c ] + 2 * c1[ c ] ) / 3;
+        }
+        for ( uint32_t idx{ 0 } ; idx < 16 ; ++idx ) {
+            int best{ 0 }, best_distance{ std::numeric_limits< int >::max() };
+            for ( int entry{ 0 } ; entry < 4 ; ++entry ) {
+                int distance{ 0 };
+                for ( int c{ 0 } ; c < 3 ; ++c ) {
+                    const int delta = block[ idx ][ c ] - palette[ entry ][ c ];
+                    distance += delta * delta;
+                }
+                if ( distance < best_distance ) {
+                    best_distance = distance;
+                    best = entry;
+                }
+            }
+            indices |= static_cast< uint32_t >( best ) << ( idx * 2 );
+        }
+    }
+    output[0] = color0 & 0xFF;
+    output[1] = color0 >> 8;
+    output[2] = color1 & 0xFF;
+    output[3] = color1 >> 8;
+    for ( int byte{ 0 } ; byte < 4 ; ++byte ) {
+        output[ 4 + byte ] = ( indices >> ( byte * 8 ) ) & 0xFF;
+    }
+}
+
+/*
+ * BC3 alpha block, eight alpha values mode
+ */
+void encode_alpha_block( const rgba_t ( &block )[16],
+                         uint8_t* output )
+{
+    int alpha0{ 0 }, alpha1{ 255 };
+    for ( auto&& pixel : block ) {
+        alpha0 = std::max< int >( alpha0, pixel[3] );
+        alpha1 = std::min< int >( alpha1, pixel[3] );
+    }
+    uint64_t indices{ 0 };
+    if ( alpha0 != alpha1 ) {
+        int palette[8] = { alpha0, alpha1 };
+        for ( int entry{ 1 } ; entry < 7 ; ++entry ) {
+            palette[ entry + 1 ] = ( ( 7 - entry ) * alpha0 + entry * alpha1 ) / 7;
+        }
+        for ( uint32_t idx{ 0 } ; idx < 16 ; ++idx ) {
+            int best{ 0 }, best_distance{ 256 };
+            for ( int entry{ 0 } ; entry < 8 ; ++entry ) {
+                const int distance = std::abs( block[ idx ][3] - palette[ entry ] );
+                if ( distance < best_distance ) {
+                    best_distance = distance;
+                    best = entry;
+                }
+            }
+            indices |= static_cast< uint64_t >( best ) << ( idx * 3 );
+        }
+    }
+    output[0] = alpha0;
+    output[1] = alpha1;
+    for ( int byte{ 0 } ; byte < 6 ; ++byte ) {
+        output[ 2 + byte ] = ( indices >> ( byte * 8 ) ) & 0xFF;
+    }
+}
+
+std::size_t level_size( const compiled_format format,
+                        const uint32_t width,
+                        const uint32_t height )
+{
+    const std::size_t blocks = ( ( width + 3 ) / 4 ) * ( ( height + 3 ) / 4 );
+    switch ( format ) {
+    case compiled_format::bc1:
+        return blocks * 8;
+    case compiled_format::bc3:
+        return blocks * 16;
+    default:
+        break;
+    }
+    return static_cast< std::size_t >( width ) * height * 4;
+}
+
+void encode_level( const compiled_format format,
+                   const std::vector< uint8_t >& pixels,
+                   const uint32_t width,
+                   const uint32_t height,
+                   uint8_t* output )
+{
+    if ( format == compiled_format::rgba8 ) {
+        std::memcpy( output, pixels.data(), pixels.size() );
+        return;
+    }
+    rgba_t block[16];
+    for ( uint32_t by{ 0 } ; by < ( height + 3 ) / 4 ; ++by ) {
+        for ( uint32_t bx{ 0 } ; bx < ( width + 3 ) / 4 ; ++bx ) {
+            fetch_block( pixels, width, height, bx, by, block );
+            if ( format == compiled_format::bc3 ) {
+                encode_alpha_block( block, output );
+                output += 8;
+            }
+            encode_color_block( block, output );
+            output += 8;
+        }
+    }
+}
+
+}
+
+std::vector< uint8_t > compile_texture( const Texture_image& image,
+                                        const uint64_t source_size,
+                                        const int64_t source_mtime,
+                                        const bool allow_compression )
+{
+    const uint32_t width = image.width, height = image.height;
+    std::vector< uint8_t > pixels( image.pixels.get(),
+                                   image.pixels.get() + width * height * 4 );
+    compiled_format format{ compiled_format::rgba8 };
+    if ( allow_compression ) {
+        format = compiled_format::bc1;
+        for ( std::size_t idx{ 3 } ; idx < pixels.size() ; idx += 4 ) {
+            if ( pixels[ idx ] != 255 ) {
+                format = compiled_format::bc3;
+                break;
+            }
+        }
+    }
+
+    Compiled_texture_header header;
+    std::memset( &header, 0, sizeof( header ) );
+    std::memcpy( header.magic, compiled_texture_magic, sizeof( compiled_texture_magic ) );
+    header.version = compiled_texture_version;
+    header.format = static_cast< uint32_t >( format );
+    header.width = width;
+    header.height = height;
+    header.compression = allow_compression ? 1 : 0;
+    header.levels = 1;
+    for ( uint32_t size = std::max( width, height ) ; size > 1 ; size /= 2 ) {
+        ++header.levels;
+    }
+    header.source_size = source_size;
+    header.source_mtime = source_mtime;
+
+    std::vector< Compiled_texture_level > levels( header.levels );
+    std::size_t offset = files::align_offset( sizeof( header ) +
+                         levels.size() * sizeof( Compiled_texture_level ), 16 );
+    uint32_t level_width = width, level_height = height;
+    for ( auto&& level : levels ) {
+        level.offset = offset;
+        level.size = level_size( format, level_width, level_height );
+        level.width = level_width;
+        level.height = level_height;
+        offset = files::align_offset( offset + level.size, 16 );
+        level_width = std::max< uint32_t >( 1, level_width / 2 );
+        level_height = std::max< uint32_t >( 1, level_height / 2 );
+    }
+
+    std::vector< uint8_t > buffer( offset, 0 );
+    std::memcpy( buffer.data(), &header, sizeof( header ) );
+    std::memcpy( buffer.data() + sizeof( header ), levels.data(),
+                 levels.size() * sizeof( Compiled_texture_level ) );
+    for ( std::size_t idx{ 0 } ; idx < levels.size() ; ++idx ) {
+        if ( idx > 0 ) {
+            pixels = downsample( pixels, levels[ idx - 1 ].width,
+                                 levels[ idx - 1 ].height );
+        }
+        encode_level( format, pixels, levels[ idx ].width,
+                      levels[ idx ].height,
+                      buffer.data() + levels[ idx ].offset );
+    }
+    return buffer;
+}
+
+Compiled_texture::Compiled_texture( files::Mapped_file::pointer file,
+                                    std::vector< uint8_t > buffer ) :
+    file{ file },
+    buffer{ std::move( buffer ) },
+    header{ nullptr },
+    level_table{ nullptr }
+{
+    if ( nullptr != this->file ) {
+        data = this->file->data();
+        data_size = this->file->size();
+    } else {
+        data = this->buffer.data();
+        data_size = this->buffer.size();
+    }
+}
+
+Compiled_texture::pointer Compiled_texture::load( const std::string& source_path,
+        const bool allow_compression )
+{
+    const std::string path = source_path + compiled_texture_extension;
+    uint64_t size;
+    int64_t mtime;
+    if ( files::file_info( path, size, mtime ) ) {
+        auto mapped = std::make_shared< files::Mapped_file >( path );
+        auto texture = validate( std::make_shared< Compiled_texture >( mapped,
+                                 std::vector< uint8_t >() ),
+                                 source_path,
+                                 allow_compression );
+        if ( nullptr != texture ) {
+            return texture;
+        }
+    }
+
+    uint64_t source_size;
+    int64_t source_mtime;
+    if ( false == files::file_info( source_path, source_size, source_mtime ) ) {
+        ERR( "Unable to access the texture ", source_path );
+        return nullptr;
+    }
+    LOG1( "Compiling the texture ", source_path );
+    auto buffer = compile_texture( decode_texture( source_path ),
+                                   source_size,
+                                   source_mtime,
+                                   allow_compression );
+    const std::string temp_path = path + ".tmp";
+    {
+        std::ofstream output( temp_path, std::ios::binary | std::ios::trunc );
+        output.write( reinterpret_cast< const char* >( buffer.data() ),
+                      buffer.size() );
+        if ( !output ) {
+            WARN1( "Unable to write the compiled texture ", path );
+        }
+    }
+    if ( false == files::file_info( temp_path, size, mtime ) ||
+         size != buffer.size() ||
+         0 != std::rename( temp_path.c_str(), path.c_str() ) ) {
+        std::remove( temp_path.c_str() );
+    }
+    //The compiled data is used from memory
+    return validate( std::make_shared< Compiled_texture >( nullptr,
+                     std::move( buffer ) ),
+                     source_path,
+                     allow_compression );
+}
+
+Compiled_texture::pointer Compiled_texture::validate( pointer texture,
+        const std::string& source_path,
+        const bool allow_compression )
+{
+    if ( texture->data_size < sizeof( Compiled_texture_header ) ) {
+        return nullptr;
+    }
+    const auto* header = reinterpret_cast< const Compiled_texture_header* >( texture->data );
+    if ( 0 != std::memcmp( header->magic, compiled_texture_magic, sizeof( compiled_texture_magic ) ) ||
+         header->version != compiled_texture_version ||
+         header->format > static_cast< uint32_t >( compiled_format::bc3 ) ||
+         header->compression != ( allow_compression ? 1u : 0u ) ||
+         header->levels == 0 ||
+         header->levels > 32 ||
+         sizeof( Compiled_texture_header ) + header->levels * sizeof( Compiled_texture_level ) >
+         texture->data_size ) {
+        LOG1( "Outdated compiled texture for ", source_path );
+        return nullptr;
+    }
+    uint64_t source_size;
+    int64_t source_mtime;
+    if ( files::file_info( source_path, source_size, source_mtime ) &&
+         ( source_size != header->source_size ||
+           source_mtime != header->source_mtime ) ) {
+        LOG1( "The texture ", source_path, " changed, recompiling" );
+        return nullptr;
+    }
+    const auto* levels = reinterpret_cast< const Compiled_texture_level* >(
+                             texture->data + sizeof( Compiled_texture_header ) );
+    for ( uint32_t idx{ 0 } ; idx < header->levels ; ++idx ) {
+        if ( levels[ idx ].offset > texture->data_size ||
+             levels[ idx ].size > texture->data_size - levels[ idx ].offset ||
+             levels[ idx ].size != level_size( static_cast< compiled_format >( header->format ),
+                                               levels[ idx ].width,
+                                               levels[ idx ].height ) ) {
+            ERR( "Corrupted compiled texture for ", source_path );
+            return nullptr;
+        }
+    }
+    texture->header = header;
+    texture->level_table = levels;
+    return texture;
+}
+
+compiled_format Compiled_texture::format() const
+{
+    return static_cast< compiled_format >( header->format );
+}
+
+GLint Compiled_texture::width() const
+{
+    return header->width;
+}
+
+GLint Compiled_texture::height() const
+{
+    return header->height;
+}
+
+std::size_t Compiled_texture::levels() const
+{
+    return header->levels;
+}
+
+const Compiled_texture_level& Compiled_texture::level( const std::size_t idx ) const
+{
+    return level_table[ idx ];
+}
+
+const uint8_t* Compiled_texture::level_data( const std::size_t idx ) const
+{
+    return data + level_table[ idx ].offset;
+}
+
+uint64_t Compiled_texture::size_in_bytes() const
+{
+    uint64_t size{ 0 };
+    for ( std::size_t idx{ 0 } ; idx < levels() ; ++idx ) {
+        size += level_table[ idx ].size;
+    }
+    return size;
+}
+
+bool s3tc_supported()
+{
+    GLint num_of_extensions{ 0 };
+    glGetIntegerv( GL_NUM_EXTENSIONS, &num_of_extensions );
+    for ( GLint idx{ 0 } ; idx < num_of_extensions ; ++idx ) {
+        const char* name = reinterpret_cast< const char* >(
+                               glGetStringi( GL_EXTENSIONS, idx ) );
+        if ( nullptr != name &&
+             0 == std::strcmp( name, "GL_EXT_texture_compression_s3tc" ) ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
@@ -0,0 +1,122 @@
+#ifndef TEXTURE_COMPILER_HPP
+#define TEXTURE_COMPILER_HPP
+
+#include <textures.hpp>
+#include <mapped_file.hpp>
+#include <cstdint>
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+namespace textures {
+
+/*
+ * Precompiled texture container.
+ *
+ * The first time an image is loaded it is compiled
+ * next to the source (<image>.btex) with the whole mip
+ * chain, block compressed when supported: BC1 for the
+ * opaque images, BC3 when the alpha is used, RGBA8
+ * otherwise. The following loads map the file and
+ * pass the levels directly to OpenGL (see
+ * texture_arrays.hpp).
+ *
+ * Layout, the levels are aligned to 16 bytes:
+ * Compiled_texture_header
+ * Compiled_texture_level[ levels ]
+ * level data
+ */
+constexpr uint32_t compiled_texture_version{ 2 };
+const std::string compiled_texture_extension{ ".btex" };
+
+enum class compiled_format : uint32_t {
+    rgba8,
+    bc1,
+    bc3
+};
+
+struct Compiled_texture_header {
+    char     magic[4];
+    uint32_t version;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levels;
+    /*
+     * 1 if compiled with the compression allowed, the
+     * texture is compiled again when the setting or the
+     * support of the context changes
+     */
+    uint32_t compression;
+    uint64_t source_size;
+    int64_t  source_mtime;
+};
+
+struct Compiled_texture_level {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t width;
+    uint32_t height;
+};
+
+/*
+ * Mip chain of an image ready for the upload,
+ * either mapped from the compiled file or kept
+ * in memory when the file cannot be written
+ */
+class Compiled_texture
+{
+public:
+    using pointer = std::shared_ptr< Compiled_texture >;
+    /*
+     * Open the compiled texture, compile it if missing
+     * or outdated. Does not perform GL calls
+     */
+    static pointer load( const std::string& source_path,
+                         const bool allow_compression );
+    Compiled_texture( files::Mapped_file::pointer file,
+                      std::vector< uint8_t > buffer );
+    compiled_format format() const;
+    GLint width() const;
+    GLint height() const;
+    std::size_t levels() const;
+    const Compiled_texture_level& level( const std::size_t idx ) const;
+    const uint8_t* level_data( const std::size_t idx ) const;
+    /*
+     * Size of all the levels
+     */
+    uint64_t size_in_bytes() const;
+private:
+    static pointer validate( pointer texture,
+                             const std::string& source_path,
+                             const bool allow_compression );
+    files::Mapped_file::pointer file;
+    std::vector< uint8_t > buffer;
+    const uint8_t* data;
+    std::size_t data_size;
+    const Compiled_texture_header* header;
+    const Compiled_texture_level* level_table;
+};
+
+/*
+ * Build the container for the image: mip chain
+ * and block compression
+ */
+std::vector< uint8_t > compile_texture( const Texture_image& image,
+                                        const uint64_t source_size,
+                                        const int64_t source_mtime,
+                                        const bool allow_compression );
+
+/*
+ * Whether the context supports the S3TC (BC1-3)
+ * formats, GL thread only
+ */
+bool s3tc_supported();
+
+}
+
+#endif //TEXTURE_COMPILER_HPP
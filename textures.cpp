@@ -6,23 +6,32 @@ namespace textures {
 
 typedef unsigned char byte_t;
 
-texture_t load_texture( const std::string& filename,
-                        GLint wrapping_method )
+Texture_image decode_texture( const std::string& filename )
 {
-    LOG2( "load_texture: ", filename.c_str() );
-    texture_t TEX;
+    LOG2( "decode_texture: ", filename.c_str() );
+    Texture_image image;
     //Load the texture image
-    byte_t* image = SOIL_load_image( filename.c_str(),
-                                     &TEX.width,
-                                     &TEX.height,
-                                     0,
-                                     SOIL_LOAD_RGBA );
+    byte_t* data = SOIL_load_image( filename.c_str(),
+                                    &image.width,
+                                    &image.height,
+                                    0,
+                                    SOIL_LOAD_RGBA );
 
-    if ( image == nullptr ) {
+    if ( data == nullptr ) {
         PANIC( "Unable to load the texture! ",
                filename.c_str() );
     }
-    LOG2( "Loaded texture size: ", TEX.width, "/", TEX.height );
+    image.pixels = std::shared_ptr< byte_t >( data, SOIL_free_image_data );
+    LOG2( "Loaded texture size: ", image.width, "/", image.height );
+    return image;
+}
+
+texture_t upload_texture( const Texture_image& image,
+                          GLint wrapping_method )
+{
+    texture_t TEX;
+    TEX.width = image.width;
+    TEX.height = image.height;
     //Create the texture
     glGenTextures( 1, &TEX.id );
     glBindTexture( GL_TEXTURE_2D, TEX.id );
@@ -46,13 +55,20 @@ texture_t load_texture( const std::string& filename,
                   0,
                   GL_RGBA,
                   GL_UNSIGNED_BYTE,
-                  image );
+                  image.pixels.get() );
     glGenerateMipmap( GL_TEXTURE_2D );
 
-    SOIL_free_image_data( image );
     glBindTexture( GL_TEXTURE_2D, 0 );
 
     return TEX;
 }
 
+texture_t load_texture( const std::string& filename,
+                        GLint wrapping_method )
+{
+    LOG2( "load_texture: ", filename.c_str() );
+    return upload_texture( decode_texture( filename ),
+                           wrapping_method );
+}
+
 }
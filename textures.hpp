@@ -3,6 +3,7 @@
 
 #include <headers.hpp>
 #include <assimp/scene.h>
+#include <memory>
 
 namespace textures {
 
@@ -13,11 +14,20 @@ enum class texture_type {
     unknown
 };
 
+class Cached_texture;
+
 struct texture_t {
     GLuint id;
+    //Layer of the texture array id (a Texture_layer handle), -1 for 2D textures
+    GLint  layer{ -1 };
     GLint  width, height;
     texture_type type;
     std::string path;
+    /*
+     * Keep alive the shared texture,
+     * if loaded through the cache
+     */
+    std::shared_ptr< Cached_texture > resource;
     operator GLuint()
     {
         return id;
@@ -41,6 +51,28 @@ constexpr texture_type map_texture_type( const aiTextureType type )
     return texture_type::unknown;
 }
 
+/*
+ * Decoded RGBA8 image, not yet uploaded
+ * to the GPU
+ */
+struct Texture_image {
+    GLint width, height;
+    std::shared_ptr< unsigned char > pixels;
+};
+
+/*
+ * Load and decode the image, no OpenGL call is
+ * performed: safe to be called from any thread
+ */
+Texture_image decode_texture( const std::string& filename );
+
+/*
+ * Create the OpenGL texture for the decoded image,
+ * must be called from the thread which own the context
+ */
+texture_t upload_texture( const Texture_image& image,
+                          GLint wrapping_method = GL_REPEAT );
+
 //I'll find a better place for this function at the next refactoring.
 texture_t load_texture( const std::string& filename, GLint wrapping_method = GL_REPEAT );
 
@@ -0,0 +1,140 @@
+#include <thread_pool.hpp>
+#include <logger/logger.hpp>
+#include <algorithm>
+
+namespace workers {
+
+Thread_pool::Thread_pool( std::size_t num_of_threads ) :
+    terminate{ false }
+{
+    if ( num_of_threads == 0 ) {
+        num_of_threads = 1;
+    }
+    LOG3( "Creating the thread pool, number of threads: ",
+          num_of_threads );
+    //Nested parallel_for calls, one for each thread
+    range_jobs.reserve( num_of_threads + 1 );
+    for ( std::size_t idx{ 0 } ; idx < num_of_threads ; ++idx ) {
+        threads.emplace_back( &Thread_pool::worker_loop, this, idx );
+    }
+}
+
+Thread_pool::~Thread_pool()
+{
+    {
+        std::lock_guard< std::mutex > lock( tasks_mutex );
+        terminate = true;
+    }
+    tasks_cv.notify_all();
+    for ( auto&& thread : threads ) {
+        thread.join();
+    }
+}
+
+std::size_t Thread_pool::size() const
+{
+    return threads.size();
+}
+
+void Thread_pool::run_ranges( Range_job& job )
+{
+    std::unique_lock< std::mutex > lock( tasks_mutex );
+    if ( job.num_of_ranges > 1 ) {
+        range_jobs.push_back( &job );
+        tasks_cv.notify_all();
+    }
+    while ( job.next_range < job.num_of_ranges ) {
+        execute_range( job, claim_range( job ), lock );
+    }
+    ranges_cv.wait( lock, [ &job ]() {
+        return job.completed_ranges == job.num_of_ranges;
+    } );
+}
+
+std::size_t Thread_pool::claim_range( Range_job& job )
+{
+    const std::size_t range = job.next_range++;
+    if ( job.next_range == job.num_of_ranges ) {
+        auto it = std::find( range_jobs.begin(), range_jobs.end(), &job );
+        if ( it != range_jobs.end() ) {
+            range_jobs.erase( it );
+        }
+    }
+    return range;
+}
+
+void Thread_pool::execute_range( Range_job& job,
+                                 const std::size_t range,
+                                 std::unique_lock< std::mutex >& lock )
+{
+    const std::size_t begin = range * job.range_size;
+    const std::size_t end = std::min( begin + job.range_size, job.count );
+    lock.unlock();
+    job.run( job.func, begin, end );
+    lock.lock();
+    /*
+     * The caller might return as soon as the last
+     * range is completed, the job is not accessed
+     * after this point
+     */
+    if ( ++job.completed_ranges == job.num_of_ranges ) {
+        ranges_cv.notify_all();
+    }
+}
+
+void Thread_pool::worker_loop( const std::size_t worker_idx )
+{
+    SET_LOG_THREAD_NAME( "WORKER" + std::to_string( worker_idx ) );
+    LOG1( "Worker thread ready" );
+    while ( true ) {
+        std::function< void() > task;
+        {
+            std::unique_lock< std::mutex > lock( tasks_mutex );
+            tasks_cv.wait( lock, [ this ]() {
+                return terminate || false == tasks.empty() ||
+                       false == range_jobs.empty();
+            } );
+            //The ranges are waited by a parallel_for, they go first
+            if ( false == range_jobs.empty() ) {
+                Range_job& job = *range_jobs.front();
+                execute_range( job, claim_range( job ), lock );
+                continue;
+            }
+            if ( terminate && tasks.empty() ) {
+                break;
+            }
+            task = std::move( tasks.front() );
+            tasks.pop_front();
+        }
+        task();
+    }
+    LOG1( "Worker thread terminated" );
+}
+
+bool Thread_pool::run_pending_task()
+{
+    std::function< void() > task;
+    {
+        std::lock_guard< std::mutex > lock( tasks_mutex );
+        if ( tasks.empty() ) {
+            return false;
+        }
+        task = std::move( tasks.front() );
+        tasks.pop_front();
+    }
+    task();
+    return true;
+}
+
+Thread_pool& pool()
+{
+    /*
+     * The calling thread takes part to parallel_for,
+     * one core is left for it.
+     */
+    static Thread_pool game_pool(
+        std::max< unsigned >( std::thread::hardware_concurrency(), 2 ) - 1 );
+    return game_pool;
+}
+
+}
@@ -0,0 +1,150 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <headers.hpp>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <atomic>
+#include <type_traits>
+
+namespace workers {
+
+/*
+ * Pool of worker threads shared by the whole game,
+ * used for the CPU heavy processing (light culling,
+ * asset loading &c). Do not perform GL calls from
+ * the tasks, the GL context is owned by the main
+ * thread.
+ */
+class Thread_pool
+{
+public:
+    using pointer = std::shared_ptr< Thread_pool >;
+    explicit Thread_pool( std::size_t num_of_threads );
+    ~Thread_pool();
+    /*
+     * Queue a new task, the returned future
+     * provide the result of the task
+     */
+    template< typename Func >
+    auto submit( Func&& func ) -> std::future< decltype( func() ) >
+    {
+        using result_t = decltype( func() );
+        auto task = std::make_shared< std::packaged_task< result_t() > >(
+                        std::forward< Func >( func ) );
+        std::future< result_t > result = task->get_future();
+        {
+            std::lock_guard< std::mutex > lock( tasks_mutex );
+            tasks.emplace_back( [ task ]() {
+                ( *task )();
+            } );
+        }
+        tasks_cv.notify_one();
+        return result;
+    }
+    /*
+     * Split [0,count) in ranges of at least min_range
+     * elements and call func( begin, end ) for each of
+     * them in parallel. The calling thread takes part
+     * to the processing and the function returns only
+     * when all the ranges are completed. The ranges are
+     * picked by the workers before the queued tasks, the
+     * calling thread processes only the ranges of this
+     * call. Nothing is allocated.
+     */
+    template< typename Func >
+    void parallel_for( const std::size_t count,
+                       const std::size_t min_range,
+                       Func&& func )
+    {
+        if ( count == 0 ) {
+            return;
+        }
+        const std::size_t max_ranges = ( count + min_range - 1 ) / std::max< std::size_t >( min_range, 1 );
+        Range_job job;
+        job.num_of_ranges = std::min( max_ranges, threads.size() + 1 );
+        job.range_size = ( count + job.num_of_ranges - 1 ) / job.num_of_ranges;
+        job.count = count;
+        job.func = &func;
+        job.run = []( void* func, std::size_t begin, std::size_t end ) {
+            ( *static_cast< typename std::remove_reference< Func >::type* >( func ) )( begin, end );
+        };
+        run_ranges( job );
+    }
+    /*
+     * Wait for the future, in the meanwhile
+     * the calling thread execute the queued tasks.
+     * Safe to be called from a worker thread.
+     */
+    template< typename T >
+    void wait( std::future< T >& future )
+    {
+        while ( future.wait_for( std::chrono::seconds( 0 ) ) !=
+                std::future_status::ready ) {
+            if ( false == run_pending_task() ) {
+                future.wait_for( std::chrono::microseconds( 100 ) );
+            }
+        }
+    }
+    std::size_t size() const;
+private:
+    /*
+     * A parallel_for call, the fields are
+     * protected by tasks_mutex
+     */
+    struct Range_job {
+        void ( *run )( void*, std::size_t, std::size_t );
+        void* func;
+        std::size_t count;
+        std::size_t range_size;
+        std::size_t num_of_ranges;
+        std::size_t next_range{ 0 };
+        std::size_t completed_ranges{ 0 };
+    };
+    /*
+     * Queue the job, process its ranges and wait
+     * for the ranges taken by the workers
+     */
+    void run_ranges( Range_job& job );
+    /*
+     * Take the next range of the job, the job leaves
+     * the queue with its last range. Call with
+     * tasks_mutex locked
+     */
+    std::size_t claim_range( Range_job& job );
+    /*
+     * Execute the range, tasks_mutex is
+     * unlocked in the meanwhile
+     */
+    void execute_range( Range_job& job,
+                        const std::size_t range,
+                        std::unique_lock< std::mutex >& lock );
+    void worker_loop( const std::size_t worker_idx );
+    /*
+     * Execute one of the queued tasks, if any.
+     */
+    bool run_pending_task();
+    std::vector< std::thread > threads;
+    std::deque< std::function< void() > > tasks;
+    //The jobs with ranges not taken yet
+    std::vector< Range_job* > range_jobs;
+    std::mutex tasks_mutex;
+    std::condition_variable tasks_cv;
+    std::condition_variable ranges_cv;
+    bool terminate;
+};
+
+/*
+ * The pool used by the game, created
+ * at the first call
+ */
+Thread_pool& pool();
+
+}
+
+#endif //THREAD_POOL_HPP
@@ -18,9 +18,7 @@ Unit_model::Unit_model( const Unit_model_data& data ) :
     model = factory< models::model_loader >::create(
                 data.model_path
             );
-    if ( false == model->load_model() ) {
-        PANIC( "Not able to load the requested model!" );
-    }
+    asset = assets::loader().load_model( model );
 }
 
 models::my_mesh::meshes& Unit_model::get_meshes()
@@ -28,6 +26,16 @@ models::my_mesh::meshes& Unit_model::get_meshes()
     return model->get_mesh();
 }
 
+GLfloat Unit_model::get_model_radius()
+{
+    return model->get_model_radius();
+}
+
+assets::Model_asset::pointer Unit_model::get_asset() const
+{
+    return asset;
+}
+
 Unit::Unit( Unit_model::pointer unit_model ) :
     model{ unit_model }
 {
@@ -35,6 +43,7 @@ Unit::Unit( Unit_model::pointer unit_model ) :
           ", created! Pretty name: ",
           unit_model->model_data.pretty_name );
     rendering_data.default_color = unit_model->model_data.default_color;
+    rendering_data.bounding_radius = unit_model->get_model_radius();
 }
 
 bool Unit::render()
@@ -6,6 +6,7 @@
 #include <factory.hpp>
 #include <models.hpp>
 #include <renderable_object.hpp>
+#include <assets.hpp>
 
 namespace game_units {
 
@@ -37,7 +38,8 @@ struct Unit_model_data {
 
 /*
  * Reponsible for loading and manipulating
- * a unit model
+ * a unit model, the model is loaded
+ * asynchronously
  */
 class Unit_model
 {
@@ -46,6 +48,8 @@ public:
     using container = std::vector< pointer >;
     explicit Unit_model( const Unit_model_data& data );
     models::my_mesh::meshes& get_meshes();
+    GLfloat get_model_radius();
+    assets::Model_asset::pointer get_asset() const;
     operator uint64_t() const
     {
         return model_data.id;
@@ -54,6 +58,7 @@ public:
     Unit_model_data model_data;
 private:
     models::model_loader::pointer model;
+    assets::Model_asset::pointer asset;
 };
 
 namespace internal {
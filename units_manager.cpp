@@ -2,159 +2,6 @@
 
 namespace game_units {
 
-void Movements::change_unit_heading(
-    Unit::pointer& unit,
-    const Terrain_lot::pointer& target
-)
-{
-    const GLfloat new_heading = calculate_heading(
-                                    unit->rendering_data.position,
-                                    target->rendering_data.update_pos_from_model_matrix() );
-    unit->rendering_data.model_matrix = glm::rotate(
-                                            unit->rendering_data.model_matrix,
-                                            new_heading - unit->rendering_data.heading,
-                                            glm::vec3( 0.0f, 0.0f, 1.0f ) );
-    unit->rendering_data.heading = new_heading;
-}
-
-void Movements::place_unit_on_lot(
-    Unit::pointer& unit,
-    const game_terrains::Terrain_lot::pointer& lot )
-{
-    const glm::mat4 lot_mod_matx = lot->rendering_data.model_matrix;
-    unit->rendering_data.model_matrix = lot_mod_matx;
-    /*
-     * In order to avoid units to be 'inside'
-     * the terrain model, we need to translate the
-     * model matrix of an amount equal to the 'altitude'
-     * of the terrain'
-     */
-    unit->rendering_data.model_matrix = glm::translate(
-                                            unit->rendering_data.model_matrix,
-                                            glm::vec3(
-                                                    0.0,
-                                                    0.0,
-                                                    lot->altitude
-                                            ) );
-    /*
-     * Account for the heading as well
-     */
-    unit->rendering_data.model_matrix = glm::rotate(
-                                            unit->rendering_data.model_matrix,
-                                            unit->rendering_data.heading,
-                                            glm::vec3( 0.0f, 0.0f, 1.0f ) );
-    unit->rendering_data.update_pos_from_model_matrix();
-}
-
-GLfloat Movements::calculate_heading(
-    const types::point& source,
-    const types::point& target ) const
-{
-    if ( source == target ) {
-        return 0.0f;
-    }
-    return std::atan2( target.y - source.y,
-                       target.x - source.x ) + glm::half_pi<GLfloat>();
-}
-
-Move_processor::Move_processor(
-    Unit::pointer unit,
-    Terrain_lot::pointer lot ) :
-    unit{ unit },
-    target_lot{ lot },
-    status{ Move_processor::moving_status::READY },
-    original_position{ unit->rendering_data.position }
-{
-    LOG2( "Created, ID:", id, "! target unitID:", unit->id,
-          ", target lot:", lot->id );
-    const types::point from = unit->rendering_data.position;
-    const types::point to = glm::vec3(
-                                lot->rendering_data.position.x,
-                                lot->rendering_data.position.y,
-                                lot->altitude );
-    distance = glm::distance( from, to );
-    direction = glm::normalize( to - from );
-    LOG2( "Distance: ", distance,
-          ", Direction: ", direction,
-          ", from:", from,
-          ", to:", to );
-    heading = movement_impl.calculate_heading( from, to );
-}
-
-Move_processor::~Move_processor()
-{
-    LOG2( "Destroyed, ID:", id );
-}
-
-Move_processor::moving_status Move_processor::get_status() const
-{
-    return status;
-}
-
-void Move_processor::start()
-{
-    start_time = std::chrono::duration_cast< std::chrono::microseconds >
-                 (
-                     std::chrono::high_resolution_clock::now().time_since_epoch()
-                 );
-    arrival_time = std::chrono::duration_cast< std::chrono::microseconds >
-                   (
-                       start_time + std::chrono::seconds(
-                           static_cast< long int >( glm::ceil( distance / 4.0f ) )
-                       )
-                   );
-    status = Move_processor::moving_status::MOVING;
-    LOG2( "Movement unitID:", unit->id,
-          ", start:", start_time.count(),
-          ", arrival:", arrival_time.count(),
-          ", distance:", distance );
-}
-
-
-Move_processor::moving_status Move_processor::step(
-    const types::timestamp& current
-)
-{
-    /*
-     * The progress variable is needed to calculate at which
-     * point of the path the unit is
-     */
-    const GLfloat progress = movement_impl.speed_function(
-                                 static_cast<GLfloat>( ( current - start_time ).count() ) /
-                                 static_cast<GLfloat>( ( arrival_time - start_time ).count() )
-                             );
-
-    const glm::vec3 new_dir = direction * progress * distance;
-    const glm::vec3 new_pos = original_position + new_dir;
-    glm::mat4 model;
-
-    unit->rendering_state.set_disable();
-    /*
-     * Set the position and heading of the unit
-     */
-    unit->rendering_data.model_matrix = glm::translate(
-                                            model,
-                                            new_pos );
-
-    unit->rendering_data.model_matrix = glm::rotate(
-                                            unit->rendering_data.model_matrix,
-                                            heading,
-                                            glm::vec3( 0.0f, 0.0f, 1.0f ) );
-
-    if ( current > arrival_time ) {
-        /*
-         * Movement completed
-         */
-        LOG2( "Complete! ID:", id );
-        status = moving_status::COMPLETED;
-        unit->rendering_data.heading = heading;
-        movement_impl.place_unit_on_lot( unit, target_lot );
-    }
-    unit->rendering_state.set_enable();
-    return status;
-}
-
-
 Units_movement_processor::Units_movement_processor(
     Units_data_container& container
 ) :
@@ -177,16 +24,20 @@ bool Units_movement_processor::teleport(
      * in the new lot.
      */
     if ( nullptr != unit_info->location ) {
-        unit_info->location->units->remove( unit_info->unit );
+        unit_info->location->units()->remove( unit_info->unit );
     } else {
         LOG3( "Unit ID:", unit_id, ", do not have a location." );
     }
     mov_impl.change_unit_heading( unit_info->unit,
                                   target_lot );
-    target_lot->units->add( unit_info->unit );
+    target_lot->units()->add( unit_info->unit );
     unit_info->location = target_lot;
     mov_impl.place_unit_on_lot( unit_info->unit,
                                 target_lot );
+    unit_positions.update( unit_id,
+                           glm::vec2( unit_info->unit->rendering_data.position ),
+                           glm::vec2( 0.0f ),
+                           unit_info->unit->rendering_data.bounding_radius );
     unit_info->unit->rendering_state.set_enable();
     LOG1( "Unit ID:", unit_id, ", is now on position:",
           unit_info->unit->rendering_data.position );
@@ -219,7 +70,7 @@ bool Units_movement_processor::move(
         return false;
     }
 
-    if ( unit_info->movement != nullptr ) {
+    if ( unit_info->moving || unit_info->waiting_path ) {
         WARN1( "UnitID:", unit_id, " already moving!" );
         return false;
     }
@@ -230,13 +81,121 @@ bool Units_movement_processor::move(
         return false;
     }
 
-    unit_info->location->units->remove( unit_info->unit );
-    unit_info->movement = factory< Move_processor >::create(
-                              unit_info->unit,
-                              target_lot );
+    if ( nullptr != pathfinder ) {
+        request_path( unit_info, target_lot );
+        return true;
+    }
+    begin_move( unit_info, target_lot, {} );
+    return true;
+}
+
+void Units_movement_processor::request_path(
+    Unit_info::pointer unit_info,
+    Terrain_lot::pointer target_lot )
+{
+    /*
+     * The unit stays on its lot till the path is
+     * available, the target lot is pinned in the
+     * meanwhile: the request might wait behind
+     * other tasks and the camera move away
+     */
+    unit_info->waiting_path = true;
+    target_lot->pin();
+    path_requests.push_back( {
+        unit_info,
+        target_lot,
+        pathfinder->request_path( unit_info->location->position,
+                                  target_lot->position )
+    } );
+}
+
+void Units_movement_processor::begin_move(
+    Unit_info::pointer unit_info,
+    Terrain_lot::pointer target_lot,
+    const std::vector< glm::vec2 >& waypoints )
+{
+    /*
+     * The unit belongs to the target lot from now on: the
+     * chunk hosting it is not released while the unit
+     * is walking there nor after its arrival
+     */
+    unit_info->location->units()->remove( unit_info->unit );
+    target_lot->units()->add( unit_info->unit );
+    movement_table.add( unit_info->unit,
+                        target_lot,
+                        waypoints,
+                        std::chrono::duration_cast< std::chrono::microseconds > (
+                            std::chrono::high_resolution_clock::now().time_since_epoch()
+                        ) );
+    unit_info->moving = true;
     unit_info->location = target_lot;
+}
+
+void Units_movement_processor::complete_path_requests()
+{
+    for ( auto&& group : group_requests ) {
+        if ( group.paths.wait_for( std::chrono::seconds( 0 ) ) !=
+             std::future_status::ready ) {
+            continue;
+        }
+        group.target_lot->unpin();
+        std::vector< pathfinding::Path > paths;
+        try {
+            paths = group.paths.get();
+        } catch ( std::exception& ex ) {
+            ERR( "Flow field computation failed, ", ex.what() );
+        }
+        for ( std::size_t idx{ 0 } ; idx < group.units.size() ; ++idx ) {
+            auto& unit_info = group.units[ idx ];
+            unit_info->waiting_path = false;
+            if ( idx < paths.size() && paths[ idx ].found ) {
+                begin_move( unit_info, group.target_lot, paths[ idx ].waypoints );
+                continue;
+            }
+            //Not covered by the field, search its own path
+            request_path( unit_info, group.target_lot );
+        }
+    }
+    group_requests.erase( std::remove_if( group_requests.begin(),
+                                          group_requests.end(),
+    []( const Group_request & request ) {
+        return false == request.paths.valid();
+    } ),
+    group_requests.end() );
+
+    for ( auto&& request : path_requests ) {
+        if ( request.path.wait_for( std::chrono::seconds( 0 ) ) !=
+             std::future_status::ready ) {
+            continue;
+        }
+        const types::id_type unit_id = request.unit_info->unit->id;
+        request.unit_info->waiting_path = false;
+        request.target_lot->unpin();
+        pathfinding::Path path;
+        try {
+            path = request.path.get();
+        } catch ( std::exception& ex ) {
+            ERR( "Path search failed for unitID:", unit_id, ", ", ex.what() );
+            continue;
+        }
+        if ( false == path.found ) {
+            WARN1( "No path for unitID:", unit_id,
+                   " to lotID:", request.target_lot->id );
+            continue;
+        }
+        begin_move( request.unit_info, request.target_lot, path.waypoints );
+    }
+    path_requests.erase( std::remove_if( path_requests.begin(),
+                                         path_requests.end(),
+    []( const Path_request & request ) {
+        return false == request.path.valid();
+    } ),
+    path_requests.end() );
+}
 
-    start_movement( unit_info );
+void Units_movement_processor::set_pathfinder( pathfinding::Pathfinder::pointer finder )
+{
+    pathfinder = finder;
 }
 
 bool Units_movement_processor::multiple_move(
@@ -246,53 +205,105 @@ bool Units_movement_processor::multiple_move(
     LOG3( "Attempt to move ", units.size(), " units to lot ID:",
           target_lot->id );
     bool ret{ true };
-    //Move them all..
-    for ( auto&& unit : units ) {
-        ret = move( unit, target_lot ) && ret;
+    if ( nullptr == pathfinder || units.size() < 2 ) {
+        //Move them all..
+        for ( auto&& unit : units ) {
+            ret = move( unit, target_lot ) && ret;
+        }
+        return ret;
+    }
+    /*
+     * One flow field toward the target
+     * for the whole group
+     */
+    Group_request group;
+    group.target_lot = target_lot;
+    std::vector< glm::vec2 > starts;
+    for ( auto&& unit_id : units ) {
+        auto unit_info = units_container.find( unit_id );
+        if ( nullptr == unit_info ) {
+            ret = false;
+            continue;
+        }
+        if ( unit_info->moving || unit_info->waiting_path ) {
+            WARN1( "UnitID:", unit_id, " already moving!" );
+            ret = false;
+            continue;
+        }
+        if ( unit_info->location == target_lot ) {
+            ret = false;
+            continue;
+        }
+        unit_info->waiting_path = true;
+        group.units.push_back( unit_info );
+        starts.push_back( unit_info->location->position );
+    }
+    if ( group.units.empty() ) {
+        return ret;
     }
+    //As in request_path
+    target_lot->pin();
+    group.paths = pathfinder->request_group_paths( target_lot->position,
+                  starts );
+    group_requests.push_back( std::move( group ) );
     return ret;
 }
 
 void Units_movement_processor::process_movements()
 {
-    if ( in_movement.empty() ) {
+    complete_path_requests();
+    if ( movement_table.empty() ) {
         return;
     }
     const types::timestamp current_time =
         std::chrono::duration_cast< std::chrono::microseconds > (
             std::chrono::high_resolution_clock::now().time_since_epoch()
         );
-    for ( auto&& unit : in_movement ) {
-        if ( unit->step( current_time ) == Move_processor::moving_status::COMPLETED ) {
-            auto unit_info = units_container.find_nofail( unit->moving_unit_id() );
-            /*
-             * Cleanup the 'movement' variable in the Unit_info to make
-             * sure that future movements are allowed
-             */
-            unit_info->movement = nullptr;
+    /*
+     * The avoidance reads the positions of the previous
+     * step from the hash, in parallel, then the units
+     * move and the hash is updated
+     */
+    movement_table.avoidance_agents( avoidance_agents );
+    compute_avoidance( unit_positions,
+                       avoidance_agents,
+                       avoidance_corrections,
+                       avoidance_stats );
+    movement_table.step( current_time, avoidance_corrections );
+    movement_table.update_positions( unit_positions );
+    movement_table.remove_completed( completed_movements );
+    for ( auto&& unit_id : completed_movements ) {
+        auto unit_info = units_container.find_nofail( unit_id );
+        /*
+         * Cleanup the 'moving' flag in the Unit_info to make
+         * sure that future movements are allowed
+         */
+        unit_info->moving = false;
+        if ( nullptr == unit_info->location->units()->find( unit_id ) ) {
+            ERR( "UnitID:", unit_id, " is not registered on its lotID:",
+                 unit_info->location->id, ", the chunk might be released!" );
+            unit_info->location->units()->add( unit_info->unit );
         }
+        unit_positions.update( unit_id,
+                               glm::vec2( unit_info->unit->rendering_data.position ),
+                               glm::vec2( 0.0f ),
+                               unit_info->unit->rendering_data.bounding_radius );
     }
-    in_movement.erase( std::remove_if( in_movement.begin(),
-                                       in_movement.end(),
-    [ this ]( const Move_processor::pointer & ptr ) {
-        return ptr->get_status() == Move_processor::moving_status::COMPLETED;
-    } ),
-    in_movement.end() );
 }
 
-void Units_movement_processor::start_movement(
-    Unit_info::pointer unit
-)
+const Spatial_hash& Units_movement_processor::proximity() const
 {
-    LOG2( "Starting movement for unitID:", unit->unit->id );
-    if ( unit->movement == nullptr ) {
-        PANIC( "Requested to start unit movement, but no movement data available!" );
-    }
-    in_movement.push_back( unit->movement );
+    return unit_positions;
+}
 
-    unit->movement->start();
+Avoidance_stats Units_movement_processor::get_avoidance_stats() const
+{
+    return avoidance_stats;
+}
 
-    LOG2( "Number of unit in movement: ", in_movement.size() );
+Movement_stats Units_movement_processor::get_movement_stats() const
+{
+    return movement_table.get_stats();
 }
 
 Units::Units( renderer::Core_renderer_proxy renderer ) :
@@ -300,6 +311,7 @@ Units::Units( renderer::Core_renderer_proxy renderer ) :
     movement_processor( units_container )
 {
     LOG3( "Loading ", internal::units.size(), " unit models!" );
+    //The models are loaded asynchronously, see loading_assets
     for ( auto&& unit : internal::units ) {
         Unit_model::pointer model = factory< Unit_model >::create(
                                         unit
@@ -354,6 +366,15 @@ Units_movement_processor& Units::movements()
     return movement_processor;
 }
 
+assets::Model_asset::container Units::loading_assets() const
+{
+    assets::Model_asset::container assets;
+    for ( auto&& model : available_models ) {
+        assets.push_back( model->get_asset() );
+    }
+    return assets;
+}
+
 Unit_model::pointer Units::find_model( const uint64_t id )
 {
     for ( auto&& model : available_models ) {
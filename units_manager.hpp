@@ -1,82 +1,15 @@
 #include <headers.hpp>
 #include <units.hpp>
 #include <terrains.hpp>
+#include <pathfinding.hpp>
+#include <spatial_hash.hpp>
+#include <movement_table.hpp>
+#include <future>
 
 namespace game_units {
 
 using namespace game_terrains;
 
-/*
- * Here we have some utility functions
- * mostly needed for "animation" purpose
- */
-class Movements
-{
-public:
-    GLfloat calculate_heading( const types::point& source,
-                               const types::point& target ) const;
-    /* The unit will point in the direction of the
-    * given terrain
-    */
-    void change_unit_heading( Unit::pointer& unit,
-                              const Terrain_lot::pointer& target );
-    /*
-     * Update the model matrix for the unit in order
-     * to make sure that it is placed on the given
-     * lot
-     */
-    void place_unit_on_lot( Unit::pointer& unit,
-                            const game_terrains::Terrain_lot::pointer& lot );
-    /*
-     * Usefull function that kind of emulate the acceleration
-     * and deceleration of a moving unit, when you start the movement
-     * you accelerate till a certain speed, then the unit slow down
-     * till it stops
-     */
-    constexpr GLfloat speed_function( const GLfloat x )
-    {
-        return ( 2.0f * x - x * x ) * std::pow( sin( x * glm::half_pi<GLfloat>() ), 2.0f );
-    }
-
-};
-
-/*
- * Define all the data for a given movement
- */
-class Move_processor
-{
-
-public:
-    Move_processor( Unit::pointer unit,
-                    game_terrains::Terrain_lot::pointer lot );
-    ~Move_processor();
-    using pointer = std::shared_ptr< Move_processor >;
-    enum struct moving_status {
-        READY, //But not started
-        MOVING,
-        COMPLETED
-    };
-    moving_status get_status() const;
-    void start();
-    moving_status step( const types::timestamp& current );
-    types::id_type moving_unit_id() const
-    {
-        return unit->id;
-    }
-private:
-    id_factory< Move_processor > id;
-    Unit::pointer unit;
-    Terrain_lot::pointer target_lot;
-    GLfloat       distance;
-    glm::vec3     direction;
-    moving_status status;
-    types::timestamp start_time;
-    types::timestamp arrival_time;
-    Movements     movement_impl;
-    types::point  original_position;
-    GLfloat       heading;
-};
-
 /*
  * Information about a given unit,
  * like the terrain lot where it is &c.
@@ -85,11 +18,10 @@ struct Unit_info {
     using pointer = std::shared_ptr< Unit_info >;
     Unit::pointer unit;
     game_terrains::Terrain_lot::pointer location;
-    /*
-     * The target location is the place where
-     * the unit is moving towards
-     */
-    Move_processor::pointer movement;
+    //Set while the unit is in the movement table
+    bool moving{ false };
+    //Set while the path to the target is searched
+    bool waiting_path{ false };
     Unit_info() = default;
 };
 /*
@@ -118,10 +50,19 @@ private:
 class Units_movement_processor
 {
     /*
-     * Manage the unit movement, estimate travel time,
-     * update position etc.
+     * Add the movement along the waypoints
+     * to the table, it starts immediately
+     */
+    void begin_move( Unit_info::pointer unit_info,
+                     Terrain_lot::pointer target_lot,
+                     const std::vector< glm::vec2 >& waypoints );
+    /*
+     * Start the movements of the units whose
+     * path or flow field is ready
      */
-    void start_movement( Unit_info::pointer unit );
+    void complete_path_requests();
+    void request_path( Unit_info::pointer unit_info,
+                       Terrain_lot::pointer target_lot );
 public:
     Units_movement_processor( Units_data_container& container );
     /*
@@ -134,10 +75,18 @@ public:
                             game_terrains::Terrain_lot::pointer& target_lot );
     /*
      * This is initiate the movement 'animation' of the unit
-     * to the target location
+     * to the target location. With a pathfinder the path is
+     * searched asynchronously and the unit starts moving in
+     * one of the next calls to process_movements, otherwise
+     * the unit moves in straight line
      */
     bool move( types::id_type unit_id,
                Terrain_lot::pointer target_lot );
+    /*
+     * With a pathfinder the units of the group follow one
+     * shared flow field toward the target, instead of
+     * searching a path each
+     */
     bool multiple_move( const std::vector< types::id_type >& units,
                         game_terrains::Terrain_lot::pointer& target_lot );
     /*
@@ -145,10 +94,37 @@ public:
      * the units position, manage the movement etc
      */
     void process_movements();
+    void set_pathfinder( pathfinding::Pathfinder::pointer finder );
+    /*
+     * The position of the units placed on the
+     * terrain, for the proximity queries
+     */
+    const Spatial_hash& proximity() const;
+    Avoidance_stats get_avoidance_stats() const;
+    Movement_stats get_movement_stats() const;
 private:
+    struct Path_request {
+        Unit_info::pointer unit_info;
+        Terrain_lot::pointer target_lot;
+        std::future< pathfinding::Path > path;
+    };
+    struct Group_request {
+        std::vector< Unit_info::pointer > units;
+        Terrain_lot::pointer target_lot;
+        //In the order of units
+        std::future< std::vector< pathfinding::Path > > paths;
+    };
     Movements mov_impl;
     Units_data_container& units_container;
-    std::vector< Move_processor::pointer > in_movement;
+    Movement_table movement_table;
+    std::vector< types::id_type > completed_movements;
+    pathfinding::Pathfinder::pointer pathfinder;
+    std::vector< Path_request > path_requests;
+    std::vector< Group_request > group_requests;
+    Spatial_hash unit_positions;
+    std::vector< Avoidance_agent > avoidance_agents;
+    std::vector< glm::vec2 > avoidance_corrections;
+    Avoidance_stats avoidance_stats;
 };
 
 /*
@@ -179,6 +155,11 @@ public:
     bool place_unit( Unit::pointer unit,
                      game_terrains::Terrain_lot::pointer lot );
     Units_movement_processor& movements();
+    /*
+     * The unit models being loaded, create_unit
+     * can be called only when they are ready
+     */
+    assets::Model_asset::container loading_assets() const;
 private:
     /*
      * Those are the units we ca use for
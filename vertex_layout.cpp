@@ -0,0 +1,178 @@
+#include <vertex_layout.hpp>
+#include <logger/logger.hpp>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+
+namespace models {
+
+constexpr vertex_format vertex_layout< vertex_t >::format;
+constexpr vertex_format vertex_layout< packed_vertex_t >::format;
+
+void setup_vertex_attributes( const vertex_format format )
+{
+    switch ( format ) {
+    case vertex_format::packed:
+        setup_vertex_attributes< packed_vertex_t >();
+        break;
+    default:
+        setup_vertex_attributes< vertex_t >();
+        break;
+    }
+}
+
+std::size_t vertex_stride( const vertex_format format )
+{
+    switch ( format ) {
+    case vertex_format::packed:
+        return sizeof( packed_vertex_t );
+    default:
+        break;
+    }
+    return sizeof( vertex_t );
+}
+
+GLushort float_to_half( const GLfloat value )
+{
+    uint32_t bits;
+    std::memcpy( &bits, &value, sizeof( bits ) );
+    const uint32_t sign = ( bits >> 16 ) & 0x8000;
+    const int32_t exponent = static_cast< int32_t >( ( bits >> 23 ) & 0xFF ) - 127 + 15;
+    uint32_t mantissa = bits & 0x7FFFFF;
+    if ( exponent <= 0 ) {
+        if ( exponent < -10 ) {
+            return sign;
+        }
+        //Denormal
+        mantissa |= 0x800000;
+        const uint32_t shift = 14 - exponent;
+        return sign | ( ( mantissa + ( 1u << ( shift - 1 ) ) ) >> shift );
+    }
+    if ( exponent >= 31 ) {
+        //Overflow, infinity
+        return sign | 0x7C00;
+    }
+    //Round to nearest, a carry in the mantissa increments the exponent
+    return sign | ( ( ( exponent << 10 ) | ( mantissa >> 13 ) ) +
+                    ( ( mantissa >> 12 ) & 1 ) );
+}
+
+GLfloat half_to_float( const GLushort value )
+{
+    const GLfloat sign = ( value & 0x8000 ) ? -1.0f : 1.0f;
+    const int exponent = ( value >> 10 ) & 0x1F;
+    const int mantissa = value & 0x3FF;
+    if ( exponent == 0 ) {
+        //Zero or denormal
+        return sign * std::ldexp( static_cast< GLfloat >( mantissa ), -24 );
+    }
+    if ( exponent == 31 ) {
+        return sign * std::numeric_limits< GLfloat >::infinity();
+    }
+    return sign * std::ldexp( static_cast< GLfloat >( mantissa | 0x400 ), exponent - 25 );
+}
+
+namespace {
+
+GLfloat unpack_normal_component( const GLuint bits )
+{
+    //Sign extension of the 10 bits
+    const GLint value = static_cast< GLint >( bits << 22 ) >> 22;
+    return std::max( -1.0f, value / 511.0f );
+}
+
+GLuint pack_normal( const glm::vec3& normal )
+{
+    const auto pack = []( const GLfloat value ) {
+        const GLint quantized = static_cast< GLint >(
+                                    std::round( std::max( -1.0f, std::min( 1.0f, value ) ) * 511.0f ) );
+        return static_cast< GLuint >( quantized ) & 0x3FF;
+    };
+    return pack( normal.x ) | pack( normal.y ) << 10 | pack( normal.z ) << 20;
+}
+
+}
+
+bool pack_vertices( const vertex_t* vertices,
+                    const std::size_t count,
+                    const glm::vec3& bounds_min,
+                    const glm::vec3& bounds_max,
+                    std::vector< packed_vertex_t >& packed,
+                    position_dequantization& dequantization )
+{
+    const glm::vec3 extent = bounds_max - bounds_min;
+    const GLfloat max_extent = std::max( extent.x, std::max( extent.y, extent.z ) );
+    //Half of the quantization step
+    if ( max_extent / 65535.0f / 2.0f > position_error_budget ) {
+        return false;
+    }
+    /*
+     * The half float spacing in [2^e,2^(e+1)) is
+     * 2^(e-10), the rounding error half of it
+     */
+    GLfloat max_coord{ 0.0f };
+    for ( std::size_t idx{ 0 } ; idx < count ; ++idx ) {
+        max_coord = std::max( max_coord, std::abs( vertices[ idx ].texture_coord.x ) );
+        max_coord = std::max( max_coord, std::abs( vertices[ idx ].texture_coord.y ) );
+    }
+    if ( max_coord > 0.0f &&
+         std::ldexp( 1.0f, static_cast< int >( std::floor( std::log2( max_coord ) ) ) - 11 ) >
+         texture_coord_error_budget ) {
+        return false;
+    }
+
+    dequantization.offset = bounds_min;
+    dequantization.scale = glm::max( extent, glm::vec3( 1e-6f ) );
+    packed.resize( count );
+    for ( std::size_t idx{ 0 } ; idx < count ; ++idx ) {
+        const vertex_t& vertex = vertices[ idx ];
+        packed_vertex_t& result = packed[ idx ];
+        for ( int axis{ 0 } ; axis < 3 ; ++axis ) {
+            const GLfloat normalized = ( vertex.coordinate[ axis ] - dequantization.offset[ axis ] ) /
+                                       dequantization.scale[ axis ];
+            result.coordinate[ axis ] = static_cast< GLushort >(
+                                            std::round( std::max( 0.0f, std::min( 1.0f, normalized ) ) * 65535.0f ) );
+        }
+        result.coordinate[3] = 0;
+        result.texture_coord[0] = float_to_half( vertex.texture_coord.x );
+        result.texture_coord[1] = float_to_half( vertex.texture_coord.y );
+        result.normal = pack_normal( vertex.normal );
+    }
+    return true;
+}
+
+glm::vec3 vertex_position( const void* vertices,
+                           const vertex_format format,
+                           const position_dequantization& dequantization,
+                           const std::size_t idx )
+{
+    if ( format == vertex_format::packed ) {
+        const auto& vertex = static_cast< const packed_vertex_t* >( vertices )[ idx ];
+        const glm::vec3 normalized( vertex.coordinate[0] / 65535.0f,
+                                    vertex.coordinate[1] / 65535.0f,
+                                    vertex.coordinate[2] / 65535.0f );
+        return normalized * dequantization.scale + dequantization.offset;
+    }
+    return static_cast< const vertex_t* >( vertices )[ idx ].coordinate;
+}
+
+vertex_t unpack_vertex( const void* vertices,
+                        const vertex_format format,
+                        const position_dequantization& dequantization,
+                        const std::size_t idx )
+{
+    if ( format != vertex_format::packed ) {
+        return static_cast< const vertex_t* >( vertices )[ idx ];
+    }
+    const auto& packed = static_cast< const packed_vertex_t* >( vertices )[ idx ];
+    vertex_t vertex;
+    vertex.coordinate = vertex_position( vertices, format, dequantization, idx );
+    vertex.texture_coord = glm::vec2( half_to_float( packed.texture_coord[0] ),
+                                      half_to_float( packed.texture_coord[1] ) );
+    vertex.normal = glm::vec3( unpack_normal_component( packed.normal ),
+                               unpack_normal_component( packed.normal >> 10 ),
+                               unpack_normal_component( packed.normal >> 20 ) );
+    return vertex;
+}
+
+}
@@ -0,0 +1,165 @@
+#ifndef VERTEX_LAYOUT_HPP
+#define VERTEX_LAYOUT_HPP
+
+#include <headers.hpp>
+#include <array>
+#include <cstddef>
+
+namespace models {
+
+/*
+ * Full precision vertex, 32 bytes
+ */
+struct vertex_t {
+    glm::vec3 coordinate;
+    glm::vec2 texture_coord;
+    glm::vec3 normal;
+};
+
+/*
+ * Compact vertex, 16 bytes:
+ * position: unsigned normalized 16 bit, relative
+ *           to the mesh bounds (w unused)
+ * texture coordinates: half float
+ * normal: signed normalized 10_10_10_2
+ */
+struct packed_vertex_t {
+    GLushort coordinate[4];
+    GLushort texture_coord[2];
+    GLuint   normal;
+};
+
+static_assert( sizeof( vertex_t ) == 32, "Unexpected vertex_t padding" );
+static_assert( sizeof( packed_vertex_t ) == 16, "Unexpected packed_vertex_t padding" );
+
+enum class vertex_format : uint32_t {
+    full,
+    packed
+};
+
+/*
+ * Description of one vertex attribute
+ */
+struct vertex_attribute {
+    GLuint      location;
+    GLint       components;
+    GLenum      type;
+    GLboolean   normalized;
+    std::size_t offset;
+};
+
+/*
+ * Texture array layers (vec2) in model_shader.vert: per
+ * vertex for the terrain chunks, a constant attribute
+ * for the meshes
+ */
+constexpr GLuint texture_layers_attribute{ 3 };
+
+/*
+ * Attribute layout of each vertex type, the locations
+ * match the inputs of model_shader.vert
+ */
+template< typename Vertex >
+struct vertex_layout;
+
+template<>
+struct vertex_layout< vertex_t > {
+    static constexpr vertex_format format{ vertex_format::full };
+    static constexpr std::array< vertex_attribute, 3 > attributes()
+    {
+        return { {
+                { 0, 3, GL_FLOAT, GL_FALSE, offsetof( vertex_t, coordinate ) },
+                { 1, 2, GL_FLOAT, GL_FALSE, offsetof( vertex_t, texture_coord ) },
+                { 2, 3, GL_FLOAT, GL_FALSE, offsetof( vertex_t, normal ) }
+            }
+        };
+    }
+};
+
+template<>
+struct vertex_layout< packed_vertex_t > {
+    static constexpr vertex_format format{ vertex_format::packed };
+    static constexpr std::array< vertex_attribute, 3 > attributes()
+    {
+        return { {
+                { 0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof( packed_vertex_t, coordinate ) },
+                { 1, 2, GL_HALF_FLOAT, GL_FALSE, offsetof( packed_vertex_t, texture_coord ) },
+                { 2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof( packed_vertex_t, normal ) }
+            }
+        };
+    }
+};
+
+/*
+ * Enable and configure the attributes of the vertex
+ * type for the bound VAO and array buffer
+ */
+template< typename Vertex >
+void setup_vertex_attributes()
+{
+    for ( auto&& attribute : vertex_layout< Vertex >::attributes() ) {
+        glEnableVertexAttribArray( attribute.location );
+        glVertexAttribPointer( attribute.location,
+                               attribute.components,
+                               attribute.type,
+                               attribute.normalized,
+                               sizeof( Vertex ),
+                               ( GLvoid* )attribute.offset );
+    }
+}
+
+void setup_vertex_attributes( const vertex_format format );
+std::size_t vertex_stride( const vertex_format format );
+
+/*
+ * Maximum error allowed by the automatic quantization,
+ * position in model units, texture coordinates in
+ * texture space
+ */
+constexpr GLfloat position_error_budget{ 0.001f };
+constexpr GLfloat texture_coord_error_budget{ 1.0f / 2048.0f };
+
+/*
+ * Mapping from the packed positions (0..1) to
+ * the model space: position * scale + offset
+ */
+struct position_dequantization {
+    glm::vec3 offset{ 0.0f };
+    glm::vec3 scale{ 1.0f };
+};
+
+/*
+ * Pack the vertices if the quantization error is
+ * within the budget, bounds are the bounds of the
+ * vertex coordinates. False if the full precision
+ * format shall be used
+ */
+bool pack_vertices( const vertex_t* vertices,
+                    const std::size_t count,
+                    const glm::vec3& bounds_min,
+                    const glm::vec3& bounds_max,
+                    std::vector< packed_vertex_t >& packed,
+                    position_dequantization& dequantization );
+
+GLushort float_to_half( const GLfloat value );
+GLfloat half_to_float( const GLushort value );
+
+/*
+ * Model space position of the vertex idx
+ */
+glm::vec3 vertex_position( const void* vertices,
+                           const vertex_format format,
+                           const position_dequantization& dequantization,
+                           const std::size_t idx );
+/*
+ * The vertex idx in full precision, with
+ * the position in model space
+ */
+vertex_t unpack_vertex( const void* vertices,
+                        const vertex_format format,
+                        const position_dequantization& dequantization,
+                        const std::size_t idx );
+
+}
+
+#endif //VERTEX_LAYOUT_HPP